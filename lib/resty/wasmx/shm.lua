@@ -9,6 +9,8 @@ local error = error
 local type = type
 local tonumber = tonumber
 local min = math.min
+local floor = math.floor
+local ceil = math.ceil
 local new_tab = table.new
 local insert = table.insert
 local str_fmt = string.format
@@ -43,14 +45,40 @@ ffi.cdef [[
         NGX_WA_SHM_EVICTION_NONE,
     } ngx_wa_shm_eviction_e;
 
-    typedef struct {
+    typedef struct ngx_wa_shm_s      ngx_wa_shm_t;
+
+    struct ngx_wa_shm_s {
         ngx_wa_shm_type_e            type;
         ngx_wa_shm_eviction_e        eviction;
         ngx_str_t                    name;
         ngx_log_t                   *log;
         ngx_slab_pool_t             *shpool;
         void                        *data;
-    } ngx_wa_shm_t;
+        ngx_uint_t                   cache_max;
+        ngx_msec_t                   cache_ttl;
+        void                        *cache;
+        ngx_uint_t                   nshards;
+        ngx_wa_shm_t                *shards;
+        ngx_flag_t                   ordered;
+        ngx_str_t                    persist;
+        ngx_uint_t                   persisted;
+        ngx_msec_t                   persisted_at;
+        ngx_flag_t                   admission;
+    };
+
+    typedef struct {
+        ngx_uint_t                   hits;
+        ngx_uint_t                   misses;
+        ngx_uint_t                   admitted;
+        ngx_uint_t                   rejected;
+    } ngx_wa_shm_kv_stats_t;
+
+    typedef struct {
+        ngx_uint_t                   shard;
+        ngx_uint_t                   it;
+        ngx_uint_t                   seq;
+        ngx_uint_t                   started;
+    } ngx_wa_shm_kv_cursor_t;
 
     typedef enum {
         NGX_WA_METRIC_COUNTER,
@@ -98,8 +126,8 @@ ffi.cdef [[
     ngx_int_t ngx_wa_ffi_shm_setup_zones(ngx_wa_ffi_shm_setup_zones_handler handler);
     ngx_int_t ngx_wa_ffi_shm_iterate_keys(ngx_wa_shm_t *shm,
                                           ngx_uint_t page_size,
-                                          ngx_uint_t *clast_index,
-                                          ngx_uint_t *cur_idx,
+                                          ngx_wa_shm_kv_cursor_t *cursor,
+                                          ngx_uint_t *nkeys,
                                           ngx_str_t **keys);
 
     ngx_uint_t ngx_wa_ffi_shm_kv_nelts(ngx_wa_shm_t *shm);
@@ -111,7 +139,38 @@ ffi.cdef [[
                                     ngx_str_t *k,
                                     ngx_str_t *v,
                                     uint32_t cas,
+                                    ngx_msec_t ttl,
                                     unsigned *written);
+    ngx_int_t ngx_wa_ffi_shm_kv_set_many(ngx_wa_shm_t *shm,
+                                         ngx_str_t *keys,
+                                         ngx_str_t *values,
+                                         ngx_uint_t nkeys,
+                                         ngx_msec_t ttl,
+                                         ngx_uint_t *nwritten);
+    ngx_int_t ngx_wa_ffi_shm_kv_delete_prefix(ngx_wa_shm_t *shm,
+                                              ngx_str_t *prefix,
+                                              ngx_uint_t *ndeleted);
+    ngx_int_t ngx_wa_ffi_shm_kv_scan(ngx_wa_shm_t *shm,
+                                     ngx_str_t *prefix,
+                                     ngx_str_t *start,
+                                     ngx_str_t *stop,
+                                     unsigned exclusive,
+                                     ngx_str_t **keys,
+                                     ngx_uint_t max,
+                                     ngx_uint_t *nkeys);
+    ngx_int_t ngx_wa_ffi_shm_kv_stats(ngx_wa_shm_t *shm,
+                                      ngx_wa_shm_kv_stats_t *stats);
+    ngx_int_t ngx_wa_ffi_shm_kv_int_op(ngx_wa_shm_t *shm,
+                                       ngx_str_t *k,
+                                       int64_t operand,
+                                       int64_t expected,
+                                       unsigned cmpxchg,
+                                       int64_t init,
+                                       int64_t min,
+                                       int64_t max,
+                                       ngx_msec_t ttl,
+                                       int64_t *value,
+                                       unsigned *written);
 
     ngx_int_t ngx_wa_ffi_shm_metric_define(ngx_str_t *name,
                                            ngx_wa_metric_type_e type,
@@ -138,6 +197,8 @@ ffi.cdef [[
 
 local WASM_SHM_KEY = {}
 local DEFAULT_KEYS_PAGE_SIZE = 500
+local INT64_MAX = 9223372036854775807LL
+local INT64_MIN = -INT64_MAX - 1
 local HISTOGRAM_MAX_BINS = C.ngx_wa_ffi_shm_metrics_histogram_max_bins()
 
 
@@ -185,14 +246,14 @@ end
 
 
 local function key_iterator(ctx)
-    if ctx.i == tonumber(ctx.ccur_index[0]) then
+    if ctx.i == tonumber(ctx.cnkeys[0]) then
         ngx_sleep(0) -- TODO: support non-yielding phases
 
         ctx.i = 0
-        ctx.ccur_index[0] = 0
+        ctx.cnkeys[0] = 0
 
         local rc = C.ngx_wa_ffi_shm_iterate_keys(ctx.shm, ctx.page_size,
-                                                 ctx.clast_index, ctx.ccur_index,
+                                                 ctx.ccursor, ctx.cnkeys,
                                                  ctx.ckeys)
 
         if rc == FFI_ABORT then
@@ -209,6 +270,16 @@ local function key_iterator(ctx)
             return
         end
 
+        if rc == FFI_DECLINED then
+            -- the cursor is a position in the index, moved by writes
+            local zone_name = ffi_str(ctx.shm.name.data, ctx.shm.name.len)
+            local err = "attempt to resume %s:iterate_keys() but the " ..
+                        "shm zone was written to since the iteration " ..
+                        "started; keep it locked until the iteration ends."
+
+            error(str_fmt(err, zone_name), 2)
+        end
+
         assert_debug(rc == FFI_OK)
 
         ngx_log(DEBUG, "iterate_keys fetched a new page")
@@ -247,8 +318,8 @@ local function shm_iterate_keys(zone, opts)
                     and opts.page_size
                     or DEFAULT_KEYS_PAGE_SIZE,
         i = 0,
-        clast_index = ffi_new("ngx_uint_t[1]"),
-        ccur_index = ffi_new("ngx_uint_t[1]"),
+        ccursor = ffi_new("ngx_wa_shm_kv_cursor_t[1]"),
+        cnkeys = ffi_new("ngx_uint_t[1]"),
         ckeys = page_size and ffi_new("ngx_str_t *[?]", page_size) or _kbuf,
     }
 
@@ -287,9 +358,9 @@ local function shm_get_keys(zone, max_count)
 
     shm_unlock(zone)
 
+    -- may be less than nkeys: expired entries not swept yet are skipped
     local total = tonumber(ctotal[0])
     local keys = new_tab(0, total)
-    assert(total == nkeys)
 
     for i = 1, total do
         keys[i] = ffi_str(ckeys[i - 1].data, ckeys[i - 1].len)
@@ -320,7 +391,7 @@ local function shm_kv_get(zone, key)
 end
 
 
-local function shm_kv_set(zone, key, value, cas)
+local function shm_kv_set(zone, key, value, cas, ttl)
     if type(key) ~= "string" then
         error("key must be a string", 2)
     end
@@ -336,12 +407,21 @@ local function shm_kv_set(zone, key, value, cas)
         error("cas must be a number", 2)
     end
 
+    if ttl == nil then
+        ttl = 0
+
+    elseif type(ttl) ~= "number" or ttl < 0 then
+        error("ttl must be a positive number", 2)
+    end
+
     local shm = zone[WASM_SHM_KEY]
     local cname = ffi_new("ngx_str_t", { data = key, len = #key })
     local cvalue = ffi_new("ngx_str_t", { data = value, len = #value })
     local written = ffi_new("unsigned[1]")
 
-    local rc = C.ngx_wa_ffi_shm_kv_set(shm, cname, cvalue, cas, written)
+    -- ttl in seconds, as ngx.shared.DICT
+    local rc = C.ngx_wa_ffi_shm_kv_set(shm, cname, cvalue, cas,
+                                       ceil(ttl * 1000), written)
     if rc == FFI_ERROR then
         return nil, "no memory"
     end
@@ -356,6 +436,342 @@ local function shm_kv_set(zone, key, value, cas)
 end
 
 
+local function shm_kv_set_many(zone, kvs, ttl)
+    if type(kvs) ~= "table" then
+        error("kvs must be a table", 2)
+    end
+
+    if ttl == nil then
+        ttl = 0
+
+    elseif type(ttl) ~= "number" or ttl < 0 then
+        error("ttl must be a positive number", 2)
+    end
+
+    local n = 0
+
+    for k, v in pairs(kvs) do
+        if type(k) ~= "string" then
+            error("keys must be strings", 2)
+        end
+
+        if type(v) ~= "string" then
+            error("values must be strings", 2)
+        end
+
+        n = n + 1
+    end
+
+    if n == 0 then
+        return 0
+    end
+
+    local shm = zone[WASM_SHM_KEY]
+    local ckeys = ffi_new("ngx_str_t[?]", n)
+    local cvalues = ffi_new("ngx_str_t[?]", n)
+    local cwritten = ffi_new("ngx_uint_t[1]")
+    local i = 0
+
+    for k, v in pairs(kvs) do
+        ckeys[i].data = k
+        ckeys[i].len = #k
+        cvalues[i].data = v
+        cvalues[i].len = #v
+        i = i + 1
+    end
+
+    local rc = C.ngx_wa_ffi_shm_kv_set_many(shm, ckeys, cvalues, n,
+                                            ceil(ttl * 1000), cwritten)
+    if rc == FFI_ERROR then
+        return nil, "no memory"
+    end
+
+    if rc == FFI_ABORT then
+        return nil, "locked"
+    end
+
+    assert_debug(rc == FFI_OK)
+
+    return tonumber(cwritten[0])
+end
+
+
+local function shm_kv_delete_many(zone, keys)
+    if type(keys) ~= "table" then
+        error("keys must be a table", 2)
+    end
+
+    local n = #keys
+    if n == 0 then
+        return 0
+    end
+
+    local shm = zone[WASM_SHM_KEY]
+    local ckeys = ffi_new("ngx_str_t[?]", n)
+    local cdeleted = ffi_new("ngx_uint_t[1]")
+
+    for i = 1, n do
+        local k = keys[i]
+        if type(k) ~= "string" then
+            error("keys must be strings", 2)
+        end
+
+        ckeys[i - 1].data = k
+        ckeys[i - 1].len = #k
+    end
+
+    local rc = C.ngx_wa_ffi_shm_kv_set_many(shm, ckeys, nil, n, 0, cdeleted)
+    if rc == FFI_ABORT then
+        return nil, "locked"
+    end
+
+    -- FFI_ERROR: unreachable (no allocation)
+    assert_debug(rc == FFI_OK)
+
+    return tonumber(cdeleted[0])
+end
+
+
+local function shm_kv_delete_prefix(zone, prefix)
+    if type(prefix) ~= "string" then
+        error("prefix must be a string", 2)
+    end
+
+    local shm = zone[WASM_SHM_KEY]
+    local cprefix = ffi_new("ngx_str_t", { data = prefix, len = #prefix })
+    local cdeleted = ffi_new("ngx_uint_t[1]")
+
+    local rc = C.ngx_wa_ffi_shm_kv_delete_prefix(shm, cprefix, cdeleted)
+    if rc == FFI_ABORT then
+        return nil, "locked"
+    end
+
+    assert_debug(rc == FFI_OK)
+
+    return tonumber(cdeleted[0])
+end
+
+
+local function is_integer(n)
+    return type(n) == "number" and floor(n) == n
+end
+
+
+local function shm_kv_int_op(zone, key, operand, expected, opts)
+    if type(key) ~= "string" then
+        error("key must be a string", 3)
+    end
+
+    local init = 0
+    local ttl = 0
+    local lo = INT64_MIN
+    local hi = INT64_MAX
+
+    if opts ~= nil then
+        if type(opts) ~= "table" then
+            error("opts must be a table", 3)
+        end
+
+        for _, k in ipairs({ "init", "min", "max" }) do
+            if opts[k] ~= nil and not is_integer(opts[k]) then
+                error("opts." .. k .. " must be an integer", 3)
+            end
+        end
+
+        if opts.ttl ~= nil then
+            if type(opts.ttl) ~= "number" or opts.ttl < 0 then
+                error("opts.ttl must be a positive number", 3)
+            end
+
+            ttl = opts.ttl
+        end
+
+        init = opts.init or init
+        lo = opts.min or lo
+        hi = opts.max or hi
+    end
+
+    local shm = zone[WASM_SHM_KEY]
+    local cname = ffi_new("ngx_str_t", { data = key, len = #key })
+    local cvalue = ffi_new("int64_t[1]")
+    local written = ffi_new("unsigned[1]")
+
+    -- ttl in seconds, as ngx.shared.DICT
+    local rc = C.ngx_wa_ffi_shm_kv_int_op(shm, cname, operand, expected or 0,
+                                          expected and 1 or 0, init, lo, hi,
+                                          ceil(ttl * 1000), cvalue, written)
+    if rc == FFI_DECLINED then
+        return nil, "not a number"
+    end
+
+    if rc == FFI_BUSY then
+        return nil, "not admitted"
+    end
+
+    if rc == FFI_ERROR then
+        return nil, "no memory"
+    end
+
+    if rc == FFI_ABORT then
+        return nil, "locked"
+    end
+
+    assert_debug(rc == FFI_OK)
+
+    return tonumber(written[0]) == 1, tonumber(cvalue[0])
+end
+
+
+local function shm_kv_incr(zone, key, delta, opts)
+    if delta == nil then
+        delta = 1
+
+    elseif not is_integer(delta) then
+        error("delta must be an integer", 2)
+    end
+
+    local ok, value = shm_kv_int_op(zone, key, delta, nil, opts)
+    if ok == nil then
+        return nil, value
+    end
+
+    if not ok then
+        return nil, "out of bounds", value
+    end
+
+    return value
+end
+
+
+local function shm_kv_decr(zone, key, delta, opts)
+    if delta == nil then
+        delta = 1
+
+    elseif not is_integer(delta) then
+        error("delta must be an integer", 2)
+    end
+
+    local ok, value = shm_kv_int_op(zone, key, -delta, nil, opts)
+    if ok == nil then
+        return nil, value
+    end
+
+    if not ok then
+        return nil, "out of bounds", value
+    end
+
+    return value
+end
+
+
+local function shm_kv_compare_exchange(zone, key, expected, value, opts)
+    if not is_integer(expected) then
+        error("expected must be an integer", 2)
+    end
+
+    if not is_integer(value) then
+        error("value must be an integer", 2)
+    end
+
+    local ok, current = shm_kv_int_op(zone, key, value, expected, opts)
+    if ok == nil then
+        return nil, current
+    end
+
+    return ok, current
+end
+
+
+local function shm_kv_scan(zone, opts)
+    local max_count = DEFAULT_KEYS_PAGE_SIZE
+
+    if opts ~= nil then
+        if type(opts) ~= "table" then
+            error("opts must be a table", 2)
+        end
+
+        for _, k in ipairs({ "prefix", "start", "stop", "cursor" }) do
+            if opts[k] ~= nil and type(opts[k]) ~= "string" then
+                error("opts." .. k .. " must be a string", 2)
+            end
+        end
+
+        if opts.max_count ~= nil then
+            if type(opts.max_count) ~= "number" then
+                error("opts.max_count must be a number", 2)
+            end
+
+            if opts.max_count < 1 then
+                error("opts.max_count must be > 0", 2)
+            end
+
+            max_count = opts.max_count
+        end
+    end
+
+    local shm = zone[WASM_SHM_KEY]
+    if shm.ordered == 0 then
+        return nil, "not ordered"
+    end
+
+    local prefix = opts and opts.prefix or ""
+    local stop = opts and opts.stop or ""
+    local start = opts and (opts.cursor or opts.start) or ""
+    local exclusive = (opts and opts.cursor) and 1 or 0
+
+    local cprefix = ffi_new("ngx_str_t", { data = prefix, len = #prefix })
+    local cstart = ffi_new("ngx_str_t", { data = start, len = #start })
+    local cstop = ffi_new("ngx_str_t", { data = stop, len = #stop })
+    local cnkeys = ffi_new("ngx_uint_t[1]")
+    local ckeys = max_count > DEFAULT_KEYS_PAGE_SIZE
+                  and ffi_new("ngx_str_t *[?]", max_count)
+                  or _kbuf
+
+    shm_lock(zone)
+
+    local rc = C.ngx_wa_ffi_shm_kv_scan(shm, cprefix, cstart, cstop, exclusive,
+                                        ckeys, max_count, cnkeys)
+
+    local n = tonumber(cnkeys[0])
+    local keys = new_tab(n, 0)
+
+    for i = 1, n do
+        keys[i] = ffi_str(ckeys[i - 1].data, ckeys[i - 1].len)
+    end
+
+    shm_unlock(zone)
+
+    if rc == FFI_DONE then
+        return keys
+    end
+
+    assert_debug(rc == FFI_OK)
+
+    -- more keys in range: resume after the last one
+    return keys, keys[n]
+end
+
+
+local function shm_kv_stats(zone)
+    local shm = zone[WASM_SHM_KEY]
+    local cstats = ffi_new("ngx_wa_shm_kv_stats_t")
+
+    local rc = C.ngx_wa_ffi_shm_kv_stats(shm, cstats)
+    if rc == FFI_DECLINED then
+        return nil, "no admission policy"
+    end
+
+    assert_debug(rc == FFI_OK)
+
+    return {
+        hits = tonumber(cstats.hits),
+        misses = tonumber(cstats.misses),
+        admitted = tonumber(cstats.admitted),
+        rejected = tonumber(cstats.rejected),
+    }
+end
+
+
 local function metrics_define(zone, name, metric_type, opts)
     if type(name) ~= "string" or name == "" then
         error("name must be a non-empty string", 2)
@@ -587,6 +1003,14 @@ function(shm)
         _M[zone_name].get_keys = shm_get_keys
         _M[zone_name].get = shm_kv_get
         _M[zone_name].set = shm_kv_set
+        _M[zone_name].set_many = shm_kv_set_many
+        _M[zone_name].delete_many = shm_kv_delete_many
+        _M[zone_name].delete_prefix = shm_kv_delete_prefix
+        _M[zone_name].incr = shm_kv_incr
+        _M[zone_name].decr = shm_kv_decr
+        _M[zone_name].compare_exchange = shm_kv_compare_exchange
+        _M[zone_name].scan = shm_kv_scan
+        _M[zone_name].stats = shm_kv_stats
 
     elseif shm.type == _types.ffi_shm.SHM_TYPE_QUEUE then
         -- NYI
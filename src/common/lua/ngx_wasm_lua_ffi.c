@@ -71,7 +71,7 @@ ngx_http_wasm_ffi_plan_new(ngx_wavm_t *vm,
         rc = ngx_http_wasm_ops_add_filter(plan,
                                           ffi_filter->name,
                                           ffi_filter->config,
-                                          vm);
+                                          NULL, 0, vm);
         if (rc != NGX_OK) {
             if (rc == NGX_ABORT) {
                 *errlen = ngx_snprintf(err, NGX_WASM_LUA_FFI_MAX_ERRLEN,
@@ -169,8 +169,7 @@ get_pwctx(ngx_http_request_t *r)
         return NULL;
     }
 
-    return ngx_proxy_wasm_ctx(NULL, NULL,
-                              NGX_PROXY_WASM_ISOLATION_STREAM,
+    return ngx_proxy_wasm_ctx(NULL, NGX_PROXY_WASM_ISOLATION_STREAM,
                               &ngx_http_proxy_wasm, rctx);
 }
 
@@ -285,40 +284,11 @@ ngx_wa_ffi_shm_setup_zones(ngx_wa_ffi_shm_setup_zones_handler_pt setup_handler)
 }
 
 
-static void
-retrieve_keys(ngx_rbtree_node_t *node, ngx_rbtree_node_t *sentinel,
-    ngx_uint_t limit, ngx_uint_t start_idx, ngx_uint_t *cur_idx,
-    ngx_str_t **keys)
-{
-    ngx_wa_shm_kv_node_t  *n = (ngx_wa_shm_kv_node_t *) node;
-
-    if ((*cur_idx - start_idx) == limit) {
-        return;
-    }
-
-    if (*cur_idx >= start_idx) {
-        /* append to result */
-        keys[(*cur_idx - start_idx)] = &n->key.str;
-    }
-
-    (*cur_idx)++;
-
-    if (node->left != sentinel) {
-        retrieve_keys(node->left, sentinel, limit, start_idx, cur_idx, keys);
-    }
-
-    if (node->right != sentinel) {
-        retrieve_keys(node->right, sentinel, limit, start_idx, cur_idx, keys);
-    }
-}
-
-
 ngx_int_t
 ngx_wa_ffi_shm_iterate_keys(ngx_wa_shm_t *shm, ngx_uint_t page_size,
-    ngx_uint_t *clast_idx, ngx_uint_t *cur_idx, ngx_str_t **keys)
+    ngx_wa_shm_kv_cursor_t *cursor, ngx_uint_t *nkeys, ngx_str_t **keys)
 {
-    ngx_uint_t        last_idx = clast_idx ? *clast_idx : 0;
-    ngx_wa_shm_kv_t  *kv;
+    ngx_wa_shm_kv_cursor_t  first;
 
     ngx_wa_assert(shm->type == NGX_WA_SHM_TYPE_KV
                   || shm->type == NGX_WA_SHM_TYPE_METRICS);
@@ -327,40 +297,38 @@ ngx_wa_ffi_shm_iterate_keys(ngx_wa_shm_t *shm, ngx_uint_t page_size,
         return NGX_ABORT;
     }
 
-    kv = shm->data;
-
-    if (last_idx >= kv->nelts) {
-        /* finished */
-        return NGX_DONE;
+    if (cursor == NULL) {
+        /* first page only */
+        ngx_memzero(&first, sizeof(ngx_wa_shm_kv_cursor_t));
+        cursor = &first;
     }
 
-    /* cannot be empty here (kv->nelts > 0) */
-    ngx_wa_assert(kv->rbtree.root != kv->rbtree.sentinel);
-
-    retrieve_keys(kv->rbtree.root, kv->rbtree.sentinel, page_size, last_idx,
-                  cur_idx, keys);
-
-    *cur_idx -= last_idx;
-
-    if (clast_idx) {
-        *clast_idx += *cur_idx;
-    }
-
-    return NGX_OK;
+    return ngx_wa_shm_kv_keys_locked(shm, cursor, keys, page_size, nkeys);
 }
 
 
 ngx_uint_t
 ngx_wa_ffi_shm_kv_nelts(ngx_wa_shm_t *shm)
 {
+    ngx_uint_t        i, nelts;
     ngx_wa_shm_kv_t  *kv;
 
     ngx_wa_assert(shm->type == NGX_WA_SHM_TYPE_KV
                   || shm->type == NGX_WA_SHM_TYPE_METRICS);
 
-    kv = shm->data;
+    if (shm->nshards == 0) {
+        kv = shm->data;
+        return kv->nelts;
+    }
+
+    nelts = 0;
+
+    for (i = 0; i < shm->nshards; i++) {
+        kv = shm->shards[i].data;
+        nelts += kv->nelts;
+    }
 
-    return kv->nelts;
+    return nelts;
 }
 
 
@@ -373,6 +341,8 @@ ngx_wa_ffi_shm_kv_get(ngx_wa_shm_t *shm, ngx_str_t *k, ngx_str_t **v,
 
     ngx_wa_assert(shm->type == NGX_WA_SHM_TYPE_KV);
 
+    shm = ngx_wa_shm_kv_shard(shm, k);
+
     if (!ngx_wa_shm_locked(shm)) {
         /* e.g. already locked if in iterate_keys() */
         ngx_wa_shm_lock(shm);
@@ -391,7 +361,32 @@ ngx_wa_ffi_shm_kv_get(ngx_wa_shm_t *shm, ngx_str_t *k, ngx_str_t **v,
 
 ngx_int_t
 ngx_wa_ffi_shm_kv_set(ngx_wa_shm_t *shm, ngx_str_t *k, ngx_str_t *v,
-    uint32_t cas, unsigned *written)
+    uint32_t cas, ngx_msec_t ttl, unsigned *written)
+{
+    ngx_int_t  rc;
+
+    ngx_wa_assert(shm->type == NGX_WA_SHM_TYPE_KV);
+
+    shm = ngx_wa_shm_kv_shard(shm, k);
+
+    if (ngx_wa_shm_locked(shm)) {
+        /* already locked by the current worker */
+        return NGX_ABORT;
+    }
+
+    ngx_wa_shm_lock(shm);
+
+    rc = ngx_wa_shm_kv_set_locked(shm, k, v, cas, ttl, written);
+
+    ngx_wa_shm_unlock(shm);
+
+    return rc;
+}
+
+
+ngx_int_t
+ngx_wa_ffi_shm_kv_set_many(ngx_wa_shm_t *shm, ngx_str_t *keys,
+    ngx_str_t *values, ngx_uint_t nkeys, ngx_msec_t ttl, ngx_uint_t *nwritten)
 {
     ngx_int_t  rc;
 
@@ -404,7 +399,102 @@ ngx_wa_ffi_shm_kv_set(ngx_wa_shm_t *shm, ngx_str_t *k, ngx_str_t *v,
 
     ngx_wa_shm_lock(shm);
 
-    rc = ngx_wa_shm_kv_set_locked(shm, k, v, cas, written);
+    rc = ngx_wa_shm_kv_set_many_locked(shm, keys, values, nkeys, ttl,
+                                       nwritten);
+
+    ngx_wa_shm_unlock(shm);
+
+    return rc;
+}
+
+
+ngx_int_t
+ngx_wa_ffi_shm_kv_delete_prefix(ngx_wa_shm_t *shm, ngx_str_t *prefix,
+    ngx_uint_t *ndeleted)
+{
+    ngx_int_t  rc;
+
+    ngx_wa_assert(shm->type == NGX_WA_SHM_TYPE_KV);
+
+    if (ngx_wa_shm_locked(shm)) {
+        /* already locked by the current worker */
+        return NGX_ABORT;
+    }
+
+    ngx_wa_shm_lock(shm);
+
+    rc = ngx_wa_shm_kv_delete_prefix_locked(shm, prefix, ndeleted);
+
+    ngx_wa_shm_unlock(shm);
+
+    return rc;
+}
+
+
+ngx_int_t
+ngx_wa_ffi_shm_kv_scan(ngx_wa_shm_t *shm, ngx_str_t *prefix, ngx_str_t *start,
+    ngx_str_t *end, unsigned exclusive, ngx_str_t **keys, ngx_uint_t max,
+    ngx_uint_t *nkeys)
+{
+    ngx_wa_shm_kv_range_t  range;
+
+    ngx_wa_assert(shm->type == NGX_WA_SHM_TYPE_KV);
+
+    if (!shm->ordered) {
+        return NGX_DECLINED;
+    }
+
+    if (!ngx_wa_shm_locked(shm)) {
+        /* keys are only valid while locked */
+        return NGX_ABORT;
+    }
+
+    range.prefix = *prefix;
+    range.start = *start;
+    range.end = *end;
+    range.exclusive = exclusive;
+
+    return ngx_wa_shm_kv_scan_locked(shm, &range, keys, max, nkeys);
+}
+
+
+ngx_int_t
+ngx_wa_ffi_shm_kv_stats(ngx_wa_shm_t *shm, ngx_wa_shm_kv_stats_t *stats)
+{
+    ngx_wa_assert(shm->type == NGX_WA_SHM_TYPE_KV);
+
+    return ngx_wa_shm_kv_stats(shm, stats);
+}
+
+
+ngx_int_t
+ngx_wa_ffi_shm_kv_int_op(ngx_wa_shm_t *shm, ngx_str_t *k, int64_t operand,
+    int64_t expected, unsigned cmpxchg, int64_t init, int64_t min,
+    int64_t max, ngx_msec_t ttl, int64_t *value, unsigned *written)
+{
+    ngx_int_t               rc;
+    ngx_wa_shm_kv_int_op_t  op;
+
+    ngx_wa_assert(shm->type == NGX_WA_SHM_TYPE_KV);
+
+    shm = ngx_wa_shm_kv_shard(shm, k);
+
+    if (ngx_wa_shm_locked(shm)) {
+        /* already locked by the current worker */
+        return NGX_ABORT;
+    }
+
+    op.operand = operand;
+    op.expected = expected;
+    op.cmpxchg = cmpxchg;
+    op.init = init;
+    op.min = min;
+    op.max = max;
+    op.ttl = ttl;
+
+    ngx_wa_shm_lock(shm);
+
+    rc = ngx_wa_shm_kv_int_op_locked(shm, k, &op, value, written);
 
     ngx_wa_shm_unlock(shm);
 
@@ -49,13 +49,27 @@ ngx_int_t ngx_http_wasm_ffi_set_host_properties_handlers(ngx_http_request_t *r,
 ngx_int_t ngx_wa_ffi_shm_setup_zones(
     ngx_wa_ffi_shm_setup_zones_handler_pt handler);
 ngx_int_t ngx_wa_ffi_shm_iterate_keys(ngx_wa_shm_t *shm, ngx_uint_t page_size,
-    ngx_uint_t *clast_idx, ngx_uint_t *cur_idx, ngx_str_t **keys);
+    ngx_wa_shm_kv_cursor_t *cursor, ngx_uint_t *nkeys, ngx_str_t **keys);
 
 ngx_uint_t ngx_wa_ffi_shm_kv_nelts(ngx_wa_shm_t *shm);
 ngx_int_t ngx_wa_ffi_shm_kv_get(ngx_wa_shm_t *shm, ngx_str_t *k,
     ngx_str_t **v, uint32_t *cas);
 ngx_int_t ngx_wa_ffi_shm_kv_set(ngx_wa_shm_t *shm, ngx_str_t *k,
-    ngx_str_t *v, uint32_t cas, unsigned *written);
+    ngx_str_t *v, uint32_t cas, ngx_msec_t ttl, unsigned *written);
+ngx_int_t ngx_wa_ffi_shm_kv_set_many(ngx_wa_shm_t *shm, ngx_str_t *keys,
+    ngx_str_t *values, ngx_uint_t nkeys, ngx_msec_t ttl,
+    ngx_uint_t *nwritten);
+ngx_int_t ngx_wa_ffi_shm_kv_delete_prefix(ngx_wa_shm_t *shm,
+    ngx_str_t *prefix, ngx_uint_t *ndeleted);
+ngx_int_t ngx_wa_ffi_shm_kv_scan(ngx_wa_shm_t *shm, ngx_str_t *prefix,
+    ngx_str_t *start, ngx_str_t *end, unsigned exclusive, ngx_str_t **keys,
+    ngx_uint_t max, ngx_uint_t *nkeys);
+ngx_int_t ngx_wa_ffi_shm_kv_stats(ngx_wa_shm_t *shm,
+    ngx_wa_shm_kv_stats_t *stats);
+ngx_int_t ngx_wa_ffi_shm_kv_int_op(ngx_wa_shm_t *shm, ngx_str_t *k,
+    int64_t operand, int64_t expected, unsigned cmpxchg, int64_t init,
+    int64_t min, int64_t max, ngx_msec_t ttl, int64_t *value,
+    unsigned *written);
 
 ngx_int_t ngx_wa_ffi_shm_metric_define(ngx_str_t *name,
     ngx_wa_metric_type_e type, uint32_t *bins, uint16_t n_bins,
@@ -87,28 +87,22 @@ realloc_histogram(ngx_wa_metrics_t *metrics, ngx_wa_metric_t *old_m,
 
 
 static ngx_int_t
-realloc_metrics(ngx_wa_metrics_t *metrics, ngx_rbtree_node_t *node,
-    ngx_rbtree_node_t *sentinel)
+realloc_metric(ngx_wa_metrics_t *metrics, ngx_wa_shm_kv_node_t *n)
 {
-    uint32_t               mid;
-    ngx_int_t              rc;
-    ngx_uint_t             val;
-    ngx_wa_shm_kv_node_t  *n = (ngx_wa_shm_kv_node_t *) node;
-    ngx_wa_metric_t       *m = (ngx_wa_metric_t *) n->value.data;
-
-    if (node == sentinel) {
-        return NGX_OK;
-    }
+    uint32_t          mid;
+    ngx_int_t         rc;
+    ngx_uint_t        val;
+    ngx_wa_metric_t  *m = (ngx_wa_metric_t *) n->value.data;
 
     ngx_log_debug1(NGX_LOG_DEBUG_WASM, metrics->shm->log, 0,
-                   "reallocating metric \"%V\"", &n->key.str);
+                   "reallocating metric \"%V\"", &n->key);
 
-    if (ngx_wa_metrics_define(metrics, &n->key.str, m->type, NULL, 0, &mid)
+    if (ngx_wa_metrics_define(metrics, &n->key, m->type, NULL, 0, &mid)
         != NGX_OK)
     {
         ngx_wasm_log_error(NGX_LOG_ERR, metrics->shm->log, 0,
                            "failed redefining metric \"%V\"",
-                           &n->key.str);
+                           &n->key);
         return NGX_ERROR;
     }
 
@@ -134,20 +128,29 @@ realloc_metrics(ngx_wa_metrics_t *metrics, ngx_rbtree_node_t *node,
 
     if (rc != NGX_OK) {
         ngx_wasm_log_error(NGX_LOG_ERR, metrics->shm->log, 0,
-                           "failed updating metric \"%V\"", &n->key.str);
+                           "failed updating metric \"%V\"", &n->key);
         return NGX_ERROR;
     }
 
-    if (node->left
-        && realloc_metrics(metrics, node->left, sentinel) != NGX_OK)
-    {
-        return NGX_ERROR;
-    }
+    return NGX_OK;
+}
 
-    if (node->right
-        && realloc_metrics(metrics, node->right, sentinel) != NGX_OK)
-    {
-        return NGX_ERROR;
+
+static ngx_int_t
+realloc_metrics(ngx_wa_metrics_t *metrics, ngx_wa_shm_kv_t *old_kv)
+{
+    ngx_uint_t             it = 0;
+    ngx_wa_shm_kv_node_t  *n;
+
+    for ( ;; ) {
+        n = ngx_wa_shm_kv_next(old_kv, &it);
+        if (n == NULL) {
+            break;
+        }
+
+        if (realloc_metric(metrics, n) != NGX_OK) {
+            return NGX_ERROR;
+        }
     }
 
     return NGX_OK;
@@ -262,8 +265,7 @@ ngx_wa_metrics_shm_init(ngx_cycle_t *cycle)
         /* realloc old kv store */
         old_shm_kv = ngx_wa_shm_get_kv(metrics->old_metrics->shm);
 
-        return realloc_metrics(metrics, old_shm_kv->rbtree.root,
-                               old_shm_kv->rbtree.sentinel);
+        return realloc_metrics(metrics, old_shm_kv);
     }
 
     return NGX_OK;
@@ -327,7 +329,7 @@ ngx_wa_metrics_define(ngx_wa_metrics_t *metrics, ngx_str_t *name,
     val.len = size;
     val.data = buf;
 
-    rc = ngx_wa_shm_kv_set_locked(metrics->shm, name, &val, 0, &written);
+    rc = ngx_wa_shm_kv_set_locked(metrics->shm, name, &val, 0, 0, &written);
     if (rc != NGX_OK) {
         goto error;
     }
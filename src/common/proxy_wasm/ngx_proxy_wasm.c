@@ -31,6 +31,7 @@ static ngx_proxy_wasm_exec_t *ngx_proxy_wasm_lookup_ctx(
     ngx_proxy_wasm_instance_t *ictx, ngx_uint_t id);
 static ngx_int_t ngx_proxy_wasm_filter_init_abi(
     ngx_proxy_wasm_filter_t *filter);
+static void ngx_proxy_wasm_filter_init_steps(ngx_proxy_wasm_filter_t *filter);
 static ngx_int_t ngx_proxy_wasm_filter_start(ngx_proxy_wasm_filter_t *filter);
 static void ngx_proxy_wasm_instance_update(
     ngx_proxy_wasm_instance_t *ictx, ngx_proxy_wasm_exec_t *pwexec);
@@ -209,6 +210,53 @@ done:
 }
 
 
+ngx_int_t
+ngx_proxy_wasm_chain_init(ngx_proxy_wasm_chain_t *chain,
+    ngx_proxy_wasm_filters_root_t *pwroot, ngx_array_t *filter_ids,
+    ngx_pool_t *pool, ngx_log_t *log)
+{
+    size_t                    i;
+    ngx_uint_t                id;
+    ngx_proxy_wasm_exec_t    *pwexec;
+    ngx_proxy_wasm_filter_t  *filter;
+
+    chain->nfilters = filter_ids->nelts;
+    chain->steps = 0;
+    chain->pwexecs = NULL;
+
+    if (chain->nfilters == 0) {
+        return NGX_OK;
+    }
+
+    chain->pwexecs = ngx_pcalloc(pool, chain->nfilters
+                                       * sizeof(ngx_proxy_wasm_exec_t));
+    if (chain->pwexecs == NULL) {
+        return NGX_ERROR;
+    }
+
+    for (i = 0; i < chain->nfilters; i++) {
+        id = ((ngx_uint_t *) filter_ids->elts)[i];
+
+        filter = ngx_proxy_wasm_lookup_filter(pwroot, id);
+        if (filter == NULL) {
+            ngx_proxy_wasm_log_error(NGX_LOG_ALERT, log, 0,
+                                     "no filter with id %ui in chain", id);
+            return NGX_ERROR;
+        }
+
+        pwexec = &chain->pwexecs[i];
+
+        pwexec->root_id = filter->id;
+        pwexec->index = i;
+        pwexec->filter = filter;
+
+        chain->steps |= filter->steps;
+    }
+
+    return NGX_OK;
+}
+
+
 /* context - stream */
 
 
@@ -237,15 +285,14 @@ ngx_proxy_wasm_ctx_alloc(ngx_pool_t *pool)
 
 
 ngx_proxy_wasm_ctx_t *
-ngx_proxy_wasm_ctx(ngx_proxy_wasm_filters_root_t *pwroot,
-    ngx_array_t *filter_ids, ngx_uint_t isolation,
+ngx_proxy_wasm_ctx(ngx_proxy_wasm_chain_t *chain, ngx_uint_t isolation,
     ngx_proxy_wasm_subsystem_t *subsys, void *data)
 {
-    size_t                    i;
-    ngx_uint_t                id;
-    ngx_proxy_wasm_ctx_t     *pwctx;
-    ngx_proxy_wasm_filter_t  *filter;
-    ngx_proxy_wasm_exec_t    *pwexec = NULL;
+    size_t                  i;
+    ngx_int_t               rc;
+    ngx_proxy_wasm_err_e    ecode;
+    ngx_proxy_wasm_ctx_t   *pwctx;
+    ngx_proxy_wasm_exec_t  *pwexec, *pwexecs;
 
     pwctx = subsys->get_context(data);
     if (pwctx == NULL) {
@@ -260,34 +307,69 @@ ngx_proxy_wasm_ctx(ngx_proxy_wasm_filters_root_t *pwroot,
         pwctx->init = 1;
     }
 
-    if (!pwctx->ready && filter_ids) {
-        ngx_wa_assert(pwroot);
-
+    if (!pwctx->ready && chain) {
         pwctx->isolation = isolation;
-        pwctx->nfilters = filter_ids->nelts;
+        pwctx->nfilters = chain->nfilters;
+        pwctx->steps = 0;
 
         ngx_log_debug2(NGX_LOG_DEBUG_WASM, pwctx->log, 0,
                        "proxy_wasm initializing filter chain "
                        "(nfilters: %l, isolation: %ui)",
                        pwctx->nfilters, pwctx->isolation);
 
-        ngx_array_init(&pwctx->pwexecs, pwctx->pool, pwctx->nfilters,
-                       sizeof(ngx_proxy_wasm_exec_t));
+        if (ngx_array_init(&pwctx->pwexecs, pwctx->pool, pwctx->nfilters,
+                           sizeof(ngx_proxy_wasm_exec_t))
+            != NGX_OK)
+        {
+            return NULL;
+        }
 
-        for (i = 0; i < filter_ids->nelts; i++) {
-            id = ((ngx_uint_t *) filter_ids->elts)[i];
+        pwexecs = (ngx_proxy_wasm_exec_t *) pwctx->pwexecs.elts;
 
-            filter = ngx_proxy_wasm_lookup_filter(pwroot, id);
+        if (chain->nfilters) {
+            ngx_memcpy(pwexecs, chain->pwexecs,
+                       chain->nfilters * sizeof(ngx_proxy_wasm_exec_t));
 
-            if (filter == NULL) {
-                /* TODO: log error */
-                ngx_wa_assert(0);
-                return NULL;
+            pwctx->pwexecs.nelts = chain->nfilters;
+        }
+
+        for (i = 0; i < pwctx->nfilters; i++) {
+            pwexec = &pwexecs[i];
+
+            pwexec->id = ++next_id;
+            pwexec->pool = pwctx->pool;
+            pwexec->parent = pwctx;
+
+            ngx_queue_init(&pwexec->calls);
+
+            if (pwexec->filter->cond && subsys->applies) {
+                rc = subsys->applies(pwexec->filter, data);
+                if (rc == NGX_ERROR) {
+                    return NULL;
+                }
+
+                if (rc == NGX_DECLINED) {
+                    ngx_proxy_wasm_log_error(NGX_LOG_DEBUG, pwctx->log, 0,
+                                             "\"%V\" filter skipped "
+                                             "(%l/%l): conditions not met",
+                                             pwexec->filter->name,
+                                             pwexec->index + 1,
+                                             pwctx->nfilters);
+
+                    pwexec->skip = 1;
+                    continue;
+                }
             }
 
-            (void) ngx_proxy_wasm_create_context(filter, pwctx, ++next_id,
-                                                 NULL, &pwexec);
-            if (pwexec == NULL) {
+            /* steps implemented by the applicable filters */
+            pwctx->steps |= pwexec->filter->steps;
+
+            ecode = ngx_proxy_wasm_create_context(pwexec->filter, pwctx,
+                                                  pwexec->id, pwexec, NULL);
+            if (ecode != NGX_PROXY_WASM_ERR_NONE
+                && pwexec->ecode == NGX_PROXY_WASM_ERR_NONE)
+            {
+                /* failed before reaching the filter context */
                 return NULL;
             }
 
@@ -629,6 +711,30 @@ done:
 }
 
 
+unsigned
+ngx_proxy_wasm_ctx_idle(ngx_proxy_wasm_ctx_t *pwctx)
+{
+    size_t                  i;
+    ngx_proxy_wasm_exec_t  *pwexecs;
+
+    if (pwctx->exec_index || pwctx->action == NGX_PROXY_WASM_ACTION_PAUSE) {
+        /* chain in progress or yielded */
+        return 0;
+    }
+
+    pwexecs = (ngx_proxy_wasm_exec_t *) pwctx->pwexecs.elts;
+
+    for (i = 0; i < pwctx->pwexecs.nelts; i++) {
+        if (!ngx_queue_empty(&pwexecs[i].calls)) {
+            /* pending dispatch calls */
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+
 ngx_int_t
 ngx_proxy_wasm_resume(ngx_proxy_wasm_ctx_t *pwctx,
     ngx_wasm_phase_t *phase, ngx_proxy_wasm_step_e step)
@@ -655,6 +761,13 @@ ngx_proxy_wasm_resume(ngx_proxy_wasm_ctx_t *pwctx,
 
         break;
     default:
+        if (step == NGX_PROXY_WASM_STEP_REQ_BODY
+            && pwctx->req_body_streaming)
+        {
+            /* resumed for each request body chunk */
+            break;
+        }
+
         if (step <= pwctx->last_completed_step) {
             dd("step %d already completed, exit", step);
             ngx_wa_assert(rc == NGX_OK);
@@ -662,6 +775,20 @@ ngx_proxy_wasm_resume(ngx_proxy_wasm_ctx_t *pwctx,
         }
     }
 
+    if (!(pwctx->steps & ngx_proxy_wasm_step_flag(step))
+        && ngx_proxy_wasm_ctx_idle(pwctx))
+    {
+        ngx_log_debug1(NGX_LOG_DEBUG_WASM, pwctx->log, 0,
+                       "proxy_wasm skipping \"%V\" step: "
+                       "not implemented by any filter",
+                       ngx_proxy_wasm_step_name(step));
+
+        pwctx->last_completed_step = step;
+
+        ngx_wa_assert(rc == NGX_OK);
+        goto ret;
+    }
+
     /* resume filters chain */
 
     pwexecs = (ngx_proxy_wasm_exec_t *) pwctx->pwexecs.elts;
@@ -690,6 +817,14 @@ ngx_proxy_wasm_resume(ngx_proxy_wasm_ctx_t *pwctx,
             goto ret;
         }
 
+        if (pwexec->skip
+            || !(pwexec->filter->steps & ngx_proxy_wasm_step_flag(step)))
+        {
+            dd("filter skipped or does not implement step %d, skip", step);
+            pwctx->exec_index++;
+            goto next;
+        }
+
         if (step == NGX_PROXY_WASM_STEP_DONE
             && (pwexec->ictx == NULL || pwexec->ictx->instance->trapped))
         {
@@ -739,6 +874,8 @@ ngx_proxy_wasm_resume(ngx_proxy_wasm_ctx_t *pwctx,
 
         dd("end of loop pwctx->exec_index = %ld", pwctx->exec_index);
 
+next:
+
         /* next step */
 
         ngx_wa_assert(pwctx->exec_index <= pwctx->nfilters);
@@ -1271,6 +1408,11 @@ ngx_proxy_wasm_create_context(ngx_proxy_wasm_filter_t *filter,
                     in->started = 0;
                 }
 
+                if (in->store == NULL) {
+                    /* chain template */
+                    in->store = ictx->store;
+                }
+
                 pwexec = in;
             }
 
@@ -1359,14 +1501,18 @@ ngx_proxy_wasm_on_log(ngx_proxy_wasm_exec_t *pwexec)
     ngx_proxy_wasm_filter_t  *filter = pwexec->filter;
     ngx_wavm_instance_t      *instance = ngx_proxy_wasm_pwexec2instance(pwexec);
 
-    if (filter->abi_version < NGX_PROXY_WASM_VNEXT) {
+    if (filter->abi_version < NGX_PROXY_WASM_VNEXT
+        && filter->proxy_on_done)
+    {
         /* 0.1.0 - 0.2.1 */
         (void) ngx_wavm_instance_call_funcref(instance, filter->proxy_on_done,
                                               NULL, pwexec->id);
     }
 
-    (void) ngx_wavm_instance_call_funcref(instance, filter->proxy_on_log,
-                                          NULL, pwexec->id);
+    if (filter->proxy_on_log) {
+        (void) ngx_wavm_instance_call_funcref(instance, filter->proxy_on_log,
+                                              NULL, pwexec->id);
+    }
 }
 
 
@@ -1398,9 +1544,11 @@ ngx_proxy_wasm_on_done(ngx_proxy_wasm_exec_t *pwexec)
 #endif
 #endif
 
-    (void) ngx_wavm_instance_call_funcref(instance,
-                                          filter->proxy_on_context_finalize,
-                                          NULL, pwexec->id);
+    if (filter->proxy_on_context_finalize) {
+        (void) ngx_wavm_instance_call_funcref(instance,
+                                              filter->proxy_on_context_finalize,
+                                              NULL, pwexec->id);
+    }
 
     if (pwexec->node.key) {
         ngx_rbtree_delete(&pwexec->ictx->tree_ctxs, &pwexec->node);
@@ -1770,10 +1918,62 @@ ngx_proxy_wasm_filter_init_abi(ngx_proxy_wasm_filter_t *filter)
         return NGX_ERROR;
     }
 
+    ngx_proxy_wasm_filter_init_steps(filter);
+
     return NGX_OK;
 }
 
 
+static void
+ngx_proxy_wasm_filter_init_steps(ngx_proxy_wasm_filter_t *filter)
+{
+    /* always resumed: contexts finalization, root contexts, and callouts */
+
+    filter->steps = ngx_proxy_wasm_step_flag(NGX_PROXY_WASM_STEP_DONE)
+                    | ngx_proxy_wasm_step_flag(NGX_PROXY_WASM_STEP_TICK)
+                    | ngx_proxy_wasm_step_flag(
+                          NGX_PROXY_WASM_STEP_DISPATCH_RESPONSE);
+
+    if (filter->proxy_on_http_request_headers) {
+        filter->steps |= ngx_proxy_wasm_step_flag(
+                             NGX_PROXY_WASM_STEP_REQ_HEADERS);
+    }
+
+    if (filter->proxy_on_http_request_body) {
+        filter->steps |= ngx_proxy_wasm_step_flag(
+                             NGX_PROXY_WASM_STEP_REQ_BODY);
+    }
+
+    if (filter->proxy_on_http_request_trailers) {
+        filter->steps |= ngx_proxy_wasm_step_flag(
+                             NGX_PROXY_WASM_STEP_REQ_TRAILERS);
+    }
+
+    if (filter->proxy_on_http_response_headers) {
+        filter->steps |= ngx_proxy_wasm_step_flag(
+                             NGX_PROXY_WASM_STEP_RESP_HEADERS);
+    }
+
+    if (filter->proxy_on_http_response_body) {
+        filter->steps |= ngx_proxy_wasm_step_flag(
+                             NGX_PROXY_WASM_STEP_RESP_BODY);
+    }
+
+    if (filter->proxy_on_http_response_trailers) {
+        filter->steps |= ngx_proxy_wasm_step_flag(
+                             NGX_PROXY_WASM_STEP_RESP_TRAILERS);
+    }
+
+    if (filter->proxy_on_log || filter->proxy_on_done) {
+        filter->steps |= ngx_proxy_wasm_step_flag(NGX_PROXY_WASM_STEP_LOG);
+    }
+
+    ngx_log_debug2(NGX_LOG_DEBUG_WASM, filter->log, 0,
+                   "proxy_wasm \"%V\" filter steps: 0x%xi",
+                   filter->name, filter->steps);
+}
+
+
 static ngx_int_t
 ngx_proxy_wasm_filter_start(ngx_proxy_wasm_filter_t *filter)
 {
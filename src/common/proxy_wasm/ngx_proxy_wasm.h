@@ -8,6 +8,8 @@
 
 #define NGX_PROXY_WASM_ROOT_CTX_ID  0
 
+#define ngx_proxy_wasm_step_flag(step)  ((ngx_uint_t) 1 << (step))
+
 
 typedef enum {
     NGX_PROXY_WASM_0_1_0 = 0,
@@ -191,15 +193,50 @@ struct ngx_proxy_wasm_exec_s {
     ngx_http_proxy_wasm_dispatch_t    *call;  /* swap pointer for host functions */
 #endif
     ngx_queue_t                        calls;
+    off_t                              req_body_seen;   /* streamed bytes seen within body_window */
+    size_t                             body_visible;    /* body bytes within body_window, 0: all */
 
     /* flags */
 
     unsigned                           started:1;
     unsigned                           in_tick:1;
     unsigned                           ecode_logged:1;
+    unsigned                           skip:1;          /* filter conditions not met */
+    unsigned                           req_body_windowed:1;   /* request body_window inspected */
+    unsigned                           resp_body_windowed:1;  /* response body_window inspected */
 };
 
 
+typedef struct {
+    ngx_str_t                          data;        /* marshalled pairs */
+    size_t                             size;        /* allocated buffer size */
+    ngx_uint_t                         generation;  /* pwctx->maps_generation */
+    ngx_uint_t                         max_pairs;
+    ngx_uint_t                         truncated;
+    ngx_proxy_wasm_step_e              step;
+} ngx_proxy_wasm_maps_cache_t;
+
+
+typedef struct {
+    ngx_uint_t                         hash;        /* lowercased key hash */
+    ngx_table_elt_t                   *elt;
+} ngx_proxy_wasm_maps_slot_t;
+
+
+typedef struct {
+    ngx_list_t                        *list;
+    void                              *elts;        /* list->part.elts */
+    ngx_list_part_t                   *part;        /* last indexed part */
+    ngx_uint_t                         npart;       /* indexed elts in part */
+    ngx_uint_t                         nfirst;      /* list->part.nelts */
+    ngx_list_part_t                   *last;        /* list->last */
+    u_char                            *key;         /* last indexed key */
+    ngx_uint_t                         nelts;
+    ngx_uint_t                         size;        /* power of 2 */
+    ngx_proxy_wasm_maps_slot_t        *slots;
+} ngx_proxy_wasm_maps_index_t;
+
+
 #if (NGX_WASM_LUA)
 typedef ngx_int_t (*ngx_proxy_wasm_properties_ffi_handler_pt)(void *data,
     ngx_str_t *key, ngx_str_t *value, ngx_str_t *err);
@@ -225,6 +262,7 @@ struct ngx_proxy_wasm_ctx_s {
     ngx_proxy_wasm_step_e                         step;
     ngx_proxy_wasm_step_e                         last_completed_step;
     ngx_uint_t                                    exec_index;
+    ngx_uint_t                                    steps;             /* steps implemented by the chain */
 
     /* cache */
 
@@ -246,6 +284,23 @@ struct ngx_proxy_wasm_ctx_s {
     ngx_uint_t                                    call_code;
     ngx_uint_t                                    response_code;
 
+    /* maps */
+
+    ngx_uint_t                                    maps_generation;   /* bumped on maps writes */
+    ngx_proxy_wasm_maps_cache_t                   maps_cache[NGX_PROXY_WASM_MAP_HTTP_RESPONSE_HEADERS + 1];
+    ngx_proxy_wasm_maps_index_t                   maps_index[NGX_PROXY_WASM_MAP_HTTP_RESPONSE_HEADERS + 1];
+
+    /* properties */
+
+    ngx_array_t                                   props_memo;        /* ngx_http_variable_value_t * */
+    ngx_proxy_wasm_step_e                         props_memo_step;
+    ngx_uint_t                                    props_memo_generation;
+    ngx_array_t                                   query_args;        /* ngx_keyval_t */
+    ngx_str_t                                     query_args_src;    /* parsed r->args */
+    ngx_array_t                                   cookies;           /* ngx_keyval_t */
+    ngx_uint_t                                    cookies_generation;
+    ngx_proxy_wasm_step_e                         cookies_step;
+
     /* host properties */
 
     ngx_rbtree_t                                  host_props_tree;
@@ -262,6 +317,8 @@ struct ngx_proxy_wasm_ctx_s {
     unsigned                                      init:1;            /* can be utilized (has no filters) */
     unsigned                                      ready:1;           /* filters chain ready */
     unsigned                                      req_headers_in_access:1;
+    unsigned                                      req_body_streaming:1;  /* "on_request_body" resumed per chunk */
+    unsigned                                      cookies_parsed:1;
 };
 
 
@@ -289,6 +346,8 @@ typedef struct {
                                                  ngx_proxy_wasm_step_e step,
                                                  ngx_proxy_wasm_action_e *out);
     ngx_int_t                          (*ecode)(ngx_proxy_wasm_err_e ecode);
+    ngx_int_t                          (*applies)(ngx_proxy_wasm_filter_t *filter,
+                                                  void *data);
 } ngx_proxy_wasm_subsystem_t;
 
 
@@ -303,11 +362,14 @@ struct ngx_proxy_wasm_filter_s {
     ngx_proxy_wasm_subsystem_t    *subsystem;
     ngx_proxy_wasm_store_t        *store;   /* mcf->pwroot.store */
     ngx_proxy_wasm_err_e           ecode;
+    void                          *cond;    /* subsystem applicability conditions */
+    size_t                         body_window;  /* body_window= */
 
     /* dyn config */
 
     ngx_uint_t                     id;
     ngx_uint_t                     max_pairs;
+    ngx_uint_t                     steps;   /* steps implemented by the module */
 
     /**
      * SDK
@@ -393,6 +455,13 @@ typedef struct {
 } ngx_proxy_wasm_filters_root_t;
 
 
+typedef struct {
+    ngx_uint_t                     nfilters;
+    ngx_uint_t                     steps;     /* steps implemented by the chain */
+    ngx_proxy_wasm_exec_t         *pwexecs;   /* filter contexts template */
+} ngx_proxy_wasm_chain_t;
+
+
 /* root context */
 ngx_proxy_wasm_filters_root_t *ngx_proxy_wasm_root_alloc(ngx_pool_t *pool);
 void ngx_proxy_wasm_root_init(ngx_proxy_wasm_filters_root_t *pwroot,
@@ -401,14 +470,17 @@ void ngx_proxy_wasm_root_destroy(ngx_proxy_wasm_filters_root_t *pwroot);
 ngx_int_t ngx_proxy_wasm_load(ngx_proxy_wasm_filters_root_t *pwroot,
     ngx_proxy_wasm_filter_t *filter, ngx_log_t *log);
 ngx_int_t ngx_proxy_wasm_start(ngx_proxy_wasm_filters_root_t *pwroot);
+ngx_int_t ngx_proxy_wasm_chain_init(ngx_proxy_wasm_chain_t *chain,
+    ngx_proxy_wasm_filters_root_t *pwroot, ngx_array_t *filter_ids,
+    ngx_pool_t *pool, ngx_log_t *log);
 
 
 /* stream context */
 ngx_proxy_wasm_ctx_t *ngx_proxy_wasm_ctx_alloc(ngx_pool_t *pool);
-ngx_proxy_wasm_ctx_t *ngx_proxy_wasm_ctx(ngx_proxy_wasm_filters_root_t *pwroot,
-    ngx_array_t *filter_ids, ngx_uint_t isolation,
-    ngx_proxy_wasm_subsystem_t *subsys, void *data);
+ngx_proxy_wasm_ctx_t *ngx_proxy_wasm_ctx(ngx_proxy_wasm_chain_t *chain,
+    ngx_uint_t isolation, ngx_proxy_wasm_subsystem_t *subsys, void *data);
 void ngx_proxy_wasm_ctx_destroy(ngx_proxy_wasm_ctx_t *pwctx);
+unsigned ngx_proxy_wasm_ctx_idle(ngx_proxy_wasm_ctx_t *pwctx);
 ngx_int_t ngx_proxy_wasm_resume(ngx_proxy_wasm_ctx_t *pwctx,
     ngx_wasm_phase_t *phase, ngx_proxy_wasm_step_e step);
 ngx_proxy_wasm_err_e ngx_proxy_wasm_run_step(ngx_proxy_wasm_exec_t *pwexec,
@@ -431,9 +503,17 @@ void ngx_proxy_wasm_log_error(ngx_uint_t level, ngx_log_t *log,
 void ngx_proxy_wasm_filter_tick_handler(ngx_event_t *ev);
 ngx_int_t ngx_proxy_wasm_pairs_unmarshal(ngx_proxy_wasm_exec_t *pwexec,
     ngx_array_t *dst, ngx_proxy_wasm_marshalled_map_t *map);
+ngx_int_t ngx_proxy_wasm_keys_unmarshal(ngx_proxy_wasm_exec_t *pwexec,
+    ngx_array_t *dst, ngx_proxy_wasm_marshalled_map_t *map);
 unsigned ngx_proxy_wasm_marshal(ngx_proxy_wasm_exec_t *pwexec,
     ngx_list_t *list, ngx_array_t *extras, ngx_wavm_ptr_t *out,
     uint32_t *out_size, ngx_uint_t *truncated);
+ngx_int_t ngx_proxy_wasm_marshal_cache(ngx_proxy_wasm_exec_t *pwexec,
+    ngx_proxy_wasm_maps_cache_t *cache, ngx_list_t *list,
+    ngx_array_t *extras);
+unsigned ngx_proxy_wasm_marshal_cached(ngx_proxy_wasm_exec_t *pwexec,
+    ngx_proxy_wasm_maps_cache_t *cache, ngx_wavm_ptr_t *out,
+    uint32_t *out_size);
 
 
 static ngx_inline void
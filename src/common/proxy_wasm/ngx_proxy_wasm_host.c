@@ -63,6 +63,15 @@ ngx_proxy_wasm_get_buffer_helper(ngx_wavm_instance_t *instance,
         rctx = ngx_http_proxy_wasm_get_rctx(instance);
         r = rctx->r;
 
+        if (rctx->in_req_body_filter) {
+            /* streamed chunk */
+            if (rctx->req_chunk == NULL) {
+                *none = 1;
+            }
+
+            return rctx->req_chunk;
+        }
+
         if (r->request_body == NULL
             || r->request_body->bufs == NULL)
         {
@@ -71,14 +80,7 @@ ngx_proxy_wasm_get_buffer_helper(ngx_wavm_instance_t *instance,
             return NULL;
         }
 
-        if (r->request_body->temp_file) {
-            ngx_wavm_log_error(NGX_LOG_ERR, instance->log, NULL,
-                               "cannot read request body buffered "
-                               "to file at \"%V\"",
-                               &r->request_body->temp_file->file.name);
-            *none = 1;
-            return NULL;
-        }
+        /* file buffers are read on demand by get_buffer */
 
         return r->request_body->bufs;
 
@@ -299,16 +301,81 @@ nomem:
 /* buffers */
 
 
+static ngx_int_t
+ngx_proxy_wasm_copy_chain(ngx_wavm_instance_t *instance, ngx_wavm_ptr_t p,
+    ngx_chain_t *cl, size_t offset, size_t len)
+{
+    size_t      n, size;
+    ssize_t     rc;
+    u_char     *dst;
+    unsigned    err_count = 0;
+    ngx_buf_t  *buf;
+
+    for (/* void */; cl && len; cl = cl->next) {
+        buf = cl->buf;
+        size = ngx_buf_size(buf);
+
+        if (offset >= size) {
+            /* before the requested window */
+            offset -= size;
+            goto next;
+        }
+
+        n = ngx_min(size - offset, len);
+
+        dst = ngx_wavm_memory_lift(instance->memory, p, n, 1, &err_count);
+        if (err_count) {
+            return NGX_ABORT;
+        }
+
+        if (ngx_buf_in_memory(buf)) {
+            ngx_memcpy(dst, buf->pos + offset, n);
+
+        } else {
+            /**
+             * File buffer (e.g. request body buffered to a temporary
+             * file): only read the requested window, straight into the
+             * instance memory.
+             */
+            rc = ngx_read_file(buf->file, dst, n, buf->file_pos + offset);
+            if (rc == NGX_ERROR) {
+                return NGX_ERROR;
+            }
+
+            if ((size_t) rc != n) {
+                ngx_wavm_log_error(NGX_LOG_ERR, instance->log, NULL,
+                                   "file \"%V\" was truncated "
+                                   "(read %z of %uz bytes)",
+                                   &buf->file->name, rc, n);
+                return NGX_ERROR;
+            }
+        }
+
+        p += n;
+        len -= n;
+        offset = 0;
+
+next:
+
+        if (buf->last_buf || buf->last_in_chain) {
+            break;
+        }
+    }
+
+    return NGX_OK;
+}
+
+
 static ngx_int_t
 ngx_proxy_wasm_hfuncs_get_buffer(ngx_wavm_instance_t *instance,
     wasm_val_t args[], wasm_val_t rets[])
 {
-    size_t                         offset, max_len, len, chunk_len;
+    size_t                         offset, max_len, len;
     unsigned                       none = 0;
     char                          *trapmsg = NULL;
     u_char                        *start = NULL;
+    ngx_int_t                      rc;
     ngx_chain_t                   *cl = NULL;
-    ngx_buf_t                     *buf;
     uint32_t                      *rlen;
     ngx_wavm_ptr_t                *rbuf, p;
     ngx_proxy_wasm_buffer_type_e   buf_type;
@@ -350,18 +417,28 @@ ngx_proxy_wasm_hfuncs_get_buffer(ngx_wavm_instance_t *instance,
         }
 
         len = ngx_wasm_chain_len(cl, NULL);
+
+        if (pwexec->body_visible
+            && (buf_type == NGX_PROXY_WASM_BUFFER_HTTP_REQUEST_BODY
+                || buf_type == NGX_PROXY_WASM_BUFFER_HTTP_RESPONSE_BODY))
+        {
+            /* body_window */
+            len = ngx_min(len, pwexec->body_visible);
+        }
+
         break;
     }
 
-    len = ngx_min(len, max_len);
-
-    if (offset > offset + len) {
-        /* overflow */
-        return ngx_proxy_wasm_result_err(rets);
+    if (offset >= len) {
+        /* eof */
+        return ngx_proxy_wasm_result_ok(rets);
     }
 
+    /* window */
+
+    len = ngx_min(len - offset, max_len);
+
     if (!len) {
-        /* eof */
         return ngx_proxy_wasm_result_ok(rets);
     }
 
@@ -373,49 +450,24 @@ ngx_proxy_wasm_hfuncs_get_buffer(ngx_wavm_instance_t *instance,
     *rbuf = p;
     *rlen = (uint32_t) len;
 
-    if (start == NULL) {
-        ngx_wa_assert(cl);
-
-        if (cl && cl->next == NULL) {
-            /* single buffer */
-            start = cl->buf->pos;
-        }
-    }
-
     if (start) {
-        if (!ngx_wavm_memory_memcpy(instance->memory, p, start, len)) {
+        if (!ngx_wavm_memory_memcpy(instance->memory, p, start + offset,
+                                    len))
+        {
             return ngx_proxy_wasm_result_invalid_mem(rets);
         }
 
-    } else {
-        ngx_wa_assert(cl);
-        ngx_wa_assert(cl->buf);
-        ngx_wa_assert(cl->next);
-
-        len = 0;
-
-        for (/* void */; cl; cl = cl->next) {
-            buf = cl->buf;
-            chunk_len = buf->last - buf->pos;
-            len += chunk_len;
+        return ngx_proxy_wasm_result_ok(rets);
+    }
 
-            if (len > max_len) {
-                chunk_len -= len - max_len;
-                len = 0; /* break after copy */
-            }
+    ngx_wa_assert(cl);
 
-            if (chunk_len) {
-                p = ngx_wavm_memory_cpymem(instance->memory, p, buf->pos,
-                                           chunk_len);
-                if (p == 0) {
-                    return ngx_proxy_wasm_result_invalid_mem(rets);
-                }
-            }
+    rc = ngx_proxy_wasm_copy_chain(instance, p, cl, offset, len);
+    if (rc == NGX_ABORT) {
+        return ngx_proxy_wasm_result_invalid_mem(rets);
 
-            if (buf->last_buf || buf->last_in_chain) {
-                break;
-            }
-        }
+    } else if (rc == NGX_ERROR) {
+        return ngx_proxy_wasm_result_err(rets);
     }
 
     return ngx_proxy_wasm_result_ok(rets);
@@ -528,6 +580,119 @@ ngx_proxy_wasm_hfuncs_set_buffer(ngx_wavm_instance_t *instance,
 
     }
 
+#ifdef NGX_WASM_HTTP
+    /* body updates may update Content-Length */
+    ngx_proxy_wasm_maps_invalidate(pwctx);
+#endif
+
+    if (rc != NGX_OK) {
+        return ngx_proxy_wasm_result_err(rets);
+    }
+
+    return ngx_proxy_wasm_result_ok(rets);
+}
+
+
+static ngx_int_t
+ngx_proxy_wasm_hfuncs_splice_buffer(ngx_wavm_instance_t *instance,
+    wasm_val_t args[], wasm_val_t rets[])
+{
+    ngx_int_t                      rc = NGX_ERROR;
+    ngx_proxy_wasm_buffer_type_e   buf_type;
+#ifdef NGX_WASM_HTTP
+    size_t                         start, end;
+    ngx_str_t                      s;
+    ngx_http_wasm_req_ctx_t       *rctx;
+    ngx_proxy_wasm_exec_t         *pwexec;
+    ngx_proxy_wasm_ctx_t          *pwctx;
+
+    pwexec = ngx_proxy_wasm_instance2pwexec(instance);
+    pwctx = pwexec->parent;
+
+    start = args[1].of.i32;
+    end = args[2].of.i32;
+
+    if (start > end) {
+        return ngx_proxy_wasm_result_badarg(rets);
+    }
+
+    s.len = args[4].of.i32;
+    s.data = (u_char *) NGX_WAVM_HOST_LIFT_SLICE(instance, args[3].of.i32,
+                                                 s.len);
+#endif
+
+    buf_type = args[0].of.i32;
+
+    switch (buf_type) {
+
+#ifdef NGX_WASM_HTTP
+    case NGX_PROXY_WASM_BUFFER_HTTP_REQUEST_BODY:
+
+        /* check context */
+
+        switch (pwctx->step) {
+        case NGX_PROXY_WASM_STEP_REQ_HEADERS:
+        case NGX_PROXY_WASM_STEP_REQ_BODY:
+            break;
+        default:
+            return ngx_proxy_wasm_result_trap(pwexec,
+                                              "can only set request body "
+                                              "during \"on_request_body\"",
+                                              rets, NGX_WAVM_BAD_USAGE);
+        }
+
+        /* splice */
+
+        rctx = ngx_http_proxy_wasm_get_rctx(instance);
+
+        ngx_wa_assert(rctx);
+
+        rc = ngx_http_wasm_splice_req_body(rctx, &s, start, end);
+
+        ngx_wa_assert(rc != NGX_ABORT);
+        break;
+
+    case NGX_PROXY_WASM_BUFFER_HTTP_RESPONSE_BODY:
+
+        /* check context */
+
+        switch (pwctx->step) {
+        case NGX_PROXY_WASM_STEP_RESP_BODY:
+            break;
+        default:
+            return ngx_proxy_wasm_result_trap(pwexec,
+                                              "can only set response body "
+                                              "during \"on_response_body\"",
+                                              rets, NGX_WAVM_BAD_USAGE);
+        }
+
+        /* splice */
+
+        rctx = ngx_http_proxy_wasm_get_rctx(instance);
+
+        ngx_wa_assert(rctx);
+
+        rc = ngx_http_wasm_splice_resp_body(rctx, &s, start, end);
+        if (rc == NGX_ABORT) {
+            /* no response chunk */
+            return ngx_proxy_wasm_result_notfound(rets);
+        }
+
+        break;
+#endif
+
+    default:
+        ngx_wavm_log_error(NGX_LOG_WASM_NYI, instance->log, NULL,
+                           "NYI - splice_buffer bad buf_type: %d", buf_type);
+        return ngx_proxy_wasm_result_badarg(rets);
+
+    }
+
+#ifdef NGX_WASM_HTTP
+    /* body updates may update Content-Length */
+    ngx_proxy_wasm_maps_invalidate(pwctx);
+#endif
+
     if (rc != NGX_OK) {
         return ngx_proxy_wasm_result_err(rets);
     }
@@ -536,6 +701,92 @@ ngx_proxy_wasm_hfuncs_set_buffer(ngx_wavm_instance_t *instance,
 }
 
 
+static ngx_list_t *
+ngx_proxy_wasm_hfuncs_lift_keys(ngx_wavm_instance_t *instance,
+    uint32_t keys_data, uint32_t keys_size, ngx_array_t *keys,
+    ngx_int_t *rc)
+{
+    ngx_list_t                       *list;
+    ngx_proxy_wasm_exec_t            *pwexec;
+    ngx_proxy_wasm_marshalled_map_t   map;
+
+    pwexec = ngx_proxy_wasm_instance2pwexec(instance);
+
+    map.len = keys_size;
+    map.data = NGX_WAVM_HOST_LIFT_SLICE(instance, keys_data, map.len);
+
+    *rc = ngx_proxy_wasm_keys_unmarshal(pwexec, keys, &map);
+    if (*rc != NGX_OK) {
+        return NULL;
+    }
+
+    list = ngx_list_create(pwexec->pool, keys->nelts ? keys->nelts : 1,
+                           sizeof(ngx_table_elt_t));
+    if (list == NULL) {
+        *rc = NGX_ERROR;
+    }
+
+    return list;
+}
+
+
+static ngx_int_t
+ngx_proxy_wasm_hfuncs_push_pair(ngx_proxy_wasm_exec_t *pwexec,
+    ngx_list_t *list, ngx_str_t *key, ngx_str_t *value)
+{
+    ngx_table_elt_t  *elt;
+
+    elt = ngx_list_push(list);
+    if (elt == NULL) {
+        return NGX_ERROR;
+    }
+
+    /**
+     * Keys are lifted from the guest memory, which may be grown when
+     * allocating the returned buffer: copy them.
+     */
+
+    elt->hash = 1;
+    elt->lowcase_key = NULL;
+    elt->key.len = key->len;
+    elt->key.data = ngx_pstrdup(pwexec->pool, key);
+    elt->value.len = value->len;
+    elt->value.data = ngx_pstrdup(pwexec->pool, value);
+
+    if ((key->len && elt->key.data == NULL)
+        || (value->len && elt->value.data == NULL))
+    {
+        return NGX_ERROR;
+    }
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_proxy_wasm_hfuncs_return_pairs(ngx_wavm_instance_t *instance,
+    ngx_list_t *list, ngx_wavm_ptr_t *rbuf, uint32_t *rlen,
+    wasm_val_t rets[])
+{
+    ngx_uint_t              truncated = 0;
+    ngx_proxy_wasm_exec_t  *pwexec;
+
+    pwexec = ngx_proxy_wasm_instance2pwexec(instance);
+
+    if (!ngx_proxy_wasm_marshal(pwexec, list, NULL, rbuf, rlen, &truncated)) {
+        return ngx_proxy_wasm_result_invalid_mem(rets);
+    }
+
+    if (truncated) {
+        ngx_proxy_wasm_log_error(NGX_LOG_WARN, pwexec->log, 0,
+                                 "marshalled map truncated to %ui elements",
+                                 truncated);
+    }
+
+    return ngx_proxy_wasm_result_ok(rets);
+}
+
+
 /* maps */
 
 
@@ -543,13 +794,14 @@ static ngx_int_t
 ngx_proxy_wasm_hfuncs_get_header_map_pairs(ngx_wavm_instance_t *instance,
     wasm_val_t args[], wasm_val_t rets[])
 {
-    uint32_t                   *rlen;
-    ngx_uint_t                  truncated = 0;
-    ngx_list_t                 *list;
-    ngx_array_t                 extras;
-    ngx_wavm_ptr_t             *rbuf;
-    ngx_proxy_wasm_exec_t      *pwexec;
-    ngx_proxy_wasm_map_type_e   map_type;
+    uint32_t                      *rlen;
+    ngx_uint_t                     truncated = 0;
+    ngx_list_t                    *list;
+    ngx_array_t                    extras;
+    ngx_wavm_ptr_t                *rbuf;
+    ngx_proxy_wasm_exec_t         *pwexec;
+    ngx_proxy_wasm_maps_cache_t   *cache;
+    ngx_proxy_wasm_map_type_e      map_type;
 
     pwexec = ngx_proxy_wasm_instance2pwexec(instance);
 
@@ -557,19 +809,43 @@ ngx_proxy_wasm_hfuncs_get_header_map_pairs(ngx_wavm_instance_t *instance,
     rbuf = NGX_WAVM_HOST_LIFT(instance, args[1].of.i32, ngx_wavm_ptr_t);
     rlen = NGX_WAVM_HOST_LIFT(instance, args[2].of.i32, uint32_t);
 
-    ngx_array_init(&extras, pwexec->pool, 8, sizeof(ngx_table_elt_t));
+    cache = ngx_proxy_wasm_maps_cache(pwexec->parent, map_type);
 
-    list = ngx_proxy_wasm_maps_get_all(instance, map_type, &extras);
-    if (list == NULL) {
-        return ngx_proxy_wasm_result_badarg(rets);
+    if (cache == NULL || !ngx_proxy_wasm_maps_cache_valid(pwexec, cache)) {
+        ngx_array_init(&extras, pwexec->pool, 8, sizeof(ngx_table_elt_t));
+
+        list = ngx_proxy_wasm_maps_get_all(instance, map_type, &extras);
+        if (list == NULL) {
+            return ngx_proxy_wasm_result_badarg(rets);
+        }
+
+        if (cache == NULL) {
+            if (!ngx_proxy_wasm_marshal(pwexec, list, &extras, rbuf, rlen,
+                                        &truncated))
+            {
+                return ngx_proxy_wasm_result_invalid_mem(rets);
+            }
+
+            goto done;
+        }
+
+        if (ngx_proxy_wasm_marshal_cache(pwexec, cache, list, &extras)
+            != NGX_OK)
+        {
+            return ngx_proxy_wasm_result_err(rets);
+        }
     }
 
-    if (!ngx_proxy_wasm_marshal(pwexec, list, &extras, rbuf, rlen,
-                                &truncated))
-    {
+    /* marshalled once per maps generation, shared by the chain */
+
+    if (!ngx_proxy_wasm_marshal_cached(pwexec, cache, rbuf, rlen)) {
         return ngx_proxy_wasm_result_invalid_mem(rets);
     }
 
+    truncated = cache->truncated;
+
+done:
+
     if (truncated) {
         ngx_proxy_wasm_log_error(NGX_LOG_WARN, pwexec->log, 0,
                                  "marshalled map truncated to %ui elements",
@@ -626,28 +902,87 @@ ngx_proxy_wasm_hfuncs_get_header_map_value(ngx_wavm_instance_t *instance,
 
 
 static ngx_int_t
-ngx_proxy_wasm_hfuncs_set_header_check(ngx_wavm_instance_t *instance,
-    ngx_proxy_wasm_map_type_e map_type, wasm_val_t rets[])
+ngx_proxy_wasm_hfuncs_get_map_values(ngx_wavm_instance_t *instance,
+    wasm_val_t args[], wasm_val_t rets[])
 {
-#ifdef NGX_WASM_HTTP
-    ngx_proxy_wasm_exec_t    *pwexec;
-    ngx_proxy_wasm_ctx_t     *pwctx;
-    ngx_http_wasm_req_ctx_t  *rctx;
+    size_t                      i;
+    uint32_t                   *rlen;
+    ngx_int_t                   rc;
+    ngx_str_t                  *keys, *value;
+    ngx_list_t                 *list;
+    ngx_array_t                 karr;
+    ngx_wavm_ptr_t             *rbuf;
+    ngx_proxy_wasm_exec_t      *pwexec;
+    ngx_proxy_wasm_map_type_e   map_type;
+    wasm_val_t                  pairs_args[3];
 
-    rctx = ngx_http_proxy_wasm_get_rctx(instance);
-    pwexec = ngx_proxy_wasm_instance2pwexec(instance);
-    pwctx = pwexec->parent;
-#endif
+    if (args[2].of.i32 == 0) {
+        /* no keys: all pairs */
+        pairs_args[0] = args[0];
+        pairs_args[1] = args[3];
+        pairs_args[2] = args[4];
 
-    switch (map_type) {
-#ifdef NGX_WASM_HTTP
-    case NGX_PROXY_WASM_MAP_HTTP_REQUEST_HEADERS:
+        return ngx_proxy_wasm_hfuncs_get_header_map_pairs(instance,
+                                                          pairs_args, rets);
+    }
 
-        /* check context */
+    pwexec = ngx_proxy_wasm_instance2pwexec(instance);
 
-        switch (pwctx->step) {
-        case NGX_PROXY_WASM_STEP_REQ_HEADERS:
-        case NGX_PROXY_WASM_STEP_REQ_BODY:
+    map_type = args[0].of.i32;
+    rbuf = NGX_WAVM_HOST_LIFT(instance, args[3].of.i32, ngx_wavm_ptr_t);
+    rlen = NGX_WAVM_HOST_LIFT(instance, args[4].of.i32, uint32_t);
+
+    list = ngx_proxy_wasm_hfuncs_lift_keys(instance, args[1].of.i32,
+                                           args[2].of.i32, &karr, &rc);
+    if (list == NULL) {
+        return rc == NGX_DECLINED
+               ? ngx_proxy_wasm_result_badarg(rets)
+               : ngx_proxy_wasm_result_err(rets);
+    }
+
+    keys = karr.elts;
+
+    for (i = 0; i < karr.nelts; i++) {
+        value = ngx_proxy_wasm_maps_get(instance, map_type, &keys[i]);
+        if (value == NULL) {
+            continue;
+        }
+
+        if (ngx_proxy_wasm_hfuncs_push_pair(pwexec, list, &keys[i], value)
+            != NGX_OK)
+        {
+            return ngx_proxy_wasm_result_err(rets);
+        }
+    }
+
+    return ngx_proxy_wasm_hfuncs_return_pairs(instance, list, rbuf, rlen,
+                                              rets);
+}
+
+
+static ngx_int_t
+ngx_proxy_wasm_hfuncs_set_header_check(ngx_wavm_instance_t *instance,
+    ngx_proxy_wasm_map_type_e map_type, wasm_val_t rets[])
+{
+#ifdef NGX_WASM_HTTP
+    ngx_proxy_wasm_exec_t    *pwexec;
+    ngx_proxy_wasm_ctx_t     *pwctx;
+    ngx_http_wasm_req_ctx_t  *rctx;
+
+    rctx = ngx_http_proxy_wasm_get_rctx(instance);
+    pwexec = ngx_proxy_wasm_instance2pwexec(instance);
+    pwctx = pwexec->parent;
+#endif
+
+    switch (map_type) {
+#ifdef NGX_WASM_HTTP
+    case NGX_PROXY_WASM_MAP_HTTP_REQUEST_HEADERS:
+
+        /* check context */
+
+        switch (pwctx->step) {
+        case NGX_PROXY_WASM_STEP_REQ_HEADERS:
+        case NGX_PROXY_WASM_STEP_REQ_BODY:
         case NGX_PROXY_WASM_STEP_REQ_TRAILERS:
             break;
         case NGX_PROXY_WASM_STEP_DISPATCH_RESPONSE:
@@ -745,6 +1080,8 @@ ngx_proxy_wasm_hfuncs_set_header_map_pairs(ngx_wavm_instance_t *instance,
         return ngx_proxy_wasm_result_err(rets);
     }
 
+    ngx_proxy_wasm_maps_invalidate(pwexec->parent);
+
     rc = ngx_proxy_wasm_maps_set_all(instance, map_type, &headers);
     if (rc == NGX_ERROR) {
         return ngx_proxy_wasm_result_err(rets);
@@ -932,6 +1269,77 @@ ngx_proxy_wasm_hfuncs_get_property(ngx_wavm_instance_t *instance,
 }
 
 
+static ngx_int_t
+ngx_proxy_wasm_hfuncs_get_properties(ngx_wavm_instance_t *instance,
+    wasm_val_t args[], wasm_val_t rets[])
+{
+    size_t                  i;
+    char                    trapmsg[NGX_MAX_ERROR_STR];
+    uint32_t               *rlen;
+    ngx_int_t               rc;
+    ngx_str_t              *keys, value;
+    ngx_str_t               err = { 0, NULL };
+    ngx_list_t             *list;
+    ngx_array_t             karr;
+    u_char                 *dotted_path, *last;
+    ngx_wavm_ptr_t         *rbuf;
+    ngx_proxy_wasm_exec_t  *pwexec;
+
+    pwexec = ngx_proxy_wasm_instance2pwexec(instance);
+
+    rbuf = NGX_WAVM_HOST_LIFT(instance, args[2].of.i32, ngx_wavm_ptr_t);
+    rlen = NGX_WAVM_HOST_LIFT(instance, args[3].of.i32, uint32_t);
+
+    list = ngx_proxy_wasm_hfuncs_lift_keys(instance, args[0].of.i32,
+                                           args[1].of.i32, &karr, &rc);
+    if (list == NULL) {
+        return rc == NGX_DECLINED
+               ? ngx_proxy_wasm_result_badarg(rets)
+               : ngx_proxy_wasm_result_err(rets);
+    }
+
+    keys = karr.elts;
+
+    for (i = 0; i < karr.nelts; i++) {
+        rc = ngx_proxy_wasm_properties_get(pwexec->parent, &keys[i], &value,
+                                           &err);
+
+        switch (rc) {
+        case NGX_DECLINED:
+            continue;
+        case NGX_ERROR:
+            if (err.len) {
+                ngx_proxy_wasm_properties_unmarsh_path(&keys[i],
+                                                       &dotted_path);
+
+                last = ngx_slprintf((u_char *) &trapmsg,
+                                    (u_char *) trapmsg + NGX_MAX_ERROR_STR - 1,
+                                    "could not get \"%s\": %V",
+                                    dotted_path,
+                                    &err);
+                *last++ = '\0';
+
+                return ngx_proxy_wasm_result_trap(pwexec, trapmsg, rets,
+                                                  NGX_WAVM_ERROR);
+            }
+
+            return ngx_proxy_wasm_result_err(rets);
+        default:
+            ngx_wa_assert(rc == NGX_OK);
+        }
+
+        if (ngx_proxy_wasm_hfuncs_push_pair(pwexec, list, &keys[i], &value)
+            != NGX_OK)
+        {
+            return ngx_proxy_wasm_result_err(rets);
+        }
+    }
+
+    return ngx_proxy_wasm_hfuncs_return_pairs(instance, list, rbuf, rlen,
+                                              rets);
+}
+
+
 static ngx_int_t
 ngx_proxy_wasm_hfuncs_set_property(ngx_wavm_instance_t *instance,
     wasm_val_t args[], wasm_val_t rets[])
@@ -1068,6 +1476,8 @@ ngx_proxy_wasm_hfuncs_send_local_response(ngx_wavm_instance_t *instance,
         return ngx_proxy_wasm_result_err(rets);
     }
 
+    ngx_proxy_wasm_maps_invalidate(pwexec->parent);
+
     if (rctx->entered_header_filter && !rctx->entered_body_filter) {
         r = rctx->r;
         s.data = body;
@@ -1136,215 +1546,616 @@ ngx_proxy_wasm_hfuncs_send_local_response(ngx_wavm_instance_t *instance,
                                           "response already sent", rets,
                                           NGX_WAVM_BAD_USAGE);
 
-    default:
-        /* unreachable */
-        ngx_wa_assert(0);
-        return NGX_WAVM_NYI;
+    default:
+        /* unreachable */
+        ngx_wa_assert(0);
+        return NGX_WAVM_NYI;
+
+    }
+
+    return ngx_proxy_wasm_result_ok(rets);
+}
+
+
+/* http callouts */
+
+
+static ngx_int_t
+ngx_proxy_wasm_hfuncs_dispatch_http_call(ngx_wavm_instance_t *instance,
+    wasm_val_t args[], wasm_val_t rets[])
+{
+    uint32_t                         *callout_id, timeout;
+    ngx_str_t                         host, body;
+    ngx_proxy_wasm_marshalled_map_t   headers, trailers;
+    ngx_proxy_wasm_ctx_t             *pwctx;
+    ngx_proxy_wasm_exec_t            *pwexec;
+    ngx_http_wasm_req_ctx_t          *rctx;
+    ngx_http_proxy_wasm_dispatch_t   *call = NULL;
+
+    pwexec = ngx_proxy_wasm_instance2pwexec(instance);
+    rctx = ngx_http_proxy_wasm_get_rctx(instance);
+    pwctx = pwexec->parent;
+
+    /* check context */
+
+    switch (pwctx->step) {
+    case NGX_PROXY_WASM_STEP_REQ_HEADERS:
+    case NGX_PROXY_WASM_STEP_REQ_BODY:
+    case NGX_PROXY_WASM_STEP_TICK:
+    case NGX_PROXY_WASM_STEP_DISPATCH_RESPONSE:
+        break;
+    default:
+        return ngx_proxy_wasm_result_trap(pwexec,
+                                          "can only send HTTP dispatch "
+                                          "during "
+                                          "\"on_request_headers\", "
+                                          "\"on_request_body\", "
+                                          "\"on_dispatch_response\", "
+                                          "\"on_tick\"",
+                                          rets, NGX_WAVM_BAD_USAGE);
+    }
+
+    host.len = args[1].of.i32;
+    host.data = NGX_WAVM_HOST_LIFT_SLICE(instance, args[0].of.i32, host.len);
+
+    headers.len = args[3].of.i32;
+    headers.data = NGX_WAVM_HOST_LIFT_SLICE(instance, args[2].of.i32,
+                                            headers.len);
+
+    body.len = args[5].of.i32;
+    body.data = NGX_WAVM_HOST_LIFT_SLICE(instance, args[4].of.i32, body.len);
+
+    trailers.len = args[7].of.i32;
+    trailers.data = NGX_WAVM_HOST_LIFT_SLICE(instance, args[6].of.i32,
+                                             trailers.len);
+
+    timeout = args[8].of.i32;
+    callout_id = NGX_WAVM_HOST_LIFT(instance, args[9].of.i32, uint32_t);
+
+    call = ngx_http_proxy_wasm_dispatch(pwexec, rctx, &host,
+                                        &headers, &trailers,
+                                        &body, timeout);
+    if (call == NULL) {
+        return ngx_proxy_wasm_result_err(rets);
+    }
+
+    *callout_id = call->id;
+
+    return ngx_proxy_wasm_result_ok(rets);
+}
+
+
+#else
+static ngx_int_t
+ngx_proxy_wasm_hfuncs_no_http(ngx_wavm_instance_t *instance,
+    wasm_val_t args[], wasm_val_t rets[])
+{
+    ngx_proxy_wasm_exec_t  *pwexec;
+
+    pwexec = ngx_proxy_wasm_instance2pwexec(instance);
+
+    return ngx_proxy_wasm_result_trap(pwexec,
+                                      "NYI - not supported without "
+                                      "ngx_http_core_module",
+                                      rets, NGX_WAVM_ERROR);
+}
+#endif
+
+
+/* grpc callouts */
+/* NYI */
+
+
+/* shared k/v store */
+
+
+#define NGX_PROXY_WASM_SHM_READ_BUF_SIZE  256
+#define NGX_PROXY_WASM_SHM_KEYS_MAX       1000
+
+
+static ngx_int_t
+ngx_proxy_wasm_shm_kv_read(ngx_wa_shm_t *shm, ngx_str_t *key,
+    ngx_str_t *value, size_t size, uint32_t *cas, ngx_log_t *log)
+{
+    u_char     *buf = value->data;
+    ngx_int_t   rc;
+
+    /**
+     * Values are copied out of the zone into the caller's buffer, or
+     * into a heap buffer when larger (value->data != buf, to be freed
+     * by the caller).
+     */
+
+    for ( ;; ) {
+        rc = ngx_wa_shm_kv_read(shm, key, value, size, cas);
+        if (rc != NGX_AGAIN) {
+            return rc;
+        }
+
+        if (value->data != buf) {
+            ngx_free(value->data);
+        }
+
+        size = value->len;
+
+        value->data = ngx_alloc(size, log);
+        if (value->data == NULL) {
+            return NGX_ERROR;
+        }
+    }
+}
+
+
+static ngx_int_t
+ngx_proxy_wasm_hfuncs_get_shared_data(ngx_wavm_instance_t *instance,
+    wasm_val_t args[], wasm_val_t rets[])
+{
+    ngx_int_t               rc;
+    ngx_str_t               key, value;
+    u_char                  buf[NGX_PROXY_WASM_SHM_READ_BUF_SIZE];
+    uint32_t               *value_data, *value_size, *cas;
+    uint32_t                wbuf_ptr;
+    ngx_wa_shm_kv_key_t     resolved;
+    ngx_proxy_wasm_exec_t  *pwexec = ngx_proxy_wasm_instance2pwexec(instance);
+
+    key.len = args[1].of.i32;
+    key.data = NGX_WAVM_HOST_LIFT_SLICE(instance, args[0].of.i32, key.len);
+    value_data = NGX_WAVM_HOST_LIFT(instance, args[2].of.i32, uint32_t);
+    value_size = NGX_WAVM_HOST_LIFT(instance, args[3].of.i32, uint32_t);
+    cas = NGX_WAVM_HOST_LIFT(instance, args[4].of.i32, uint32_t);
+
+    dd("getting \"%.*s\"", (int) key.len, key.data);
+
+    /* resolve key namespace */
+
+    rc = ngx_wa_shm_kv_resolve_key(&key, &resolved);
+    if (rc == NGX_ABORT) {
+        return ngx_proxy_wasm_result_trap(pwexec, "attempt to get "
+                                          "key/value from a queue", rets,
+                                          NGX_WAVM_BAD_USAGE);
+    }
+
+    if (rc == NGX_DECLINED) {
+        /* TODO: format with key */
+        return ngx_proxy_wasm_result_trap(pwexec, "failed getting value "
+                                          "from shm (could not resolve "
+                                          "namespace)", rets,
+                                          NGX_WAVM_BAD_USAGE);
+    }
+
+    ngx_wa_assert(rc == NGX_OK);
+
+    /* get */
+
+    value.data = buf;
+
+    rc = ngx_proxy_wasm_shm_kv_read(resolved.shm, &key, &value, sizeof(buf),
+                                    cas, pwexec->log);
+    if (rc != NGX_OK) {
+        if (value.data != buf) {
+            ngx_free(value.data);
+        }
+
+        if (rc == NGX_DECLINED) {
+            return ngx_proxy_wasm_result_notfound(rets);
+        }
+
+        return ngx_proxy_wasm_result_err(rets);
+    }
+
+    /* return value */
+
+    wbuf_ptr = ngx_proxy_wasm_alloc(pwexec, value.len);
+    if (wbuf_ptr == 0) {
+        if (value.data != buf) {
+            ngx_free(value.data);
+        }
+
+        /* TODO: format with key */
+        return ngx_proxy_wasm_result_trap(pwexec, "failed getting value "
+                                          "from shm (no memory)", rets,
+                                          NGX_WAVM_ERROR);
+    }
+
+    ngx_memcpy(NGX_WAVM_HOST_LIFT_SLICE(instance, wbuf_ptr, value.len),
+               value.data, value.len);
+
+    if (value.data != buf) {
+        ngx_free(value.data);
+    }
+
+    *value_data = wbuf_ptr;
+    *value_size = value.len;
+
+    return ngx_proxy_wasm_result_ok(rets);
+}
+
+
+static ngx_int_t
+ngx_proxy_wasm_hfuncs_get_shared_data_many(ngx_wavm_instance_t *instance,
+    wasm_val_t args[], wasm_val_t rets[])
+{
+    size_t                  i;
+    u_char                  buf[NGX_PROXY_WASM_SHM_READ_BUF_SIZE];
+    uint32_t               *rlen;
+    ngx_int_t               rc;
+    ngx_str_t              *keys, value;
+    ngx_list_t             *list;
+    ngx_array_t             karr;
+    ngx_wavm_ptr_t         *rbuf;
+    ngx_wa_shm_kv_key_t     resolved;
+    ngx_proxy_wasm_exec_t  *pwexec = ngx_proxy_wasm_instance2pwexec(instance);
+
+    rbuf = NGX_WAVM_HOST_LIFT(instance, args[2].of.i32, ngx_wavm_ptr_t);
+    rlen = NGX_WAVM_HOST_LIFT(instance, args[3].of.i32, uint32_t);
+
+    list = ngx_proxy_wasm_hfuncs_lift_keys(instance, args[0].of.i32,
+                                           args[1].of.i32, &karr, &rc);
+    if (list == NULL) {
+        return rc == NGX_DECLINED
+               ? ngx_proxy_wasm_result_badarg(rets)
+               : ngx_proxy_wasm_result_err(rets);
+    }
+
+    keys = karr.elts;
+
+    for (i = 0; i < karr.nelts; i++) {
+        dd("getting \"%.*s\"", (int) keys[i].len, keys[i].data);
+
+        /* resolve key namespace */
+
+        rc = ngx_wa_shm_kv_resolve_key(&keys[i], &resolved);
+        if (rc != NGX_OK) {
+            if (rc == NGX_ABORT) {
+                return ngx_proxy_wasm_result_trap(pwexec, "attempt to get "
+                                                  "key/value from a queue",
+                                                  rets, NGX_WAVM_BAD_USAGE);
+            }
+
+            return ngx_proxy_wasm_result_trap(pwexec, "failed getting value "
+                                              "from shm (could not resolve "
+                                              "namespace)", rets,
+                                              NGX_WAVM_BAD_USAGE);
+        }
+
+        /* get */
+
+        value.data = buf;
+
+        rc = ngx_proxy_wasm_shm_kv_read(resolved.shm, &keys[i], &value,
+                                        sizeof(buf), NULL, pwexec->log);
+        if (rc == NGX_OK) {
+            rc = ngx_proxy_wasm_hfuncs_push_pair(pwexec, list, &keys[i],
+                                                 &value);
+        }
+
+        if (value.data != buf) {
+            ngx_free(value.data);
+        }
+
+        if (rc == NGX_ERROR) {
+            return ngx_proxy_wasm_result_err(rets);
+        }
+
+        /* NGX_OK, NGX_DECLINED (not found) */
+    }
+
+    return ngx_proxy_wasm_hfuncs_return_pairs(instance, list, rbuf, rlen,
+                                              rets);
+}
+
+
+static ngx_int_t
+ngx_proxy_wasm_shm_kv_set(ngx_wavm_instance_t *instance, wasm_val_t args[],
+    wasm_val_t rets[], ngx_msec_t ttl)
+{
+    uint32_t                cas;
+    unsigned                written;
+    ngx_int_t               rc;
+    ngx_str_t               key, value;
+    ngx_wa_shm_kv_key_t     resolved;
+    ngx_proxy_wasm_exec_t  *pwexec = ngx_proxy_wasm_instance2pwexec(instance);
+
+    key.len = args[1].of.i32;
+    key.data = NGX_WAVM_HOST_LIFT_SLICE(instance, args[0].of.i32, key.len);
+    value.len = args[3].of.i32;
+    value.data = NGX_WAVM_HOST_LIFT_SLICE(instance, args[2].of.i32, value.len);
+    cas = args[4].of.i32;
+
+    dd("setting \"%.*s\" -> \"%.*s\"",
+       (int) key.len, key.data,
+       (int) value.len, value.data);
+
+    /* resolve key namespace */
+
+    rc = ngx_wa_shm_kv_resolve_key(&key, &resolved);
+    if (rc == NGX_ABORT) {
+        /* TODO: format with key */
+        return ngx_proxy_wasm_result_trap(pwexec, "attempt to set "
+                                          "key/value in a queue", rets,
+                                          NGX_WAVM_BAD_USAGE);
+    }
+
+    if (rc == NGX_DECLINED) {
+        /* TODO: format with key */
+        return ngx_proxy_wasm_result_trap(pwexec, "failed setting value "
+                                          "to shm (could not resolve "
+                                          "namespace)", rets,
+                                          NGX_WAVM_BAD_USAGE);
+    }
+
+    ngx_wa_assert(rc == NGX_OK);
+
+    /* set */
+
+    ngx_wa_shm_lock(resolved.shm);
+
+    /*
+     * If the filter passes a NULL value pointer, treat it as a delete request.
+     * It is still possible to distinguish between:
+     * - Setting an empty value (ptr != NULL, len == 0)
+     * - Deleting a k/v pair (ptr == NULL, len == 0)
+     */
+    rc = ngx_wa_shm_kv_set_locked(resolved.shm,
+                                  &key, value.data ? &value : NULL,
+                                  cas, ttl, &written);
+
+    ngx_wa_shm_unlock(resolved.shm);
+
+    if (rc == NGX_ERROR) {
+        /* TODO: format with key */
+        return ngx_proxy_wasm_result_trap(pwexec, "failed setting value "
+                                          "to shm (could not write to slab)",
+                                          rets,
+                                          NGX_WAVM_ERROR);
+    }
+
+    ngx_wa_assert(rc == NGX_OK);
+
+    if (!written) {
+        return ngx_proxy_wasm_result_cas_mismatch(rets);
+    }
+
+    return ngx_proxy_wasm_result_ok(rets);
+}
+
+
+static ngx_int_t
+ngx_proxy_wasm_hfuncs_set_shared_data(ngx_wavm_instance_t *instance,
+    wasm_val_t args[], wasm_val_t rets[])
+{
+    /* setting without a TTL clears the previous one */
+    return ngx_proxy_wasm_shm_kv_set(instance, args, rets, 0);
+}
+
+
+static ngx_int_t
+ngx_proxy_wasm_hfuncs_set_shared_data_ttl(ngx_wavm_instance_t *instance,
+    wasm_val_t args[], wasm_val_t rets[])
+{
+    /* proxy_set_shared_data arguments + TTL in milliseconds (0: none) */
+    return ngx_proxy_wasm_shm_kv_set(instance, args, rets,
+                                     (ngx_msec_t) args[5].of.i32);
+}
+
+
+static ngx_int_t
+ngx_proxy_wasm_shm_kv_set_many(ngx_wavm_instance_t *instance,
+    ngx_str_t *keys, ngx_str_t *values, ngx_uint_t nkeys, uint32_t *nwritten,
+    wasm_val_t rets[])
+{
+    ngx_int_t               rc;
+    ngx_uint_t              i, start, n, total = 0;
+    ngx_wa_shm_t          **zones;
+    ngx_wa_shm_kv_key_t     resolved;
+    ngx_proxy_wasm_exec_t  *pwexec = ngx_proxy_wasm_instance2pwexec(instance);
+
+    zones = ngx_palloc(pwexec->pool, sizeof(ngx_wa_shm_t *) * (nkeys + 1));
+    if (zones == NULL) {
+        return ngx_proxy_wasm_result_err(rets);
+    }
+
+    /* resolve all namespaces first: nothing is written on failure */
+
+    for (i = 0; i < nkeys; i++) {
+        rc = ngx_wa_shm_kv_resolve_key(&keys[i], &resolved);
+        if (rc == NGX_ABORT) {
+            return ngx_proxy_wasm_result_trap(pwexec, "attempt to set "
+                                              "key/value in a queue", rets,
+                                              NGX_WAVM_BAD_USAGE);
+        }
+
+        if (rc == NGX_DECLINED) {
+            return ngx_proxy_wasm_result_trap(pwexec, "failed setting value "
+                                              "to shm (could not resolve "
+                                              "namespace)", rets,
+                                              NGX_WAVM_BAD_USAGE);
+        }
+
+        zones[i] = resolved.zone->data;
+    }
+
+    /**
+     * Consecutive keys of a zone are written under a single lock.
+     * Writes stop at the first allocation failure: the leading pairs
+     * already written are kept and counted in nwritten.
+     */
+
+    rc = NGX_OK;
+
+    for (start = 0; start < nkeys; start = i) {
+        for (i = start + 1; i < nkeys && zones[i] == zones[start]; i++) {
+            /* void */
+        }
+
+        ngx_wa_shm_lock(zones[start]);
+
+        rc = ngx_wa_shm_kv_set_many_locked(zones[start], &keys[start],
+                                           values ? &values[start] : NULL,
+                                           i - start, 0, &n);
+
+        ngx_wa_shm_unlock(zones[start]);
+
+        total += n;
+
+        if (rc != NGX_OK) {
+            break;
+        }
+    }
+
+    if (nwritten) {
+        *nwritten = (uint32_t) total;
+    }
+
+    if (rc == NGX_ERROR) {
+        ngx_wavm_log_error(NGX_LOG_ERR, instance->log, NULL,
+                           "failed setting value to shm (could not write "
+                           "to slab), %ui of %ui pairs written",
+                           total, nkeys);
 
+        return ngx_proxy_wasm_result_err(rets);
     }
 
     return ngx_proxy_wasm_result_ok(rets);
 }
 
 
-/* http callouts */
-
-
 static ngx_int_t
-ngx_proxy_wasm_hfuncs_dispatch_http_call(ngx_wavm_instance_t *instance,
+ngx_proxy_wasm_hfuncs_set_shared_data_many(ngx_wavm_instance_t *instance,
     wasm_val_t args[], wasm_val_t rets[])
 {
-    uint32_t                         *callout_id, timeout;
-    ngx_str_t                         host, body;
-    ngx_proxy_wasm_marshalled_map_t   headers, trailers;
-    ngx_proxy_wasm_ctx_t             *pwctx;
+    uint32_t                         *nwritten;
+    ngx_uint_t                        i;
+    ngx_str_t                        *keys, *values;
+    ngx_array_t                       pairs;
+    ngx_table_elt_t                  *elts;
     ngx_proxy_wasm_exec_t            *pwexec;
-    ngx_http_wasm_req_ctx_t          *rctx;
-    ngx_http_proxy_wasm_dispatch_t   *call = NULL;
+    ngx_proxy_wasm_marshalled_map_t   map;
 
     pwexec = ngx_proxy_wasm_instance2pwexec(instance);
-    rctx = ngx_http_proxy_wasm_get_rctx(instance);
-    pwctx = pwexec->parent;
 
-    /* check context */
+    map.len = args[1].of.i32;
+    map.data = NGX_WAVM_HOST_LIFT_SLICE(instance, args[0].of.i32, map.len);
+    nwritten = NGX_WAVM_HOST_LIFT(instance, args[2].of.i32, uint32_t);
 
-    switch (pwctx->step) {
-    case NGX_PROXY_WASM_STEP_REQ_HEADERS:
-    case NGX_PROXY_WASM_STEP_REQ_BODY:
-    case NGX_PROXY_WASM_STEP_TICK:
-    case NGX_PROXY_WASM_STEP_DISPATCH_RESPONSE:
-        break;
-    default:
-        return ngx_proxy_wasm_result_trap(pwexec,
-                                          "can only send HTTP dispatch "
-                                          "during "
-                                          "\"on_request_headers\", "
-                                          "\"on_request_body\", "
-                                          "\"on_dispatch_response\", "
-                                          "\"on_tick\"",
-                                          rets, NGX_WAVM_BAD_USAGE);
+    if (ngx_proxy_wasm_pairs_unmarshal(pwexec, &pairs, &map) != NGX_OK) {
+        return ngx_proxy_wasm_result_err(rets);
     }
 
-    host.len = args[1].of.i32;
-    host.data = NGX_WAVM_HOST_LIFT_SLICE(instance, args[0].of.i32, host.len);
-
-    headers.len = args[3].of.i32;
-    headers.data = NGX_WAVM_HOST_LIFT_SLICE(instance, args[2].of.i32,
-                                            headers.len);
-
-    body.len = args[5].of.i32;
-    body.data = NGX_WAVM_HOST_LIFT_SLICE(instance, args[4].of.i32, body.len);
-
-    trailers.len = args[7].of.i32;
-    trailers.data = NGX_WAVM_HOST_LIFT_SLICE(instance, args[6].of.i32,
-                                             trailers.len);
-
-    timeout = args[8].of.i32;
-    callout_id = NGX_WAVM_HOST_LIFT(instance, args[9].of.i32, uint32_t);
-
-    call = ngx_http_proxy_wasm_dispatch(pwexec, rctx, &host,
-                                        &headers, &trailers,
-                                        &body, timeout);
-    if (call == NULL) {
+    keys = ngx_palloc(pwexec->pool, sizeof(ngx_str_t) * 2 * (pairs.nelts + 1));
+    if (keys == NULL) {
         return ngx_proxy_wasm_result_err(rets);
     }
 
-    *callout_id = call->id;
+    values = keys + pairs.nelts + 1;
+    elts = pairs.elts;
 
-    return ngx_proxy_wasm_result_ok(rets);
+    for (i = 0; i < pairs.nelts; i++) {
+        keys[i] = elts[i].key;
+        values[i] = elts[i].value;
+    }
+
+    return ngx_proxy_wasm_shm_kv_set_many(instance, keys, values, pairs.nelts,
+                                          nwritten, rets);
 }
 
 
-#else
 static ngx_int_t
-ngx_proxy_wasm_hfuncs_no_http(ngx_wavm_instance_t *instance,
+ngx_proxy_wasm_hfuncs_delete_shared_data_many(ngx_wavm_instance_t *instance,
     wasm_val_t args[], wasm_val_t rets[])
 {
-    ngx_proxy_wasm_exec_t  *pwexec;
+    ngx_int_t                         rc;
+    ngx_array_t                       keys;
+    ngx_proxy_wasm_exec_t            *pwexec;
+    ngx_proxy_wasm_marshalled_map_t   map;
 
     pwexec = ngx_proxy_wasm_instance2pwexec(instance);
 
-    return ngx_proxy_wasm_result_trap(pwexec,
-                                      "NYI - not supported without "
-                                      "ngx_http_core_module",
-                                      rets, NGX_WAVM_ERROR);
-}
-#endif
-
-
-/* grpc callouts */
-/* NYI */
+    map.len = args[1].of.i32;
+    map.data = NGX_WAVM_HOST_LIFT_SLICE(instance, args[0].of.i32, map.len);
 
+    rc = ngx_proxy_wasm_keys_unmarshal(pwexec, &keys, &map);
+    if (rc != NGX_OK) {
+        return rc == NGX_DECLINED
+               ? ngx_proxy_wasm_result_badarg(rets)
+               : ngx_proxy_wasm_result_err(rets);
+    }
 
-/* shared k/v store */
+    return ngx_proxy_wasm_shm_kv_set_many(instance, keys.elts, NULL,
+                                          keys.nelts, NULL, rets);
+}
 
 
 static ngx_int_t
-ngx_proxy_wasm_hfuncs_get_shared_data(ngx_wavm_instance_t *instance,
+ngx_proxy_wasm_hfuncs_delete_shared_data_prefix(ngx_wavm_instance_t *instance,
     wasm_val_t args[], wasm_val_t rets[])
 {
+    uint32_t               *ndeleted;
     ngx_int_t               rc;
-    ngx_str_t               key;
-    ngx_str_t              *value;
-    uint32_t               *value_data, *value_size, *cas;
-    uint32_t                wbuf_ptr;
+    ngx_str_t               prefix;
+    ngx_uint_t              n;
+    ngx_wa_shm_t           *shm;
     ngx_wa_shm_kv_key_t     resolved;
     ngx_proxy_wasm_exec_t  *pwexec = ngx_proxy_wasm_instance2pwexec(instance);
 
-    key.len = args[1].of.i32;
-    key.data = NGX_WAVM_HOST_LIFT_SLICE(instance, args[0].of.i32, key.len);
-    value_data = NGX_WAVM_HOST_LIFT(instance, args[2].of.i32, uint32_t);
-    value_size = NGX_WAVM_HOST_LIFT(instance, args[3].of.i32, uint32_t);
-    cas = NGX_WAVM_HOST_LIFT(instance, args[4].of.i32, uint32_t);
-
-    dd("getting \"%.*s\"", (int) key.len, key.data);
-
-    /* resolve key namespace */
+    prefix.len = args[1].of.i32;
+    prefix.data = NGX_WAVM_HOST_LIFT_SLICE(instance, args[0].of.i32,
+                                           prefix.len);
+    ndeleted = NGX_WAVM_HOST_LIFT(instance, args[2].of.i32, uint32_t);
 
-    rc = ngx_wa_shm_kv_resolve_key(&key, &resolved);
+    rc = ngx_wa_shm_kv_resolve_key(&prefix, &resolved);
     if (rc == NGX_ABORT) {
-        return ngx_proxy_wasm_result_trap(pwexec, "attempt to get "
-                                          "key/value from a queue", rets,
+        return ngx_proxy_wasm_result_trap(pwexec, "attempt to set "
+                                          "key/value in a queue", rets,
                                           NGX_WAVM_BAD_USAGE);
     }
 
     if (rc == NGX_DECLINED) {
-        /* TODO: format with key */
-        return ngx_proxy_wasm_result_trap(pwexec, "failed getting value "
-                                          "from shm (could not resolve "
+        return ngx_proxy_wasm_result_trap(pwexec, "failed setting value "
+                                          "to shm (could not resolve "
                                           "namespace)", rets,
                                           NGX_WAVM_BAD_USAGE);
     }
 
     ngx_wa_assert(rc == NGX_OK);
 
-    /* get */
-
-    ngx_wa_shm_lock(resolved.shm);
-
-    rc = ngx_wa_shm_kv_get_locked(resolved.shm, &key, NULL, &value, cas);
+    /* all shards of the zone */
+    shm = resolved.zone->data;
 
-    ngx_wa_shm_unlock(resolved.shm);
-
-    if (rc == NGX_DECLINED) {
-        return ngx_proxy_wasm_result_notfound(rets);
-    }
-
-    ngx_wa_assert(rc == NGX_OK);
-
-    /* return value */
+    ngx_wa_shm_lock(shm);
 
-    wbuf_ptr = ngx_proxy_wasm_alloc(pwexec, value->len);
-    if (wbuf_ptr == 0) {
-        /* TODO: format with key */
-        return ngx_proxy_wasm_result_trap(pwexec, "failed getting value "
-                                          "from shm (no memory)", rets,
-                                          NGX_WAVM_ERROR);
-    }
+    (void) ngx_wa_shm_kv_delete_prefix_locked(shm, &prefix, &n);
 
-    ngx_memcpy(NGX_WAVM_HOST_LIFT_SLICE(instance, wbuf_ptr, value->len),
-               value->data, value->len);
+    ngx_wa_shm_unlock(shm);
 
-    *value_data = wbuf_ptr;
-    *value_size = value->len;
+    *ndeleted = n;
 
     return ngx_proxy_wasm_result_ok(rets);
 }
 
 
 static ngx_int_t
-ngx_proxy_wasm_hfuncs_set_shared_data(ngx_wavm_instance_t *instance,
-    wasm_val_t args[], wasm_val_t rets[])
+ngx_proxy_wasm_shm_kv_int_op(ngx_wavm_instance_t *instance, wasm_val_t args[],
+    wasm_val_t rets[], ngx_wa_shm_kv_int_op_t *op, int64_t *ret)
 {
-    uint32_t                cas;
+    int64_t                 value;
     unsigned                written;
     ngx_int_t               rc;
-    ngx_str_t               key, value;
+    ngx_str_t               key;
     ngx_wa_shm_kv_key_t     resolved;
     ngx_proxy_wasm_exec_t  *pwexec = ngx_proxy_wasm_instance2pwexec(instance);
 
     key.len = args[1].of.i32;
     key.data = NGX_WAVM_HOST_LIFT_SLICE(instance, args[0].of.i32, key.len);
-    value.len = args[3].of.i32;
-    value.data = NGX_WAVM_HOST_LIFT_SLICE(instance, args[2].of.i32, value.len);
-    cas = args[4].of.i32;
-
-    dd("setting \"%.*s\" -> \"%.*s\"",
-       (int) key.len, key.data,
-       (int) value.len, value.data);
-
-    /* resolve key namespace */
 
     rc = ngx_wa_shm_kv_resolve_key(&key, &resolved);
     if (rc == NGX_ABORT) {
-        /* TODO: format with key */
         return ngx_proxy_wasm_result_trap(pwexec, "attempt to set "
                                           "key/value in a queue", rets,
                                           NGX_WAVM_BAD_USAGE);
     }
 
     if (rc == NGX_DECLINED) {
-        /* TODO: format with key */
         return ngx_proxy_wasm_result_trap(pwexec, "failed setting value "
                                           "to shm (could not resolve "
                                           "namespace)", rets,
@@ -1353,33 +2164,36 @@ ngx_proxy_wasm_hfuncs_set_shared_data(ngx_wavm_instance_t *instance,
 
     ngx_wa_assert(rc == NGX_OK);
 
-    /* set */
-
     ngx_wa_shm_lock(resolved.shm);
 
-    /*
-     * If the filter passes a NULL value pointer, treat it as a delete request.
-     * It is still possible to distinguish between:
-     * - Setting an empty value (ptr != NULL, len == 0)
-     * - Deleting a k/v pair (ptr == NULL, len == 0)
-     */
-    rc = ngx_wa_shm_kv_set_locked(resolved.shm,
-                                  &key, value.data ? &value : NULL,
-                                  cas, &written);
+    rc = ngx_wa_shm_kv_int_op_locked(resolved.shm, &key, op, &value,
+                                     &written);
 
     ngx_wa_shm_unlock(resolved.shm);
 
     if (rc == NGX_ERROR) {
-        /* TODO: format with key */
         return ngx_proxy_wasm_result_trap(pwexec, "failed setting value "
                                           "to shm (could not write to slab)",
                                           rets,
                                           NGX_WAVM_ERROR);
     }
 
+    if (rc == NGX_DECLINED) {
+        /* value is not an 8-byte integer */
+        return ngx_proxy_wasm_result_badarg(rets);
+    }
+
+    if (rc == NGX_BUSY) {
+        /* new key not admitted (admission=tinylfu): nothing written */
+        return ngx_proxy_wasm_result_err(rets);
+    }
+
     ngx_wa_assert(rc == NGX_OK);
 
+    *ret = value;
+
     if (!written) {
+        /* out of bounds or not the expected value: *ret is the current one */
         return ngx_proxy_wasm_result_cas_mismatch(rets);
     }
 
@@ -1387,6 +2201,146 @@ ngx_proxy_wasm_hfuncs_set_shared_data(ngx_wavm_instance_t *instance,
 }
 
 
+static ngx_int_t
+ngx_proxy_wasm_hfuncs_increment_shared_data(ngx_wavm_instance_t *instance,
+    wasm_val_t args[], wasm_val_t rets[])
+{
+    int64_t                 *ret;
+    ngx_wa_shm_kv_int_op_t   op;
+
+    /* key, key_size, delta, init, min, max, ttl (ms), return_value */
+
+    ngx_memzero(&op, sizeof(ngx_wa_shm_kv_int_op_t));
+
+    op.operand = args[2].of.i64;
+    op.init = args[3].of.i64;
+    op.min = args[4].of.i64;
+    op.max = args[5].of.i64;
+    op.ttl = (ngx_msec_t) args[6].of.i32;
+    ret = NGX_WAVM_HOST_LIFT(instance, args[7].of.i32, int64_t);
+
+    return ngx_proxy_wasm_shm_kv_int_op(instance, args, rets, &op, ret);
+}
+
+
+static ngx_int_t
+ngx_proxy_wasm_hfuncs_compare_exchange_shared_data(
+    ngx_wavm_instance_t *instance, wasm_val_t args[], wasm_val_t rets[])
+{
+    int64_t                 *ret;
+    ngx_wa_shm_kv_int_op_t   op;
+
+    /* key, key_size, expected, desired, ttl (ms), return_value */
+
+    ngx_memzero(&op, sizeof(ngx_wa_shm_kv_int_op_t));
+
+    op.cmpxchg = 1;
+    op.expected = args[2].of.i64;
+    op.operand = args[3].of.i64;
+    op.min = INT64_MIN;
+    op.max = INT64_MAX;
+    op.ttl = (ngx_msec_t) args[4].of.i32;
+    ret = NGX_WAVM_HOST_LIFT(instance, args[5].of.i32, int64_t);
+
+    return ngx_proxy_wasm_shm_kv_int_op(instance, args, rets, &op, ret);
+}
+
+
+static ngx_int_t
+ngx_proxy_wasm_hfuncs_get_shared_data_keys(ngx_wavm_instance_t *instance,
+    wasm_val_t args[], wasm_val_t rets[])
+{
+    uint32_t               *rlen;
+    ngx_int_t               rc;
+    ngx_str_t              *key, **keys, empty = ngx_null_string;
+    ngx_uint_t              i, max, nkeys;
+    ngx_list_t             *list;
+    ngx_wavm_ptr_t         *rbuf;
+    ngx_wa_shm_t           *shm;
+    ngx_wa_shm_kv_key_t     resolved;
+    ngx_wa_shm_kv_range_t   range;
+    ngx_proxy_wasm_exec_t  *pwexec = ngx_proxy_wasm_instance2pwexec(instance);
+
+    ngx_memzero(&range, sizeof(ngx_wa_shm_kv_range_t));
+
+    range.prefix.len = args[1].of.i32;
+    range.prefix.data = NGX_WAVM_HOST_LIFT_SLICE(instance, args[0].of.i32,
+                                                 range.prefix.len);
+    range.start.len = args[3].of.i32;
+    range.start.data = NGX_WAVM_HOST_LIFT_SLICE(instance, args[2].of.i32,
+                                                range.start.len);
+    range.exclusive = range.start.len > 0;  /* cursor: last returned key */
+    max = ngx_min((uint32_t) args[4].of.i32, NGX_PROXY_WASM_SHM_KEYS_MAX);
+    rbuf = NGX_WAVM_HOST_LIFT(instance, args[5].of.i32, ngx_wavm_ptr_t);
+    rlen = NGX_WAVM_HOST_LIFT(instance, args[6].of.i32, uint32_t);
+
+    if (max == 0) {
+        return ngx_proxy_wasm_result_badarg(rets);
+    }
+
+    /* resolve namespace from the prefix, or from the cursor */
+
+    key = range.prefix.len ? &range.prefix : &range.start;
+
+    rc = ngx_wa_shm_kv_resolve_key(key, &resolved);
+    if (rc == NGX_ABORT) {
+        return ngx_proxy_wasm_result_trap(pwexec, "attempt to get "
+                                          "keys from a queue", rets,
+                                          NGX_WAVM_BAD_USAGE);
+    }
+
+    if (rc == NGX_DECLINED) {
+        return ngx_proxy_wasm_result_trap(pwexec, "failed getting keys "
+                                          "from shm (could not resolve "
+                                          "namespace)", rets,
+                                          NGX_WAVM_BAD_USAGE);
+    }
+
+    ngx_wa_assert(rc == NGX_OK);
+
+    /* all shards of the zone */
+    shm = resolved.zone->data;
+
+    if (!shm->ordered) {
+        return ngx_proxy_wasm_result_trap(pwexec, "failed getting keys "
+                                          "from shm (zone is not ordered)",
+                                          rets, NGX_WAVM_BAD_USAGE);
+    }
+
+    keys = ngx_palloc(pwexec->pool, sizeof(ngx_str_t *) * max);
+    if (keys == NULL) {
+        return ngx_proxy_wasm_result_err(rets);
+    }
+
+    ngx_wa_shm_lock(shm);
+
+    (void) ngx_wa_shm_kv_scan_locked(shm, &range, keys, max, &nkeys);
+
+    /* keys are copied before unlocking */
+
+    list = ngx_list_create(pwexec->pool, nkeys ? nkeys : 1,
+                           sizeof(ngx_table_elt_t));
+    if (list == NULL) {
+        ngx_wa_shm_unlock(shm);
+        return ngx_proxy_wasm_result_err(rets);
+    }
+
+    for (i = 0; i < nkeys; i++) {
+        if (ngx_proxy_wasm_hfuncs_push_pair(pwexec, list, keys[i], &empty)
+            != NGX_OK)
+        {
+            ngx_wa_shm_unlock(shm);
+            return ngx_proxy_wasm_result_err(rets);
+        }
+    }
+
+    ngx_wa_shm_unlock(shm);
+
+    return ngx_proxy_wasm_hfuncs_return_pairs(instance, list, rbuf, rlen,
+                                              rets);
+}
+
+
 /* shared queue */
 
 
@@ -1932,11 +2886,15 @@ static ngx_wavm_host_func_def_t  ngx_proxy_wasm_hfuncs[] = {
       &ngx_proxy_wasm_hfuncs_set_buffer,
       ngx_wavm_arity_i32x5,
       ngx_wavm_arity_i32 },
+    { ngx_string("proxy_splice_buffer_bytes"),           /* ngx_wasm_module */
+      &ngx_proxy_wasm_hfuncs_splice_buffer,
+      ngx_wavm_arity_i32x5,
+      ngx_wavm_arity_i32 },
 
     /* maps */
 
     { ngx_string("proxy_get_map_values"),                /* vNEXT */
-      &ngx_proxy_wasm_hfuncs_nop,                        /* NYI */
+      &ngx_proxy_wasm_hfuncs_get_map_values,
       ngx_wavm_arity_i32x5,
       ngx_wavm_arity_i32 },
     { ngx_string("proxy_get_header_map_pairs"),          /* <= 0.2.1 */
@@ -1978,6 +2936,10 @@ static ngx_wavm_host_func_def_t  ngx_proxy_wasm_hfuncs[] = {
       &ngx_proxy_wasm_hfuncs_get_property,
       ngx_wavm_arity_i32x4,
       ngx_wavm_arity_i32 },
+    { ngx_string("proxy_get_properties"),                /* ngx_wasm_module */
+      &ngx_proxy_wasm_hfuncs_get_properties,
+      ngx_wavm_arity_i32x4,
+      ngx_wavm_arity_i32 },
     { ngx_string("proxy_set_property"),                  /* <= 0.2.1 */
       &ngx_proxy_wasm_hfuncs_set_property,
       ngx_wavm_arity_i32x4,
@@ -2122,6 +3084,14 @@ static ngx_wavm_host_func_def_t  ngx_proxy_wasm_hfuncs[] = {
       &ngx_proxy_wasm_hfuncs_get_shared_data,
       ngx_wavm_arity_i32x5,
       ngx_wavm_arity_i32 },
+    { ngx_string("proxy_get_shared_data_many"),          /* ngx_wasm_module */
+      &ngx_proxy_wasm_hfuncs_get_shared_data_many,
+      ngx_wavm_arity_i32x4,
+      ngx_wavm_arity_i32 },
+    { ngx_string("proxy_get_shared_data_keys"),          /* ngx_wasm_module */
+      &ngx_proxy_wasm_hfuncs_get_shared_data_keys,
+      ngx_wavm_arity_i32x7,
+      ngx_wavm_arity_i32 },
     { ngx_string("proxy_set_shared_kvstore_key_values"), /* vNEXT */
       &ngx_proxy_wasm_hfuncs_nop,                        /* NYI */
       ngx_wavm_arity_i32x6,
@@ -2130,6 +3100,30 @@ static ngx_wavm_host_func_def_t  ngx_proxy_wasm_hfuncs[] = {
       &ngx_proxy_wasm_hfuncs_set_shared_data,
       ngx_wavm_arity_i32x5,
       ngx_wavm_arity_i32 },
+    { ngx_string("proxy_set_shared_data_ttl"),           /* ngx_wasm_module */
+      &ngx_proxy_wasm_hfuncs_set_shared_data_ttl,
+      ngx_wavm_arity_i32x6,
+      ngx_wavm_arity_i32 },
+    { ngx_string("proxy_set_shared_data_many"),          /* ngx_wasm_module */
+      &ngx_proxy_wasm_hfuncs_set_shared_data_many,
+      ngx_wavm_arity_i32x3,
+      ngx_wavm_arity_i32 },
+    { ngx_string("proxy_delete_shared_data_many"),       /* ngx_wasm_module */
+      &ngx_proxy_wasm_hfuncs_delete_shared_data_many,
+      ngx_wavm_arity_i32x2,
+      ngx_wavm_arity_i32 },
+    { ngx_string("proxy_delete_shared_data_prefix"),     /* ngx_wasm_module */
+      &ngx_proxy_wasm_hfuncs_delete_shared_data_prefix,
+      ngx_wavm_arity_i32x3,
+      ngx_wavm_arity_i32 },
+    { ngx_string("proxy_increment_shared_data"),         /* ngx_wasm_module */
+      &ngx_proxy_wasm_hfuncs_increment_shared_data,
+      ngx_wavm_arity_i32x2_i64x4_i32x2,
+      ngx_wavm_arity_i32 },
+    { ngx_string("proxy_compare_exchange_shared_data"),  /* ngx_wasm_module */
+      &ngx_proxy_wasm_hfuncs_compare_exchange_shared_data,
+      ngx_wavm_arity_i32x2_i64x2_i32x2,
+      ngx_wavm_arity_i32 },
     { ngx_string("proxy_add_shared_kvstore_key_values"), /* vNEXT */
       &ngx_proxy_wasm_hfuncs_nop,                        /* NYI */
       ngx_wavm_arity_i32x6,
@@ -12,6 +12,14 @@
 
 static ngx_list_t *ngx_proxy_wasm_maps_get_map(ngx_wavm_instance_t *instance,
     ngx_proxy_wasm_map_type_e map_type);
+static ngx_str_t *ngx_proxy_wasm_maps_index_lookup(
+    ngx_proxy_wasm_maps_index_t *index, ngx_list_t *list, ngx_pool_t *pool,
+    ngx_str_t *key);
+static ngx_int_t ngx_proxy_wasm_maps_index_sync(
+    ngx_proxy_wasm_maps_index_t *index, ngx_list_t *list, ngx_pool_t *pool);
+static ngx_int_t ngx_proxy_wasm_maps_index_init(
+    ngx_proxy_wasm_maps_index_t *index, ngx_list_t *list, ngx_pool_t *pool,
+    ngx_uint_t size);
 static ngx_str_t *ngx_proxy_wasm_maps_get_special_key(
     ngx_wavm_instance_t *instance, ngx_uint_t map_type, ngx_str_t *key);
 static ngx_int_t ngx_proxy_wasm_maps_set_special_key(
@@ -263,6 +271,8 @@ ngx_proxy_wasm_maps_get(ngx_wavm_instance_t *instance,
 {
     ngx_str_t                *value;
     ngx_list_t               *list;
+    ngx_proxy_wasm_exec_t    *pwexec;
+    ngx_proxy_wasm_ctx_t     *pwctx;
 #ifdef NGX_WASM_HTTP
     ngx_http_wasm_req_ctx_t  *rctx;
 
@@ -283,7 +293,21 @@ ngx_proxy_wasm_maps_get(ngx_wavm_instance_t *instance,
 
     /* key lookup */
 
-    value = ngx_wasm_get_list_elem(list, key->data, key->len);
+    switch (map_type) {
+    case NGX_PROXY_WASM_MAP_HTTP_REQUEST_HEADERS:
+    case NGX_PROXY_WASM_MAP_HTTP_RESPONSE_HEADERS:
+        pwexec = ngx_proxy_wasm_instance2pwexec(instance);
+        pwctx = pwexec->parent;
+
+        value = ngx_proxy_wasm_maps_index_lookup(&pwctx->maps_index[map_type],
+                                                 list, pwctx->pool, key);
+        break;
+    default:
+        /* dispatch response maps are specific to each call */
+        value = ngx_wasm_get_list_elem(list, key->data, key->len);
+        break;
+    }
+
     if (value) {
         goto found;
     }
@@ -326,6 +350,8 @@ ngx_proxy_wasm_maps_set(ngx_wavm_instance_t *instance,
     rctx = ngx_http_proxy_wasm_get_rctx(instance);
     r = rctx->r;
 
+    ngx_proxy_wasm_maps_invalidate(pwctx);
+
     switch (map_op) {
 
     case NGX_PROXY_WASM_MAP_SET:
@@ -423,6 +449,181 @@ done:
 }
 
 
+ngx_proxy_wasm_maps_cache_t *
+ngx_proxy_wasm_maps_cache(ngx_proxy_wasm_ctx_t *pwctx,
+    ngx_proxy_wasm_map_type_e map_type)
+{
+    switch (map_type) {
+    case NGX_PROXY_WASM_MAP_HTTP_REQUEST_HEADERS:
+    case NGX_PROXY_WASM_MAP_HTTP_RESPONSE_HEADERS:
+        return &pwctx->maps_cache[map_type];
+    default:
+        /* dispatch response maps are specific to each call */
+        return NULL;
+    }
+}
+
+
+static ngx_str_t *
+ngx_proxy_wasm_maps_index_lookup(ngx_proxy_wasm_maps_index_t *index,
+    ngx_list_t *list, ngx_pool_t *pool, ngx_str_t *key)
+{
+    ngx_uint_t                   i, hash;
+    ngx_table_elt_t             *elt;
+    ngx_proxy_wasm_maps_slot_t  *slot;
+
+    if (ngx_proxy_wasm_maps_index_sync(index, list, pool) != NGX_OK) {
+        return ngx_wasm_get_list_elem(list, key->data, key->len);
+    }
+
+    hash = ngx_hash_key_lc(key->data, key->len);
+
+    for (i = hash & (index->size - 1);
+         /* void */ ;
+         i = (i + 1) & (index->size - 1))
+    {
+        slot = &index->slots[i];
+        elt = slot->elt;
+
+        if (elt == NULL) {
+            return NULL;
+        }
+
+        /* removed headers are kept in the list with a 0 hash */
+
+        if (slot->hash == hash
+            && elt->hash
+            && elt->key.len == key->len
+            && ngx_strncasecmp(elt->key.data, key->data, key->len) == 0)
+        {
+            return &elt->value;
+        }
+    }
+}
+
+
+static ngx_int_t
+ngx_proxy_wasm_maps_index_sync(ngx_proxy_wasm_maps_index_t *index,
+    ngx_list_t *list, ngx_pool_t *pool)
+{
+    ngx_uint_t                   i, j, hash;
+    ngx_table_elt_t             *elt;
+    ngx_list_part_t             *part;
+    ngx_proxy_wasm_maps_slot_t  *slot;
+
+    if (index->slots == NULL
+        || index->list != list
+        || index->elts != list->part.elts
+        || list->part.nelts < index->nfirst
+        || index->part->nelts < index->npart
+        || (list->last != index->last && index->last->next == NULL)
+        || (index->npart
+            && ((ngx_table_elt_t *) index->part->elts)[index->npart - 1]
+               .key.data != index->key))
+    {
+        /**
+         * New or reinitialized list: resets (e.g. ngx_http_clean_header)
+         * keep the first part storage but shrink it, move the list tail
+         * back or, once refilled, replace the last indexed element.
+         */
+        return ngx_proxy_wasm_maps_index_init(index, list, pool,
+                                              index->size ? index->size : 32);
+    }
+
+    /**
+     * Headers are never moved nor unlinked from their list: updates
+     * happen in place and removals zero the element hash, both of
+     * which lookups account for; additions are pushed at the tail of
+     * the list and indexed here.
+     */
+
+    part = index->part;
+    elt = part->elts;
+
+    for (i = index->npart; /* void */; i++) {
+
+        if (i >= part->nelts) {
+            if (part->next == NULL) {
+                break;
+            }
+
+            part = part->next;
+            elt = part->elts;
+            i = 0;
+        }
+
+        if ((index->nelts + 1) * 2 > index->size) {
+            return ngx_proxy_wasm_maps_index_init(index, list, pool,
+                                                  index->size * 2);
+        }
+
+        hash = ngx_hash_key_lc(elt[i].key.data, elt[i].key.len);
+
+        for (j = hash & (index->size - 1);
+             index->slots[j].elt;
+             j = (j + 1) & (index->size - 1))
+        {
+            /* void */
+        }
+
+        slot = &index->slots[j];
+        slot->hash = hash;
+        slot->elt = &elt[i];
+
+        index->nelts++;
+    }
+
+    index->part = part;
+    index->npart = part->nelts;
+    index->nfirst = list->part.nelts;
+    index->last = list->last;
+    index->key = part->nelts
+                 ? ((ngx_table_elt_t *) part->elts)[part->nelts - 1].key.data
+                 : NULL;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_proxy_wasm_maps_index_init(ngx_proxy_wasm_maps_index_t *index,
+    ngx_list_t *list, ngx_pool_t *pool, ngx_uint_t size)
+{
+    ngx_uint_t        n;
+    ngx_list_part_t  *part;
+
+    for (n = 0, part = &list->part; part; part = part->next) {
+        n += part->nelts;
+    }
+
+    while (n * 2 > size) {
+        size *= 2;
+    }
+
+    if (index->slots) {
+        ngx_pfree(pool, index->slots);
+    }
+
+    index->slots = ngx_pcalloc(pool, size * sizeof(ngx_proxy_wasm_maps_slot_t));
+    if (index->slots == NULL) {
+        index->size = 0;
+        return NGX_ERROR;
+    }
+
+    index->list = list;
+    index->elts = list->part.elts;
+    index->part = &list->part;
+    index->npart = 0;
+    index->nfirst = 0;
+    index->last = list->last;
+    index->key = NULL;
+    index->nelts = 0;
+    index->size = size;
+
+    return ngx_proxy_wasm_maps_index_sync(index, list, pool);
+}
+
+
 static ngx_str_t *
 ngx_proxy_wasm_maps_get_special_key(ngx_wavm_instance_t *instance,
     ngx_uint_t map_type, ngx_str_t *key)
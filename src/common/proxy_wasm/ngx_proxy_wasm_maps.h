@@ -4,6 +4,9 @@
 #include <ngx_proxy_wasm.h>
 
 
+#define ngx_proxy_wasm_maps_invalidate(pwctx)  (pwctx)->maps_generation++
+
+
 typedef enum {
     NGX_PROXY_WASM_MAP_SET = 0,
     NGX_PROXY_WASM_MAP_ADD,
@@ -38,6 +41,21 @@ ngx_str_t *ngx_proxy_wasm_maps_get(ngx_wavm_instance_t *instance,
 ngx_int_t ngx_proxy_wasm_maps_set(ngx_wavm_instance_t *instance,
     ngx_proxy_wasm_map_type_e map_type, ngx_str_t *key, ngx_str_t *value,
     ngx_uint_t map_op);
+ngx_proxy_wasm_maps_cache_t *ngx_proxy_wasm_maps_cache(
+    ngx_proxy_wasm_ctx_t *pwctx, ngx_proxy_wasm_map_type_e map_type);
+
+
+static ngx_inline unsigned
+ngx_proxy_wasm_maps_cache_valid(ngx_proxy_wasm_exec_t *pwexec,
+    ngx_proxy_wasm_maps_cache_t *cache)
+{
+    ngx_proxy_wasm_ctx_t  *pwctx = pwexec->parent;
+
+    return cache->data.data
+           && cache->generation == pwctx->maps_generation
+           && cache->step == pwctx->step
+           && cache->max_pairs == pwexec->filter->max_pairs;
+}
 
 
 #endif /* _NGX_PROXY_WASM_MAPS_H_INCLUDED_ */
@@ -19,9 +19,14 @@
 #define NGX_WASM_HOST_PROPERTY_NAMESPACE_STR \
           NGX_WASM_XSTR(NGX_WASM_HOST_PROPERTY_NAMESPACE)
 
+#define NGX_PROXY_WASM_PROPS_MAX_RESOLVED  1024
+#define NGX_PROXY_WASM_PROPS_NO_MEMO       (ngx_uint_t) -1
+
 
 static ngx_int_t ngx_proxy_wasm_properties_get_ngx(
     ngx_proxy_wasm_ctx_t *pwctx, ngx_str_t *path, ngx_str_t *value);
+static ngx_int_t ngx_proxy_wasm_properties_get_host(
+    ngx_proxy_wasm_ctx_t *pwctx, ngx_str_t *path, ngx_str_t *value);
 static ngx_int_t ngx_proxy_wasm_properties_set_ngx(
     ngx_proxy_wasm_ctx_t *pwctx, ngx_str_t *path, ngx_str_t *value);
 
@@ -50,6 +55,29 @@ static const char  *host_prefix = NGX_WASM_HOST_PROPERTY_NAMESPACE_STR ".";
 static size_t       host_prefix_len;
 
 
+/**
+ * Property paths resolved in this worker; a path always resolves to
+ * the same getter or nginx variable.
+ */
+typedef struct {
+    ngx_str_node_t                     sn;           /* dotted path */
+    pwm2ngx_mapping_t                 *mapping;
+    ngx_str_t                          ngx_key;      /* ngx.* variable */
+#ifdef NGX_WASM_HTTP
+    ngx_http_variable_t               *var;          /* NULL if prefixed */
+#endif
+    ngx_uint_t                         hash;         /* variable name hash */
+    ngx_uint_t                         index;        /* props_memo slot */
+    unsigned                           host:1;
+    unsigned                           var_resolved:1;
+} resolved_prop_t;
+
+
+static ngx_rbtree_t       resolved_props_tree;
+static ngx_rbtree_node_t  resolved_props_sentinel;
+static ngx_uint_t         resolved_props_n;
+
+
 typedef struct {
     ngx_str_node_t   sn;
     ngx_str_t        value;
@@ -82,6 +110,8 @@ not_supported(ngx_proxy_wasm_ctx_t *pwctx, ngx_str_t *path, ngx_str_t *value)
 #ifdef NGX_WASM_HTTP
 static const size_t  request_headers_prefix_len = 16;   /* request.headers. */
 static const size_t  response_headers_prefix_len = 17;  /* response.headers. */
+static const size_t  request_query_prefix_len = 14;     /* request.query. */
+static const size_t  request_cookies_prefix_len = 16;   /* request.cookies. */
 
 
 static ngx_uint_t
@@ -271,6 +301,238 @@ get_response_header(ngx_proxy_wasm_ctx_t *pwctx, ngx_str_t *path,
 }
 
 
+static ngx_int_t
+find_keyval(ngx_array_t *index, ngx_str_t *name, ngx_str_t *value)
+{
+    size_t         i;
+    ngx_keyval_t  *kv = index->elts;
+
+    for (i = 0; i < index->nelts; i++) {
+        if (kv[i].key.len == name->len
+            && ngx_strncasecmp(kv[i].key.data, name->data, name->len) == 0)
+        {
+            value->data = kv[i].value.data;
+            value->len = kv[i].value.len;
+
+            return NGX_OK;
+        }
+    }
+
+    return NGX_DECLINED;
+}
+
+
+static ngx_int_t
+parse_query_args(ngx_proxy_wasm_ctx_t *pwctx, ngx_str_t *args)
+{
+    u_char        *p, *last, *end, *eq;
+    ngx_keyval_t  *kv;
+
+    if (pwctx->query_args.elts == NULL) {
+        if (ngx_array_init(&pwctx->query_args, pwctx->pool, 4,
+                           sizeof(ngx_keyval_t))
+            != NGX_OK)
+        {
+            return NGX_ERROR;
+        }
+
+    } else {
+        pwctx->query_args.nelts = 0;
+    }
+
+    p = args->data;
+    last = p + args->len;
+
+    for ( /* void */ ; p < last; p = end + 1) {
+        end = ngx_strlchr(p, last, '&');
+        if (end == NULL) {
+            end = last;
+        }
+
+        if (end == p) {
+            continue;
+        }
+
+        kv = ngx_array_push(&pwctx->query_args);
+        if (kv == NULL) {
+            return NGX_ERROR;
+        }
+
+        kv->key.data = p;
+
+        eq = ngx_strlchr(p, end, '=');
+        if (eq) {
+            kv->key.len = eq - p;
+            kv->value.data = eq + 1;
+            kv->value.len = end - eq - 1;
+
+        } else {
+            kv->key.len = end - p;
+            kv->value.data = end;
+            kv->value.len = 0;
+        }
+    }
+
+    pwctx->query_args_src = *args;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+parse_cookies(ngx_proxy_wasm_ctx_t *pwctx, ngx_list_t *headers)
+{
+    size_t            i;
+    u_char           *p, *last, *end, *eq, *v;
+    ngx_keyval_t     *kv;
+    ngx_table_elt_t  *h;
+    ngx_list_part_t  *part;
+
+    if (pwctx->cookies.elts == NULL) {
+        if (ngx_array_init(&pwctx->cookies, pwctx->pool, 4,
+                           sizeof(ngx_keyval_t))
+            != NGX_OK)
+        {
+            return NGX_ERROR;
+        }
+
+    } else {
+        pwctx->cookies.nelts = 0;
+    }
+
+    part = &headers->part;
+    h = part->elts;
+
+    for (i = 0; /* void */; i++) {
+
+        if (i >= part->nelts) {
+            if (part->next == NULL) {
+                break;
+            }
+
+            part = part->next;
+            h = part->elts;
+            i = 0;
+        }
+
+        if (h[i].hash == 0
+            || h[i].key.len != sizeof("cookie") - 1
+            || ngx_strncasecmp(h[i].key.data, (u_char *) "cookie",
+                               sizeof("cookie") - 1) != 0)
+        {
+            continue;
+        }
+
+        p = h[i].value.data;
+        last = p + h[i].value.len;
+
+        for ( /* void */ ; p < last; p = end + 1) {
+            while (p < last && (*p == ' ' || *p == '\t')) {
+                p++;
+            }
+
+            end = ngx_strlchr(p, last, ';');
+            if (end == NULL) {
+                end = last;
+            }
+
+            eq = ngx_strlchr(p, end, '=');
+            if (eq == NULL || eq == p) {
+                continue;
+            }
+
+            for (v = end; v > eq + 1 && (v[-1] == ' ' || v[-1] == '\t'); v--) {
+                /* void */
+            }
+
+            kv = ngx_array_push(&pwctx->cookies);
+            if (kv == NULL) {
+                return NGX_ERROR;
+            }
+
+            kv->key.data = p;
+            kv->key.len = eq - p;
+            kv->value.data = eq + 1;
+            kv->value.len = v - eq - 1;
+        }
+    }
+
+    pwctx->cookies_parsed = 1;
+    pwctx->cookies_generation = pwctx->maps_generation;
+    pwctx->cookies_step = pwctx->step;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+get_request_query_arg(ngx_proxy_wasm_ctx_t *pwctx, ngx_str_t *path,
+    ngx_str_t *value)
+{
+    ngx_str_t                 name;
+    ngx_http_request_t       *r;
+    ngx_http_wasm_req_ctx_t  *rctx = pwctx->data;
+
+    if (rctx == NULL || rctx->fake_request) {
+        ngx_wavm_log_error(NGX_LOG_ERR, pwctx->log, NULL,
+                           "cannot get query arguments outside of a request");
+        return NGX_ERROR;
+    }
+
+    r = rctx->r;
+
+    name.data = (u_char *) (path->data + request_query_prefix_len);
+    name.len = path->len - request_query_prefix_len;
+
+    /* parsed once per r->args value */
+
+    if (pwctx->query_args_src.data != r->args.data
+        || pwctx->query_args_src.len != r->args.len
+        || pwctx->query_args.elts == NULL)
+    {
+        if (parse_query_args(pwctx, &r->args) != NGX_OK) {
+            return NGX_ERROR;
+        }
+    }
+
+    return find_keyval(&pwctx->query_args, &name, value);
+}
+
+
+static ngx_int_t
+get_request_cookie(ngx_proxy_wasm_ctx_t *pwctx, ngx_str_t *path,
+    ngx_str_t *value)
+{
+    ngx_str_t                 name;
+    ngx_http_wasm_req_ctx_t  *rctx = pwctx->data;
+
+    if (rctx == NULL || rctx->fake_request) {
+        ngx_wavm_log_error(NGX_LOG_ERR, pwctx->log, NULL,
+                           "cannot get cookies outside of a request");
+        return NGX_ERROR;
+    }
+
+    name.data = (u_char *) (path->data + request_cookies_prefix_len);
+    name.len = path->len - request_cookies_prefix_len;
+
+    /**
+     * Parsed once per maps generation: headers may also be updated by
+     * nginx between steps.
+     */
+
+    if (!pwctx->cookies_parsed
+        || pwctx->cookies_generation != pwctx->maps_generation
+        || pwctx->cookies_step != pwctx->step)
+    {
+        if (parse_cookies(pwctx, &rctx->r->headers_in.headers) != NGX_OK) {
+            return NGX_ERROR;
+        }
+    }
+
+    return find_keyval(&pwctx->cookies, &name, value);
+}
+
+
 static ngx_int_t
 get_connection_id(ngx_proxy_wasm_ctx_t *pwctx, ngx_str_t *path,
     ngx_str_t *value)
@@ -472,6 +734,12 @@ static pwm2ngx_mapping_t  pw2ngx[] = {
     { ngx_string("request.headers.*"),
       ngx_null_string,
       &get_request_header, NULL },
+    { ngx_string("request.query.*"),
+      ngx_null_string,
+      &get_request_query_arg, NULL },
+    { ngx_string("request.cookies.*"),
+      ngx_null_string,
+      &get_request_cookie, NULL },
 
     /* Response properties */
 
@@ -688,6 +956,11 @@ ngx_proxy_wasm_properties_init(ngx_conf_t *cf)
     ngx_int_t           rc = NGX_ERROR;
     pwm2ngx_mapping_t  *m;
 
+    ngx_rbtree_init(&resolved_props_tree, &resolved_props_sentinel,
+                    ngx_str_rbtree_insert_value);
+
+    resolved_props_n = 0;
+
     pwm2ngx_init.hash = &pwm2ngx_hash.hash;
     pwm2ngx_init.key = ngx_hash_key;
     pwm2ngx_init.max_size = 512;
@@ -766,20 +1039,158 @@ ngx_proxy_wasm_properties_unmarsh_path(ngx_str_t *from, u_char **to)
 }
 
 
+static resolved_prop_t *
+resolve_property(ngx_str_t *path, resolved_prop_t *tmp)
+{
+    uint32_t            hash;
+    ngx_uint_t          key;
+    resolved_prop_t    *rp = NULL;
+    pwm2ngx_mapping_t  *m;
+
+    hash = ngx_crc32_long(path->data, path->len);
+
+    rp = (resolved_prop_t *)
+             ngx_str_rbtree_lookup(&resolved_props_tree, path, hash);
+    if (rp) {
+        return rp;
+    }
+
+    if (resolved_props_n < NGX_PROXY_WASM_PROPS_MAX_RESOLVED) {
+        rp = ngx_pcalloc(ngx_cycle->pool, sizeof(resolved_prop_t) + path->len);
+    }
+
+    if (rp == NULL) {
+        /* resolve without caching */
+        ngx_memzero(tmp, sizeof(resolved_prop_t));
+
+        rp = tmp;
+        rp->sn.str = *path;
+        rp->index = NGX_PROXY_WASM_PROPS_NO_MEMO;
+
+    } else {
+        rp->sn.node.key = hash;
+        rp->sn.str.len = path->len;
+        rp->sn.str.data = (u_char *) rp + sizeof(resolved_prop_t);
+        ngx_memcpy(rp->sn.str.data, path->data, path->len);
+        rp->index = resolved_props_n++;
+    }
+
+    key = ngx_hash_key(path->data, path->len);
+
+    m = ngx_hash_find_combined(&pwm2ngx_hash, key, path->data, path->len);
+    if (m) {
+        rp->mapping = m;
+
+        if (!m->getter) {
+            /* attribute mapped to an nginx variable */
+            rp->ngx_key = m->ngx_key;
+        }
+
+    } else if (path->len > ngx_prefix_len
+               && ngx_memcmp(path->data, ngx_prefix, ngx_prefix_len) == 0)
+    {
+        /* nginx variable (ngx.*) */
+        rp->ngx_key = rp->sn.str;
+
+    } else if (path->len > host_prefix_len
+               && ngx_memcmp(path->data, host_prefix, host_prefix_len) == 0)
+    {
+        /* host variable */
+        rp->host = 1;
+    }
+
+    if (rp != tmp) {
+        ngx_rbtree_insert(&resolved_props_tree, &rp->sn.node);
+    }
+
+    return rp;
+}
+
+
+#ifdef NGX_WASM_HTTP
+static ngx_http_variable_value_t *
+get_memoized_variable(ngx_proxy_wasm_ctx_t *pwctx, ngx_http_request_t *r,
+    resolved_prop_t *rp)
+{
+    ngx_uint_t                   n;
+    ngx_http_variable_t         *v = rp->var;
+    ngx_http_variable_value_t   *vv, **memo = NULL, **p;
+
+    /**
+     * Non-indexed variables are not cached by nginx: memoize them for
+     * the duration of a step, until the next maps write.
+     */
+
+    if (rp->index != NGX_PROXY_WASM_PROPS_NO_MEMO
+        && !(v->flags & NGX_HTTP_VAR_NOCACHEABLE))
+    {
+        if (pwctx->props_memo.elts == NULL) {
+            if (ngx_array_init(&pwctx->props_memo, pwctx->pool, 8,
+                               sizeof(ngx_http_variable_value_t *))
+                != NGX_OK)
+            {
+                return NULL;
+            }
+
+            pwctx->props_memo_step = pwctx->step;
+            pwctx->props_memo_generation = pwctx->maps_generation;
+
+        } else if (pwctx->props_memo_step != pwctx->step
+                   || pwctx->props_memo_generation != pwctx->maps_generation)
+        {
+            pwctx->props_memo.nelts = 0;
+            pwctx->props_memo_step = pwctx->step;
+            pwctx->props_memo_generation = pwctx->maps_generation;
+        }
+
+        if (rp->index >= pwctx->props_memo.nelts) {
+            n = rp->index + 1 - pwctx->props_memo.nelts;
+
+            p = ngx_array_push_n(&pwctx->props_memo, n);
+            if (p == NULL) {
+                return NULL;
+            }
+
+            ngx_memzero(p, n * sizeof(ngx_http_variable_value_t *));
+        }
+
+        memo = &((ngx_http_variable_value_t **)
+                 pwctx->props_memo.elts)[rp->index];
+
+        if (*memo) {
+            return *memo;
+        }
+    }
+
+    vv = ngx_palloc(r->pool, sizeof(ngx_http_variable_value_t));
+    if (vv == NULL) {
+        return NULL;
+    }
+
+    if (v->get_handler(r, vv, v->data) != NGX_OK) {
+        vv->valid = 0;
+        vv->not_found = 1;
+    }
+
+    if (memo) {
+        *memo = vv;
+    }
+
+    return vv;
+}
+#endif
+
+
 static ngx_int_t
-ngx_proxy_wasm_properties_get_ngx(ngx_proxy_wasm_ctx_t *pwctx,
-    ngx_str_t *path, ngx_str_t *value)
+get_resolved_ngx(ngx_proxy_wasm_ctx_t *pwctx, resolved_prop_t *rp,
+    ngx_str_t *value)
 {
 #ifdef NGX_WASM_HTTP
-    ngx_uint_t                  hash;
     ngx_str_t                   name;
+    ngx_http_request_t         *r;
     ngx_http_variable_value_t  *vv;
     ngx_http_wasm_req_ctx_t    *rctx;
-
-    name.data = (u_char *) (path->data + ngx_prefix_len);
-    name.len = path->len - ngx_prefix_len;
-
-    hash = hash_str(name.data, name.len);
+    ngx_http_core_main_conf_t  *cmcf;
 
     rctx = (ngx_http_wasm_req_ctx_t *) pwctx->data;
     if (rctx == NULL || rctx->fake_request) {
@@ -788,7 +1199,32 @@ ngx_proxy_wasm_properties_get_ngx(ngx_proxy_wasm_ctx_t *pwctx,
         return NGX_ERROR;
     }
 
-    vv = ngx_http_get_variable(rctx->r, &name, hash);
+    r = rctx->r;
+
+    name.data = (u_char *) (rp->ngx_key.data + ngx_prefix_len);
+    name.len = rp->ngx_key.len - ngx_prefix_len;
+
+    if (!rp->var_resolved) {
+        cmcf = ngx_http_get_module_main_conf(r, ngx_http_core_module);
+
+        rp->hash = hash_str(name.data, name.len);
+        rp->var = ngx_hash_find(&cmcf->variables_hash, rp->hash,
+                                name.data, name.len);
+        rp->var_resolved = 1;
+    }
+
+    if (rp->var == NULL) {
+        /* prefixed variables (e.g. http_*, arg_*) or not found */
+        vv = ngx_http_get_variable(r, &name, rp->hash);
+
+    } else if (rp->var->flags & NGX_HTTP_VAR_INDEXED) {
+        /* cached in r->variables unless non-cacheable */
+        vv = ngx_http_get_flushed_variable(r, rp->var->index);
+
+    } else {
+        vv = get_memoized_variable(pwctx, r, rp);
+    }
+
     if (vv && !vv->not_found) {
         value->data = vv->data;
         value->len = vv->len;
@@ -801,6 +1237,20 @@ ngx_proxy_wasm_properties_get_ngx(ngx_proxy_wasm_ctx_t *pwctx,
 }
 
 
+static ngx_int_t
+ngx_proxy_wasm_properties_get_ngx(ngx_proxy_wasm_ctx_t *pwctx,
+    ngx_str_t *path, ngx_str_t *value)
+{
+    resolved_prop_t   tmp, *rp;
+
+    rp = resolve_property(path, &tmp);
+
+    ngx_wa_assert(rp->ngx_key.len);
+
+    return get_resolved_ngx(pwctx, rp, value);
+}
+
+
 static ngx_int_t
 ngx_proxy_wasm_properties_set_ngx(ngx_proxy_wasm_ctx_t *pwctx,
     ngx_str_t *path, ngx_str_t *value)
@@ -824,6 +1274,9 @@ ngx_proxy_wasm_properties_set_ngx(ngx_proxy_wasm_ctx_t *pwctx,
 
     r = rctx->r;
 
+    /* variables may depend on one another */
+    pwctx->props_memo.nelts = 0;
+
     cmcf = ngx_http_get_module_main_conf(r, ngx_http_core_module);
     if (cmcf == NULL) {
         /* possible path on fake request, no http{} block */
@@ -1078,38 +1531,27 @@ ngx_proxy_wasm_properties_get(ngx_proxy_wasm_ctx_t *pwctx,
 {
     u_char              dotted_path_buf[path->len];
     ngx_int_t           rc;
-    ngx_uint_t          key;
     ngx_str_t           p = { path->len, NULL };
-    pwm2ngx_mapping_t  *m;
+    resolved_prop_t     tmp, *rp;
 
     p.data = replace_nulls_by_dots(path, dotted_path_buf);
-    key = ngx_hash_key(p.data, p.len);
 
     ngx_log_debug1(NGX_LOG_DEBUG_WASM, pwctx->log, 0,
                    "wasm properties get \"%V\"", &p);
 
-    m = ngx_hash_find_combined(&pwm2ngx_hash, key, p.data, p.len);
-    if (m) {
-        if (!m->getter) {
-            /* attribute mapped to an nginx variable */
-            return ngx_proxy_wasm_properties_get_ngx(pwctx, &m->ngx_key,
-                                                     value);
-        }
+    rp = resolve_property(&p, &tmp);
 
+    if (rp->mapping && rp->mapping->getter) {
         /* attribute getter */
-        return m->getter(pwctx, &p, value);
+        return rp->mapping->getter(pwctx, &p, value);
     }
 
-    if (p.len > ngx_prefix_len
-        && ngx_memcmp(p.data, ngx_prefix, ngx_prefix_len) == 0)
-    {
-        /* nginx variable (ngx.*) */
-        return ngx_proxy_wasm_properties_get_ngx(pwctx, &p, value);
+    if (rp->ngx_key.len) {
+        /* attribute mapped to an nginx variable, or nginx variable */
+        return get_resolved_ngx(pwctx, rp, value);
     }
 
-    if (p.len > host_prefix_len
-        && ngx_memcmp(p.data, host_prefix, host_prefix_len) == 0)
-    {
+    if (rp->host) {
         /* host variable */
 
         /* even if there is an FFI getter, try reading const value first */
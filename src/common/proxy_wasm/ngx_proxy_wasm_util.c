@@ -533,6 +533,70 @@ failed:
 }
 
 
+ngx_int_t
+ngx_proxy_wasm_keys_unmarshal(ngx_proxy_wasm_exec_t *pwexec,
+    ngx_array_t *dst, ngx_proxy_wasm_marshalled_map_t *map)
+{
+    size_t      i, size;
+    uint32_t    count;
+    u_char     *buf, *last;
+    ngx_str_t  *key;
+
+    /**
+     * Serialized keys list:
+     * [count: u32] [key_len: u32] * count [key bytes + '\0'] * count
+     */
+
+    buf = map->data;
+    last = map->data + map->len;
+
+    if (map->len < NGX_PROXY_WASM_PTR_SIZE) {
+        return NGX_DECLINED;
+    }
+
+    count = *((uint32_t *) buf);
+    buf += NGX_PROXY_WASM_PTR_SIZE;
+
+    if (count > (size_t) (last - buf) / NGX_PROXY_WASM_PTR_SIZE) {
+        return NGX_DECLINED;
+    }
+
+    if (ngx_array_init(dst, pwexec->pool, count ? count : 1,
+                       sizeof(ngx_str_t))
+        != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+
+    size = count * NGX_PROXY_WASM_PTR_SIZE;
+
+    for (i = 0; i < count; i++) {
+        key = ngx_array_push(dst);
+        if (key == NULL) {
+            return NGX_ERROR;
+        }
+
+        key->len = *((uint32_t *) buf);
+        buf += NGX_PROXY_WASM_PTR_SIZE;
+
+        size += key->len + 1;
+    }
+
+    if (size != map->len - NGX_PROXY_WASM_PTR_SIZE) {
+        return NGX_DECLINED;
+    }
+
+    key = dst->elts;
+
+    for (i = 0; i < dst->nelts; i++) {
+        key[i].data = buf;
+        buf += key[i].len + 1;
+    }
+
+    return NGX_OK;
+}
+
+
 unsigned
 ngx_proxy_wasm_marshal(ngx_proxy_wasm_exec_t *pwexec, ngx_list_t *list,
     ngx_array_t *shims, ngx_wavm_ptr_t *out, uint32_t *out_size,
@@ -563,3 +627,68 @@ ngx_proxy_wasm_marshal(ngx_proxy_wasm_exec_t *pwexec, ngx_list_t *list,
 
     return 1;
 }
+
+
+ngx_int_t
+ngx_proxy_wasm_marshal_cache(ngx_proxy_wasm_exec_t *pwexec,
+    ngx_proxy_wasm_maps_cache_t *cache, ngx_list_t *list,
+    ngx_array_t *extras)
+{
+    size_t                 size;
+    ngx_uint_t             max = pwexec->filter->max_pairs;
+    ngx_proxy_wasm_ctx_t  *pwctx = pwexec->parent;
+
+    size = ngx_proxy_wasm_pairs_size(list, extras, max);
+
+    if (size > cache->size) {
+        if (cache->data.data) {
+            ngx_pfree(pwctx->pool, cache->data.data);
+        }
+
+        cache->data.data = ngx_palloc(pwctx->pool, size);
+        if (cache->data.data == NULL) {
+            cache->size = 0;
+            return NGX_ERROR;
+        }
+
+        cache->size = size;
+    }
+
+    cache->truncated = 0;
+
+    ngx_proxy_wasm_pairs_marshal(list, extras, cache->data.data, max,
+                                 &cache->truncated);
+
+    cache->data.len = size;
+    cache->generation = pwctx->maps_generation;
+    cache->max_pairs = max;
+    cache->step = pwctx->step;
+
+    return NGX_OK;
+}
+
+
+unsigned
+ngx_proxy_wasm_marshal_cached(ngx_proxy_wasm_exec_t *pwexec,
+    ngx_proxy_wasm_maps_cache_t *cache, ngx_wavm_ptr_t *out,
+    uint32_t *out_size)
+{
+    ngx_wavm_ptr_t        p;
+    ngx_wavm_instance_t  *instance = ngx_proxy_wasm_pwexec2instance(pwexec);
+
+    p = ngx_proxy_wasm_alloc(pwexec, cache->data.len);
+    if (!p) {
+        return 0;
+    }
+
+    if (!ngx_wavm_memory_memcpy(instance->memory, p,
+                                cache->data.data, cache->data.len))
+    {
+        return 0;
+    }
+
+    *out = p;
+    *out_size = (uint32_t) cache->data.len;
+
+    return 1;
+}
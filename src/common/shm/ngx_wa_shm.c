@@ -40,7 +40,14 @@ ngx_wa_shm_init(ngx_cycle_t *cycle)
 
         switch (shm->type) {
         case NGX_WA_SHM_TYPE_KV:
-            rc = ngx_wa_shm_kv_init(shm);
+            rc = shm->nshards
+                 ? ngx_wa_shm_kv_init_shards(shm, cycle)
+                 : ngx_wa_shm_kv_init(shm);
+
+            if (rc == NGX_OK && shm->persist.len) {
+                rc = ngx_wa_shm_kv_restore(shm);
+            }
+
             break;
         case NGX_WA_SHM_TYPE_QUEUE:
             rc = ngx_wa_shm_queue_init(shm);
@@ -65,8 +72,7 @@ ngx_wa_shm_init(ngx_cycle_t *cycle)
 ngx_int_t
 ngx_wa_shm_init_process(ngx_cycle_t *cycle)
 {
-#if (NGX_DEBUG)
-    size_t                 i;
+    size_t                 i, j;
     ngx_array_t           *shms = ngx_wasmx_shms(cycle);
     ngx_wa_shm_mapping_t  *mappings = shms->elts;
     ngx_wa_shm_t          *shm;
@@ -77,8 +83,25 @@ ngx_wa_shm_init_process(ngx_cycle_t *cycle)
         ngx_log_debug2(NGX_LOG_DEBUG_WASM, shm->log, 0,
                        "wasm \"%V\" shm: process initialization (zone: %p)",
                        &shm->name, mappings[i].zone->shm.addr);
+
+        if (shm->type != NGX_WA_SHM_TYPE_KV || shm->cache_max == 0) {
+            continue;
+        }
+
+        for (j = 0; j < shm->nshards; j++) {
+            if (ngx_wa_shm_kv_cache_init(&shm->shards[j], cycle->pool)
+                != NGX_OK)
+            {
+                return NGX_ERROR;
+            }
+        }
+
+        if (shm->nshards == 0
+            && ngx_wa_shm_kv_cache_init(shm, cycle->pool) != NGX_OK)
+        {
+            return NGX_ERROR;
+        }
     }
-#endif
 
     /* TODO: initialize inter-process notifications */
 
@@ -7,6 +7,8 @@
 
 #define NGX_WA_SHM_MIN_SIZE       (3 * ngx_pagesize)
 #define NGX_WA_SHM_INDEX_NOTFOUND -1
+#define NGX_WA_SHM_CACHE_TTL      1000
+#define NGX_WA_SHM_MAX_SHARDS     64
 
 
 typedef enum {
@@ -23,14 +25,31 @@ typedef enum {
 } ngx_wa_shm_eviction_e;
 
 
-typedef struct {
+typedef struct ngx_wa_shm_s  ngx_wa_shm_t;
+
+
+struct ngx_wa_shm_s {
     ngx_wa_shm_type_e       type;
     ngx_wa_shm_eviction_e   eviction;
     ngx_str_t               name;
     ngx_log_t              *log;
     ngx_slab_pool_t        *shpool;
     void                   *data;
-} ngx_wa_shm_t;
+    ngx_uint_t              cache_max;   /* shm_kv cache= */
+    ngx_msec_t              cache_ttl;   /* shm_kv cache_ttl= */
+    void                   *cache;       /* per-worker cache */
+    ngx_uint_t              nshards;     /* shm_kv shards= */
+    ngx_wa_shm_t           *shards;
+    ngx_flag_t              ordered;     /* shm_kv ordered */
+    ngx_str_t               persist;     /* shm_kv persist= */
+    ngx_uint_t              persisted;   /* writes seq of the last snapshot */
+    ngx_msec_t              persisted_at;
+    ngx_flag_t              persisting;  /* snapshot being written */
+#if (NGX_THREADS)
+    ngx_thread_pool_t      *thread_pool; /* snapshots writer */
+#endif
+    ngx_flag_t              admission;   /* shm_kv admission=tinylfu */
+};
 
 
 typedef struct {
@@ -48,20 +67,42 @@ ngx_int_t ngx_wa_shm_lookup_index(ngx_str_t *name);
 static ngx_inline void
 ngx_wa_shm_lock(ngx_wa_shm_t *shm)
 {
-    ngx_shmtx_lock(&shm->shpool->mutex);
+    ngx_uint_t  i;
+
+    /* sharded zones: lock all shards, always in the same order */
+
+    for (i = 0; i < shm->nshards; i++) {
+        ngx_shmtx_lock(&shm->shards[i].shpool->mutex);
+    }
+
+    if (shm->nshards == 0) {
+        ngx_shmtx_lock(&shm->shpool->mutex);
+    }
 }
 
 
 static ngx_inline void
 ngx_wa_shm_unlock(ngx_wa_shm_t *shm)
 {
-    ngx_shmtx_unlock(&shm->shpool->mutex);
+    ngx_uint_t  i;
+
+    for (i = 0; i < shm->nshards; i++) {
+        ngx_shmtx_unlock(&shm->shards[i].shpool->mutex);
+    }
+
+    if (shm->nshards == 0) {
+        ngx_shmtx_unlock(&shm->shpool->mutex);
+    }
 }
 
 
 static ngx_inline unsigned
 ngx_wa_shm_locked(ngx_wa_shm_t *shm)
 {
+    if (shm->nshards) {
+        shm = &shm->shards[0];
+    }
+
     return (ngx_pid_t) *shm->shpool->mutex.lock == ngx_pid;
 }
 
@@ -3,6 +3,7 @@
 #endif
 #include "ddebug.h"
 
+#include <ngx_event.h>
 #include <ngx_wasm.h>
 #include <ngx_wa_shm_kv.h>
 
@@ -14,6 +15,53 @@
 /* one extra queue for larger items */
 #define NGX_WASM_SLRU_NQUEUES(pool)  (NGX_WASM_SLAB_SLOTS(pool) + 1)
 
+/* optimistic reads attempts before falling back to locking */
+#define NGX_WA_SHM_KV_READ_TRIES     8
+#define NGX_WA_SHM_KV_MAX_PROBES     128
+
+#define NGX_WA_SHM_KV_INIT_SLOTS     16
+/* old index slots migrated per write while resizing */
+#define NGX_WA_SHM_KV_MIGRATE_STEP   8
+/* marks migrated or deleted slots of the old index */
+#define NGX_WA_SHM_KV_MOVED          ((ngx_wa_shm_kv_node_t *) 1)
+
+/* distance of slot i from the ideal slot of hash h */
+#define ngx_wa_shm_kv_dib(t, h, i)   (((i) - ((h) & (t)->mask)) & (t)->mask)
+
+/* expiration wheel resolution (ms) */
+#define NGX_WA_SHM_KV_WHEEL_TICK     1000
+#define NGX_WA_SHM_KV_WHEEL_MASK     (NGX_WA_SHM_KV_WHEEL_SLOTS - 1)
+/* expired entries freed per zone and per sweep */
+#define NGX_WA_SHM_KV_SWEEP_MAX      1024
+#define NGX_WA_SHM_KV_SWEEP_INTERVAL 1000
+/* admission=tinylfu: frequency sketch counters */
+#define NGX_WA_SHM_KV_SKETCH_MIN     256
+#define NGX_WA_SHM_KV_SKETCH_MAX     (1 << 20)
+#define NGX_WA_SHM_KV_SKETCH_RATIO   256   /* zone bytes per counter */
+#define NGX_WA_SHM_KV_SKETCH_FREQ    15    /* saturation */
+#define NGX_WA_SHM_KV_SKETCH_SAMPLE  10    /* aging every 10 * counters */
+/* persist= snapshots, taken by the sweeping worker */
+#define NGX_WA_SHM_KV_PERSIST_INTERVAL 10000
+
+#define ngx_wa_shm_kv_expired(n, now)                                        \
+    ((n)->expires && (n)->expires <= (now))
+
+/* ordered zones: skiplist forward pointers, between the node and its key */
+#define ngx_wa_shm_kv_tower(n)       ((ngx_wa_shm_kv_node_t **) ((n) + 1))
+
+
+static ngx_event_t  ngx_wa_shm_kv_sweep_ev;
+
+
+static ngx_inline uint64_t
+ngx_wa_shm_kv_now(void)
+{
+    ngx_time_t  *tp = ngx_timeofday();
+
+    /* wall clock: expiration times are compared across processes */
+    return (uint64_t) tp->sec * 1000 + tp->msec;
+}
+
 
 ngx_wa_shm_kv_t *
 ngx_wa_shm_get_kv(ngx_wa_shm_t *shm)
@@ -24,366 +72,2119 @@ ngx_wa_shm_get_kv(ngx_wa_shm_t *shm)
 }
 
 
+static ngx_uint_t
+ngx_wa_shm_kv_level(ngx_str_t *key)
+{
+    uint32_t    h;
+    ngx_uint_t  level;
+
+    /**
+     * Skiplist tower height (p = 1/4), derived from the key so that it
+     * needs not be stored in the node. From the top bits: shards are
+     * picked from the same hash modulo their number.
+     */
+
+    h = ngx_murmur_hash2(key->data, key->len);
+
+    for (level = 1;
+         level < NGX_WA_SHM_KV_SKIPLIST_MAX && (h & 0xc0000000) == 0;
+         level++)
+    {
+        h <<= 2;
+    }
+
+    return level;
+}
+
+
+static ngx_inline unsigned
+ngx_wa_shm_kv_has_prefix(ngx_str_t *key, ngx_str_t *prefix)
+{
+    return prefix->len == 0
+           || (key->len >= prefix->len
+               && ngx_memcmp(key->data, prefix->data, prefix->len) == 0);
+}
+
+
+static ngx_inline size_t
+ngx_wa_shm_kv_node_size(ngx_wa_shm_t *shm, ngx_str_t *key, size_t value_len)
+{
+    size_t  size = sizeof(ngx_wa_shm_kv_node_t) + key->len + value_len;
+
+    if (shm->ordered) {
+        size += sizeof(ngx_wa_shm_kv_node_t *) * ngx_wa_shm_kv_level(key);
+    }
+
+    return size;
+}
+
+
+static ngx_inline u_char *
+ngx_wa_shm_kv_sketch_counter(ngx_wa_shm_kv_sketch_t *sk, uint32_t hash,
+    ngx_uint_t row)
+{
+    uint32_t  h2 = (hash >> 17) | (hash << 15);
+
+    /* double hashing: one counter per row */
+    return &sk->counters[row * (sk->mask + 1)
+                         + ((hash + row * h2) & sk->mask)];
+}
+
+
+static ngx_uint_t
+ngx_wa_shm_kv_sketch_estimate(ngx_wa_shm_kv_sketch_t *sk, uint32_t hash)
+{
+    ngx_uint_t  row, freq = NGX_WA_SHM_KV_SKETCH_FREQ;
+
+    for (row = 0; row < NGX_WA_SHM_KV_SKETCH_DEPTH; row++) {
+        freq = ngx_min(freq, *ngx_wa_shm_kv_sketch_counter(sk, hash, row));
+    }
+
+    return freq;
+}
+
+
+static void
+ngx_wa_shm_kv_sketch_add(ngx_wa_shm_kv_sketch_t *sk, uint32_t hash)
+{
+    u_char      *c;
+    ngx_uint_t   row;
+
+    /**
+     * Also called by lock-free readers: concurrent increments may be
+     * lost, which only makes the estimate more conservative.
+     */
+
+    for (row = 0; row < NGX_WA_SHM_KV_SKETCH_DEPTH; row++) {
+        c = ngx_wa_shm_kv_sketch_counter(sk, hash, row);
+
+        if (*c < NGX_WA_SHM_KV_SKETCH_FREQ) {
+            *c += 1;
+        }
+    }
+
+    (void) ngx_atomic_fetch_add(&sk->additions, 1);
+}
+
+
+static void
+ngx_wa_shm_kv_sketch_age(ngx_wa_shm_kv_sketch_t *sk)
+{
+    ngx_uint_t  i;
+
+    /* locked: halve all frequencies so that past popularity fades */
+
+    if (sk->additions < sk->sample) {
+        return;
+    }
+
+    for (i = 0; i < (sk->mask + 1) * NGX_WA_SHM_KV_SKETCH_DEPTH; i++) {
+        sk->counters[i] >>= 1;
+    }
+
+    sk->additions /= 2;
+}
+
+
+static void
+ngx_wa_shm_kv_record(ngx_wa_shm_kv_t *kv, uint32_t key_hash, unsigned hit)
+{
+    /* admission=tinylfu: reads and misses count as accesses */
+
+    ngx_wa_shm_kv_sketch_add(kv->sketch, key_hash);
+
+    (void) ngx_atomic_fetch_add(hit ? &kv->sketch->hits : &kv->sketch->misses,
+                                1);
+}
+
+
 ngx_int_t
 ngx_wa_shm_kv_init(ngx_wa_shm_t *shm)
 {
-    size_t            size, i;
+    size_t            size, width, i;
     ngx_uint_t        n;
     ngx_wa_shm_kv_t  *kv;
 
     n = 0;
     size = sizeof(ngx_wa_shm_kv_t);
 
-    if (shm->eviction == NGX_WA_SHM_EVICTION_SLRU) {
-        n = NGX_WASM_SLRU_NQUEUES(shm->shpool);
-        size += sizeof(ngx_queue_t) * n;
+    if (shm->eviction == NGX_WA_SHM_EVICTION_SLRU) {
+        n = NGX_WASM_SLRU_NQUEUES(shm->shpool);
+        size += sizeof(ngx_queue_t) * n;
+    }
+
+    /**
+     * Allocate the store and its initial index from the same slab slot
+     * so that they share a page in small zones.
+     */
+    size = ngx_max(size, sizeof(ngx_wa_shm_kv_slot_t)
+                         * NGX_WA_SHM_KV_INIT_SLOTS);
+
+    kv = ngx_slab_calloc(shm->shpool, size);
+    if (kv == NULL) {
+        return NGX_ERROR;
+    }
+
+    kv->table.slots = ngx_slab_calloc(shm->shpool,
+                                      sizeof(ngx_wa_shm_kv_slot_t)
+                                      * NGX_WA_SHM_KV_INIT_SLOTS);
+    if (kv->table.slots == NULL) {
+        return NGX_ERROR;
+    }
+
+    kv->table.mask = NGX_WA_SHM_KV_INIT_SLOTS - 1;
+
+    if (shm->ordered) {
+        kv->skiplist = ngx_slab_calloc(shm->shpool,
+                                       sizeof(ngx_wa_shm_kv_node_t *)
+                                       * NGX_WA_SHM_KV_SKIPLIST_MAX);
+        if (kv->skiplist == NULL) {
+            return NGX_ERROR;
+        }
+    }
+
+    if (shm->admission) {
+        for (width = NGX_WA_SHM_KV_SKETCH_MIN;
+             width < NGX_WA_SHM_KV_SKETCH_MAX
+             && width < (size_t) (shm->shpool->end - shm->shpool->start)
+                        / NGX_WA_SHM_KV_SKETCH_RATIO;
+             width <<= 1)
+        {
+            /* void */
+        }
+
+        kv->sketch = ngx_slab_calloc(shm->shpool,
+                                     sizeof(ngx_wa_shm_kv_sketch_t)
+                                     + width * NGX_WA_SHM_KV_SKETCH_DEPTH);
+        if (kv->sketch == NULL) {
+            return NGX_ERROR;
+        }
+
+        kv->sketch->mask = width - 1;
+        kv->sketch->sample = width * NGX_WA_SHM_KV_SKETCH_SAMPLE;
+    }
+
+    shm->data = kv;
+    shm->shpool->log_nomem = 0;
+
+    kv->nelts = 0;
+
+    if (shm->eviction == NGX_WA_SHM_EVICTION_LRU) {
+        ngx_queue_init(&kv->eviction.lru_queue);
+
+    } else if (shm->eviction == NGX_WA_SHM_EVICTION_SLRU) {
+        for (i = 0; i < n; i++) {
+            ngx_queue_init(&kv->eviction.slru_queues[i]);
+        }
+    }
+
+    ngx_log_debug1(NGX_LOG_DEBUG_WASM, shm->log, 0,
+                   "wasm \"%V\" shm store: initialized", &shm->name);
+
+    return NGX_OK;
+}
+
+
+ngx_int_t
+ngx_wa_shm_kv_init_shards(ngx_wa_shm_t *shm, ngx_cycle_t *cycle)
+{
+    size_t            size;
+    ngx_uint_t        i;
+    ngx_slab_pool_t  *sp;
+    ngx_wa_shm_t     *shard;
+
+    /**
+     * Split the zone's pages into independent slab pools, each with its
+     * own mutex, index and eviction queues.
+     */
+
+    size = (shm->shpool->pfree / shm->nshards) * ngx_pagesize;
+
+    if (size < NGX_WA_SHM_MIN_SIZE) {
+        ngx_wasm_log_error(NGX_LOG_EMERG, cycle->log, 0,
+                           "\"%V\" shm store: zone too small for %ui shards",
+                           &shm->name, shm->nshards);
+        return NGX_ERROR;
+    }
+
+    shm->shards = ngx_pcalloc(cycle->pool,
+                              sizeof(ngx_wa_shm_t) * shm->nshards);
+    if (shm->shards == NULL) {
+        return NGX_ERROR;
+    }
+
+    for (i = 0; i < shm->nshards; i++) {
+        sp = ngx_slab_alloc(shm->shpool, size);
+        if (sp == NULL) {
+            return NGX_ERROR;
+        }
+
+        sp->end = (u_char *) sp + size;
+        sp->min_shift = 3;
+        sp->addr = sp;
+
+        /* sharding requires atomic ops (see ngx_wasm_directives.c) */
+        if (ngx_shmtx_create(&sp->mutex, &sp->lock, NULL) != NGX_OK) {
+            return NGX_ERROR;
+        }
+
+        ngx_slab_init(sp);
+
+        shard = &shm->shards[i];
+        *shard = *shm;
+        shard->shpool = sp;
+        shard->nshards = 0;
+        shard->shards = NULL;
+
+        if (ngx_wa_shm_kv_init(shard) != NGX_OK) {
+            return NGX_ERROR;
+        }
+    }
+
+    ngx_log_debug2(NGX_LOG_DEBUG_WASM, shm->log, 0,
+                   "wasm \"%V\" shm store: %ui shards initialized",
+                   &shm->name, shm->nshards);
+
+    return NGX_OK;
+}
+
+
+static ngx_uint_t
+slru_index_for_size(ngx_wa_shm_t *shm, size_t size)
+{
+    size_t      s;
+    ngx_uint_t  shift;
+
+    if (size > NGX_WASM_SLAB_MAX_SIZE) {
+        return NGX_WASM_SLRU_NQUEUES(shm->shpool) - 1;
+    }
+
+    if (size > shm->shpool->min_size) {
+        shift = 1;
+        for (s = size - 1; s >>= 1; shift++) { /* void */ }
+
+        return shift - shm->shpool->min_shift;
+    }
+
+    /**
+     * The above condition will always be true as long as
+     * sizeof(ngx_wa_shm_kv_node_t) > shm->shpool->min_size. We do not assert
+     * it unconditionally because min_size depends on the Nginx page size
+     * configuration. The fallback case is to use the first queue for small
+     * items, strictly following the Nginx slot selection algorithm.
+     */
+    return 0;
+}
+
+
+static ngx_queue_t*
+queue_for_node(ngx_wa_shm_t *shm, ngx_wa_shm_kv_node_t *n)
+{
+    size_t            size;
+    ngx_wa_shm_kv_t  *kv = ngx_wa_shm_get_kv(shm);
+
+    if (shm->eviction == NGX_WA_SHM_EVICTION_LRU) {
+        return &kv->eviction.lru_queue;
+    }
+
+    if (shm->eviction == NGX_WA_SHM_EVICTION_SLRU) {
+        size = ngx_wa_shm_kv_node_size(shm, &n->key, n->value.len);
+
+        return &kv->eviction.slru_queues[slru_index_for_size(shm, size)];
+    }
+
+    /* unreachable */
+    ngx_wa_assert(0);
+    return NULL;
+}
+
+
+static ngx_wa_shm_kv_slot_t *
+ngx_wa_shm_kv_table_lookup(ngx_wa_shm_kv_table_t *t, ngx_str_t *key,
+    uint32_t key_hash)
+{
+    ngx_uint_t             i, dist;
+    ngx_wa_shm_kv_slot_t  *s;
+    ngx_wa_shm_kv_node_t  *n;
+
+    /**
+     * Robin Hood probing: stop at an empty slot or at a slot closer to
+     * its ideal position than the key would be. A NULL key matches on
+     * the hash only (e.g. metric ids).
+     */
+
+    i = key_hash & t->mask;
+
+    for (dist = 0; /* void */; dist++, i = (i + 1) & t->mask) {
+        s = &t->slots[i];
+        n = s->node;
+
+        if (n == NULL || ngx_wa_shm_kv_dib(t, s->hash, i) < dist) {
+            return NULL;
+        }
+
+        if (s->hash != key_hash || n == NGX_WA_SHM_KV_MOVED) {
+            continue;
+        }
+
+        if (key == NULL
+            || ngx_str_eq(n->key.data, n->key.len, key->data, key->len))
+        {
+            return s;
+        }
+    }
+}
+
+
+static void
+ngx_wa_shm_kv_table_insert(ngx_wa_shm_kv_table_t *t, ngx_wa_shm_kv_node_t *n)
+{
+    ngx_uint_t             i, dist, d;
+    ngx_wa_shm_kv_slot_t   cur, tmp, *s;
+
+    cur.hash = n->hash;
+    cur.node = n;
+
+    i = cur.hash & t->mask;
+
+    for (dist = 0; /* void */; dist++, i = (i + 1) & t->mask) {
+        s = &t->slots[i];
+
+        if (s->node == NULL) {
+            *s = cur;
+            return;
+        }
+
+        d = ngx_wa_shm_kv_dib(t, s->hash, i);
+        if (d < dist) {
+            /* take the slot from the closer entry, carry on inserting it */
+            tmp = *s;
+            *s = cur;
+            cur = tmp;
+            dist = d;
+        }
+    }
+}
+
+
+static void
+ngx_wa_shm_kv_table_delete(ngx_wa_shm_kv_table_t *t, ngx_wa_shm_kv_slot_t *s)
+{
+    ngx_uint_t             i, next;
+    ngx_wa_shm_kv_slot_t  *ns;
+
+    /* backward shift deletion: no tombstones */
+
+    i = s - t->slots;
+
+    for ( ;; ) {
+        next = (i + 1) & t->mask;
+        ns = &t->slots[next];
+
+        if (ns->node == NULL || ngx_wa_shm_kv_dib(t, ns->hash, next) == 0) {
+            break;
+        }
+
+        t->slots[i] = *ns;
+        i = next;
+    }
+
+    t->slots[i].node = NULL;
+    t->slots[i].hash = 0;
+}
+
+
+static ngx_wa_shm_kv_node_t *
+ngx_wa_shm_kv_lookup(ngx_wa_shm_kv_t *kv, ngx_str_t *key, uint32_t key_hash)
+{
+    ngx_wa_shm_kv_slot_t  *s;
+
+    s = ngx_wa_shm_kv_table_lookup(&kv->table, key, key_hash);
+
+    if (s == NULL && kv->old.slots) {
+        s = ngx_wa_shm_kv_table_lookup(&kv->old, key, key_hash);
+    }
+
+    return s ? s->node : NULL;
+}
+
+
+static void
+ngx_wa_shm_kv_unlink(ngx_wa_shm_kv_t *kv, ngx_wa_shm_kv_node_t *n)
+{
+    ngx_wa_shm_kv_slot_t  *s;
+
+    s = ngx_wa_shm_kv_table_lookup(&kv->table, &n->key, n->hash);
+    if (s) {
+        ngx_wa_shm_kv_table_delete(&kv->table, s);
+        return;
+    }
+
+    ngx_wa_assert(kv->old.slots);
+
+    s = ngx_wa_shm_kv_table_lookup(&kv->old, &n->key, n->hash);
+    if (s) {
+        /* the old index is not probed past its migration */
+        s->node = NGX_WA_SHM_KV_MOVED;
+    }
+}
+
+
+static void
+ngx_wa_shm_kv_skiplist_find(ngx_wa_shm_kv_t *kv, ngx_str_t *key,
+    ngx_wa_shm_kv_node_t ***update)
+{
+    ngx_int_t               i;
+    ngx_wa_shm_kv_node_t  **tower = kv->skiplist;
+
+    /* update[i]: level i forward pointer to the first key >= key */
+
+    for (i = NGX_WA_SHM_KV_SKIPLIST_MAX - 1; i >= 0; i--) {
+        while (tower[i]
+               && ngx_memn2cmp(tower[i]->key.data, key->data,
+                               tower[i]->key.len, key->len) < 0)
+        {
+            tower = ngx_wa_shm_kv_tower(tower[i]);
+        }
+
+        update[i] = &tower[i];
+    }
+}
+
+
+static void
+ngx_wa_shm_kv_skiplist_insert(ngx_wa_shm_kv_t *kv, ngx_wa_shm_kv_node_t *n)
+{
+    ngx_uint_t              i, level;
+    ngx_wa_shm_kv_node_t  **tower = ngx_wa_shm_kv_tower(n);
+    ngx_wa_shm_kv_node_t  **update[NGX_WA_SHM_KV_SKIPLIST_MAX];
+
+    ngx_wa_shm_kv_skiplist_find(kv, &n->key, update);
+
+    level = ngx_wa_shm_kv_level(&n->key);
+
+    for (i = 0; i < level; i++) {
+        tower[i] = *update[i];
+        *update[i] = n;
+    }
+}
+
+
+static void
+ngx_wa_shm_kv_skiplist_delete(ngx_wa_shm_kv_t *kv, ngx_wa_shm_kv_node_t *n)
+{
+    ngx_uint_t              i;
+    ngx_wa_shm_kv_node_t  **update[NGX_WA_SHM_KV_SKIPLIST_MAX];
+
+    ngx_wa_shm_kv_skiplist_find(kv, &n->key, update);
+
+    for (i = 0; i < NGX_WA_SHM_KV_SKIPLIST_MAX && *update[i] == n; i++) {
+        *update[i] = ngx_wa_shm_kv_tower(n)[i];
+    }
+}
+
+
+static void
+ngx_wa_shm_kv_migrate(ngx_wa_shm_t *shm, ngx_uint_t nslots)
+{
+    ngx_uint_t             i;
+    ngx_wa_shm_kv_slot_t  *s;
+    ngx_wa_shm_kv_t       *kv = ngx_wa_shm_get_kv(shm);
+
+    for (i = 0; i < nslots && kv->old.slots; i++) {
+        s = &kv->old.slots[kv->migrated];
+
+        if (s->node && s->node != NGX_WA_SHM_KV_MOVED) {
+            ngx_wa_shm_kv_table_insert(&kv->table, s->node);
+            s->node = NGX_WA_SHM_KV_MOVED;
+        }
+
+        if (++kv->migrated > kv->old.mask) {
+            ngx_slab_free_locked(shm->shpool, kv->old.slots);
+
+            kv->old.slots = NULL;
+            kv->old.mask = 0;
+            kv->migrated = 0;
+
+            ngx_log_debug1(NGX_LOG_DEBUG_WASM, shm->log, 0,
+                           "wasm \"%V\" shm store: index resized",
+                           &shm->name);
+        }
+    }
+}
+
+
+static void
+ngx_wa_shm_kv_grow(ngx_wa_shm_t *shm)
+{
+    ngx_uint_t             nslots;
+    ngx_wa_shm_kv_slot_t  *slots;
+    ngx_wa_shm_kv_t       *kv = ngx_wa_shm_get_kv(shm);
+
+    nslots = kv->table.mask + 1;
+
+    if ((kv->nelts + 1) * 4 <= nslots * 3) {
+        /* load factor <= 0.75 */
+        return;
+    }
+
+    if (kv->old.slots) {
+        /* finish the previous resize */
+        ngx_wa_shm_kv_migrate(shm, kv->old.mask + 1);
+    }
+
+    slots = ngx_slab_calloc_locked(shm->shpool,
+                                   sizeof(ngx_wa_shm_kv_slot_t) * nslots * 2);
+    if (slots == NULL) {
+        /* keep filling the current index */
+        return;
+    }
+
+    ngx_log_debug2(NGX_LOG_DEBUG_WASM, shm->log, 0,
+                   "wasm \"%V\" shm store: resizing index to %ui slots",
+                   &shm->name, nslots * 2);
+
+    /* entries are moved incrementally by subsequent writes */
+
+    kv->old = kv->table;
+    kv->migrated = 0;
+    kv->table.slots = slots;
+    kv->table.mask = nslots * 2 - 1;
+}
+
+
+ngx_wa_shm_kv_node_t *
+ngx_wa_shm_kv_next(ngx_wa_shm_kv_t *kv, ngx_uint_t *it)
+{
+    uint64_t               now;
+    ngx_uint_t             i, nslots;
+    ngx_wa_shm_kv_slot_t  *s;
+
+    /**
+     * Iterates over the index, then over the one being migrated.
+     * Expired entries not swept yet are skipped.
+     */
+
+    now = kv->wheel ? ngx_wa_shm_kv_now() : 0;
+    nslots = kv->table.mask + 1;
+
+    for (i = *it; /* void */; i++) {
+        if (i < nslots) {
+            s = &kv->table.slots[i];
+
+        } else if (kv->old.slots && i - nslots <= kv->old.mask) {
+            s = &kv->old.slots[i - nslots];
+
+        } else {
+            *it = i;
+            return NULL;
+        }
+
+        if (s->node
+            && s->node != NGX_WA_SHM_KV_MOVED
+            && !ngx_wa_shm_kv_expired(s->node, now))
+        {
+            *it = i + 1;
+            return s->node;
+        }
+    }
+}
+
+
+ngx_int_t
+ngx_wa_shm_kv_keys_locked(ngx_wa_shm_t *shm, ngx_wa_shm_kv_cursor_t *cursor,
+    ngx_str_t **keys, ngx_uint_t max, ngx_uint_t *nkeys)
+{
+    ngx_uint_t             i, seq, nshards;
+    ngx_wa_shm_t          *shards;
+    ngx_wa_shm_kv_node_t  *n;
+
+    /**
+     * At most max keys of a locked zone, in index order, resumed from
+     * cursor. Index slots only move on writes (Robin Hood shifts,
+     * incremental resizes), so a cursor is only valid while the zone is
+     * not written to: every key present for the whole iteration is then
+     * returned exactly once. NGX_DECLINED: the zone was written to since
+     * the cursor started. NGX_DONE: no more keys.
+     */
+
+    *nkeys = 0;
+
+    shards = shm->nshards ? shm->shards : shm;
+    nshards = shm->nshards ? shm->nshards : 1;
+
+    for (i = 0, seq = 0; i < nshards; i++) {
+        seq += ngx_wa_shm_get_kv(&shards[i])->seq;
+    }
+
+    if (!cursor->started) {
+        cursor->started = 1;
+        cursor->seq = seq;
+
+    } else if (cursor->seq != seq) {
+        return NGX_DECLINED;
+    }
+
+    for ( /* void */ ; cursor->shard < nshards; cursor->shard++) {
+        while (*nkeys < max) {
+            n = ngx_wa_shm_kv_next(ngx_wa_shm_get_kv(&shards[cursor->shard]),
+                                   &cursor->it);
+            if (n == NULL) {
+                break;
+            }
+
+            keys[(*nkeys)++] = &n->key;
+        }
+
+        if (*nkeys == max) {
+            break;
+        }
+
+        cursor->it = 0;
+    }
+
+    return *nkeys ? NGX_OK : NGX_DONE;
+}
+
+
+ngx_int_t
+ngx_wa_shm_kv_scan_locked(ngx_wa_shm_t *shm, ngx_wa_shm_kv_range_t *range,
+    ngx_str_t **keys, ngx_uint_t max, ngx_uint_t *nkeys)
+{
+    uint64_t                now;
+    ngx_uint_t              i, j = 0, nshards;
+    ngx_str_t              *from;
+    ngx_wa_shm_t           *shards;
+    ngx_wa_shm_kv_node_t   *n, *heads[NGX_WA_SHM_MAX_SHARDS];
+    ngx_wa_shm_kv_node_t  **update[NGX_WA_SHM_KV_SKIPLIST_MAX];
+
+    /**
+     * At most max keys of range, in ascending order; the keys of sharded
+     * zones are merged from each shard's skiplist. NGX_DONE: no more
+     * keys in range.
+     */
+
+    *nkeys = 0;
+
+    if (!shm->ordered) {
+        return NGX_DECLINED;
+    }
+
+    shards = shm->nshards ? shm->shards : shm;
+    nshards = shm->nshards ? shm->nshards : 1;
+
+    /* seek to the greatest lower bound */
+
+    from = (range->prefix.len
+            && ngx_memn2cmp(range->prefix.data, range->start.data,
+                            range->prefix.len, range->start.len) > 0)
+           ? &range->prefix : &range->start;
+
+    for (i = 0; i < nshards; i++) {
+        ngx_wa_shm_kv_skiplist_find(ngx_wa_shm_get_kv(&shards[i]), from,
+                                    update);
+        n = *update[0];
+
+        if (n
+            && range->exclusive
+            && from == &range->start
+            && ngx_str_eq(n->key.data, n->key.len,
+                          range->start.data, range->start.len))
+        {
+            n = ngx_wa_shm_kv_tower(n)[0];
+        }
+
+        heads[i] = n;
+    }
+
+    now = ngx_wa_shm_kv_now();
+
+    for ( ;; ) {
+        n = NULL;
+
+        for (i = 0; i < nshards; i++) {
+            if (heads[i]
+                && (n == NULL
+                    || ngx_memn2cmp(heads[i]->key.data, n->key.data,
+                                    heads[i]->key.len, n->key.len) < 0))
+            {
+                n = heads[i];
+                j = i;
+            }
+        }
+
+        if (n == NULL
+            || (range->end.len
+                && ngx_memn2cmp(n->key.data, range->end.data,
+                                n->key.len, range->end.len) >= 0)
+            || !ngx_wa_shm_kv_has_prefix(&n->key, &range->prefix))
+        {
+            return NGX_DONE;
+        }
+
+        heads[j] = ngx_wa_shm_kv_tower(n)[0];
+
+        if (ngx_wa_shm_kv_expired(n, now)) {
+            /* not swept yet */
+            continue;
+        }
+
+        if (*nkeys == max) {
+            /* more keys in range */
+            return NGX_OK;
+        }
+
+        keys[(*nkeys)++] = &n->key;
+    }
+}
+
+
+static ngx_wa_shm_kv_node_t *
+ngx_wa_shm_kv_get_node_locked(ngx_wa_shm_t *shm, ngx_str_t *key,
+    uint32_t key_hash)
+{
+    ngx_wa_shm_kv_t       *kv = ngx_wa_shm_get_kv(shm);
+    ngx_wa_shm_kv_node_t  *n;
+
+    n = ngx_wa_shm_kv_lookup(kv, key, key_hash);
+
+    if (n == NULL || ngx_wa_shm_kv_expired(n, ngx_wa_shm_kv_now())) {
+        /* expired entries are freed by writes or the sweeper */
+        return NULL;
+    }
+
+    if (shm->eviction == NGX_WA_SHM_EVICTION_LRU
+        || shm->eviction == NGX_WA_SHM_EVICTION_SLRU)
+    {
+        ngx_queue_remove(&n->queue);
+        ngx_queue_insert_head(queue_for_node(shm, n), &n->queue);
+    }
+
+    return n;
+}
+
+
+ngx_int_t
+ngx_wa_shm_kv_get_locked(ngx_wa_shm_t *shm, ngx_str_t *key,
+    uint32_t *key_hash, ngx_str_t **value_out, uint32_t *cas)
+{
+    uint32_t               hash;
+    ngx_wa_shm_kv_t       *kv = ngx_wa_shm_get_kv(shm);
+    ngx_wa_shm_kv_node_t  *n;
+
+    hash = key_hash ? *key_hash : ngx_crc32_long(key->data, key->len);
+
+    n = ngx_wa_shm_kv_get_node_locked(shm, key, hash);
+
+    if (kv->sketch) {
+        ngx_wa_shm_kv_record(kv, hash, n != NULL);
+    }
+
+    if (n == NULL) {
+        return NGX_DECLINED;
+    }
+
+    if (value_out) {
+        *value_out = &n->value;
+    }
+
+    if (cas) {
+        *cas = n->cas;
+    }
+
+    return NGX_OK;
+}
+
+
+static ngx_inline void
+ngx_wa_shm_kv_write_begin(ngx_wa_shm_kv_t *kv)
+{
+    kv->seq++;
+    ngx_memory_barrier();
+}
+
+
+static ngx_inline void
+ngx_wa_shm_kv_write_end(ngx_wa_shm_kv_t *kv)
+{
+    ngx_memory_barrier();
+    kv->seq++;
+}
+
+
+static ngx_inline unsigned
+ngx_wa_shm_kv_in_zone(ngx_wa_shm_t *shm, void *p, size_t size)
+{
+    return (u_char *) p >= shm->shpool->start
+           && size <= (size_t) (shm->shpool->end - (u_char *) p);
+}
+
+
+static ngx_int_t
+ngx_wa_shm_kv_read_optimistic(ngx_wa_shm_t *shm, ngx_str_t *key,
+    uint32_t key_hash, ngx_str_t *value, size_t size, uint32_t *cas,
+    uint64_t *expires)
+{
+    uint32_t                n_cas;
+    uint64_t                n_expires;
+    ngx_uint_t              i, dist, j;
+    ngx_int_t               rc;
+    ngx_str_t               k;
+    ngx_atomic_uint_t       seq;
+    ngx_wa_shm_kv_table_t   t;
+    ngx_wa_shm_kv_slot_t   *s;
+    ngx_wa_shm_kv_t        *kv = ngx_wa_shm_get_kv(shm);
+    ngx_wa_shm_kv_node_t   *node, *n = NULL;
+
+    /**
+     * Seqlock read: the index and values may be modified concurrently,
+     * every pointer is checked to be within the zone and the result is
+     * discarded if a writer was active meanwhile.
+     */
+
+    seq = kv->seq;
+    ngx_memory_barrier();
+
+    if (seq & 1) {
+        return NGX_BUSY;
+    }
+
+    for (j = 0; j < 2 && n == NULL; j++) {
+        t = j ? kv->old : kv->table;
+
+        if (t.slots == NULL) {
+            continue;
+        }
+
+        i = key_hash & t.mask;
+
+        for (dist = 0; /* void */; dist++, i = (i + 1) & t.mask) {
+            s = &t.slots[i];
+
+            if (dist == NGX_WA_SHM_KV_MAX_PROBES
+                || !ngx_wa_shm_kv_in_zone(shm, s, sizeof(ngx_wa_shm_kv_slot_t)))
+            {
+                return NGX_BUSY;
+            }
+
+            node = s->node;
+
+            if (node == NULL || ngx_wa_shm_kv_dib(&t, s->hash, i) < dist) {
+                break;
+            }
+
+            if (s->hash != key_hash || node == NGX_WA_SHM_KV_MOVED) {
+                continue;
+            }
+
+            if (!ngx_wa_shm_kv_in_zone(shm, node, sizeof(ngx_wa_shm_kv_node_t)))
+            {
+                return NGX_BUSY;
+            }
+
+            k = node->key;
+
+            if (k.len != key->len) {
+                continue;
+            }
+
+            if (!ngx_wa_shm_kv_in_zone(shm, k.data, k.len)) {
+                return NGX_BUSY;
+            }
+
+            if (ngx_memcmp(k.data, key->data, k.len) == 0) {
+                n = node;
+                break;
+            }
+        }
+    }
+
+    if (n == NULL) {
+        rc = NGX_DECLINED;
+        goto validate;
+    }
+
+    k = n->value;
+    n_cas = n->cas;
+    n_expires = n->expires;
+
+    if (n_expires && n_expires <= ngx_wa_shm_kv_now()) {
+        rc = NGX_DECLINED;
+        goto validate;
+    }
+
+    value->len = k.len;
+
+    if (k.len > size) {
+        rc = NGX_AGAIN;
+        goto validate;
+    }
+
+    if (!ngx_wa_shm_kv_in_zone(shm, k.data, k.len)) {
+        return NGX_BUSY;
+    }
+
+    ngx_memcpy(value->data, k.data, k.len);
+
+    if (cas) {
+        *cas = n_cas;
+    }
+
+    *expires = n_expires;
+
+    rc = NGX_OK;
+
+validate:
+
+    ngx_memory_barrier();
+
+    if (kv->seq != seq) {
+        return NGX_BUSY;
+    }
+
+    return rc;
+}
+
+
+ngx_int_t
+ngx_wa_shm_kv_read(ngx_wa_shm_t *shm, ngx_str_t *key, ngx_str_t *value,
+    size_t size, uint32_t *cas)
+{
+    uint32_t               key_hash, n_cas = 0;
+    uint64_t               expires = 0, now;
+    ngx_uint_t             i;
+    ngx_int_t              rc = NGX_BUSY;
+    ngx_msec_t             ttl;
+    ngx_atomic_uint_t      seq = 0;
+    ngx_wa_shm_kv_node_t  *n;
+    ngx_wa_shm_kv_t       *kv = ngx_wa_shm_get_kv(shm);
+
+    /**
+     * Copy the value of key into value->data (of size bytes) without
+     * taking the zone lock when possible. NGX_AGAIN: the buffer is too
+     * small and value->len holds the value size.
+     */
+
+    key_hash = ngx_crc32_long(key->data, key->len);
+
+    if (shm->cache) {
+        rc = ngx_wa_shm_kv_cache_get(shm, key, key_hash, value, size, cas);
+        if (rc != NGX_DECLINED) {
+            return rc;
+        }
+
+        rc = NGX_BUSY;
+    }
+
+    for (i = 0; i < NGX_WA_SHM_KV_READ_TRIES; i++) {
+        seq = kv->seq;
+        ngx_memory_barrier();
+
+        rc = ngx_wa_shm_kv_read_optimistic(shm, key, key_hash, value, size,
+                                           &n_cas, &expires);
+        if (rc != NGX_BUSY) {
+            break;
+        }
+
+        ngx_cpu_pause();
+    }
+
+    if (rc == NGX_BUSY) {
+        /* writers contention, fallback to locking */
+        ngx_wa_shm_lock(shm);
+
+        seq = kv->seq;
+
+        n = ngx_wa_shm_kv_get_node_locked(shm, key, key_hash);
+        if (n == NULL) {
+            rc = NGX_DECLINED;
+
+        } else {
+            n_cas = n->cas;
+            expires = n->expires;
+            value->len = n->value.len;
+
+            if (n->value.len > size) {
+                rc = NGX_AGAIN;
+
+            } else {
+                ngx_memcpy(value->data, n->value.data, n->value.len);
+                rc = NGX_OK;
+            }
+        }
+
+        ngx_wa_shm_unlock(shm);
+
+    } else if (rc == NGX_OK
+               && (shm->eviction == NGX_WA_SHM_EVICTION_LRU
+                   || shm->eviction == NGX_WA_SHM_EVICTION_SLRU)
+               && ngx_shmtx_trylock(&shm->shpool->mutex))
+    {
+        /* best-effort recency update, skipped under contention */
+        n = ngx_wa_shm_kv_lookup(kv, key, key_hash);
+        if (n) {
+            ngx_queue_remove(&n->queue);
+            ngx_queue_insert_head(queue_for_node(shm, n), &n->queue);
+        }
+
+        ngx_wa_shm_unlock(shm);
+    }
+
+    if (kv->sketch && rc != NGX_AGAIN) {
+        /* NGX_AGAIN: read again with a larger buffer */
+        ngx_wa_shm_kv_record(kv, key_hash, rc == NGX_OK);
+    }
+
+    if (rc != NGX_OK) {
+        return rc;
+    }
+
+    if (cas) {
+        *cas = n_cas;
+    }
+
+    if (shm->cache) {
+        ttl = shm->cache_ttl;
+
+        if (expires) {
+            /* do not serve the value past its expiration */
+            now = ngx_wa_shm_kv_now();
+            ttl = (expires > now) ? ngx_min(ttl, expires - now) : 0;
+        }
+
+        ngx_memory_barrier();
+
+        if (kv->seq == seq && ttl) {
+            /* no write since the value was read */
+            ngx_wa_shm_kv_cache_set(shm, key, key_hash, value, n_cas, seq,
+                                    ttl);
+        }
+    }
+
+    return NGX_OK;
+}
+
+
+static ngx_inline void
+node_queue_remove(ngx_wa_shm_t *shm, ngx_wa_shm_kv_node_t *n)
+{
+    if (shm->eviction == NGX_WA_SHM_EVICTION_LRU
+        || shm->eviction == NGX_WA_SHM_EVICTION_SLRU)
+    {
+        ngx_queue_remove(&n->queue);
+    }
+}
+
+
+static void
+ngx_wa_shm_kv_free_node(ngx_wa_shm_t *shm, ngx_wa_shm_kv_node_t *n)
+{
+    ngx_wa_shm_kv_t  *kv = ngx_wa_shm_get_kv(shm);
+
+    node_queue_remove(shm, n);
+
+    if (n->expires) {
+        ngx_queue_remove(&n->wheel);
+    }
+
+    if (shm->ordered) {
+        ngx_wa_shm_kv_skiplist_delete(kv, n);
+    }
+
+    ngx_wa_shm_kv_unlink(kv, n);
+    ngx_slab_free_locked(shm->shpool, n);
+
+    kv->nelts--;
+}
+
+
+static ngx_int_t
+queue_expire(ngx_wa_shm_t *shm, ngx_queue_t *queue, ngx_queue_t *q)
+{
+    ngx_wa_shm_kv_node_t  *node;
+
+    node = ngx_queue_data(q, ngx_wa_shm_kv_node_t, queue);
+
+    ngx_wa_shm_kv_free_node(shm, node);
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+slru_expire(ngx_wa_shm_t *shm, size_t size)
+{
+    ngx_int_t         i;
+    ngx_uint_t        n, start;
+    ngx_queue_t      *q, *queue;
+    ngx_wa_shm_kv_t  *kv = ngx_wa_shm_get_kv(shm);
+
+    n = NGX_WASM_SLRU_NQUEUES(shm->shpool);
+    start = slru_index_for_size(shm, size);
+
+    /* find a non-empty queue to expire something,
+       starting from the correct one, then into larger slots */
+    for (i = start; i < (ngx_int_t) n; i++) {
+        queue = &kv->eviction.slru_queues[i];
+
+        q = ngx_queue_last(queue);
+        if (q != ngx_queue_sentinel(queue)) {
+            return queue_expire(shm, queue, q);
+        }
+    }
+
+    /* fallback into freeing smaller slots */
+    for (i = start - 1; i >= 0; i--) {
+        queue = &kv->eviction.slru_queues[i];
+
+        q = ngx_queue_last(queue);
+        if (q != ngx_queue_sentinel(queue)) {
+            return queue_expire(shm, queue, q);
+        }
+    }
+
+    /* no luck */
+    return NGX_ABORT;
+}
+
+
+static ngx_int_t
+lru_expire(ngx_wa_shm_t *shm)
+{
+    ngx_wa_shm_kv_t  *kv = ngx_wa_shm_get_kv(shm);
+    ngx_queue_t      *q, *lru_queue = &kv->eviction.lru_queue;
+
+    q = ngx_queue_last(lru_queue);
+    if (q == ngx_queue_sentinel(lru_queue)) {
+        return NGX_ABORT;
+    }
+
+    return queue_expire(shm, lru_queue, q);
+}
+
+
+static ngx_wa_shm_kv_node_t *
+ngx_wa_shm_kv_victim(ngx_wa_shm_t *shm, size_t size)
+{
+    ngx_int_t         i, n, start;
+    ngx_queue_t      *queue;
+    ngx_wa_shm_kv_t  *kv = ngx_wa_shm_get_kv(shm);
+
+    /* the entry lru_expire() or slru_expire() would evict next */
+
+    if (shm->eviction == NGX_WA_SHM_EVICTION_LRU) {
+        queue = &kv->eviction.lru_queue;
+
+        return ngx_queue_empty(queue)
+               ? NULL
+               : ngx_queue_data(ngx_queue_last(queue), ngx_wa_shm_kv_node_t,
+                                queue);
+    }
+
+    n = NGX_WASM_SLRU_NQUEUES(shm->shpool);
+    start = slru_index_for_size(shm, size);
+
+    for (i = start; i < n; i++) {
+        queue = &kv->eviction.slru_queues[i];
+
+        if (!ngx_queue_empty(queue)) {
+            return ngx_queue_data(ngx_queue_last(queue), ngx_wa_shm_kv_node_t,
+                                  queue);
+        }
+    }
+
+    for (i = start - 1; i >= 0; i--) {
+        queue = &kv->eviction.slru_queues[i];
+
+        if (!ngx_queue_empty(queue)) {
+            return ngx_queue_data(ngx_queue_last(queue), ngx_wa_shm_kv_node_t,
+                                  queue);
+        }
+    }
+
+    return NULL;
+}
+
+
+static unsigned
+ngx_wa_shm_kv_admit(ngx_wa_shm_t *shm, uint32_t key_hash, size_t size)
+{
+    ngx_wa_shm_kv_node_t    *victim;
+    ngx_wa_shm_kv_sketch_t  *sk = ngx_wa_shm_get_kv(shm)->sketch;
+
+    /**
+     * TinyLFU: a new key may only evict an entry accessed less
+     * frequently than itself, so that bursts of one-off keys do not
+     * flush the working set.
+     */
+
+    victim = ngx_wa_shm_kv_victim(shm, size);
+
+    if (victim == NULL
+        || ngx_wa_shm_kv_sketch_estimate(sk, key_hash)
+           > ngx_wa_shm_kv_sketch_estimate(sk, victim->hash))
+    {
+        return 1;
+    }
+
+    (void) ngx_atomic_fetch_add(&sk->rejected, 1);
+
+    ngx_log_debug1(NGX_LOG_DEBUG_WASM, shm->log, 0,
+                   "wasm \"%V\" shm store: rejected new entry",
+                   &shm->name);
+
+    return 0;
+}
+
+
+static void
+ngx_wa_shm_kv_wheel_add(ngx_wa_shm_kv_wheel_t *w, ngx_wa_shm_kv_node_t *n)
+{
+    uint64_t    tick, delta;
+    ngx_uint_t  level;
+
+    /**
+     * Hierarchical timer wheel: level l holds entries due within
+     * SLOTS^(l + 1) ticks, in slots of SLOTS^l ticks each. Upper slots
+     * are cascaded into lower levels as the wheel turns.
+     */
+
+    tick = ngx_max(n->expires / NGX_WA_SHM_KV_WHEEL_TICK, w->tick);
+    delta = tick - w->tick;
+
+    if (delta >> (NGX_WA_SHM_KV_WHEEL_BITS * NGX_WA_SHM_KV_WHEEL_LEVELS)) {
+        /* beyond the wheel span: re-added when cascaded */
+        tick = w->tick + ((uint64_t) 1 << (NGX_WA_SHM_KV_WHEEL_BITS
+                                           * NGX_WA_SHM_KV_WHEEL_LEVELS)) - 1;
+        delta = tick - w->tick;
+    }
+
+    for (level = 0; level < NGX_WA_SHM_KV_WHEEL_LEVELS - 1; level++) {
+        if ((delta >> (NGX_WA_SHM_KV_WHEEL_BITS * (level + 1))) == 0) {
+            break;
+        }
+    }
+
+    ngx_queue_insert_tail(&w->slots[level][(tick >> (NGX_WA_SHM_KV_WHEEL_BITS
+                                                     * level))
+                                           & NGX_WA_SHM_KV_WHEEL_MASK],
+                          &n->wheel);
+}
+
+
+static void
+ngx_wa_shm_kv_wheel_cascade(ngx_wa_shm_kv_wheel_t *w, ngx_queue_t *slot)
+{
+    ngx_queue_t            head, *q;
+    ngx_wa_shm_kv_node_t  *n;
+
+    if (ngx_queue_empty(slot)) {
+        return;
+    }
+
+    /* detach the slot first: entries may be re-added to it */
+
+    ngx_queue_init(&head);
+    ngx_queue_add(&head, slot);
+    ngx_queue_init(slot);
+
+    while (!ngx_queue_empty(&head)) {
+        q = ngx_queue_head(&head);
+        ngx_queue_remove(q);
+
+        n = ngx_queue_data(q, ngx_wa_shm_kv_node_t, wheel);
+        ngx_wa_shm_kv_wheel_add(w, n);
+    }
+}
+
+
+static ngx_int_t
+ngx_wa_shm_kv_wheel_init(ngx_wa_shm_t *shm)
+{
+    ngx_uint_t              i, j;
+    ngx_wa_shm_kv_wheel_t  *w;
+    ngx_wa_shm_kv_t        *kv = ngx_wa_shm_get_kv(shm);
+
+    for ( ;; ) {
+        w = ngx_slab_alloc_locked(shm->shpool, sizeof(ngx_wa_shm_kv_wheel_t));
+        if (w) {
+            break;
+        }
+
+        if ((shm->eviction == NGX_WA_SHM_EVICTION_LRU
+             && lru_expire(shm) == NGX_OK) ||
+            (shm->eviction == NGX_WA_SHM_EVICTION_SLRU
+             && slru_expire(shm, sizeof(ngx_wa_shm_kv_wheel_t)) == NGX_OK))
+        {
+            continue;
+        }
+
+        ngx_wasm_log_error(NGX_LOG_CRIT, shm->log, 0,
+                           "\"%V\" shm store: "
+                           "no memory; cannot allocate expiration wheel",
+                           &shm->name);
+        return NGX_ERROR;
+    }
+
+    for (i = 0; i < NGX_WA_SHM_KV_WHEEL_LEVELS; i++) {
+        for (j = 0; j < NGX_WA_SHM_KV_WHEEL_SLOTS; j++) {
+            ngx_queue_init(&w->slots[i][j]);
+        }
+    }
+
+    w->tick = ngx_wa_shm_kv_now() / NGX_WA_SHM_KV_WHEEL_TICK;
+    kv->wheel = w;
+
+    ngx_log_debug1(NGX_LOG_DEBUG_WASM, shm->log, 0,
+                   "wasm \"%V\" shm store: expiration wheel initialized",
+                   &shm->name);
+
+    return NGX_OK;
+}
+
+
+static ngx_uint_t
+ngx_wa_shm_kv_sweep_locked(ngx_wa_shm_t *shm, uint64_t now)
+{
+    uint64_t                tick;
+    ngx_uint_t              level, n = 0;
+    ngx_queue_t            *slot;
+    ngx_wa_shm_kv_t        *kv = ngx_wa_shm_get_kv(shm);
+    ngx_wa_shm_kv_wheel_t  *w = kv->wheel;
+
+    /* only fully elapsed ticks: all entries of their slot are expired */
+
+    tick = now / NGX_WA_SHM_KV_WHEEL_TICK;
+
+    for ( /* void */ ; w->tick < tick; w->tick++) {
+
+        for (level = NGX_WA_SHM_KV_WHEEL_LEVELS - 1; level > 0; level--) {
+            if ((w->tick & (((uint64_t) 1 << (NGX_WA_SHM_KV_WHEEL_BITS
+                                              * level)) - 1)) == 0)
+            {
+                ngx_wa_shm_kv_wheel_cascade(w,
+                    &w->slots[level][(w->tick >> (NGX_WA_SHM_KV_WHEEL_BITS
+                                                  * level))
+                                     & NGX_WA_SHM_KV_WHEEL_MASK]);
+            }
+        }
+
+        slot = &w->slots[0][w->tick & NGX_WA_SHM_KV_WHEEL_MASK];
+
+        while (!ngx_queue_empty(slot)) {
+            if (n == NGX_WA_SHM_KV_SWEEP_MAX) {
+                /* resumed from this tick on the next sweep */
+                goto done;
+            }
+
+            if (n++ == 0) {
+                ngx_wa_shm_kv_write_begin(kv);
+            }
+
+            ngx_wa_shm_kv_free_node(shm,
+                                    ngx_queue_data(ngx_queue_head(slot),
+                                                   ngx_wa_shm_kv_node_t,
+                                                   wheel));
+        }
+    }
+
+done:
+
+    if (n) {
+        ngx_wa_shm_kv_write_end(kv);
+    }
+
+    return n;
+}
+
+
+static void
+ngx_wa_shm_kv_sweep(ngx_wa_shm_t *shm)
+{
+    ngx_uint_t        n;
+    ngx_wa_shm_kv_t  *kv = ngx_wa_shm_get_kv(shm);
+
+    if (kv->wheel == NULL) {
+        /* no TTL ever set */
+        return;
+    }
+
+    if (!ngx_shmtx_trylock(&shm->shpool->mutex)) {
+        /* busy, retried on the next sweep */
+        return;
+    }
+
+    n = ngx_wa_shm_kv_sweep_locked(shm, ngx_wa_shm_kv_now());
+
+    ngx_wa_shm_unlock(shm);
+
+    if (n) {
+        ngx_log_debug2(NGX_LOG_DEBUG_WASM, shm->log, 0,
+                       "wasm \"%V\" shm store: swept %ui expired entries",
+                       &shm->name, n);
+    }
+}
+
+
+static void
+ngx_wa_shm_kv_sweep_handler(ngx_event_t *ev)
+{
+    size_t                 i, j;
+    ngx_array_t           *shms = ngx_wasmx_shms((ngx_cycle_t *) ngx_cycle);
+    ngx_wa_shm_mapping_t  *mappings = shms->elts;
+    ngx_wa_shm_t          *shm;
+
+    for (i = 0; i < shms->nelts; i++) {
+        shm = mappings[i].zone->data;
+
+        if (shm->type != NGX_WA_SHM_TYPE_KV) {
+            continue;
+        }
+
+        for (j = 0; j < shm->nshards; j++) {
+            ngx_wa_shm_kv_sweep(&shm->shards[j]);
+        }
+
+        if (shm->nshards == 0) {
+            ngx_wa_shm_kv_sweep(shm);
+        }
+
+        if (shm->persist.len
+            && ngx_current_msec - shm->persisted_at
+               >= NGX_WA_SHM_KV_PERSIST_INTERVAL)
+        {
+            shm->persisted_at = ngx_current_msec;
+            ngx_wa_shm_kv_persist(shm, 0);
+        }
+    }
+
+    if (ngx_exiting || ngx_quit) {
+        return;
+    }
+
+    ngx_add_timer(ev, NGX_WA_SHM_KV_SWEEP_INTERVAL);
+}
+
+
+ngx_int_t
+ngx_wa_shm_kv_init_sweeper(ngx_cycle_t *cycle)
+{
+    size_t                 i;
+    ngx_array_t           *shms = ngx_wasmx_shms(cycle);
+    ngx_wa_shm_mapping_t  *mappings;
+    ngx_wa_shm_t          *shm;
+    ngx_event_t           *ev = &ngx_wa_shm_kv_sweep_ev;
+
+    /**
+     * Expired entries are swept by a single worker. Called once the
+     * event timers are initialized (i.e. from a subsystem module).
+     */
+
+    if (shms == NULL
+        || ev->timer_set
+        || (ngx_process != NGX_PROCESS_SINGLE
+            && (ngx_process != NGX_PROCESS_WORKER || ngx_worker != 0)))
+    {
+        return NGX_OK;
+    }
+
+    mappings = shms->elts;
+
+    for (i = 0; i < shms->nelts; i++) {
+        shm = mappings[i].zone->data;
+
+        if (shm->type == NGX_WA_SHM_TYPE_KV) {
+            break;
+        }
+    }
+
+    if (i == shms->nelts) {
+        return NGX_OK;
+    }
+
+    ev->handler = ngx_wa_shm_kv_sweep_handler;
+    ev->log = cycle->log;
+    ev->cancelable = 1;
+
+    ngx_add_timer(ev, NGX_WA_SHM_KV_SWEEP_INTERVAL);
+
+    return NGX_OK;
+}
+
+
+void
+ngx_wa_shm_kv_exit_sweeper(ngx_cycle_t *cycle)
+{
+    size_t                 i;
+    ngx_array_t           *shms = ngx_wasmx_shms(cycle);
+    ngx_wa_shm_mapping_t  *mappings;
+    ngx_wa_shm_t          *shm;
+
+    if (ngx_wa_shm_kv_sweep_ev.handler == NULL) {
+        /* not the sweeping worker */
+        return;
+    }
+
+    mappings = shms->elts;
+
+    for (i = 0; i < shms->nelts; i++) {
+        shm = mappings[i].zone->data;
+
+        if (shm->type == NGX_WA_SHM_TYPE_KV && shm->persist.len) {
+            /* final snapshot of graceful shutdowns and restarts */
+            ngx_wa_shm_kv_persist(shm, 1);
+        }
+    }
+}
+
+
+static ngx_int_t
+ngx_wa_shm_kv_set_helper(ngx_wa_shm_t *shm, ngx_str_t *key,
+    ngx_str_t *value, uint32_t cas, ngx_msec_t ttl, unsigned *written)
+{
+    size_t                 size;
+    uint32_t               key_hash = ngx_crc32_long(key->data, key->len);
+    uint64_t               now = 0;
+    unsigned               evicting = 0;
+    ngx_wa_shm_kv_t       *kv = ngx_wa_shm_get_kv(shm);
+    ngx_wa_shm_kv_node_t  *n, *old;
+
+    old = NULL;
+
+    ngx_wa_shm_kv_migrate(shm, NGX_WA_SHM_KV_MIGRATE_STEP);
+
+    if (value && kv->sketch) {
+        ngx_wa_shm_kv_sketch_age(kv->sketch);
+        ngx_wa_shm_kv_sketch_add(kv->sketch, key_hash);
+    }
+
+    if (value && ttl && kv->wheel == NULL) {
+        /* before the lookup: may evict entries */
+        if (ngx_wa_shm_kv_wheel_init(shm) != NGX_OK) {
+            return NGX_ERROR;
+        }
+    }
+
+    n = ngx_wa_shm_kv_lookup(kv, key, key_hash);
+
+    if (ttl || (n && n->expires)) {
+        now = ngx_wa_shm_kv_now();
+    }
+
+    if (n && ngx_wa_shm_kv_expired(n, now)) {
+        /* lazy expiration */
+        ngx_wa_shm_kv_free_node(shm, n);
+        n = NULL;
+    }
+
+    if (cas != (n == NULL ? 0 : n->cas)) {
+        *written = 0;
+        return NGX_OK;
+    }
+
+    if (value == NULL) {
+
+        /* delete */
+
+        if (n) {
+            ngx_wa_shm_kv_free_node(shm, n);
+            *written = 1;
+
+        } else {
+            *written = 0;
+        }
+
+        return NGX_OK;
+    }
+
+    /* set */
+
+    if (n && value->len > n->value.len) {
+        old = n;
+        n = NULL;
+    }
+
+    if (n == NULL && old == NULL) {
+        /* new key: make room in the index */
+
+        for ( ;; ) {
+            ngx_wa_shm_kv_grow(shm);
+
+            if (kv->nelts + 1 < kv->table.mask + 1) {
+                break;
+            }
+
+            if (kv->sketch) {
+                if (!ngx_wa_shm_kv_admit(shm, key_hash, 0)) {
+                    *written = 1;
+                    return NGX_OK;
+                }
+
+                evicting = 1;
+            }
+
+            if ((shm->eviction == NGX_WA_SHM_EVICTION_LRU
+                 && lru_expire(shm) == NGX_OK) ||
+                (shm->eviction == NGX_WA_SHM_EVICTION_SLRU
+                 && slru_expire(shm, 0) == NGX_OK))
+            {
+                continue;
+            }
+
+            ngx_wasm_log_error(NGX_LOG_CRIT, shm->log, 0,
+                               "\"%V\" shm store: "
+                               "no memory; cannot allocate pair with "
+                               "key size %d and value size %d",
+                               &shm->name, key->len, value->len);
+            return NGX_ERROR;
+        }
+    }
+
+    if (n == NULL) {
+        size = ngx_wa_shm_kv_node_size(shm, key, value->len);
+
+        for ( ;; ) {
+            n = ngx_slab_calloc_locked(shm->shpool, size);
+            if (n) {
+                break;
+            }
+
+            if (kv->sketch && old == NULL) {
+                if (!ngx_wa_shm_kv_admit(shm, key_hash, size)) {
+                    /* as if evicted right away */
+                    *written = 1;
+                    return NGX_OK;
+                }
+
+                evicting = 1;
+            }
+
+            if ((shm->eviction == NGX_WA_SHM_EVICTION_LRU
+                 && lru_expire(shm) == NGX_OK) ||
+                (shm->eviction == NGX_WA_SHM_EVICTION_SLRU
+                 && slru_expire(shm, size) == NGX_OK))
+            {
+                ngx_log_debug1(NGX_LOG_DEBUG_WASM, shm->log, 0,
+                               "wasm \"%V\" shm store: expired LRU entry",
+                               &shm->name);
+
+                continue;
+            }
+
+            ngx_wasm_log_error(NGX_LOG_CRIT, shm->log, 0,
+                               "\"%V\" shm store: "
+                               "no memory; cannot allocate pair with "
+                               "key size %d and value size %d",
+                               &shm->name, key->len, value->len);
+            return NGX_ERROR;
+        }
+
+        if (evicting) {
+            (void) ngx_atomic_fetch_add(&kv->sketch->admitted, 1);
+        }
+
+        /* the key follows the skiplist tower, if any */
+        n->key.data = (u_char *) n + size - key->len - value->len;
+        n->key.len = key->len;
+        n->hash = key_hash;
+        n->value.data = n->key.data + key->len;
+        n->value.len = value->len;
+
+        if (old) {
+            n->cas = old->cas;
+            ngx_wa_shm_kv_free_node(shm, old);
+        }
+
+        kv->nelts++;
+
+        ngx_memcpy(n->key.data, key->data, key->len);
+
+        ngx_wa_shm_kv_table_insert(&kv->table, n);
+
+        if (shm->ordered) {
+            ngx_wa_shm_kv_skiplist_insert(kv, n);
+        }
+
+        if (shm->eviction == NGX_WA_SHM_EVICTION_LRU
+            || shm->eviction == NGX_WA_SHM_EVICTION_SLRU)
+        {
+            ngx_queue_insert_head(queue_for_node(shm, n), &n->queue);
+        }
+
+    } else {
+        n->value.len = value->len;
+
+        if (shm->eviction == NGX_WA_SHM_EVICTION_LRU
+            || shm->eviction == NGX_WA_SHM_EVICTION_SLRU)
+        {
+            ngx_queue_remove(&n->queue);
+            ngx_queue_insert_head(queue_for_node(shm, n), &n->queue);
+        }
+    }
+
+    /* no failure after this point */
+
+    n->cas += 1;
+
+    if (n->expires) {
+        ngx_queue_remove(&n->wheel);
+        n->expires = 0;
     }
 
-    kv = ngx_slab_calloc(shm->shpool, size);
-    if (kv == NULL) {
-        return NGX_ERROR;
+    if (ttl) {
+        n->expires = now + ttl;
+        ngx_wa_shm_kv_wheel_add(kv->wheel, n);
     }
 
-    ngx_rbtree_init(&kv->rbtree, &kv->sentinel, ngx_str_rbtree_insert_value);
-    shm->data = kv;
-    shm->shpool->log_nomem = 0;
+    ngx_memcpy(n->value.data, value->data, value->len);
 
-    kv->nelts = 0;
+    *written = 1;
 
-    if (shm->eviction == NGX_WA_SHM_EVICTION_LRU) {
-        ngx_queue_init(&kv->eviction.lru_queue);
+    return NGX_OK;
+}
 
-    } else if (shm->eviction == NGX_WA_SHM_EVICTION_SLRU) {
-        for (i = 0; i < n; i++) {
-            ngx_queue_init(&kv->eviction.slru_queues[i]);
-        }
-    }
 
-    ngx_log_debug1(NGX_LOG_DEBUG_WASM, shm->log, 0,
-                   "wasm \"%V\" shm store: initialized", &shm->name);
+ngx_int_t
+ngx_wa_shm_kv_set_locked(ngx_wa_shm_t *shm, ngx_str_t *key,
+    ngx_str_t *value, uint32_t cas, ngx_msec_t ttl, unsigned *written)
+{
+    ngx_int_t         rc;
+    ngx_wa_shm_kv_t  *kv = ngx_wa_shm_get_kv(shm);
 
-    return NGX_OK;
+    /* invalidate concurrent optimistic reads */
+
+    ngx_wa_shm_kv_write_begin(kv);
+
+    rc = ngx_wa_shm_kv_set_helper(shm, key, value, cas, ttl, written);
+
+    ngx_wa_shm_kv_write_end(kv);
+
+    return rc;
 }
 
 
-static ngx_uint_t
-slru_index_for_size(ngx_wa_shm_t *shm, size_t size)
+ngx_int_t
+ngx_wa_shm_kv_stats(ngx_wa_shm_t *shm, ngx_wa_shm_kv_stats_t *stats)
 {
-    size_t      s;
-    ngx_uint_t  shift;
+    ngx_uint_t               i, nshards;
+    ngx_wa_shm_t            *shards;
+    ngx_wa_shm_kv_sketch_t  *sk;
 
-    if (size > NGX_WASM_SLAB_MAX_SIZE) {
-        return NGX_WASM_SLRU_NQUEUES(shm->shpool) - 1;
+    /* admission=tinylfu counters, summed over shards without locking */
+
+    if (!shm->admission) {
+        return NGX_DECLINED;
     }
 
-    if (size > shm->shpool->min_size) {
-        shift = 1;
-        for (s = size - 1; s >>= 1; shift++) { /* void */ }
+    ngx_memzero(stats, sizeof(ngx_wa_shm_kv_stats_t));
 
-        return shift - shm->shpool->min_shift;
+    shards = shm->nshards ? shm->shards : shm;
+    nshards = shm->nshards ? shm->nshards : 1;
+
+    for (i = 0; i < nshards; i++) {
+        sk = ngx_wa_shm_get_kv(&shards[i])->sketch;
+
+        stats->hits += sk->hits;
+        stats->misses += sk->misses;
+        stats->admitted += sk->admitted;
+        stats->rejected += sk->rejected;
     }
 
-    /**
-     * The above condition will always be true as long as
-     * sizeof(ngx_wa_shm_kv_node_t) > shm->shpool->min_size. We do not assert
-     * it unconditionally because min_size depends on the Nginx page size
-     * configuration. The fallback case is to use the first queue for small
-     * items, strictly following the Nginx slot selection algorithm.
-     */
-    return 0;
+    return NGX_OK;
 }
 
 
-static ngx_queue_t*
-queue_for_node(ngx_wa_shm_t *shm, ngx_wa_shm_kv_node_t *n)
+ngx_int_t
+ngx_wa_shm_kv_restore_locked(ngx_wa_shm_t *shm, ngx_str_t *key,
+    ngx_str_t *value, uint32_t cas, ngx_msec_t ttl)
 {
-    size_t            size;
-    ngx_wa_shm_kv_t  *kv = ngx_wa_shm_get_kv(shm);
+    unsigned               written;
+    ngx_int_t              rc;
+    ngx_wa_shm_kv_node_t  *n;
 
-    if (shm->eviction == NGX_WA_SHM_EVICTION_LRU) {
-        return &kv->eviction.lru_queue;
+    rc = ngx_wa_shm_kv_set_locked(shm, key, value, 0, ttl, &written);
+    if (rc != NGX_OK || !written) {
+        return rc;
     }
 
-    if (shm->eviction == NGX_WA_SHM_EVICTION_SLRU) {
-        size = sizeof(ngx_wa_shm_kv_node_t)
-               + n->key.str.len
-               + n->value.len;
+    /* CAS values obtained before a restart remain valid */
 
-        return &kv->eviction.slru_queues[slru_index_for_size(shm, size)];
+    n = ngx_wa_shm_kv_lookup(ngx_wa_shm_get_kv(shm), key,
+                             ngx_crc32_long(key->data, key->len));
+    if (n) {
+        /* NULL: not admitted (admission=tinylfu) */
+        n->cas = cas;
     }
 
-    /* unreachable */
-    ngx_wa_assert(0);
-    return NULL;
+    return NGX_OK;
 }
 
 
-static ngx_wa_shm_kv_node_t *
-ngx_wa_shm_rbtree_lookup(ngx_rbtree_t *rbtree, uint32_t key_hash)
+static void
+ngx_wa_shm_kv_batch(ngx_wa_shm_t *shm, unsigned begin)
 {
-    ngx_rbtree_node_t     *node, *sentinel;
-    ngx_wa_shm_kv_node_t  *n;
+    ngx_uint_t        i, nshards;
+    ngx_wa_shm_t     *shards;
+    ngx_wa_shm_kv_t  *kv;
 
-    node = rbtree->root;
-    sentinel = rbtree->sentinel;
+    /* one write section per shard for a whole batch */
 
-    while (node != sentinel) {
+    shards = shm->nshards ? shm->shards : shm;
+    nshards = shm->nshards ? shm->nshards : 1;
 
-        n = (ngx_wa_shm_kv_node_t *) node;
+    for (i = 0; i < nshards; i++) {
+        kv = ngx_wa_shm_get_kv(&shards[i]);
 
-        if (key_hash != node->key) {
-            node = (key_hash < node->key) ? node->left : node->right;
-            continue;
-        }
+        if (begin) {
+            ngx_wa_shm_kv_write_begin(kv);
 
-        return n;
+        } else {
+            ngx_wa_shm_kv_write_end(kv);
+        }
     }
-
-    return NULL;
 }
 
 
 ngx_int_t
-ngx_wa_shm_kv_get_locked(ngx_wa_shm_t *shm, ngx_str_t *key,
-    uint32_t *key_hash, ngx_str_t **value_out, uint32_t *cas)
+ngx_wa_shm_kv_set_many_locked(ngx_wa_shm_t *shm, ngx_str_t *keys,
+    ngx_str_t *values, ngx_uint_t nkeys, ngx_msec_t ttl,
+    ngx_uint_t *nwritten)
 {
-    ngx_wa_shm_kv_t       *kv = ngx_wa_shm_get_kv(shm);
+    uint32_t               cas;
+    unsigned               written;
+    ngx_int_t              rc = NGX_OK;
+    ngx_uint_t             i;
+    ngx_wa_shm_t          *shard;
     ngx_wa_shm_kv_node_t  *n;
 
-    if (key_hash) {
-        n = ngx_wa_shm_rbtree_lookup(&kv->rbtree, *key_hash);
+    /**
+     * Unconditional writes of nkeys keys of a locked zone, or deletes
+     * if values is NULL. Stops at the first allocation failure.
+     */
 
-    } else {
-        n = ngx_wa_shm_rbtree_lookup(&kv->rbtree,
-                                     ngx_crc32_long(key->data, key->len));
-    }
+    *nwritten = 0;
 
-    if (n == NULL) {
-        return NGX_DECLINED;
-    }
+    ngx_wa_shm_kv_batch(shm, 1);
 
-    if (shm->eviction == NGX_WA_SHM_EVICTION_LRU
-        || shm->eviction == NGX_WA_SHM_EVICTION_SLRU)
-    {
-        ngx_queue_remove(&n->queue);
-        ngx_queue_insert_head(queue_for_node(shm, n), &n->queue);
-    }
+    for (i = 0; i < nkeys; i++) {
+        shard = ngx_wa_shm_kv_shard(shm, &keys[i]);
 
-    if (value_out) {
-        *value_out = &n->value;
-    }
+        n = ngx_wa_shm_kv_lookup(ngx_wa_shm_get_kv(shard), &keys[i],
+                                 ngx_crc32_long(keys[i].data, keys[i].len));
 
-    if (cas) {
-        *cas = n->cas;
+        cas = (n && !ngx_wa_shm_kv_expired(n, n->expires
+                                              ? ngx_wa_shm_kv_now() : 0))
+              ? n->cas : 0;
+
+        rc = ngx_wa_shm_kv_set_helper(shard, &keys[i],
+                                      values ? &values[i] : NULL,
+                                      cas, ttl, &written);
+        if (rc != NGX_OK) {
+            break;
+        }
+
+        *nwritten += written;
     }
 
-    return NGX_OK;
+    ngx_wa_shm_kv_batch(shm, 0);
+
+    return rc;
 }
 
 
-static ngx_int_t
-queue_expire(ngx_wa_shm_t *shm, ngx_queue_t *queue, ngx_queue_t *q)
+ngx_int_t
+ngx_wa_shm_kv_delete_prefix_locked(ngx_wa_shm_t *shm, ngx_str_t *prefix,
+    ngx_uint_t *ndeleted)
 {
-    ngx_wa_shm_kv_node_t  *node;
-    ngx_wa_shm_kv_t       *kv = ngx_wa_shm_get_kv(shm);
-
-    node = ngx_queue_data(q, ngx_wa_shm_kv_node_t, queue);
+    ngx_uint_t              i, it, nshards;
+    ngx_wa_shm_t           *shards;
+    ngx_wa_shm_kv_t        *kv;
+    ngx_wa_shm_kv_node_t   *n, *next;
+    ngx_wa_shm_kv_node_t  **update[NGX_WA_SHM_KV_SKIPLIST_MAX];
 
-    ngx_queue_remove(q);
+    /**
+     * Ordered zones only visit matching keys, others walk their whole
+     * index; either way under a single lock acquisition.
+     */
 
-    ngx_rbtree_delete(&kv->rbtree, &node->key.node);
+    *ndeleted = 0;
 
-    ngx_slab_free_locked(shm->shpool, node);
+    shards = shm->nshards ? shm->shards : shm;
+    nshards = shm->nshards ? shm->nshards : 1;
 
-    kv->nelts--;
+    for (i = 0; i < nshards; i++) {
+        kv = ngx_wa_shm_get_kv(&shards[i]);
 
-    return NGX_OK;
-}
+        ngx_wa_shm_kv_write_begin(kv);
 
+        if (shm->ordered) {
+            ngx_wa_shm_kv_skiplist_find(kv, prefix, update);
 
-static ngx_int_t
-slru_expire(ngx_wa_shm_t *shm, size_t size)
-{
-    ngx_int_t         i;
-    ngx_uint_t        n, start;
-    ngx_queue_t      *q, *queue;
-    ngx_wa_shm_kv_t  *kv = ngx_wa_shm_get_kv(shm);
+            for (n = *update[0];
+                 n && ngx_wa_shm_kv_has_prefix(&n->key, prefix);
+                 n = next)
+            {
+                next = ngx_wa_shm_kv_tower(n)[0];
 
-    n = NGX_WASM_SLRU_NQUEUES(shm->shpool);
-    start = slru_index_for_size(shm, size);
+                ngx_wa_shm_kv_free_node(&shards[i], n);
+                (*ndeleted)++;
+            }
 
-    /* find a non-empty queue to expire something,
-       starting from the correct one, then into larger slots */
-    for (i = start; i < (ngx_int_t) n; i++) {
-        queue = &kv->eviction.slru_queues[i];
+        } else {
+            it = 0;
 
-        q = ngx_queue_last(queue);
-        if (q != ngx_queue_sentinel(queue)) {
-            return queue_expire(shm, queue, q);
-        }
-    }
+            while ((n = ngx_wa_shm_kv_next(kv, &it)) != NULL) {
+                if (!ngx_wa_shm_kv_has_prefix(&n->key, prefix)) {
+                    continue;
+                }
 
-    /* fallback into freeing smaller slots */
-    for (i = start - 1; i >= 0; i--) {
-        queue = &kv->eviction.slru_queues[i];
+                ngx_wa_shm_kv_free_node(&shards[i], n);
+                (*ndeleted)++;
 
-        q = ngx_queue_last(queue);
-        if (q != ngx_queue_sentinel(queue)) {
-            return queue_expire(shm, queue, q);
+                /* backward shift deletion: revisit the freed slot */
+                it--;
+            }
         }
+
+        ngx_wa_shm_kv_write_end(kv);
     }
 
-    /* no luck */
-    return NGX_ABORT;
+    return NGX_OK;
 }
 
 
-static ngx_int_t
-lru_expire(ngx_wa_shm_t *shm)
+static ngx_inline int64_t
+ngx_wa_shm_kv_int_decode(u_char *p)
 {
-    ngx_wa_shm_kv_t  *kv = ngx_wa_shm_get_kv(shm);
-    ngx_queue_t      *q, *lru_queue = &kv->eviction.lru_queue;
+    ngx_uint_t  i;
+    uint64_t    v = 0;
 
-    q = ngx_queue_last(lru_queue);
-    if (q == ngx_queue_sentinel(lru_queue)) {
-        return NGX_ABORT;
+    /* little-endian, as stored by Wasm guests */
+
+    for (i = 8; i > 0; i--) {
+        v = (v << 8) | p[i - 1];
     }
 
-    return queue_expire(shm, lru_queue, q);
+    return (int64_t) v;
 }
 
 
 static ngx_inline void
-node_queue_remove(ngx_wa_shm_t *shm, ngx_wa_shm_kv_node_t *n)
+ngx_wa_shm_kv_int_encode(u_char *p, int64_t value)
 {
-    if (shm->eviction == NGX_WA_SHM_EVICTION_LRU
-        || shm->eviction == NGX_WA_SHM_EVICTION_SLRU)
-    {
-        ngx_queue_remove(&n->queue);
+    ngx_uint_t  i;
+    uint64_t    v = (uint64_t) value;
+
+    for (i = 0; i < 8; i++) {
+        p[i] = (u_char) (v >> (i * 8));
     }
 }
 
 
-ngx_int_t
-ngx_wa_shm_kv_set_locked(ngx_wa_shm_t *shm, ngx_str_t *key,
-    ngx_str_t *value, uint32_t cas, unsigned *written)
+static unsigned
+ngx_wa_shm_kv_int_apply(ngx_wa_shm_kv_int_op_t *op, int64_t *value)
 {
-    size_t                 size;
-    uint32_t               key_hash = ngx_crc32_long(key->data, key->len);
-    ngx_wa_shm_kv_t       *kv = ngx_wa_shm_get_kv(shm);
-    ngx_wa_shm_kv_node_t  *n, *old;
-
-    old = NULL;
-    n = ngx_wa_shm_rbtree_lookup(&kv->rbtree, key_hash);
-
-    if (cas != (n == NULL ? 0 : n->cas)) {
-        *written = 0;
-        return NGX_OK;
-    }
-
-    if (value == NULL) {
-
-        /* delete */
+    int64_t  v = *value;
 
-        if (n) {
-            node_queue_remove(shm, n);
+    if (op->cmpxchg) {
+        if (v != op->expected) {
+            return 0;
+        }
 
-            ngx_rbtree_delete(&kv->rbtree, &n->key.node);
-            ngx_slab_free_locked(shm->shpool, n);
-            *written = 1;
-            kv->nelts--;
+        v = op->operand;
 
-        } else {
-            *written = 0;
+    } else {
+        if (op->operand > 0 ? v > INT64_MAX - op->operand
+                            : v < INT64_MIN - op->operand)
+        {
+            /* overflow */
+            return 0;
         }
 
-        return NGX_OK;
+        v += op->operand;
     }
 
-    /* set */
-
-    if (n && value->len > n->value.len) {
-        old = n;
-        n = NULL;
+    if (v < op->min || v > op->max) {
+        return 0;
     }
 
-    if (n == NULL) {
-        size = sizeof(ngx_wa_shm_kv_node_t) + key->len + value->len;
+    *value = v;
 
-        for ( ;; ) {
-            n = ngx_slab_calloc_locked(shm->shpool, size);
-            if (n) {
-                break;
-            }
+    return 1;
+}
 
-            if ((shm->eviction == NGX_WA_SHM_EVICTION_LRU
-                 && lru_expire(shm) == NGX_OK) ||
-                (shm->eviction == NGX_WA_SHM_EVICTION_SLRU
-                 && slru_expire(shm, size) == NGX_OK))
-            {
-                ngx_log_debug1(NGX_LOG_DEBUG_WASM, shm->log, 0,
-                               "wasm \"%V\" shm store: expired LRU entry",
-                               &shm->name);
 
-                continue;
-            }
+ngx_int_t
+ngx_wa_shm_kv_int_op_locked(ngx_wa_shm_t *shm, ngx_str_t *key,
+    ngx_wa_shm_kv_int_op_t *op, int64_t *value, unsigned *written)
+{
+    u_char                 buf[8];
+    int64_t                v;
+    uint32_t               key_hash;
+    ngx_int_t              rc;
+    ngx_str_t              str;
+    ngx_wa_shm_kv_t       *kv = ngx_wa_shm_get_kv(shm);
+    ngx_wa_shm_kv_node_t  *n;
 
-            ngx_wasm_log_error(NGX_LOG_CRIT, shm->log, 0,
-                               "\"%V\" shm store: "
-                               "no memory; cannot allocate pair with "
-                               "key size %d and value size %d",
-                               &shm->name, key->len, value->len);
-            return NGX_ERROR;
-        }
+    /**
+     * Read-modify-write of 8-byte integers in a single critical section,
+     * sparing guests a get/CAS-set retry loop under contention. Existing
+     * values are updated in place (keeping their TTL); missing keys start
+     * from op->init and are created with op->ttl. On a bounds or compare
+     * failure nothing is written and *value holds the current value.
+     * NGX_BUSY: a missing key was not admitted in the zone.
+     */
 
-        n->key.str.data = (u_char *) n + sizeof(ngx_wa_shm_kv_node_t);
-        n->key.str.len = key->len;
-        n->key.node.key = ngx_crc32_long(key->data, key->len);
-        n->value.data = n->key.str.data + key->len;
-        n->value.len = value->len;
+    key_hash = ngx_crc32_long(key->data, key->len);
 
-        if (old) {
-            node_queue_remove(shm, old);
+    n = ngx_wa_shm_kv_get_node_locked(shm, key, key_hash);
 
-            n->cas = old->cas;
-            ngx_rbtree_delete(&kv->rbtree, &old->key.node);
-            ngx_slab_free_locked(shm->shpool, old);
+    if (n && n->value.len != sizeof(int64_t)) {
+        return NGX_DECLINED;
+    }
 
-        } else {
-            kv->nelts++;
-        }
+    v = n ? ngx_wa_shm_kv_int_decode(n->value.data) : op->init;
+
+    *value = v;
+    *written = 0;
 
-        ngx_memcpy(n->key.str.data, key->data, key->len);
-        n->key.str.len = key->len;
+    if (!ngx_wa_shm_kv_int_apply(op, &v)) {
+        return NGX_OK;
+    }
 
-        ngx_rbtree_insert(&kv->rbtree, &n->key.node);
+    ngx_wa_shm_kv_write_begin(kv);
 
-        if (shm->eviction == NGX_WA_SHM_EVICTION_LRU
-            || shm->eviction == NGX_WA_SHM_EVICTION_SLRU)
-        {
-            ngx_queue_insert_head(queue_for_node(shm, n), &n->queue);
-        }
+    if (n) {
+        ngx_wa_shm_kv_int_encode(n->value.data, v);
+        n->cas += 1;
+        *written = 1;
+        rc = NGX_OK;
 
     } else {
-        n->value.len = value->len;
+        ngx_wa_shm_kv_int_encode(buf, v);
 
-        if (shm->eviction == NGX_WA_SHM_EVICTION_LRU
-            || shm->eviction == NGX_WA_SHM_EVICTION_SLRU)
+        str.data = buf;
+        str.len = sizeof(buf);
+
+        rc = ngx_wa_shm_kv_set_helper(shm, key, &str, 0, op->ttl, written);
+
+        if (rc == NGX_OK
+            && *written
+            && ngx_wa_shm_kv_lookup(kv, key, key_hash) == NULL)
         {
-            ngx_queue_remove(&n->queue);
-            ngx_queue_insert_head(queue_for_node(shm, n), &n->queue);
+            /* not admitted (admission=tinylfu): the counter does not exist */
+            *written = 0;
+            rc = NGX_BUSY;
         }
     }
 
-    /* no failure after this point */
-
-    n->cas += 1;
-
-    ngx_memcpy(n->value.data, value->data, value->len);
+    ngx_wa_shm_kv_write_end(kv);
 
-    *written = 1;
+    if (rc == NGX_OK && *written) {
+        *value = v;
+    }
 
-    return NGX_OK;
+    return rc;
 }
 
 
@@ -441,5 +2242,8 @@ ngx_wa_shm_kv_resolve_key(ngx_str_t *key, ngx_wa_shm_kv_key_t *out)
         return NGX_ABORT;
     }
 
+    /* shards are picked from the stored (unstripped) key */
+    out->shm = ngx_wa_shm_kv_shard(out->shm, key);
+
     return NGX_OK;
 }
@@ -5,17 +5,106 @@
 #include <ngx_wa_shm.h>
 
 
+#define NGX_WA_SHM_KV_WHEEL_BITS     6
+#define NGX_WA_SHM_KV_WHEEL_SLOTS    (1 << NGX_WA_SHM_KV_WHEEL_BITS)
+#define NGX_WA_SHM_KV_WHEEL_LEVELS   3
+#define NGX_WA_SHM_KV_SKIPLIST_MAX   16
+#define NGX_WA_SHM_KV_SKETCH_DEPTH   4
+
+
+typedef struct {
+    ngx_str_t           key;
+    ngx_str_t           value;
+    uint32_t            hash;
+    uint32_t            cas;
+    ngx_queue_t         queue;
+    uint64_t            expires;  /* ms since epoch, 0: never */
+    ngx_queue_t         wheel;    /* if expires */
+} ngx_wa_shm_kv_node_t;
+
+
+typedef struct {
+    uint32_t                 hash;
+    ngx_wa_shm_kv_node_t    *node;   /* NULL: empty slot */
+} ngx_wa_shm_kv_slot_t;
+
+
+typedef struct {
+    ngx_wa_shm_kv_slot_t    *slots;
+    ngx_uint_t               mask;   /* number of slots - 1 */
+} ngx_wa_shm_kv_table_t;
+
+
+typedef struct {
+    uint64_t                 tick;     /* next tick to sweep */
+    ngx_queue_t              slots[NGX_WA_SHM_KV_WHEEL_LEVELS]
+                                  [NGX_WA_SHM_KV_WHEEL_SLOTS];
+} ngx_wa_shm_kv_wheel_t;
+
+
+typedef struct {
+    ngx_atomic_t             hits;
+    ngx_atomic_t             misses;
+    ngx_atomic_t             admitted;  /* new keys evicting others */
+    ngx_atomic_t             rejected;  /* new keys refused */
+    ngx_atomic_t             additions; /* since the last aging */
+    ngx_uint_t               sample;    /* additions between agings */
+    ngx_uint_t               mask;      /* counters per row - 1 */
+    u_char                   counters[0]; /* SKETCH_DEPTH rows */
+} ngx_wa_shm_kv_sketch_t;
+
+
 typedef struct {
-    ngx_rbtree_t        rbtree;
-    ngx_rbtree_node_t   sentinel;
-    ngx_uint_t          nelts;
+    ngx_uint_t               hits;
+    ngx_uint_t               misses;
+    ngx_uint_t               admitted;
+    ngx_uint_t               rejected;
+} ngx_wa_shm_kv_stats_t;
+
+
+typedef struct {
+    ngx_wa_shm_kv_table_t    table;
+    ngx_wa_shm_kv_table_t    old;      /* being migrated into table */
+    ngx_uint_t               migrated; /* old slots migrated so far */
+    ngx_uint_t               nelts;
+    ngx_atomic_t             seq;      /* odd while a write is in progress */
+    ngx_wa_shm_kv_wheel_t   *wheel;    /* allocated on first TTL */
+    ngx_wa_shm_kv_node_t   **skiplist; /* ordered zones: head tower */
+    ngx_wa_shm_kv_sketch_t  *sketch;   /* admission=tinylfu */
     union {
-        ngx_queue_t     lru_queue;
-        ngx_queue_t     slru_queues[0];
+        ngx_queue_t          lru_queue;
+        ngx_queue_t          slru_queues[0];
     } eviction;
 } ngx_wa_shm_kv_t;
 
 
+typedef struct {
+    ngx_str_t           prefix;     /* keys starting with prefix */
+    ngx_str_t           start;      /* keys >= start */
+    ngx_str_t           end;        /* keys < end, empty: unbounded */
+    unsigned            exclusive:1;  /* keys > start (resumed scans) */
+} ngx_wa_shm_kv_range_t;
+
+
+typedef struct {
+    ngx_uint_t          shard;
+    ngx_uint_t          it;         /* ngx_wa_shm_kv_next() position */
+    ngx_uint_t          seq;        /* zone writes when started */
+    ngx_uint_t          started;
+} ngx_wa_shm_kv_cursor_t;
+
+
+typedef struct {
+    int64_t             operand;    /* added, or stored if cmpxchg */
+    int64_t             expected;   /* if cmpxchg */
+    int64_t             init;       /* value of missing keys */
+    int64_t             min;        /* bounds of the result */
+    int64_t             max;
+    ngx_msec_t          ttl;        /* of keys created by the operation */
+    unsigned            cmpxchg:1;
+} ngx_wa_shm_kv_int_op_t;
+
+
 typedef struct {
     ngx_str_t           namespace;
     ngx_str_t           key;
@@ -24,22 +113,63 @@ typedef struct {
 } ngx_wa_shm_kv_key_t;
 
 
-typedef struct {
-    ngx_str_node_t      key;
-    ngx_str_t           value;
-    uint32_t            cas;
-    ngx_queue_t         queue;
-} ngx_wa_shm_kv_node_t;
-
-
 ngx_wa_shm_kv_t *ngx_wa_shm_get_kv(ngx_wa_shm_t *shm);
 
 ngx_int_t ngx_wa_shm_kv_init(ngx_wa_shm_t *shm);
 ngx_int_t ngx_wa_shm_kv_get_locked(ngx_wa_shm_t *shm,
     ngx_str_t *key, uint32_t *key_hash, ngx_str_t **value_out, uint32_t *cas);
+ngx_int_t ngx_wa_shm_kv_read(ngx_wa_shm_t *shm, ngx_str_t *key,
+    ngx_str_t *value, size_t size, uint32_t *cas);
 ngx_int_t ngx_wa_shm_kv_set_locked(ngx_wa_shm_t *shm,
-    ngx_str_t *key, ngx_str_t *value, uint32_t cas, unsigned *written);
+    ngx_str_t *key, ngx_str_t *value, uint32_t cas, ngx_msec_t ttl,
+    unsigned *written);
+ngx_int_t ngx_wa_shm_kv_set_many_locked(ngx_wa_shm_t *shm,
+    ngx_str_t *keys, ngx_str_t *values, ngx_uint_t nkeys, ngx_msec_t ttl,
+    ngx_uint_t *nwritten);
+ngx_int_t ngx_wa_shm_kv_delete_prefix_locked(ngx_wa_shm_t *shm,
+    ngx_str_t *prefix, ngx_uint_t *ndeleted);
+ngx_int_t ngx_wa_shm_kv_int_op_locked(ngx_wa_shm_t *shm, ngx_str_t *key,
+    ngx_wa_shm_kv_int_op_t *op, int64_t *value, unsigned *written);
+ngx_int_t ngx_wa_shm_kv_stats(ngx_wa_shm_t *shm, ngx_wa_shm_kv_stats_t *stats);
+ngx_int_t ngx_wa_shm_kv_restore_locked(ngx_wa_shm_t *shm, ngx_str_t *key,
+    ngx_str_t *value, uint32_t cas, ngx_msec_t ttl);
 ngx_int_t ngx_wa_shm_kv_resolve_key(ngx_str_t *key, ngx_wa_shm_kv_key_t *out);
+ngx_wa_shm_kv_node_t *ngx_wa_shm_kv_next(ngx_wa_shm_kv_t *kv, ngx_uint_t *it);
+ngx_int_t ngx_wa_shm_kv_scan_locked(ngx_wa_shm_t *shm,
+    ngx_wa_shm_kv_range_t *range, ngx_str_t **keys, ngx_uint_t max,
+    ngx_uint_t *nkeys);
+ngx_int_t ngx_wa_shm_kv_keys_locked(ngx_wa_shm_t *shm,
+    ngx_wa_shm_kv_cursor_t *cursor, ngx_str_t **keys, ngx_uint_t max,
+    ngx_uint_t *nkeys);
+
+ngx_int_t ngx_wa_shm_kv_init_shards(ngx_wa_shm_t *shm, ngx_cycle_t *cycle);
+ngx_int_t ngx_wa_shm_kv_init_sweeper(ngx_cycle_t *cycle);
+void ngx_wa_shm_kv_exit_sweeper(ngx_cycle_t *cycle);
+
+/* persist= snapshots */
+ngx_int_t ngx_wa_shm_kv_restore(ngx_wa_shm_t *shm);
+void ngx_wa_shm_kv_persist(ngx_wa_shm_t *shm, unsigned block);
+
+/* per-worker cache */
+ngx_int_t ngx_wa_shm_kv_cache_init(ngx_wa_shm_t *shm, ngx_pool_t *pool);
+ngx_int_t ngx_wa_shm_kv_cache_get(ngx_wa_shm_t *shm, ngx_str_t *key,
+    uint32_t key_hash, ngx_str_t *value, size_t size, uint32_t *cas);
+void ngx_wa_shm_kv_cache_set(ngx_wa_shm_t *shm, ngx_str_t *key,
+    uint32_t key_hash, ngx_str_t *value, uint32_t cas, ngx_atomic_uint_t seq,
+    ngx_msec_t ttl);
+
+
+static ngx_inline ngx_wa_shm_t *
+ngx_wa_shm_kv_shard(ngx_wa_shm_t *shm, ngx_str_t *key)
+{
+    if (shm->nshards == 0) {
+        return shm;
+    }
+
+    /* not crc32: shards would only use a fraction of their index slots */
+    return &shm->shards[ngx_murmur_hash2(key->data, key->len)
+                        % shm->nshards];
+}
 
 
 #endif /* _NGX_WA_SHM_KV_H_INCLUDED_ */
@@ -0,0 +1,154 @@
+#ifndef DDEBUG
+#define DDEBUG 0
+#endif
+#include "ddebug.h"
+
+#include <ngx_wasm.h>
+#include <ngx_wa_shm_kv.h>
+
+
+typedef struct {
+    ngx_str_node_t         sn;
+    ngx_queue_t            queue;
+    ngx_atomic_uint_t      seq;      /* kv->seq when read */
+    ngx_msec_t             expires;
+    uint32_t               cas;
+    ngx_str_t              value;
+} ngx_wa_shm_kv_cache_node_t;
+
+
+typedef struct {
+    ngx_rbtree_t           rbtree;
+    ngx_rbtree_node_t      sentinel;
+    ngx_queue_t            lru;
+    ngx_uint_t             nelts;
+} ngx_wa_shm_kv_cache_t;
+
+
+ngx_int_t
+ngx_wa_shm_kv_cache_init(ngx_wa_shm_t *shm, ngx_pool_t *pool)
+{
+    ngx_wa_shm_kv_cache_t  *cache;
+
+    ngx_wa_assert(shm->type == NGX_WA_SHM_TYPE_KV);
+    ngx_wa_assert(shm->cache_max);
+
+    cache = ngx_pcalloc(pool, sizeof(ngx_wa_shm_kv_cache_t));
+    if (cache == NULL) {
+        return NGX_ERROR;
+    }
+
+    ngx_rbtree_init(&cache->rbtree, &cache->sentinel,
+                    ngx_str_rbtree_insert_value);
+    ngx_queue_init(&cache->lru);
+
+    shm->cache = cache;
+
+    ngx_log_debug2(NGX_LOG_DEBUG_WASM, shm->log, 0,
+                   "wasm \"%V\" shm store: worker cache initialized "
+                   "(max: %ui)", &shm->name, shm->cache_max);
+
+    return NGX_OK;
+}
+
+
+static void
+ngx_wa_shm_kv_cache_delete(ngx_wa_shm_kv_cache_t *cache,
+    ngx_wa_shm_kv_cache_node_t *cn)
+{
+    ngx_queue_remove(&cn->queue);
+    ngx_rbtree_delete(&cache->rbtree, &cn->sn.node);
+    ngx_free(cn);
+
+    cache->nelts--;
+}
+
+
+ngx_int_t
+ngx_wa_shm_kv_cache_get(ngx_wa_shm_t *shm, ngx_str_t *key, uint32_t key_hash,
+    ngx_str_t *value, size_t size, uint32_t *cas)
+{
+    ngx_atomic_uint_t            seq;
+    ngx_wa_shm_kv_t             *kv = ngx_wa_shm_get_kv(shm);
+    ngx_wa_shm_kv_cache_t       *cache = shm->cache;
+    ngx_wa_shm_kv_cache_node_t  *cn;
+
+    cn = (ngx_wa_shm_kv_cache_node_t *)
+             ngx_str_rbtree_lookup(&cache->rbtree, key, key_hash);
+    if (cn == NULL) {
+        return NGX_DECLINED;
+    }
+
+    seq = kv->seq;
+    ngx_memory_barrier();
+
+    if (cn->seq != seq
+        || (ngx_msec_int_t) (cn->expires - ngx_current_msec) <= 0)
+    {
+        /* zone written to since, or expired */
+        ngx_wa_shm_kv_cache_delete(cache, cn);
+        return NGX_DECLINED;
+    }
+
+    ngx_queue_remove(&cn->queue);
+    ngx_queue_insert_head(&cache->lru, &cn->queue);
+
+    value->len = cn->value.len;
+
+    if (cn->value.len > size) {
+        return NGX_AGAIN;
+    }
+
+    ngx_memcpy(value->data, cn->value.data, cn->value.len);
+
+    if (cas) {
+        *cas = cn->cas;
+    }
+
+    return NGX_OK;
+}
+
+
+void
+ngx_wa_shm_kv_cache_set(ngx_wa_shm_t *shm, ngx_str_t *key, uint32_t key_hash,
+    ngx_str_t *value, uint32_t cas, ngx_atomic_uint_t seq, ngx_msec_t ttl)
+{
+    ngx_queue_t                 *q;
+    ngx_wa_shm_kv_cache_t       *cache = shm->cache;
+    ngx_wa_shm_kv_cache_node_t  *cn;
+
+    cn = (ngx_wa_shm_kv_cache_node_t *)
+             ngx_str_rbtree_lookup(&cache->rbtree, key, key_hash);
+    if (cn) {
+        ngx_wa_shm_kv_cache_delete(cache, cn);
+
+    } else if (cache->nelts >= shm->cache_max) {
+        q = ngx_queue_last(&cache->lru);
+        cn = ngx_queue_data(q, ngx_wa_shm_kv_cache_node_t, queue);
+        ngx_wa_shm_kv_cache_delete(cache, cn);
+    }
+
+    cn = ngx_alloc(sizeof(ngx_wa_shm_kv_cache_node_t)
+                   + key->len + value->len, shm->log);
+    if (cn == NULL) {
+        /* not cached */
+        return;
+    }
+
+    cn->sn.str.data = (u_char *) cn + sizeof(ngx_wa_shm_kv_cache_node_t);
+    cn->sn.str.len = key->len;
+    cn->sn.node.key = key_hash;
+    cn->value.data = cn->sn.str.data + key->len;
+    cn->value.len = value->len;
+    cn->seq = seq;
+    cn->cas = cas;
+    cn->expires = ngx_current_msec + ttl;
+
+    ngx_memcpy(cn->sn.str.data, key->data, key->len);
+    ngx_memcpy(cn->value.data, value->data, value->len);
+
+    ngx_rbtree_insert(&cache->rbtree, &cn->sn.node);
+    ngx_queue_insert_head(&cache->lru, &cn->queue);
+
+    cache->nelts++;
+}
@@ -0,0 +1,593 @@
+#ifndef DDEBUG
+#define DDEBUG 0
+#endif
+#include "ddebug.h"
+
+#include <ngx_wasm.h>
+#include <ngx_wa_shm_kv.h>
+
+
+#define NGX_WA_SHM_KV_PERSIST_MAGIC    "WAKV"
+#define NGX_WA_SHM_KV_PERSIST_VERSION  1
+#define NGX_WA_SHM_KV_PERSIST_CHUNK    256  /* entries per lock hold */
+#define NGX_WA_SHM_KV_PERSIST_RETRIES  3
+
+
+/**
+ * Snapshot file layout: a header followed by nelts entries, each
+ * followed by its key and value. Integers are in host byte order.
+ */
+
+typedef struct {
+    u_char              magic[4];
+    uint32_t            version;
+    uint32_t            nelts;
+    uint32_t            crc;      /* of everything after the header */
+    uint64_t            size;     /* of everything after the header */
+} ngx_wa_shm_kv_persist_header_t;
+
+
+typedef struct {
+    uint64_t            expires;  /* ms since epoch, 0: never */
+    uint32_t            cas;
+    uint32_t            key_len;
+    uint32_t            value_len;
+} ngx_wa_shm_kv_persist_entry_t;
+
+
+typedef struct ngx_wa_shm_kv_persist_chunk_s  ngx_wa_shm_kv_persist_chunk_t;
+
+struct ngx_wa_shm_kv_persist_chunk_s {
+    ngx_wa_shm_kv_persist_chunk_t   *next;
+    size_t                           size;      /* of the entries following */
+};
+
+
+typedef struct {
+#if (NGX_THREADS)
+    ngx_thread_task_t                task;
+#endif
+    ngx_wa_shm_t                    *shm;
+    ngx_wa_shm_kv_persist_chunk_t   *chunks;
+    ngx_wa_shm_kv_persist_chunk_t  **last;
+    ngx_uint_t                       nelts;
+    ngx_uint_t                       seq;       /* zone writes when copied */
+    size_t                           size;
+    u_char                          *tmp;       /* temporary file path */
+    char                            *failed;    /* failed operation */
+    ngx_err_t                        err;
+} ngx_wa_shm_kv_persist_ctx_t;
+
+
+static void
+ngx_wa_shm_kv_persist_free(ngx_wa_shm_kv_persist_chunk_t *c)
+{
+    ngx_wa_shm_kv_persist_chunk_t  *next;
+
+    for ( /* void */ ; c; c = next) {
+        next = c->next;
+        ngx_free(c);
+    }
+}
+
+
+static ngx_int_t
+ngx_wa_shm_kv_persist_shard(ngx_wa_shm_kv_persist_ctx_t *ctx,
+    ngx_wa_shm_t *shm)
+{
+    u_char                          *p;
+    size_t                           size;
+    ngx_uint_t                       i, it, end, max, nelts, retries;
+    ngx_atomic_uint_t                seq;
+    ngx_wa_shm_kv_t                 *kv = ngx_wa_shm_get_kv(shm);
+    ngx_wa_shm_kv_node_t            *n;
+    ngx_wa_shm_kv_persist_chunk_t   *c, *chunks, **last;
+    ngx_wa_shm_kv_persist_entry_t    e;
+
+    /**
+     * Copied in chunks of NGX_WA_SHM_KV_PERSIST_CHUNK entries, releasing
+     * the lock in between so that writers are not held up by large zones.
+     * Writes move entries across the cursor (e.g. deletions shifting
+     * slots back): the shard is then copied again, and in a single lock
+     * hold once retries are exhausted.
+     */
+
+    retries = 0;
+
+again:
+
+    chunks = NULL;
+    last = &chunks;
+    nelts = 0;
+    it = 0;
+
+    max = (retries < NGX_WA_SHM_KV_PERSIST_RETRIES)
+          ? NGX_WA_SHM_KV_PERSIST_CHUNK
+          : NGX_MAX_UINT32_VALUE;
+
+    ngx_wa_shm_lock(shm);
+
+    seq = kv->seq;
+
+    for ( ;; ) {
+        size = 0;
+        end = it;
+
+        for (i = 0; i < max && (n = ngx_wa_shm_kv_next(kv, &end)); i++) {
+            size += sizeof(ngx_wa_shm_kv_persist_entry_t)
+                    + n->key.len + n->value.len;
+        }
+
+        if (i == 0) {
+            break;
+        }
+
+        c = ngx_alloc(sizeof(ngx_wa_shm_kv_persist_chunk_t) + size, shm->log);
+        if (c == NULL) {
+            ngx_wa_shm_unlock(shm);
+            ngx_wa_shm_kv_persist_free(chunks);
+            return NGX_ERROR;
+        }
+
+        p = (u_char *) (c + 1);
+
+        /* entries expiring in between are skipped: size is an upper bound */
+
+        while (it < end && (n = ngx_wa_shm_kv_next(kv, &it))) {
+            if (it > end) {
+                /* past the sized entries */
+                break;
+            }
+
+            ngx_memzero(&e, sizeof(ngx_wa_shm_kv_persist_entry_t));
+
+            e.expires = n->expires;
+            e.cas = n->cas;
+            e.key_len = n->key.len;
+            e.value_len = n->value.len;
+
+            p = ngx_cpymem(p, &e, sizeof(ngx_wa_shm_kv_persist_entry_t));
+            p = ngx_cpymem(p, n->key.data, n->key.len);
+            p = ngx_cpymem(p, n->value.data, n->value.len);
+
+            nelts++;
+        }
+
+        it = end;
+
+        c->next = NULL;
+        c->size = p - (u_char *) (c + 1);
+
+        *last = c;
+        last = &c->next;
+
+        if (retries == NGX_WA_SHM_KV_PERSIST_RETRIES) {
+            /* single lock hold */
+            continue;
+        }
+
+        ngx_wa_shm_unlock(shm);
+
+        /* writers get in */
+
+        ngx_wa_shm_lock(shm);
+
+        if (kv->seq != seq) {
+            ngx_wa_shm_unlock(shm);
+            ngx_wa_shm_kv_persist_free(chunks);
+            retries++;
+            goto again;
+        }
+    }
+
+    ctx->seq += seq;
+
+    ngx_wa_shm_unlock(shm);
+
+    ctx->nelts += nelts;
+    *ctx->last = chunks;
+
+    for (c = chunks; c; c = c->next) {
+        ctx->size += c->size;
+        ctx->last = &c->next;
+    }
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_wa_shm_kv_persist_write(ngx_fd_t fd, u_char *p, size_t size)
+{
+    ssize_t  n;
+
+    while (size) {
+        n = ngx_write_fd(fd, p, size);
+        if (n == -1) {
+            return NGX_ERROR;
+        }
+
+        p += n;
+        size -= n;
+    }
+
+    return NGX_OK;
+}
+
+
+static void
+ngx_wa_shm_kv_persist_handler(void *data, ngx_log_t *log)
+{
+    ngx_fd_t                         fd;
+    ngx_wa_shm_kv_persist_ctx_t     *ctx = data;
+    ngx_wa_shm_kv_persist_chunk_t   *c;
+    ngx_wa_shm_kv_persist_header_t   h;
+
+    /**
+     * Runs in a thread pool when available: no logging nor shm access,
+     * the outcome is reported by ngx_wa_shm_kv_persist_done.
+     */
+
+    ngx_memzero(&h, sizeof(ngx_wa_shm_kv_persist_header_t));
+    ngx_memcpy(h.magic, NGX_WA_SHM_KV_PERSIST_MAGIC, 4);
+
+    h.version = NGX_WA_SHM_KV_PERSIST_VERSION;
+    h.nelts = ctx->nelts;
+    h.size = ctx->size;
+
+    ngx_crc32_init(h.crc);
+
+    for (c = ctx->chunks; c; c = c->next) {
+        ngx_crc32_update(&h.crc, (u_char *) (c + 1), c->size);
+    }
+
+    ngx_crc32_final(h.crc);
+
+    /* values may be secrets: owner only, not kept from a stale file */
+
+    (void) ngx_delete_file(ctx->tmp);
+
+    fd = ngx_open_file(ctx->tmp, NGX_FILE_WRONLY, NGX_FILE_TRUNCATE,
+                       NGX_FILE_OWNER_ACCESS);
+    if (fd == NGX_INVALID_FILE) {
+        ctx->err = ngx_errno;
+        ctx->failed = "opening";
+        return;
+    }
+
+    if (ngx_wa_shm_kv_persist_write(fd, (u_char *) &h, sizeof(h)) != NGX_OK) {
+        goto failed;
+    }
+
+    for (c = ctx->chunks; c; c = c->next) {
+        if (ngx_wa_shm_kv_persist_write(fd, (u_char *) (c + 1), c->size)
+            != NGX_OK)
+        {
+            goto failed;
+        }
+    }
+
+    /* on disk before replacing the previous snapshot */
+
+    if (fsync(fd) == -1) {
+        goto failed;
+    }
+
+    if (ngx_close_file(fd) == NGX_FILE_ERROR) {
+        fd = NGX_INVALID_FILE;
+        goto failed;
+    }
+
+    fd = NGX_INVALID_FILE;
+
+    /* written aside and renamed: the previous snapshot is never torn */
+
+    if (ngx_rename_file(ctx->tmp, ctx->shm->persist.data) == NGX_FILE_ERROR) {
+        goto failed;
+    }
+
+    return;
+
+failed:
+
+    ctx->err = ngx_errno;
+    ctx->failed = "writing";
+
+    if (fd != NGX_INVALID_FILE) {
+        (void) ngx_close_file(fd);
+    }
+
+    (void) ngx_delete_file(ctx->tmp);
+}
+
+
+static void
+ngx_wa_shm_kv_persist_done(ngx_wa_shm_kv_persist_ctx_t *ctx)
+{
+    ngx_wa_shm_t  *shm = ctx->shm;
+
+    if (ctx->failed) {
+        ngx_wasm_log_error(NGX_LOG_ERR, shm->log, ctx->err,
+                           "\"%V\" shm store: failed %s \"%s\"",
+                           &shm->name, ctx->failed, ctx->tmp);
+
+    } else {
+        shm->persisted = ctx->seq;
+
+        ngx_log_debug3(NGX_LOG_DEBUG_WASM, shm->log, 0,
+                       "wasm \"%V\" shm store: persisted %ui entries "
+                       "to \"%V\"", &shm->name, ctx->nelts, &shm->persist);
+    }
+
+    shm->persisting = 0;
+
+    ngx_wa_shm_kv_persist_free(ctx->chunks);
+    ngx_free(ctx);
+}
+
+
+#if (NGX_THREADS)
+static void
+ngx_wa_shm_kv_persist_event_handler(ngx_event_t *ev)
+{
+    ngx_wa_shm_kv_persist_done(ev->data);
+}
+#endif
+
+
+void
+ngx_wa_shm_kv_persist(ngx_wa_shm_t *shm, unsigned block)
+{
+    size_t                        len;
+    ngx_uint_t                    i, nshards, seq;
+    ngx_wa_shm_t                 *shards;
+    ngx_wa_shm_kv_persist_ctx_t  *ctx;
+
+    if (shm->persisting && !block) {
+        /**
+         * Previous snapshot still being written. When exiting, the
+         * thread pool already completed it (its exit_process runs first).
+         */
+        return;
+    }
+
+    shards = shm->nshards ? shm->shards : shm;
+    nshards = shm->nshards ? shm->nshards : 1;
+
+    seq = 0;
+
+    for (i = 0; i < nshards; i++) {
+        seq += ngx_wa_shm_get_kv(&shards[i])->seq;
+    }
+
+    if (seq == shm->persisted) {
+        /* no writes since the last snapshot */
+        return;
+    }
+
+    len = shm->persist.len + 1 + NGX_INT64_LEN + 1;
+
+    ctx = ngx_calloc(sizeof(ngx_wa_shm_kv_persist_ctx_t) + len, shm->log);
+    if (ctx == NULL) {
+        return;
+    }
+
+    ctx->shm = shm;
+    ctx->last = &ctx->chunks;
+    ctx->tmp = (u_char *) (ctx + 1);
+
+    ngx_sprintf(ctx->tmp, "%V.%P%Z", &shm->persist, ngx_pid);
+
+    for (i = 0; i < nshards; i++) {
+        if (ngx_wa_shm_kv_persist_shard(ctx, &shards[i]) != NGX_OK) {
+            ngx_wa_shm_kv_persist_free(ctx->chunks);
+            ngx_free(ctx);
+            return;
+        }
+    }
+
+    shm->persisting = 1;
+
+#if (NGX_THREADS)
+    if (!block && shm->thread_pool) {
+        /* written off the event loop */
+
+        ctx->task.ctx = ctx;
+        ctx->task.handler = ngx_wa_shm_kv_persist_handler;
+        ctx->task.event.data = ctx;
+        ctx->task.event.handler = ngx_wa_shm_kv_persist_event_handler;
+        ctx->task.event.log = shm->log;
+
+        if (ngx_thread_task_post(shm->thread_pool, &ctx->task) == NGX_OK) {
+            return;
+        }
+
+        /* queue overflow: written in place */
+    }
+#endif
+
+    ngx_wa_shm_kv_persist_handler(ctx, shm->log);
+    ngx_wa_shm_kv_persist_done(ctx);
+}
+
+
+static char *
+ngx_wa_shm_kv_restore_validate(u_char *p, size_t size)
+{
+    u_char                          *last;
+    uint32_t                         crc;
+    ngx_uint_t                       nelts;
+    ngx_wa_shm_kv_persist_header_t   h;
+    ngx_wa_shm_kv_persist_entry_t    e;
+
+    if (size < sizeof(ngx_wa_shm_kv_persist_header_t)) {
+        return "truncated header";
+    }
+
+    ngx_memcpy(&h, p, sizeof(ngx_wa_shm_kv_persist_header_t));
+
+    if (ngx_memcmp(h.magic, NGX_WA_SHM_KV_PERSIST_MAGIC, 4) != 0) {
+        return "bad magic";
+    }
+
+    if (h.version != NGX_WA_SHM_KV_PERSIST_VERSION) {
+        return "unsupported version";
+    }
+
+    p += sizeof(ngx_wa_shm_kv_persist_header_t);
+    size -= sizeof(ngx_wa_shm_kv_persist_header_t);
+
+    if (h.size != size) {
+        return "truncated file";
+    }
+
+    crc = ngx_crc32_long(p, size);
+    if (crc != h.crc) {
+        return "checksum mismatch";
+    }
+
+    last = p + size;
+
+    for (nelts = 0; p < last; nelts++) {
+        if ((size_t) (last - p) < sizeof(ngx_wa_shm_kv_persist_entry_t)) {
+            return "truncated entry";
+        }
+
+        ngx_memcpy(&e, p, sizeof(ngx_wa_shm_kv_persist_entry_t));
+
+        p += sizeof(ngx_wa_shm_kv_persist_entry_t);
+
+        if ((size_t) (last - p) < (size_t) e.key_len + e.value_len) {
+            return "truncated entry";
+        }
+
+        p += e.key_len + e.value_len;
+    }
+
+    if (nelts != h.nelts) {
+        return "entries count mismatch";
+    }
+
+    return NULL;
+}
+
+
+ngx_int_t
+ngx_wa_shm_kv_restore(ngx_wa_shm_t *shm)
+{
+    u_char                         *addr, *p, *last;
+    char                           *err;
+    size_t                          size;
+    uint64_t                        now;
+    ngx_fd_t                        fd;
+    ngx_str_t                       key, value;
+    ngx_uint_t                      n = 0;
+    ngx_time_t                     *tp;
+    ngx_file_info_t                 fi;
+    ngx_wa_shm_kv_persist_entry_t   e;
+
+    /**
+     * Called once the zone is initialized. An invalid snapshot is
+     * ignored as a whole: the zone starts empty.
+     */
+
+    fd = ngx_open_file(shm->persist.data, NGX_FILE_RDONLY, NGX_FILE_OPEN, 0);
+    if (fd == NGX_INVALID_FILE) {
+        if (ngx_errno != NGX_ENOENT) {
+            ngx_wasm_log_error(NGX_LOG_WARN, shm->log, ngx_errno,
+                               "\"%V\" shm store: failed opening \"%V\"",
+                               &shm->name, &shm->persist);
+        }
+
+        return NGX_OK;
+    }
+
+    if (ngx_fd_info(fd, &fi) == NGX_FILE_ERROR) {
+        ngx_wasm_log_error(NGX_LOG_WARN, shm->log, ngx_errno,
+                           "\"%V\" shm store: failed reading \"%V\"",
+                           &shm->name, &shm->persist);
+        goto close;
+    }
+
+    size = (size_t) ngx_file_size(&fi);
+    if (size == 0) {
+        err = "empty file";
+        goto invalid;
+    }
+
+    addr = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED) {
+        ngx_wasm_log_error(NGX_LOG_WARN, shm->log, ngx_errno,
+                           "\"%V\" shm store: failed mapping \"%V\"",
+                           &shm->name, &shm->persist);
+        goto close;
+    }
+
+    err = ngx_wa_shm_kv_restore_validate(addr, size);
+    if (err) {
+        (void) munmap(addr, size);
+        goto invalid;
+    }
+
+    tp = ngx_timeofday();
+    now = (uint64_t) tp->sec * 1000 + tp->msec;
+    p = addr + sizeof(ngx_wa_shm_kv_persist_header_t);
+    last = addr + size;
+
+    ngx_wa_shm_lock(shm);
+
+    while (p < last) {
+        ngx_memcpy(&e, p, sizeof(ngx_wa_shm_kv_persist_entry_t));
+
+        key.data = p + sizeof(ngx_wa_shm_kv_persist_entry_t);
+        key.len = e.key_len;
+        value.data = key.data + key.len;
+        value.len = e.value_len;
+
+        p = value.data + value.len;
+
+        if (e.expires && e.expires <= now) {
+            continue;
+        }
+
+        if (ngx_wa_shm_kv_restore_locked(ngx_wa_shm_kv_shard(shm, &key),
+                                         &key, &value, e.cas,
+                                         e.expires
+                                         ? (ngx_msec_t) (e.expires - now)
+                                         : 0)
+            != NGX_OK)
+        {
+            /* zone shrunk since the snapshot, logged */
+            break;
+        }
+
+        n++;
+    }
+
+    ngx_wa_shm_unlock(shm);
+
+    (void) munmap(addr, size);
+
+    ngx_wasm_log_error(NGX_LOG_NOTICE, shm->log, 0,
+                       "\"%V\" shm store: restored %ui entries from \"%V\"",
+                       &shm->name, n, &shm->persist);
+
+    goto close;
+
+invalid:
+
+    ngx_wasm_log_error(NGX_LOG_WARN, shm->log, 0,
+                       "\"%V\" shm store: ignoring invalid snapshot "
+                       "\"%V\" (%s)", &shm->name, &shm->persist, err);
+
+close:
+
+    if (ngx_close_file(fd) == NGX_FILE_ERROR) {
+        ngx_wasm_log_error(NGX_LOG_WARN, shm->log, ngx_errno,
+                           "\"%V\" shm store: failed closing \"%V\"",
+                           &shm->name, &shm->persist);
+    }
+
+    /* a partially restored zone is usable */
+    return NGX_OK;
+}
@@ -15,11 +15,16 @@
 
 #define NGX_HTTP_WASM_MAX_REQ_HEADERS      100
 
+#ifndef NGX_HTTP_WASM_RESP_BODY_TEMP_PATH
+#define NGX_HTTP_WASM_RESP_BODY_TEMP_PATH  "wasm_response_body_temp"
+#endif
+
 #define NGX_HTTP_WASM_HEADER_FILTER_PHASE  (NGX_HTTP_LOG_PHASE + 1)
 #define NGX_HTTP_WASM_BODY_FILTER_PHASE    (NGX_HTTP_LOG_PHASE + 2)
 #ifdef NGX_WASM_RESPONSE_TRAILERS
 #define NGX_HTTP_WASM_TRAILER_FILTER_PHASE (NGX_HTTP_LOG_PHASE + 3)
 #endif
+#define NGX_HTTP_WASM_REQ_BODY_FILTER_PHASE (NGX_HTTP_LOG_PHASE + 4)
 
 
 struct ngx_http_wasm_req_ctx_s {
@@ -40,9 +45,15 @@ struct ngx_http_wasm_req_ctx_s {
     ngx_uint_t                         resp_bufs_count;         /* response buffers count */
     ngx_chain_t                       *resp_bufs;               /* response buffers */
     ngx_chain_t                       *resp_buf_last;           /* last response buffers */
+    ngx_temp_file_t                   *resp_temp_file;          /* response buffers spilled to disk */
+    ngx_output_chain_ctx_t            *resp_output;             /* reads spilled buffers back */
+    off_t                              resp_bufs_len;           /* response buffers length */
+    off_t                              resp_bufs_window;        /* stop buffering past this length */
     ngx_chain_t                       *resp_chunk;
     unsigned                           resp_chunk_eof;          /* seen last buf flag */
     off_t                              resp_chunk_len;
+    ngx_chain_t                       *req_chunk;               /* streamed request body chunk */
+    off_t                              req_chunk_len;
     off_t                              req_content_length_n;
     off_t                              resp_content_length_n;
 
@@ -65,6 +76,9 @@ struct ngx_http_wasm_req_ctx_s {
     unsigned                           in_req_body_handler:1;   /* content invoked from read_request_body handler */
     unsigned                           req_body_waited:1;       /* read_request_body yielded at least once */
     unsigned                           req_body_received:1;     /* read_request_body finished */
+    unsigned                           req_body_streaming:1;    /* convenience alias to loc->pwm_req_body_streaming */
+    unsigned                           req_chunk_eof:1;         /* seen request body last buf flag */
+    unsigned                           in_req_body_filter:1;    /* ops invoked from request_body_filter handler */
     unsigned                           entered_header_filter:1; /* entered header_filter handler */
     unsigned                           entered_body_filter:1;   /* entered body_filter handler */
     unsigned                           entered_log_phase:1;     /* entered log phase */
@@ -95,11 +109,14 @@ typedef struct {
     ngx_flag_t                         socket_buffer_reuse;    /* wasm_socket_buffer_reuse */
     ngx_bufs_t                         socket_large_buffers;   /* wasm_socket_large_buffer_size */
     ngx_bufs_t                         resp_body_buffers;      /* wasm_response_body_buffers */
+    off_t                              resp_body_max_temp_file_size;
+    ngx_path_t                        *resp_body_temp_path;
 
     ngx_flag_t                         postpone_rewrite;
     ngx_flag_t                         postpone_access;
 
     ngx_flag_t                         pwm_req_headers_in_access;
+    ngx_flag_t                         pwm_req_body_streaming;
     ngx_flag_t                         pwm_lua_resolver;
     ngx_flag_t                         pwm_log_dispatch_errors;
 
@@ -112,6 +129,9 @@ typedef struct {
     ngx_wasm_ops_t                    *ops;
     ngx_queue_t                        plans;
     ngx_proxy_wasm_filters_root_t      pwroot;                 /* worker proxy-wasm root */
+
+    ngx_msec_t                         pwm_shed_lag;           /* proxy_wasm_load_shedding lag= */
+    ngx_uint_t                         pwm_shed_conns;         /* proxy_wasm_load_shedding connections= */
 } ngx_http_wasm_main_conf_t;
 
 
@@ -136,6 +156,8 @@ char *ngx_http_wasm_proxy_wasm_directive(ngx_conf_t *cf, ngx_command_t *cmd,
     void *conf);
 char *ngx_http_wasm_proxy_wasm_isolation_directive(ngx_conf_t *cf,
     ngx_command_t *cmd, void *conf);
+char *ngx_http_wasm_proxy_wasm_load_shedding_directive(ngx_conf_t *cf,
+    ngx_command_t *cmd, void *conf);
 char *ngx_http_wasm_resolver_add_directive(ngx_conf_t *cf,
     ngx_command_t *cmd, void *conf);
 
@@ -167,6 +189,10 @@ ngx_int_t ngx_http_wasm_prepend_req_body(ngx_http_wasm_req_ctx_t *rctx,
     ngx_str_t *body);
 ngx_int_t ngx_http_wasm_prepend_resp_body(ngx_http_wasm_req_ctx_t *rctx,
     ngx_str_t *body);
+ngx_int_t ngx_http_wasm_splice_req_body(ngx_http_wasm_req_ctx_t *rctx,
+    ngx_str_t *body, size_t start, size_t end);
+ngx_int_t ngx_http_wasm_splice_resp_body(ngx_http_wasm_req_ctx_t *rctx,
+    ngx_str_t *body, size_t start, size_t end);
 
 
 /* resume handler */
@@ -10,6 +10,32 @@
 #define NGX_WASM_DEFAULT_RESOLVER 1
 
 
+typedef struct {
+    ngx_str_t                   name;
+    ngx_uint_t                  method;
+} ngx_http_wasm_method_t;
+
+
+static ngx_http_wasm_method_t  ngx_http_wasm_methods[] = {
+    { ngx_string("GET"), NGX_HTTP_GET },
+    { ngx_string("HEAD"), NGX_HTTP_HEAD },
+    { ngx_string("POST"), NGX_HTTP_POST },
+    { ngx_string("PUT"), NGX_HTTP_PUT },
+    { ngx_string("DELETE"), NGX_HTTP_DELETE },
+    { ngx_string("MKCOL"), NGX_HTTP_MKCOL },
+    { ngx_string("COPY"), NGX_HTTP_COPY },
+    { ngx_string("MOVE"), NGX_HTTP_MOVE },
+    { ngx_string("OPTIONS"), NGX_HTTP_OPTIONS },
+    { ngx_string("PROPFIND"), NGX_HTTP_PROPFIND },
+    { ngx_string("PROPPATCH"), NGX_HTTP_PROPPATCH },
+    { ngx_string("LOCK"), NGX_HTTP_LOCK },
+    { ngx_string("UNLOCK"), NGX_HTTP_UNLOCK },
+    { ngx_string("PATCH"), NGX_HTTP_PATCH },
+    { ngx_string("TRACE"), NGX_HTTP_TRACE },
+    { ngx_null_string, 0 }
+};
+
+
 char *
 ngx_http_wasm_call_directive(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 {
@@ -98,14 +124,176 @@ ngx_http_wasm_call_directive(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 }
 
 
+static ngx_int_t
+ngx_http_wasm_proxy_wasm_methods(ngx_conf_t *cf, ngx_str_t *value,
+    ngx_uint_t *out)
+{
+    u_char                  *p, *last, *end;
+    ngx_http_wasm_method_t  *m;
+
+    p = value->data;
+    last = value->data + value->len;
+
+    while (p < last) {
+        end = ngx_strlchr(p, last, ',');
+        if (end == NULL) {
+            end = last;
+        }
+
+        for (m = ngx_http_wasm_methods; m->name.len; m++) {
+            if ((size_t) (end - p) == m->name.len
+                && ngx_strncasecmp(p, m->name.data, m->name.len) == 0)
+            {
+                *out |= m->method;
+                break;
+            }
+        }
+
+        if (m->name.len == 0) {
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "invalid method \"%*s\"",
+                               (size_t) (end - p), p);
+            return NGX_ERROR;
+        }
+
+        p = end + 1;
+    }
+
+    return NGX_OK;
+}
+
+
+static ngx_http_complex_value_t *
+ngx_http_wasm_proxy_wasm_cv(ngx_conf_t *cf, ngx_str_t *value)
+{
+    ngx_http_complex_value_t          *cv;
+    ngx_http_compile_complex_value_t   ccv;
+
+    cv = ngx_palloc(cf->pool, sizeof(ngx_http_complex_value_t));
+    if (cv == NULL) {
+        return NULL;
+    }
+
+    ngx_memzero(&ccv, sizeof(ngx_http_compile_complex_value_t));
+
+    ccv.cf = cf;
+    ccv.value = value;
+    ccv.complex_value = cv;
+
+    if (ngx_http_compile_complex_value(&ccv) != NGX_OK) {
+        return NULL;
+    }
+
+    return cv;
+}
+
+
+static ngx_int_t
+ngx_http_wasm_proxy_wasm_sample(ngx_conf_t *cf, ngx_str_t *value,
+    ngx_uint_t *out)
+{
+    ngx_int_t  n;
+
+    /* ratio in [0, 1] with up to 4 decimals */
+
+    n = ngx_atofp(value->data, value->len, 4);
+    if (n == NGX_ERROR || n > NGX_HTTP_PROXY_WASM_SAMPLE_MAX) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "invalid sample ratio \"%V\"", value);
+        return NGX_ERROR;
+    }
+
+    *out = (ngx_uint_t) n;
+
+    return NGX_OK;
+}
+
+
+static ngx_uint_t
+ngx_http_wasm_proxy_wasm_option(ngx_str_t *value, char *name, ngx_str_t *arg)
+{
+    size_t  len = ngx_strlen(name);
+
+    if (value->len > len && ngx_strncmp(value->data, name, len) == 0) {
+        arg->data = value->data + len;
+        arg->len = value->len - len;
+        return 1;
+    }
+
+    return 0;
+}
+
+
+static ngx_int_t
+ngx_http_wasm_proxy_wasm_cond(ngx_conf_t *cf, ngx_str_t *value,
+    ngx_http_proxy_wasm_cond_t *cond)
+{
+    ngx_str_t  arg;
+
+    if (ngx_http_wasm_proxy_wasm_option(value, "if=", &arg)) {
+        cond->predicate = ngx_http_wasm_proxy_wasm_cv(cf, &arg);
+        if (cond->predicate == NULL) {
+            return NGX_ERROR;
+        }
+
+    } else if (ngx_http_wasm_proxy_wasm_option(value, "methods=", &arg)) {
+        if (ngx_http_wasm_proxy_wasm_methods(cf, &arg, &cond->methods)
+            != NGX_OK)
+        {
+            return NGX_ERROR;
+        }
+
+    } else if (ngx_http_wasm_proxy_wasm_option(value, "prefix=", &arg)) {
+        cond->prefix = arg;
+
+    } else if (ngx_http_wasm_proxy_wasm_option(value, "sample=", &arg)) {
+        if (ngx_http_wasm_proxy_wasm_sample(cf, &arg, &cond->sample)
+            != NGX_OK)
+        {
+            return NGX_ERROR;
+        }
+
+        cond->sampled = 1;
+
+    } else if (ngx_http_wasm_proxy_wasm_option(value, "sample_key=", &arg)) {
+        cond->sample_key = ngx_http_wasm_proxy_wasm_cv(cf, &arg);
+        if (cond->sample_key == NULL) {
+            return NGX_ERROR;
+        }
+
+    } else if (ngx_http_wasm_proxy_wasm_option(value, "criticality=", &arg)) {
+        if (ngx_str_eq(arg.data, arg.len, "optional", -1)) {
+            cond->optional = 1;
+
+        } else if (ngx_str_eq(arg.data, arg.len, "critical", -1)) {
+            cond->optional = 0;
+
+        } else {
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                               "invalid criticality \"%V\"", &arg);
+            return NGX_ERROR;
+        }
+
+    } else {
+        /* not an option */
+        return NGX_DECLINED;
+    }
+
+    return NGX_OK;
+}
+
+
 char *
 ngx_http_wasm_proxy_wasm_directive(ngx_conf_t *cf, ngx_command_t *cmd,
     void *conf)
 {
-    ngx_int_t                   rc;
-    ngx_str_t                  *values, *name, *config;
-    ngx_http_wasm_loc_conf_t   *loc = conf;
-    ngx_http_wasm_main_conf_t  *mcf;
+    size_t                       i;
+    ssize_t                      body_window = 0;
+    ngx_int_t                    rc;
+    ngx_uint_t                   nconds = 0;
+    ngx_str_t                   *values, *name, *config = NULL, arg;
+    ngx_http_proxy_wasm_cond_t  *cond;
+    ngx_http_wasm_loc_conf_t    *loc = conf;
+    ngx_http_wasm_main_conf_t   *mcf;
 
     mcf = ngx_http_conf_get_module_main_conf(cf, ngx_http_wasm_module);
     if (mcf->vm == NULL) {
@@ -117,7 +305,6 @@ ngx_http_wasm_proxy_wasm_directive(ngx_conf_t *cf, ngx_command_t *cmd,
     values = cf->args->elts;
 
     name = &values[1];
-    config = cf->args->nelts > 2 ? &values[2] : NULL;
 
     if (name->len == 0) {
         ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
@@ -125,10 +312,59 @@ ngx_http_wasm_proxy_wasm_directive(ngx_conf_t *cf, ngx_command_t *cmd,
         return NGX_CONF_ERROR;
     }
 
+    cond = ngx_pcalloc(cf->pool, sizeof(ngx_http_proxy_wasm_cond_t));
+    if (cond == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    if (cf->args->nelts > 2) {
+        /* always the filter config, even if it looks like an option */
+        config = &values[2];
+    }
+
+    /* options follow the config ('' if none) */
+
+    for (i = 3; i < cf->args->nelts; i++) {
+        rc = ngx_http_wasm_proxy_wasm_cond(cf, &values[i], cond);
+        if (rc == NGX_ERROR) {
+            return NGX_CONF_ERROR;
+        }
+
+        if (rc == NGX_OK) {
+            nconds++;
+            continue;
+        }
+
+        if (ngx_http_wasm_proxy_wasm_option(&values[i], "body_window=",
+                                            &arg))
+        {
+            body_window = ngx_parse_size(&arg);
+            if (body_window == NGX_ERROR || body_window == 0) {
+                ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                                   "invalid body window \"%V\"", &arg);
+                return NGX_CONF_ERROR;
+            }
+
+            continue;
+        }
+
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "invalid parameter \"%V\"", &values[i]);
+        return NGX_CONF_ERROR;
+    }
+
+    if (cond->sample_key && !cond->sampled) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "\"sample_key\" requires \"sample\"");
+        return NGX_CONF_ERROR;
+    }
+
     loc->plan->conf.proxy_wasm.pwroot = &mcf->pwroot;
     loc->plan->conf.proxy_wasm.worker_pwroot = &mcf->pwroot;
 
-    rc = ngx_http_wasm_ops_add_filter(loc->plan, name, config, mcf->vm);
+    rc = ngx_http_wasm_ops_add_filter(loc->plan, name, config,
+                                      nconds ? cond : NULL,
+                                      (size_t) body_window, mcf->vm);
     if (rc != NGX_OK) {
         if (rc == NGX_ABORT) {
             ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
@@ -185,6 +421,57 @@ ngx_http_wasm_proxy_wasm_isolation_directive(ngx_conf_t *cf, ngx_command_t *cmd,
 }
 
 
+char *
+ngx_http_wasm_proxy_wasm_load_shedding_directive(ngx_conf_t *cf,
+    ngx_command_t *cmd, void *conf)
+{
+    size_t                      i;
+    ngx_int_t                   n;
+    ngx_str_t                  *values, arg;
+    ngx_http_wasm_main_conf_t  *mcf = conf;
+
+    if (mcf->pwm_shed_lag || mcf->pwm_shed_conns) {
+        return "is duplicate";
+    }
+
+    values = cf->args->elts;
+
+    for (i = 1; i < cf->args->nelts; i++) {
+
+        if (ngx_http_wasm_proxy_wasm_option(&values[i], "lag=", &arg)) {
+            n = ngx_parse_time(&arg, 0);
+            if (n == NGX_ERROR || n == 0) {
+                goto invalid;
+            }
+
+            mcf->pwm_shed_lag = (ngx_msec_t) n;
+
+        } else if (ngx_http_wasm_proxy_wasm_option(&values[i], "connections=",
+                                                   &arg))
+        {
+            n = ngx_atoi(arg.data, arg.len);
+            if (n == NGX_ERROR || n == 0) {
+                goto invalid;
+            }
+
+            mcf->pwm_shed_conns = (ngx_uint_t) n;
+
+        } else {
+            goto invalid;
+        }
+    }
+
+    return NGX_CONF_OK;
+
+invalid:
+
+    ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                       "invalid parameter \"%V\"", &values[i]);
+
+    return NGX_CONF_ERROR;
+}
+
+
 char *
 ngx_http_wasm_resolver_add_directive(ngx_conf_t *cf, ngx_command_t *cmd,
     void *conf)
@@ -10,6 +10,8 @@ static ngx_int_t ngx_http_wasm_filter_init(ngx_conf_t *cf);
 static ngx_int_t ngx_http_wasm_header_filter_handler(ngx_http_request_t *r);
 static ngx_int_t ngx_http_wasm_body_filter_handler(ngx_http_request_t *r,
     ngx_chain_t *in);
+static ngx_int_t ngx_http_wasm_request_body_filter_handler(
+    ngx_http_request_t *r, ngx_chain_t *in);
 
 
 static ngx_http_module_t  ngx_http_wasm_module_ctx = {
@@ -42,12 +44,17 @@ ngx_module_t  ngx_http_wasm_filter_module = {
 
 static ngx_http_output_header_filter_pt  ngx_http_next_header_filter;
 static ngx_http_output_body_filter_pt  ngx_http_next_body_filter;
+static ngx_http_request_body_filter_pt  ngx_http_next_request_body_filter;
 
 
 static void ngx_http_wasm_body_filter_resume(ngx_http_wasm_req_ctx_t *rctx,
     ngx_chain_t *in);
 static ngx_int_t ngx_http_wasm_body_filter_buffer(
     ngx_http_wasm_req_ctx_t *rctx, ngx_chain_t *in);
+static ngx_int_t ngx_http_wasm_body_filter_spill(
+    ngx_http_wasm_req_ctx_t *rctx, ngx_chain_t *in);
+static ngx_int_t ngx_http_wasm_body_filter_output(ngx_http_request_t *r,
+    ngx_http_wasm_req_ctx_t *rctx, ngx_chain_t *in);
 
 
 static ngx_int_t
@@ -59,6 +66,10 @@ ngx_http_wasm_filter_init(ngx_conf_t *cf)
     ngx_http_next_body_filter = ngx_http_top_body_filter;
     ngx_http_top_body_filter = ngx_http_wasm_body_filter_handler;
 
+    ngx_http_next_request_body_filter = ngx_http_top_request_body_filter;
+    ngx_http_top_request_body_filter =
+        ngx_http_wasm_request_body_filter_handler;
+
     return NGX_OK;
 }
 
@@ -91,6 +102,9 @@ ngx_http_wasm_header_filter_handler(ngx_http_request_t *r)
         goto done;
     }
 
+    /* in case no filter resumes the "ResponseHeaders" step */
+    rctx->resp_content_length_n = r->headers_out.content_length_n;
+
     rc = ngx_wasm_ops_resume(&rctx->opctx,
                              NGX_HTTP_WASM_HEADER_FILTER_PHASE);
 
@@ -218,8 +232,8 @@ ngx_http_wasm_body_filter_handler(ngx_http_request_t *r, ngx_chain_t *in)
     ngx_wasm_chain_log_debug(r->connection->log, rctx->resp_chunk,
                              "rctx->resp_chunk");
 
-    rc = ngx_http_next_body_filter(r, rctx->resp_chunk);
-    dd("ngx_http_next_body_filter rc: %ld", rc);
+    rc = ngx_http_wasm_body_filter_output(r, rctx, rctx->resp_chunk);
+    dd("ngx_http_wasm_body_filter_output rc: %ld", rc);
     if (rc == NGX_ERROR || rc == NGX_AGAIN) {
         goto done;
     }
@@ -302,6 +316,11 @@ ngx_http_wasm_body_filter_buffer(ngx_http_wasm_req_ctx_t *rctx, ngx_chain_t *in)
 
     ngx_wa_assert(rctx->resp_buffering);
 
+    if (rctx->resp_temp_file) {
+        /* buffers full, already spilling to disk */
+        return ngx_http_wasm_body_filter_spill(rctx, in);
+    }
+
     cl = rctx->resp_buf_last;
     loc = ngx_http_get_module_loc_conf(r, ngx_http_wasm_module);
 
@@ -323,24 +342,22 @@ ngx_http_wasm_body_filter_buffer(ngx_http_wasm_req_ctx_t *rctx, ngx_chain_t *in)
         }
 
         while (n) {
+            if (rctx->resp_bufs_window
+                && rctx->resp_bufs_len >= rctx->resp_bufs_window)
+            {
+                /* body window buffered */
+                goto full;
+            }
+
             if (cl == NULL) {
                 if (rctx->resp_bufs_count
                     >= (ngx_uint_t) loc->resp_body_buffers.num)
                 {
-                    if (rctx->resp_buf_last) {
-                        for (rl = ll; rl; rl = rl->next) {
-                            if (ngx_buf_size(rl->buf)) {
-                                rctx->resp_buf_last->next = rl;
-                                rctx->resp_buf_last = rl;
-                            }
-                        }
+                    if (loc->resp_body_max_temp_file_size) {
+                        return ngx_http_wasm_body_filter_spill(rctx, ll);
                     }
 
-                    ngx_wasm_chain_log_debug(r->connection->log,
-                                             rctx->resp_bufs,
-                                             "response buffers: ");
-
-                    return NGX_DONE;
+                    goto full;
                 }
 
                 cl = ngx_wasm_chain_get_free_buf(rctx->pool,
@@ -370,6 +387,12 @@ ngx_http_wasm_body_filter_buffer(ngx_http_wasm_req_ctx_t *rctx, ngx_chain_t *in)
 
             avail = cl->buf->end - cl->buf->last;
             copy = ngx_min(n, avail);
+
+            if (rctx->resp_bufs_window) {
+                copy = ngx_min(copy, rctx->resp_bufs_window
+                                     - rctx->resp_bufs_len);
+            }
+
             dd("avail: %ld, copy: %ld", avail, copy);
             if (copy == 0) {
                 cl = NULL;
@@ -380,17 +403,22 @@ ngx_http_wasm_body_filter_buffer(ngx_http_wasm_req_ctx_t *rctx, ngx_chain_t *in)
 
             ll->buf->pos += copy;
             cl->buf->last += copy;
+            rctx->resp_bufs_len += copy;
 
-            cl->buf->flush = ll->buf->flush;
-            cl->buf->last_buf = ll->buf->last_buf;
-            cl->buf->last_in_chain = ll->buf->last_in_chain;
+            if (copy == n) {
+                cl->buf->flush = ll->buf->flush;
+                cl->buf->last_buf = ll->buf->last_buf;
+                cl->buf->last_in_chain = ll->buf->last_in_chain;
+            }
 
             dd("f: %d, l: %d, lic: %d", ll->buf->flush,
                ll->buf->last_buf, ll->buf->last_in_chain);
 
             if (copy < n) {
-                /* more to copy, next buffer */
-                ngx_wa_assert(cl->buf->last == cl->buf->end);
+                /* more to copy, next buffer or body window reached */
+                ngx_wa_assert(cl->buf->last == cl->buf->end
+                              || rctx->resp_bufs_len
+                                 == rctx->resp_bufs_window);
                 rctx->resp_buf_last = cl;
                 cl = NULL;
             }
@@ -404,4 +432,247 @@ ngx_http_wasm_body_filter_buffer(ngx_http_wasm_req_ctx_t *rctx, ngx_chain_t *in)
                              "response buffers: ");
 
     return NGX_OK;
+
+full:
+
+    if (rctx->resp_buf_last) {
+        for (rl = ll; rl; rl = rl->next) {
+            if (ngx_buf_size(rl->buf)) {
+                rctx->resp_buf_last->next = rl;
+                rctx->resp_buf_last = rl;
+            }
+        }
+    }
+
+    ngx_wasm_chain_log_debug(r->connection->log, rctx->resp_bufs,
+                             "response buffers: ");
+
+    return NGX_DONE;
+}
+
+
+static ngx_int_t
+ngx_http_wasm_body_filter_spill(ngx_http_wasm_req_ctx_t *rctx, ngx_chain_t *in)
+{
+    off_t                      n;
+    ngx_buf_t                 *b;
+    ngx_chain_t               *cl, *ll, out;
+    ngx_temp_file_t           *tf;
+    ngx_http_request_t        *r = rctx->r;
+    ngx_http_wasm_loc_conf_t  *loc;
+
+    dd("enter");
+
+    loc = ngx_http_get_module_loc_conf(r, ngx_http_wasm_module);
+
+    tf = rctx->resp_temp_file;
+    if (tf == NULL) {
+        tf = ngx_pcalloc(r->pool, sizeof(ngx_temp_file_t));
+        if (tf == NULL) {
+            return NGX_ERROR;
+        }
+
+        tf->file.fd = NGX_INVALID_FILE;
+        tf->file.log = r->connection->log;
+        tf->path = loc->resp_body_temp_path;
+        tf->pool = r->pool;
+        tf->log_level = NGX_LOG_WARN;
+        tf->warn = "a response body is buffered to a temporary file";
+
+        b = ngx_calloc_buf(r->pool);
+        if (b == NULL) {
+            return NGX_ERROR;
+        }
+
+        b->in_file = 1;
+        b->file = &tf->file;
+        b->tag = (ngx_buf_tag_t) &ngx_http_wasm_filter_module;
+
+        cl = ngx_alloc_chain_link(r->pool);
+        if (cl == NULL) {
+            return NGX_ERROR;
+        }
+
+        cl->buf = b;
+        cl->next = NULL;
+
+        if (rctx->resp_bufs == NULL) {
+            rctx->resp_bufs = cl;
+
+        } else {
+            rctx->resp_buf_last->next = cl;
+        }
+
+        rctx->resp_buf_last = cl;
+        rctx->resp_temp_file = tf;
+    }
+
+    b = rctx->resp_buf_last->buf;
+
+    ngx_wa_assert(b->file == &tf->file);
+
+    for (ll = in; ll; ll = ll->next) {
+        n = ngx_buf_size(ll->buf);
+
+        if (n) {
+            if (tf->offset + n > loc->resp_body_max_temp_file_size
+                || (rctx->resp_bufs_window
+                    && rctx->resp_bufs_len >= rctx->resp_bufs_window))
+            {
+                /* temp file full or body window buffered, pass the rest
+                 * through */
+                for (/* void */; ll; ll = ll->next) {
+                    if (ngx_buf_size(ll->buf)) {
+                        rctx->resp_buf_last->next = ll;
+                        rctx->resp_buf_last = ll;
+                    }
+                }
+
+                ngx_wasm_chain_log_debug(r->connection->log,
+                                         rctx->resp_bufs,
+                                         "response buffers: ");
+
+                return NGX_DONE;
+            }
+
+            out.buf = ll->buf;
+            out.next = NULL;
+
+            if (ngx_write_chain_to_temp_file(tf, &out) == NGX_ERROR) {
+                return NGX_ERROR;
+            }
+
+            ll->buf->pos = ll->buf->last;
+            b->file_last = tf->offset;
+            rctx->resp_bufs_len += n;
+        }
+
+        b->flush = ll->buf->flush;
+        b->last_buf = ll->buf->last_buf;
+        b->last_in_chain = ll->buf->last_in_chain;
+    }
+
+    ngx_wasm_chain_log_debug(r->connection->log, rctx->resp_bufs,
+                             "response buffers: ");
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_wasm_body_filter_output(ngx_http_request_t *r,
+    ngx_http_wasm_req_ctx_t *rctx, ngx_chain_t *in)
+{
+    ngx_output_chain_ctx_t    *ctx = rctx->resp_output;
+    ngx_http_core_loc_conf_t  *clcf;
+
+    if (ctx && ctx->filter_ctx != r) {
+        /* subrequest sharing the main rctx */
+        return ngx_http_next_body_filter(r, in);
+    }
+
+    if (ctx == NULL) {
+        if (rctx->resp_temp_file == NULL
+            || (r->connection->sendfile
+                && !r->main_filter_need_in_memory
+                && !r->filter_need_in_memory))
+        {
+            return ngx_http_next_body_filter(r, in);
+        }
+
+        /**
+         * The copy filter already ran: read the spilled buffers back in
+         * memory for the next filters (gzip, sub...) or for connections
+         * without sendfile (e.g. SSL). Once created, all output goes
+         * through this chain to preserve ordering.
+         */
+
+        ctx = ngx_pcalloc(r->pool, sizeof(ngx_output_chain_ctx_t));
+        if (ctx == NULL) {
+            return NGX_ERROR;
+        }
+
+        clcf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
+
+        ctx->sendfile = r->connection->sendfile;
+        ctx->need_in_memory = r->main_filter_need_in_memory
+                              || r->filter_need_in_memory;
+        ctx->need_in_temp = r->filter_need_temporary;
+        ctx->alignment = clcf->directio_alignment;
+        ctx->pool = r->pool;
+        ctx->bufs = clcf->output_buffers;
+        ctx->tag = (ngx_buf_tag_t) &ngx_http_wasm_filter_module;
+        ctx->output_filter = (ngx_output_chain_filter_pt)
+                             ngx_http_next_body_filter;
+        ctx->filter_ctx = r;
+
+        rctx->resp_output = ctx;
+    }
+
+    return ngx_output_chain(ctx, in);
+}
+
+
+static ngx_int_t
+ngx_http_wasm_request_body_filter_handler(ngx_http_request_t *r,
+    ngx_chain_t *in)
+{
+    ngx_int_t                 rc;
+    ngx_chain_t              *cl;
+    ngx_http_wasm_req_ctx_t  *rctx = NULL;
+
+    dd("enter");
+
+    rc = ngx_http_wasm_rctx(r, &rctx);
+    if (rc == NGX_ERROR) {
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    }
+
+    if (rc == NGX_DECLINED
+        || !rctx->req_body_streaming
+        || (rctx->entered_header_filter && !rctx->resp_chunk_eof))
+    {
+        /* not streaming or response in progress */
+        return ngx_http_next_request_body_filter(r, in);
+    }
+
+    rctx->req_chunk = in;
+    rctx->req_chunk_len = 0;
+
+    for (cl = rctx->req_chunk; cl; cl = cl->next) {
+        rctx->req_chunk_len += ngx_buf_size(cl->buf);
+
+        if (cl->buf->last_buf) {
+            rctx->req_chunk_eof = 1;
+            break;
+        }
+    }
+
+    rctx->in_req_body_filter = 1;
+
+    rc = ngx_wasm_ops_resume(&rctx->opctx,
+                             NGX_HTTP_WASM_REQ_BODY_FILTER_PHASE);
+
+    rctx->in_req_body_filter = 0;
+
+    dd("ops resume rc: %ld", rc);
+
+    in = rctx->req_chunk;
+    rctx->req_chunk = NULL;
+
+    if (rc == NGX_ERROR || rc >= NGX_HTTP_SPECIAL_RESPONSE) {
+        rc = NGX_HTTP_INTERNAL_SERVER_ERROR;
+        goto done;
+    }
+
+    ngx_wasm_chain_log_debug(r->connection->log, in, "rctx->req_chunk");
+
+    rc = ngx_http_next_request_body_filter(r, in);
+
+done:
+
+    ngx_log_debug1(NGX_LOG_DEBUG_WASM, r->connection->log, 0,
+                   "wasm \"request_body_filter\" phase rc: %d", rc);
+
+    return rc;
 }
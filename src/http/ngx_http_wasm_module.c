@@ -4,7 +4,9 @@
 #include "ddebug.h"
 
 #include <ngx_http_wasm.h>
+#include <ngx_http_proxy_wasm.h>
 #include <ngx_proxy_wasm_properties.h>
+#include <ngx_wa_shm_kv.h>
 #if (NGX_WASM_LUA)
 #include <ngx_wasm_lua.h>
 #include <ngx_http_lua_util.h>
@@ -36,6 +38,11 @@ static ngx_int_t ngx_http_wasm_check_finalize(ngx_http_wasm_req_ctx_t *rctx,
 static void ngx_http_wasm_wev_handler(ngx_http_request_t *r);
 
 
+static ngx_path_init_t  ngx_http_wasm_resp_body_temp_path = {
+    ngx_string(NGX_HTTP_WASM_RESP_BODY_TEMP_PATH), { 1, 2, 0 }
+};
+
+
 static ngx_wasm_phase_t  ngx_http_wasm_phases[] = {
 
     { ngx_string("post_read"),
@@ -71,36 +78,41 @@ static ngx_wasm_phase_t  ngx_http_wasm_phases[] = {
       4,
       (1 << NGX_HTTP_CONTENT_PHASE) },
 
+    { ngx_string("request_body_filter"),
+      NGX_HTTP_WASM_REQ_BODY_FILTER_PHASE,
+      5,
+      (1 << NGX_HTTP_WASM_REQ_BODY_FILTER_PHASE) },
+
     { ngx_string("header_filter"),
       NGX_HTTP_WASM_HEADER_FILTER_PHASE,
-      5,
+      6,
       (1 << NGX_HTTP_WASM_HEADER_FILTER_PHASE) },
 
     { ngx_string("body_filter"),
       NGX_HTTP_WASM_BODY_FILTER_PHASE,
-      6,
+      7,
       (1 << NGX_HTTP_WASM_BODY_FILTER_PHASE) },
 
 #ifdef NGX_WASM_RESPONSE_TRAILERS
     { ngx_string("trailer_filter"),
       NGX_HTTP_WASM_TRAILER_FILTER_PHASE,
-      7,
+      8,
       (1 << NGX_HTTP_WASM_TRAILER_FILTER_PHASE) },
 #endif
 
     { ngx_string("log"),
       NGX_HTTP_LOG_PHASE,
-      8,
+      9,
       (1 << NGX_HTTP_LOG_PHASE) },
 
     { ngx_string("done"),
       NGX_WASM_DONE_PHASE,
-      9,
+      10,
       (1 << NGX_WASM_DONE_PHASE) },
 
     { ngx_string("background"),
       NGX_WASM_BACKGROUND_PHASE,
-      10,
+      11,
       (1 << NGX_WASM_BACKGROUND_PHASE) },
 
     { ngx_null_string, 0, 0, 0 }
@@ -174,6 +186,20 @@ static ngx_command_t  ngx_http_wasm_module_cmds[] = {
       offsetof(ngx_http_wasm_loc_conf_t, resp_body_buffers),
       NULL },
 
+    { ngx_string("wasm_response_body_max_temp_file_size"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_off_slot,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      offsetof(ngx_http_wasm_loc_conf_t, resp_body_max_temp_file_size),
+      NULL },
+
+    { ngx_string("wasm_response_body_temp_path"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE1234,
+      ngx_conf_set_path_slot,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      offsetof(ngx_http_wasm_loc_conf_t, resp_body_temp_path),
+      NULL },
+
     { ngx_string("wasm_postpone_rewrite"),
       NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE1,
       ngx_conf_set_flag_slot,
@@ -191,7 +217,7 @@ static ngx_command_t  ngx_http_wasm_module_cmds[] = {
     /* proxy_wasm */
 
     { ngx_string("proxy_wasm"),
-      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE12,
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_1MORE,
       ngx_http_wasm_proxy_wasm_directive,
       NGX_HTTP_LOC_CONF_OFFSET,
       NGX_HTTP_MODULE,
@@ -204,6 +230,13 @@ static ngx_command_t  ngx_http_wasm_module_cmds[] = {
       NGX_HTTP_MODULE,
       NULL },
 
+    { ngx_string("proxy_wasm_load_shedding"),
+      NGX_HTTP_MAIN_CONF|NGX_CONF_1MORE,
+      ngx_http_wasm_proxy_wasm_load_shedding_directive,
+      NGX_HTTP_MAIN_CONF_OFFSET,
+      0,
+      NULL },
+
     { ngx_string("proxy_wasm_request_headers_in_access"),
       NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE1,
       ngx_conf_set_flag_slot,
@@ -211,6 +244,13 @@ static ngx_command_t  ngx_http_wasm_module_cmds[] = {
       offsetof(ngx_http_wasm_loc_conf_t, pwm_req_headers_in_access),
       NULL },
 
+    { ngx_string("proxy_wasm_request_body_streaming"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_flag_slot,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      offsetof(ngx_http_wasm_loc_conf_t, pwm_req_body_streaming),
+      NULL },
+
     { ngx_string("proxy_wasm_lua_resolver"),
       NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE1,
       ngx_wasm_core_pwm_lua_resolver_directive,
@@ -351,7 +391,9 @@ ngx_http_wasm_create_loc_conf(ngx_conf_t *cf)
     loc->recv_timeout = NGX_CONF_UNSET_MSEC;
     loc->socket_buffer_size = NGX_CONF_UNSET_SIZE;
     loc->socket_buffer_reuse = NGX_CONF_UNSET;
+    loc->resp_body_max_temp_file_size = NGX_CONF_UNSET;
     loc->pwm_req_headers_in_access = NGX_CONF_UNSET;
+    loc->pwm_req_body_streaming = NGX_CONF_UNSET;
     loc->pwm_lua_resolver = NGX_CONF_UNSET;
     loc->pwm_log_dispatch_errors = NGX_CONF_UNSET;
     loc->postpone_rewrite = NGX_CONF_UNSET;
@@ -412,9 +454,23 @@ ngx_http_wasm_merge_loc_conf(ngx_conf_t *cf, void *parent, void *child)
                               NGX_WASM_DEFAULT_RESP_BODY_BUF_NUM,
                               NGX_WASM_DEFAULT_RESP_BODY_BUF_SIZE);
 
+    ngx_conf_merge_off_value(conf->resp_body_max_temp_file_size,
+                             prev->resp_body_max_temp_file_size, 0);
+
+    if (ngx_conf_merge_path_value(cf, &conf->resp_body_temp_path,
+                                  prev->resp_body_temp_path,
+                                  &ngx_http_wasm_resp_body_temp_path)
+        != NGX_OK)
+    {
+        return NGX_CONF_ERROR;
+    }
+
     ngx_conf_merge_value(conf->pwm_req_headers_in_access,
                          prev->pwm_req_headers_in_access, 0);
 
+    ngx_conf_merge_value(conf->pwm_req_body_streaming,
+                         prev->pwm_req_body_streaming, 0);
+
     ngx_conf_merge_value(conf->pwm_lua_resolver,
                          prev->pwm_lua_resolver, 0);
 
@@ -474,6 +530,11 @@ ngx_http_wasm_init_process(ngx_cycle_t *cycle)
     ngx_http_wasm_loc_conf_t   *loc;
     ngx_http_wasm_main_conf_t  *mcf;
 
+    /* needs event timers (not initialized in ngx_wasmx_init_process) */
+    if (ngx_wa_shm_kv_init_sweeper(cycle) != NGX_OK) {
+        return NGX_ERROR;
+    }
+
     mcf = ngx_http_cycle_get_module_main_conf(cycle, ngx_http_wasm_module);
     if (mcf == NULL || mcf->vm == NULL) {
         /* no http{} block */
@@ -498,6 +559,10 @@ ngx_http_wasm_init_process(ngx_cycle_t *cycle)
         return NGX_ERROR;
     }
 
+    if (mcf->pwm_shed_lag) {
+        ngx_http_proxy_wasm_health_init(cycle);
+    }
+
     return NGX_OK;
 }
 
@@ -507,6 +572,8 @@ ngx_http_wasm_exit_process(ngx_cycle_t *cycle)
 {
     ngx_http_wasm_main_conf_t  *mcf;
 
+    ngx_wa_shm_kv_exit_sweeper(cycle);
+
     mcf = ngx_http_cycle_get_module_main_conf(cycle, ngx_http_wasm_module);
     if (mcf) {
         ngx_proxy_wasm_root_destroy(&mcf->pwroot);
@@ -1060,6 +1127,13 @@ orig:
 
             rc = rctx->r_content_handler(r);
             dd("orig \"content\" rc: %ld", rc);
+
+            if ((rc == NGX_OK || rc == NGX_DONE)
+                && ngx_http_proxy_wasm_read_streamed_body(rctx) != NGX_OK)
+            {
+                rc = NGX_ERROR;
+            }
+
             if (rc == NGX_OK) {
                 return NGX_OK;
             }
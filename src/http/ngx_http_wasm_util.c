@@ -263,6 +263,94 @@ get_request_body(ngx_http_request_t *r)
 }
 
 
+static ngx_int_t
+ngx_http_wasm_set_req_chunk(ngx_http_wasm_req_ctx_t *rctx, ngx_str_t *body,
+    size_t at, unsigned prepend)
+{
+    size_t        len, keep, n;
+    ssize_t       rd;
+    ngx_buf_t    *b;
+    ngx_chain_t  *cl;
+
+    /**
+     * The streamed chunk buffers are owned by the request body
+     * filters ahead of us: copy what is kept along with the new body
+     * into a single buffer and mark the originals as consumed.
+     */
+
+    len = ngx_wasm_chain_len(rctx->req_chunk, NULL);
+    keep = prepend ? len : ngx_min(at, len);
+
+    if (keep + body->len) {
+        b = ngx_create_temp_buf(rctx->pool, keep + body->len);
+        if (b == NULL) {
+            return NGX_ERROR;
+        }
+
+        if (prepend) {
+            b->last = ngx_cpymem(b->last, body->data, body->len);
+        }
+
+    } else {
+        b = ngx_calloc_buf(rctx->pool);
+        if (b == NULL) {
+            return NGX_ERROR;
+        }
+    }
+
+    for (cl = rctx->req_chunk; cl; cl = cl->next) {
+        n = ngx_min((size_t) ngx_buf_size(cl->buf), keep);
+
+        if (n && ngx_buf_in_memory(cl->buf)) {
+            b->last = ngx_cpymem(b->last, cl->buf->pos, n);
+
+        } else if (n) {
+            /* larger than client_body_buffer_size: in the temp file */
+            rd = ngx_read_file(cl->buf->file, b->last, n, cl->buf->file_pos);
+            if (rd != (ssize_t) n) {
+                return NGX_ERROR;
+            }
+
+            b->last += n;
+        }
+
+        keep -= n;
+
+        cl->buf->pos = cl->buf->last;
+
+        if (cl->buf->in_file) {
+            cl->buf->file_pos = cl->buf->file_last;
+        }
+    }
+
+    if (!prepend) {
+        b->last = ngx_cpymem(b->last, body->data, body->len);
+    }
+
+    b->tag = buf_tag;
+    b->last_buf = rctx->req_chunk_eof;
+
+    if (ngx_buf_size(b) == 0 && !b->last_buf) {
+        rctx->req_chunk = NULL;
+        rctx->req_chunk_len = 0;
+        return NGX_OK;
+    }
+
+    cl = ngx_alloc_chain_link(rctx->pool);
+    if (cl == NULL) {
+        return NGX_ERROR;
+    }
+
+    cl->buf = b;
+    cl->next = NULL;
+
+    rctx->req_chunk = cl;
+    rctx->req_chunk_len = ngx_buf_size(b);
+
+    return NGX_OK;
+}
+
+
 ngx_int_t
 ngx_http_wasm_set_req_body(ngx_http_wasm_req_ctx_t *rctx, ngx_str_t *body,
     size_t at, size_t max)
@@ -274,13 +362,17 @@ ngx_http_wasm_set_req_body(ngx_http_wasm_req_ctx_t *rctx, ngx_str_t *body,
         return NGX_ABORT;
     }
 
+    body->len = ngx_min(body->len, max);
+
+    if (rctx->in_req_body_filter) {
+        return ngx_http_wasm_set_req_chunk(rctx, body, at, 0);
+    }
+
     rb = get_request_body(r);
     if (rb == NULL) {
         return NGX_ERROR;
     }
 
-    body->len = ngx_min(body->len, max);
-
     if (ngx_wasm_chain_append(r->connection->pool, &rb->bufs, at, body,
                               &rctx->free_bufs, buf_tag, 0)
         != NGX_OK)
@@ -304,6 +396,10 @@ ngx_http_wasm_prepend_req_body(ngx_http_wasm_req_ctx_t *rctx, ngx_str_t *body)
         return NGX_ABORT;
     }
 
+    if (rctx->in_req_body_filter) {
+        return ngx_http_wasm_set_req_chunk(rctx, body, 0, 1);
+    }
+
     rb = get_request_body(r);
     if (rb == NULL) {
         return NGX_ERROR;
@@ -322,6 +418,48 @@ ngx_http_wasm_prepend_req_body(ngx_http_wasm_req_ctx_t *rctx, ngx_str_t *body)
 }
 
 
+ngx_int_t
+ngx_http_wasm_splice_req_body(ngx_http_wasm_req_ctx_t *rctx, ngx_str_t *body,
+    size_t start, size_t end)
+{
+    ngx_http_request_t       *r = rctx->r;
+    ngx_http_request_body_t  *rb;
+
+    if (rctx->entered_header_filter) {
+        return NGX_ABORT;
+    }
+
+    if (rctx->in_req_body_filter) {
+        if (ngx_wasm_chain_splice(rctx->pool, &rctx->req_chunk, start, end,
+                                  body, &rctx->free_bufs, buf_tag)
+            != NGX_OK)
+        {
+            return NGX_ERROR;
+        }
+
+        rctx->req_chunk_len = ngx_wasm_chain_len(rctx->req_chunk, NULL);
+
+        return NGX_OK;
+    }
+
+    rb = get_request_body(r);
+    if (rb == NULL) {
+        return NGX_ERROR;
+    }
+
+    if (ngx_wasm_chain_splice(r->connection->pool, &rb->bufs, start, end,
+                              body, &rctx->free_bufs, buf_tag)
+        != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+
+    r->headers_in.content_length_n = ngx_wasm_chain_len(rb->bufs, NULL);
+
+    return NGX_OK;
+}
+
+
 void
 ngx_http_wasm_set_resp_status(ngx_http_wasm_req_ctx_t *rctx,
     ngx_int_t status, u_char *reason, size_t reason_len)
@@ -395,6 +533,37 @@ ngx_http_wasm_set_resp_body(ngx_http_wasm_req_ctx_t *rctx, ngx_str_t *body,
 }
 
 
+ngx_int_t
+ngx_http_wasm_splice_resp_body(ngx_http_wasm_req_ctx_t *rctx, ngx_str_t *body,
+    size_t start, size_t end)
+{
+    ngx_http_request_t  *r = rctx->r;
+
+    if (rctx->resp_chunk == NULL) {
+        return NGX_ABORT;
+    }
+
+    if (r->header_sent && !r->chunked) {
+        ngx_wasm_log_error(NGX_LOG_WARN, r->connection->log, 0,
+                           "overriding response body chunk while "
+                           "Content-Length header already sent");
+    }
+
+    if (ngx_wasm_chain_splice(r->connection->pool, &rctx->resp_chunk,
+                              start, end, body, &rctx->free_bufs,
+                              rctx->env.buf_tag)
+        != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+
+    rctx->resp_chunk_len = ngx_wasm_chain_len(rctx->resp_chunk,
+                                              &rctx->resp_chunk_eof);
+
+    return NGX_OK;
+}
+
+
 ngx_int_t
 ngx_http_wasm_prepend_resp_body(ngx_http_wasm_req_ctx_t *rctx, ngx_str_t *body)
 {
@@ -437,7 +606,8 @@ ngx_http_wasm_prepend_resp_body(ngx_http_wasm_req_ctx_t *rctx, ngx_str_t *body)
 
 ngx_int_t
 ngx_http_wasm_ops_add_filter(ngx_wasm_ops_plan_t *plan,
-    ngx_str_t *name, ngx_str_t *config, ngx_wavm_t *vm)
+    ngx_str_t *name, ngx_str_t *config, void *cond, size_t body_window,
+    ngx_wavm_t *vm)
 {
     ngx_int_t                       rc = NGX_ERROR;
     ngx_wasm_op_t                  *op;
@@ -459,6 +629,8 @@ ngx_http_wasm_ops_add_filter(ngx_wasm_ops_plan_t *plan,
     filter->log = vm->log;
     filter->pool = store->pool;
     filter->store = store;
+    filter->cond = cond;
+    filter->body_window = body_window;
 
     if (config) {
         filter->config.len = config->len;
@@ -492,6 +664,7 @@ ngx_http_wasm_ops_add_filter(ngx_wasm_ops_plan_t *plan,
     op->on_phases = (1 << NGX_HTTP_REWRITE_PHASE)
                     | (1 << NGX_HTTP_ACCESS_PHASE)
                     | (1 << NGX_HTTP_CONTENT_PHASE)
+                    | (1 << NGX_HTTP_WASM_REQ_BODY_FILTER_PHASE)
                     | (1 << NGX_HTTP_WASM_HEADER_FILTER_PHASE)
                     | (1 << NGX_HTTP_WASM_BODY_FILTER_PHASE)
 #ifdef NGX_WASM_RESPONSE_TRAILERS
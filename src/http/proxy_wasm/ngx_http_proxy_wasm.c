@@ -6,6 +6,23 @@
 #include <ngx_http_proxy_wasm.h>
 
 
+#define NGX_HTTP_PROXY_WASM_HEALTH_INTERVAL  100
+#define ngx_http_proxy_wasm_shed_recovered(v, threshold)                     \
+    ((threshold) == 0 || (v) * 4 <= (threshold) * 3)
+
+
+typedef struct {
+    ngx_event_t                        ev;
+    ngx_msec_t                         next;        /* expected next tick */
+    ngx_msec_t                         lag;         /* smoothed loop lag */
+
+    unsigned                           overloaded:1;
+} ngx_http_proxy_wasm_health_t;
+
+
+static ngx_http_proxy_wasm_health_t  health;
+
+
 static ngx_int_t
 ngx_http_proxy_wasm_on_request_headers(ngx_proxy_wasm_exec_t *pwexec,
     ngx_proxy_wasm_action_e *out)
@@ -56,19 +73,48 @@ static ngx_int_t
 ngx_http_proxy_wasm_on_request_body(ngx_proxy_wasm_exec_t *pwexec,
     ngx_proxy_wasm_action_e *out)
 {
+    size_t                    len;
+    unsigned                  eof = 1;
     ngx_int_t                 rc;
     ngx_wavm_instance_t      *instance;
+    ngx_http_wasm_req_ctx_t  *rctx;
     ngx_proxy_wasm_filter_t  *filter;
     wasm_val_vec_t           *rets;
 
     instance = ngx_proxy_wasm_pwexec2instance(pwexec);
     filter = pwexec->filter;
+    len = pwexec->parent->req_body_len;
+
+    if (pwexec->parent->req_body_streaming) {
+        rctx = ngx_http_proxy_wasm_get_rctx(instance);
+        eof = rctx->req_chunk_eof;
+    }
+
+    if (filter->body_window) {
+        if (pwexec->req_body_windowed) {
+            /* window inspected, let the rest of the body through */
+            return NGX_OK;
+        }
+
+        /* report and hand out the bytes within the window only */
+
+        len = ngx_min(len, filter->body_window
+                           - (size_t) pwexec->req_body_seen);
+
+        pwexec->req_body_seen += len;
+        pwexec->req_body_windowed =
+            !pwexec->parent->req_body_streaming
+            || pwexec->req_body_seen >= (off_t) filter->body_window;
+
+        pwexec->body_visible = len;
+    }
 
     rc = ngx_wavm_instance_call_funcref(instance,
                                         filter->proxy_on_http_request_body,
-                                        &rets, pwexec->id,
-                                        pwexec->parent->req_body_len,
-                                        1); /* eof: 1 */
+                                        &rets, pwexec->id, len, eof);
+
+    pwexec->body_visible = 0;
+
     if (rc == NGX_ERROR || rc == NGX_ABORT) {
         return rc;
     }
@@ -162,6 +208,67 @@ ngx_http_proxy_wasm_on_request_body_handler(ngx_http_request_t *r)
 }
 
 
+static void
+ngx_http_proxy_wasm_on_streamed_body_handler(ngx_http_request_t *r)
+{
+    ngx_http_wasm_req_ctx_t  *rctx;
+
+    if (ngx_http_wasm_rctx(r, &rctx) != NGX_OK) {
+        return;
+    }
+
+    /* chunks already went through the request_body_filter phase */
+    rctx->req_body_received = 1;
+
+    if (rctx->req_body_waited) {
+        /* decrement r->count */
+        ngx_http_finalize_request(r, NGX_DONE);
+    }
+}
+
+
+ngx_int_t
+ngx_http_proxy_wasm_read_streamed_body(ngx_http_wasm_req_ctx_t *rctx)
+{
+    ngx_int_t              rc;
+    ngx_http_request_t    *r = rctx->r;
+    ngx_proxy_wasm_ctx_t  *pwctx = rctx->data;
+
+    if (!rctx->req_body_streaming
+        || rctx->req_body_received
+        || pwctx == NULL
+        || !(pwctx->steps
+             & ngx_proxy_wasm_step_flag(NGX_PROXY_WASM_STEP_REQ_BODY))
+        || r != r->main
+        || r->request_body
+        || r->discard_body)
+    {
+        /* not streaming, or the content handler read the body */
+        return NGX_OK;
+    }
+
+    if ((rctx->entered_header_filter && !rctx->resp_chunk_eof)
+        || !ngx_proxy_wasm_ctx_idle(pwctx))
+    {
+        /* response steps in progress */
+        return NGX_OK;
+    }
+
+    ngx_log_debug0(NGX_LOG_DEBUG_WASM, r->connection->log, 0,
+                   "proxy_wasm reading request body left unread "
+                   "by content handler");
+
+    rc = ngx_http_wasm_read_client_request_body(r,
+             ngx_http_proxy_wasm_on_streamed_body_handler);
+    if (rc == NGX_AGAIN) {
+        rctx->req_body_waited = 1;
+        return NGX_OK;
+    }
+
+    return rc >= NGX_HTTP_SPECIAL_RESPONSE ? NGX_ERROR : NGX_OK;
+}
+
+
 static ngx_int_t
 ngx_http_proxy_wasm_on_response_headers(ngx_proxy_wasm_exec_t *pwexec,
     ngx_proxy_wasm_action_e *out)
@@ -211,10 +318,49 @@ ngx_http_proxy_wasm_on_response_headers(ngx_proxy_wasm_exec_t *pwexec,
 }
 
 
+static off_t
+ngx_http_proxy_wasm_resp_body_window(ngx_proxy_wasm_exec_t *pwexec)
+{
+    size_t                  i;
+    off_t                   window = 0;
+    ngx_proxy_wasm_ctx_t   *pwctx = pwexec->parent;
+    ngx_proxy_wasm_exec_t  *pwexecs, *next;
+
+    /**
+     * The buffered body is handed to this filter and to the next ones:
+     * buffer up to the largest of their windows, or the whole body if
+     * one of them has none.
+     */
+
+    pwexecs = (ngx_proxy_wasm_exec_t *) pwctx->pwexecs.elts;
+
+    for (i = pwexec->index; i < pwctx->nfilters; i++) {
+        next = &pwexecs[i];
+
+        if (next->skip
+            || next->resp_body_windowed
+            || !(next->filter->steps
+                 & ngx_proxy_wasm_step_flag(NGX_PROXY_WASM_STEP_RESP_BODY)))
+        {
+            continue;
+        }
+
+        if (next->filter->body_window == 0) {
+            return 0;
+        }
+
+        window = ngx_max(window, (off_t) next->filter->body_window);
+    }
+
+    return window;
+}
+
+
 static ngx_int_t
 ngx_http_proxy_wasm_on_response_body(ngx_proxy_wasm_exec_t *pwexec,
     ngx_proxy_wasm_action_e *out)
 {
+    off_t                     len;
     ngx_int_t                 rc;
     ngx_http_wasm_req_ctx_t  *rctx;
     wasm_val_vec_t           *rets;
@@ -228,14 +374,43 @@ ngx_http_proxy_wasm_on_response_body(ngx_proxy_wasm_exec_t *pwexec,
                                 == rctx->resp_content_length_n);
     }
 
-    if (rctx->resp_chunk_len || rctx->resp_chunk_eof) {
+    len = rctx->resp_chunk_len;
+
+    if (pwexec->filter->body_window) {
+        if (pwexec->resp_body_windowed) {
+            /* window inspected, let the rest of the body through */
+            return NGX_OK;
+        }
+
+        if (!rctx->resp_chunk_eof
+            && rctx->resp_bufs == NULL
+            && rctx->resp_chunk_len < (off_t) pwexec->filter->body_window)
+        {
+            /* buffer the window before invoking the filter */
+            rctx->resp_bufs_window =
+                ngx_http_proxy_wasm_resp_body_window(pwexec);
+            *out = NGX_PROXY_WASM_ACTION_PAUSE;
+            return NGX_OK;
+        }
+
+        pwexec->resp_body_windowed = 1;
+
+        /* report and hand out the bytes within the window only */
+
+        len = ngx_min(len, (off_t) pwexec->filter->body_window);
+        pwexec->body_visible = (size_t) len;
+    }
+
+    if (len || rctx->resp_chunk_eof) {
 
         rc = ngx_wavm_instance_call_funcref(instance,
                  pwexec->filter->proxy_on_http_response_body,
                  &rets, pwexec->id,
-                 rctx->resp_chunk_len,
+                 len,
                  rctx->resp_chunk_eof);
 
+        pwexec->body_visible = 0;
+
         if (rc == NGX_ERROR || rc == NGX_ABORT) {
             return rc;
         }
@@ -399,6 +574,9 @@ ngx_http_proxy_wasm_ctx(void *data)
         pwctx->main = r == r->main;
         pwctx->data = rctx;
         pwctx->req_headers_in_access = loc->pwm_req_headers_in_access;
+        pwctx->req_body_streaming = loc->pwm_req_body_streaming;
+
+        rctx->req_body_streaming = loc->pwm_req_body_streaming;
 
         /* for on_request_body retrieval */
         rctx->data = pwctx;
@@ -460,8 +638,206 @@ ngx_http_proxy_wasm_resume(ngx_proxy_wasm_exec_t *pwexec,
 }
 
 
+static void
+ngx_http_proxy_wasm_health_handler(ngx_event_t *ev)
+{
+    ngx_msec_t  lag;
+
+    lag = ngx_current_msec > health.next ? ngx_current_msec - health.next : 0;
+
+    health.lag = (health.lag * 3 + lag) / 4;
+    health.next = ngx_current_msec + NGX_HTTP_PROXY_WASM_HEALTH_INTERVAL;
+
+    ngx_add_timer(ev, NGX_HTTP_PROXY_WASM_HEALTH_INTERVAL);
+}
+
+
+void
+ngx_http_proxy_wasm_health_init(ngx_cycle_t *cycle)
+{
+    ngx_event_t  *ev = &health.ev;
+
+    ngx_memzero(&health, sizeof(ngx_http_proxy_wasm_health_t));
+
+    ev->handler = ngx_http_proxy_wasm_health_handler;
+    ev->data = &health;
+    ev->log = cycle->log;
+    ev->cancelable = 1;
+
+    health.next = ngx_current_msec + NGX_HTTP_PROXY_WASM_HEALTH_INTERVAL;
+
+    ngx_add_timer(ev, NGX_HTTP_PROXY_WASM_HEALTH_INTERVAL);
+}
+
+
+static ngx_uint_t
+ngx_http_proxy_wasm_overloaded(ngx_http_request_t *r)
+{
+    ngx_uint_t                  conns;
+    ngx_http_wasm_main_conf_t  *mcf;
+
+    mcf = ngx_http_get_module_main_conf(r, ngx_http_wasm_module);
+
+    if (mcf->pwm_shed_lag == 0 && mcf->pwm_shed_conns == 0) {
+        return 0;
+    }
+
+    conns = ngx_cycle->connection_n - ngx_cycle->free_connection_n;
+
+    if (!health.overloaded) {
+        if ((mcf->pwm_shed_lag && health.lag > mcf->pwm_shed_lag)
+            || (mcf->pwm_shed_conns && conns > mcf->pwm_shed_conns))
+        {
+            ngx_wasm_log_error(NGX_LOG_WARN, r->connection->log, 0,
+                               "proxy_wasm worker overloaded, shedding "
+                               "optional filters (lag: %Mms, "
+                               "connections: %ui)", health.lag, conns);
+
+            health.overloaded = 1;
+        }
+
+    } else if (ngx_http_proxy_wasm_shed_recovered(health.lag,
+                                                  mcf->pwm_shed_lag)
+               && ngx_http_proxy_wasm_shed_recovered(conns,
+                                                     mcf->pwm_shed_conns))
+    {
+        ngx_wasm_log_error(NGX_LOG_WARN, r->connection->log, 0,
+                           "proxy_wasm worker recovered, resuming "
+                           "optional filters (lag: %Mms, connections: %ui)",
+                           health.lag, conns);
+
+        health.overloaded = 0;
+    }
+
+    return health.overloaded;
+}
+
+
+static void
+ngx_http_proxy_wasm_shed(ngx_proxy_wasm_filter_t *filter,
+    ngx_http_proxy_wasm_cond_t *cond, ngx_log_t *log)
+{
+    ngx_int_t          rc;
+    ngx_str_t          name;
+    ngx_wa_metrics_t  *metrics = ngx_wasmx_metrics((ngx_cycle_t *) ngx_cycle);
+    u_char             buf[NGX_MAX_ERROR_STR];
+
+    ngx_log_debug1(NGX_LOG_DEBUG_WASM, log, 0,
+                   "proxy_wasm shedding optional \"%V\" filter",
+                   filter->name);
+
+    if (metrics == NULL) {
+        return;
+    }
+
+    if (!cond->shed_mid_defined) {
+        cond->shed_mid_defined = 1;
+
+        name.data = buf;
+        name.len = ngx_snprintf(buf, NGX_MAX_ERROR_STR, "wasmx:%V:shed",
+                                filter->name) - buf;
+
+        rc = ngx_wa_metrics_define(metrics, &name, NGX_WA_METRIC_COUNTER,
+                                   NULL, 0, &cond->shed_mid);
+        if (rc != NGX_OK) {
+            ngx_wasm_log_error(NGX_LOG_WARN, log, 0,
+                               "could not define \"%V\" metric", &name);
+            cond->shed_mid_error = 1;
+        }
+    }
+
+    if (!cond->shed_mid_error) {
+        (void) ngx_wa_metrics_increment(metrics, cond->shed_mid, 1);
+    }
+}
+
+
+static ngx_int_t
+ngx_http_proxy_wasm_sample(ngx_http_request_t *r,
+    ngx_http_proxy_wasm_cond_t *cond)
+{
+    uint32_t   hash;
+    ngx_str_t  key;
+
+    if (cond->sample >= NGX_HTTP_PROXY_WASM_SAMPLE_MAX) {
+        return NGX_OK;
+    }
+
+    if (cond->sample == 0) {
+        return NGX_DECLINED;
+    }
+
+    key.len = 0;
+
+    if (cond->sample_key) {
+        if (ngx_http_complex_value(r, cond->sample_key, &key) != NGX_OK) {
+            return NGX_ERROR;
+        }
+    }
+
+    if (key.len) {
+        /* consistent sampling: same decision for a given key */
+        hash = ngx_murmur_hash2(key.data, key.len);
+
+    } else {
+        hash = (uint32_t) ngx_random();
+    }
+
+    return hash % NGX_HTTP_PROXY_WASM_SAMPLE_MAX < cond->sample
+           ? NGX_OK : NGX_DECLINED;
+}
+
+
+static ngx_int_t
+ngx_http_proxy_wasm_applies(ngx_proxy_wasm_filter_t *filter, void *data)
+{
+    ngx_int_t                    rc;
+    ngx_str_t                    value;
+    ngx_http_wasm_req_ctx_t     *rctx = data;
+    ngx_http_request_t          *r = rctx->r;
+    ngx_http_proxy_wasm_cond_t  *cond = filter->cond;
+
+    if (cond->methods && !(r->method & cond->methods)) {
+        return NGX_DECLINED;
+    }
+
+    if (cond->prefix.len
+        && (r->uri.len < cond->prefix.len
+            || ngx_strncmp(r->uri.data, cond->prefix.data,
+                           cond->prefix.len) != 0))
+    {
+        return NGX_DECLINED;
+    }
+
+    if (cond->predicate) {
+        if (ngx_http_complex_value(r, cond->predicate, &value) != NGX_OK) {
+            return NGX_ERROR;
+        }
+
+        if (value.len == 0 || (value.len == 1 && value.data[0] == '0')) {
+            return NGX_DECLINED;
+        }
+    }
+
+    if (cond->sampled) {
+        rc = ngx_http_proxy_wasm_sample(r, cond);
+        if (rc != NGX_OK) {
+            return rc;
+        }
+    }
+
+    if (cond->optional && ngx_http_proxy_wasm_overloaded(r)) {
+        ngx_http_proxy_wasm_shed(filter, cond, r->connection->log);
+        return NGX_DECLINED;
+    }
+
+    return NGX_OK;
+}
+
+
 ngx_proxy_wasm_subsystem_t  ngx_http_proxy_wasm = {
     ngx_http_proxy_wasm_ctx,
     ngx_http_proxy_wasm_resume,
     ngx_http_proxy_wasm_ecode,
+    ngx_http_proxy_wasm_applies,
 };
@@ -7,7 +7,28 @@
 #include <ngx_http_proxy_wasm_dispatch.h>
 
 
+#define NGX_HTTP_PROXY_WASM_SAMPLE_MAX  10000
+
+
+typedef struct {
+    ngx_http_complex_value_t          *predicate;   /* if= */
+    ngx_uint_t                         methods;     /* methods= */
+    ngx_str_t                          prefix;      /* prefix= */
+    ngx_uint_t                         sample;      /* sample= (x 10000) */
+    ngx_http_complex_value_t          *sample_key;  /* sample_key= */
+    uint32_t                           shed_mid;    /* shed counter metric id */
+
+    unsigned                           sampled:1;
+    unsigned                           optional:1;  /* criticality=optional */
+    unsigned                           shed_mid_defined:1;
+    unsigned                           shed_mid_error:1;
+} ngx_http_proxy_wasm_cond_t;
+
+
 void ngx_http_proxy_wasm_on_request_body_handler(ngx_http_request_t *r);
+ngx_int_t ngx_http_proxy_wasm_read_streamed_body(
+    ngx_http_wasm_req_ctx_t *rctx);
+void ngx_http_proxy_wasm_health_init(ngx_cycle_t *cycle);
 
 
 static ngx_inline ngx_http_wasm_req_ctx_t *
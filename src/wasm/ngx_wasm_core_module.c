@@ -91,7 +91,7 @@ static ngx_command_t  ngx_wasm_core_commands[] = {
       NULL },
 
     { ngx_string("shm_kv"),
-      NGX_WASM_CONF|NGX_CONF_TAKE23|NGX_CONF_TAKE4,
+      NGX_WASM_CONF|NGX_CONF_2MORE,
       ngx_wasm_core_shm_kv_directive,
       NGX_WA_WASM_CONF_OFFSET,
       0,
@@ -167,7 +167,14 @@ ngx_wasm_core_shm_generic_directive(ngx_conf_t *cf, ngx_command_t *cmd,
 {
     size_t                  i;
     ssize_t                 size;
-    ngx_str_t              *value, *name, *arg3;
+    ngx_int_t               cache_max = 0, nshards = 1;
+    ngx_flag_t              ordered = 0, admission = 0;
+    ngx_msec_t              cache_ttl = NGX_CONF_UNSET_MSEC;
+    ngx_str_t              *value, *name, *arg, ttl;
+    ngx_str_t               persist = ngx_null_string;
+#if (NGX_THREADS)
+    ngx_thread_pool_t      *thread_pool = NULL;
+#endif
     ngx_array_t            *shms = ngx_wasmx_shms(cf->cycle);
     ngx_wa_shm_mapping_t   *mapping;
     ngx_wa_shm_t           *shm;
@@ -176,7 +183,6 @@ ngx_wasm_core_shm_generic_directive(ngx_conf_t *cf, ngx_command_t *cmd,
     value = cf->args->elts;
     name = &value[1];
     size = ngx_parse_size(&value[2]);
-    arg3 = (cf->args->nelts == 4) ? &value[3] : NULL;
     eviction = NGX_WA_SHM_EVICTION_SLRU;
 
     if (!name->len) {
@@ -189,30 +195,145 @@ ngx_wasm_core_shm_generic_directive(ngx_conf_t *cf, ngx_command_t *cmd,
         return NGX_CONF_ERROR;
     }
 
-    if (arg3) {
-        if (ngx_str_eq(arg3->data, arg3->len, "eviction=lru", -1)) {
+    for (i = 3; i < cf->args->nelts; i++) {
+        arg = &value[i];
+
+        if (ngx_str_eq(arg->data, arg->len, "eviction=lru", -1)) {
             eviction = NGX_WA_SHM_EVICTION_LRU;
 
-        } else if (ngx_str_eq(arg3->data, arg3->len, "eviction=slru", -1)) {
+        } else if (ngx_str_eq(arg->data, arg->len, "eviction=slru", -1)) {
             eviction = NGX_WA_SHM_EVICTION_SLRU;
 
-        } else if (ngx_str_eq(arg3->data, arg3->len, "eviction=none", -1)) {
+        } else if (ngx_str_eq(arg->data, arg->len, "eviction=none", -1)) {
             eviction = NGX_WA_SHM_EVICTION_NONE;
 
-        } else if (ngx_strncmp(arg3->data, "eviction=", 9) == 0) {
+        } else if (ngx_strncmp(arg->data, "eviction=", 9) == 0) {
             ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
                                "[wasm] invalid eviction policy \"%s\"",
-                               arg3->data + 9);
+                               arg->data + 9);
+            return NGX_CONF_ERROR;
+
+        } else if (type == NGX_WA_SHM_TYPE_KV
+                   && ngx_strncmp(arg->data, "cache=", 6) == 0)
+        {
+            cache_max = ngx_atoi(arg->data + 6, arg->len - 6);
+            if (cache_max == NGX_ERROR || cache_max == 0) {
+                ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                                   "[wasm] invalid cache size \"%s\"",
+                                   arg->data + 6);
+                return NGX_CONF_ERROR;
+            }
+
+        } else if (type == NGX_WA_SHM_TYPE_KV
+                   && ngx_strncmp(arg->data, "cache_ttl=", 10) == 0)
+        {
+            ttl.data = arg->data + 10;
+            ttl.len = arg->len - 10;
+
+            cache_ttl = ngx_parse_time(&ttl, 0);
+            if (cache_ttl == (ngx_msec_t) NGX_ERROR || cache_ttl == 0) {
+                ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                                   "[wasm] invalid cache ttl \"%V\"", &ttl);
+                return NGX_CONF_ERROR;
+            }
+
+        } else if (type == NGX_WA_SHM_TYPE_KV
+                   && ngx_strncmp(arg->data, "shards=", 7) == 0)
+        {
+            nshards = ngx_atoi(arg->data + 7, arg->len - 7);
+            if (nshards == NGX_ERROR
+                || nshards == 0
+                || nshards > NGX_WA_SHM_MAX_SHARDS)
+            {
+                ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                                   "[wasm] invalid shards \"%s\"",
+                                   arg->data + 7);
+                return NGX_CONF_ERROR;
+            }
+
+#if !(NGX_HAVE_ATOMIC_OPS)
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                               "[wasm] shards require atomic operations");
+            return NGX_CONF_ERROR;
+#endif
+
+        } else if (type == NGX_WA_SHM_TYPE_KV
+                   && ngx_str_eq(arg->data, arg->len, "ordered", -1))
+        {
+            ordered = 1;
+
+        } else if (type == NGX_WA_SHM_TYPE_KV
+                   && ngx_str_eq(arg->data, arg->len, "admission=tinylfu", -1))
+        {
+            admission = 1;
+
+        } else if (type == NGX_WA_SHM_TYPE_KV
+                   && ngx_str_eq(arg->data, arg->len, "admission=none", -1))
+        {
+            admission = 0;
+
+        } else if (type == NGX_WA_SHM_TYPE_KV
+                   && ngx_strncmp(arg->data, "admission=", 10) == 0)
+        {
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                               "[wasm] invalid admission policy \"%s\"",
+                               arg->data + 10);
             return NGX_CONF_ERROR;
 
+        } else if (type == NGX_WA_SHM_TYPE_KV
+                   && ngx_strncmp(arg->data, "persist=", 8) == 0)
+        {
+            persist.data = arg->data + 8;
+            persist.len = arg->len - 8;
+
+            if (persist.len == 0
+                || ngx_conf_full_name(cf->cycle, &persist, 0) != NGX_OK)
+            {
+                ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                                   "[wasm] invalid persist path \"%s\"",
+                                   arg->data + 8);
+                return NGX_CONF_ERROR;
+            }
+
+#if (NGX_THREADS)
+            /* snapshots are written off the event loop */
+            thread_pool = ngx_thread_pool_add(cf, NULL);
+            if (thread_pool == NULL) {
+                return NGX_CONF_ERROR;
+            }
+#endif
+
         } else {
             ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
                                "[wasm] invalid option \"%V\"",
-                               arg3);
+                               arg);
             return NGX_CONF_ERROR;
         }
     }
 
+    if (nshards > 1
+        && size / nshards < (ssize_t) (NGX_WA_SHM_MIN_SIZE + ngx_pagesize))
+    {
+        /* each shard is a slab pool of its own */
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "[wasm] shm size of %z bytes is too small "
+                           "for %i shards", size, nshards);
+        return NGX_CONF_ERROR;
+    }
+
+    if (admission && eviction == NGX_WA_SHM_EVICTION_NONE) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "[wasm] \"admission\" requires an eviction "
+                           "policy");
+        return NGX_CONF_ERROR;
+    }
+
+    if (cache_ttl != NGX_CONF_UNSET_MSEC && cache_max == 0) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "[wasm] \"cache_ttl\" requires \"cache\"");
+        return NGX_CONF_ERROR;
+    }
+
     shm = ngx_pcalloc(cf->pool, sizeof(ngx_wa_shm_t));
     if (shm == NULL) {
         return NGX_CONF_ERROR;
@@ -220,6 +341,16 @@ ngx_wasm_core_shm_generic_directive(ngx_conf_t *cf, ngx_command_t *cmd,
 
     shm->type = type;
     shm->eviction = eviction;
+    shm->nshards = (nshards > 1) ? nshards : 0;
+    shm->ordered = ordered;
+    shm->persist = persist;
+#if (NGX_THREADS)
+    shm->thread_pool = thread_pool;
+#endif
+    shm->admission = admission;
+    shm->cache_max = cache_max;
+    shm->cache_ttl = (cache_ttl == NGX_CONF_UNSET_MSEC)
+                     ? NGX_WA_SHM_CACHE_TTL : cache_ttl;
     shm->name = *name;
     shm->log = cf->cycle->log;
 
@@ -204,6 +204,16 @@ ngx_wasm_ops_plan_load(ngx_wasm_ops_plan_t *plan, ngx_log_t *log)
         }
     }
 
+    /* create filters chain template */
+
+    if (ngx_proxy_wasm_chain_init(&plan->conf.proxy_wasm.chain,
+                                  plan->conf.proxy_wasm.pwroot,
+                                  ids, plan->pool, log)
+        != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+
     plan->loaded = 1;
 
     return NGX_OK;
@@ -393,9 +403,8 @@ ngx_wasm_op_proxy_wasm_handler(ngx_wasm_op_ctx_t *opctx,
 {
     ngx_int_t                       rc = NGX_ERROR;
     ngx_uint_t                      isolation;
-    ngx_array_t                    *filter_ids;
     ngx_proxy_wasm_ctx_t           *pwctx;
-    ngx_proxy_wasm_filters_root_t  *pwroot;
+    ngx_proxy_wasm_chain_t         *chain;
     ngx_proxy_wasm_subsystem_t     *subsystem = NULL;
 #ifdef NGX_WASM_HTTP
     ngx_http_wasm_req_ctx_t        *rctx = opctx->data;
@@ -408,8 +417,7 @@ ngx_wasm_op_proxy_wasm_handler(ngx_wasm_op_ctx_t *opctx,
 
     ngx_wa_assert(op->code == NGX_WASM_OP_PROXY_WASM);
 
-    filter_ids = &opctx->plan->conf.proxy_wasm.filter_ids;
-    pwroot = opctx->plan->conf.proxy_wasm.pwroot;
+    chain = &opctx->plan->conf.proxy_wasm.chain;
     isolation = opctx->ctx.proxy_wasm.isolation;
 
     if (isolation == NGX_PROXY_WASM_ISOLATION_UNSET) {
@@ -422,8 +430,7 @@ ngx_wasm_op_proxy_wasm_handler(ngx_wasm_op_ctx_t *opctx,
 #endif
     }
 
-    pwctx = ngx_proxy_wasm_ctx(pwroot, filter_ids, isolation, subsystem,
-                               opctx->data);
+    pwctx = ngx_proxy_wasm_ctx(chain, isolation, subsystem, opctx->data);
     if (pwctx == NULL) {
         goto done;
     }
@@ -470,7 +477,37 @@ ngx_wasm_op_proxy_wasm_handler(ngx_wasm_op_ctx_t *opctx,
             r->headers_in.content_length_n = rctx->req_content_length_n;
         }
 
-        if (!rctx->req_body_received) {
+        if (!(pwctx->steps
+              & ngx_proxy_wasm_step_flag(NGX_PROXY_WASM_STEP_REQ_BODY)))
+        {
+            /* no filter implements "on_request_body" */
+            rc = NGX_OK;
+
+        } else if (rctx->req_body_streaming
+                   && (rctx->req_body_received
+                       || r->request_body
+                       || r->discard_body))
+        {
+            /* body chunks resumed by the request_body_filter phase */
+            rc = NGX_OK;
+
+        } else if (rctx->req_body_streaming
+                   && rctx->r_content_handler
+                   && !rctx->resp_content_chosen)
+        {
+            /*
+             * The content handler reads the body itself (e.g. proxy_pass,
+             * forwarding chunks as they arrive), or it is read after the
+             * handler ran (ngx_http_proxy_wasm_read_streamed_body).
+             */
+            rc = NGX_OK;
+
+        } else if (!rctx->req_body_received) {
+            /*
+             * When streaming, chunks go through the request_body_filter
+             * phase as they are read: also read the body here if no
+             * content handler will (e.g. static files).
+             */
             rc = ngx_http_wasm_read_client_request_body(r,
                      ngx_http_proxy_wasm_on_request_body_handler);
             if (rc == NGX_OK) {
@@ -520,6 +557,13 @@ ngx_wasm_op_proxy_wasm_handler(ngx_wasm_op_ctx_t *opctx,
 
         break;
 
+    case NGX_HTTP_WASM_REQ_BODY_FILTER_PHASE:
+        pwctx->req_body_len = rctx->req_chunk_len;
+
+        rc = ngx_proxy_wasm_resume(pwctx, phase,
+                                   NGX_PROXY_WASM_STEP_REQ_BODY);
+        break;
+
     case NGX_HTTP_WASM_HEADER_FILTER_PHASE:
         rc = ngx_proxy_wasm_resume(pwctx, phase,
                                    NGX_PROXY_WASM_STEP_RESP_HEADERS);
@@ -75,6 +75,7 @@ typedef struct {
 
 typedef struct {
     ngx_array_t                              filter_ids;
+    ngx_proxy_wasm_chain_t                   chain;
     ngx_proxy_wasm_filters_root_t           *pwroot;
     ngx_proxy_wasm_filters_root_t           *worker_pwroot;  /* &mcf->pwroot */
 } ngx_wasm_ops_plan_proxy_wasm_t;
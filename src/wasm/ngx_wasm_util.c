@@ -71,7 +71,7 @@ ngx_wasm_chain_clear(ngx_chain_t *in, size_t offset, unsigned *eof,
 
     for (cl = in; cl; cl = cl->next) {
         buf = cl->buf;
-        len = buf->last - buf->pos;
+        len = ngx_buf_size(buf);
 
         if (eof && (buf->last_buf || buf->last_in_chain)) {
             *eof = 1;
@@ -85,13 +85,23 @@ ngx_wasm_chain_clear(ngx_chain_t *in, size_t offset, unsigned *eof,
             /* reaching start offset */
             n = len - ((pos + len) - offset);  /* bytes left until offset */
             pos += n;
-            buf->last = buf->pos + n;  /* partially consume buffer */
+
+            /* partially consume buffer */
+
+            if (ngx_buf_in_memory(buf)) {
+                buf->last = buf->pos + n;
+            }
+
+            if (buf->in_file) {
+                buf->file_last = buf->file_pos + n;
+            }
 
             ngx_wa_assert(pos == offset);
 
         } else if (pos == offset) {
             /* past start offset, consume buffer */
             buf->pos = buf->last;
+            buf->file_pos = buf->file_last;
 
         } else {
             /* prior start offset, preserve buffer */
@@ -327,6 +337,198 @@ ngx_wasm_chain_append(ngx_pool_t *pool, ngx_chain_t **in, size_t at,
 }
 
 
+static ngx_inline void
+ngx_wasm_buf_advance(ngx_buf_t *buf, off_t n)
+{
+    if (ngx_buf_in_memory(buf)) {
+        buf->pos += n;
+    }
+
+    if (buf->in_file) {
+        buf->file_pos += n;
+    }
+}
+
+
+static ngx_inline void
+ngx_wasm_buf_truncate(ngx_buf_t *buf, off_t n)
+{
+    if (ngx_buf_in_memory(buf)) {
+        buf->last = buf->pos + n;
+    }
+
+    if (buf->in_file) {
+        buf->file_last = buf->file_pos + n;
+    }
+}
+
+
+ngx_int_t
+ngx_wasm_chain_splice(ngx_pool_t *pool, ngx_chain_t **in, size_t start,
+    size_t end, ngx_str_t *str, ngx_chain_t **free, ngx_buf_tag_t tag)
+{
+    off_t         pos = 0, len, from, to;
+    unsigned      eof = 0, flush = 0;
+    ngx_buf_t    *buf, *hb;
+    ngx_chain_t  *cl, *next, *hl, *data = NULL, *out = NULL, **ll = &out;
+
+    ngx_wa_assert(start <= end);
+
+    /**
+     * Replace the [start, end) range of the chain with str: buffers
+     * outside of the range are kept (and only trimmed when straddling
+     * it), so that only the inserted bytes are allocated and copied.
+     */
+
+    from = start;
+    to = end;
+
+    if (str->len) {
+        data = ngx_wasm_chain_get_free_buf(pool, free, str->len, tag, 1);
+        if (data == NULL) {
+            return NGX_ERROR;
+        }
+
+        data->buf->last = ngx_cpymem(data->buf->last, str->data, str->len);
+    }
+
+    for (cl = *in; cl; cl = next) {
+        next = cl->next;
+        buf = cl->buf;
+        len = ngx_buf_size(buf);
+
+        if (buf->last_buf || buf->last_in_chain) {
+            eof = 1;
+        }
+
+        if (buf->flush) {
+            flush = 1;
+        }
+
+        buf->flush = 0;
+        buf->last_buf = 0;
+        buf->last_in_chain = 0;
+
+        if (len == 0) {
+            /* flags collected, drop */
+            if (buf->tag == tag) {
+                cl->next = *free;
+                *free = cl;
+
+            } else {
+                ngx_free_chain(pool, cl);
+            }
+
+            continue;
+        }
+
+        if (pos >= to || pos + len <= from) {
+            /* outside of the range, keep */
+
+            if (pos >= to && data) {
+                *ll = data;
+                ll = &data->next;
+                data = NULL;
+            }
+
+            *ll = cl;
+            ll = &cl->next;
+
+        } else if (pos < from && pos + len > to) {
+            /**
+             * Range within the buffer: reference its head from a new
+             * buffer and keep the original one for its tail, so that
+             * it is released last.
+             */
+            hl = ngx_alloc_chain_link(pool);
+            if (hl == NULL) {
+                return NGX_ERROR;
+            }
+
+            hb = ngx_calloc_buf(pool);
+            if (hb == NULL) {
+                return NGX_ERROR;
+            }
+
+            *hb = *buf;
+            hb->tag = NULL;  /* never recycled */
+            hb->recycled = 0;
+            hb->shadow = NULL;
+
+            ngx_wasm_buf_truncate(hb, from - pos);
+            ngx_wasm_buf_advance(buf, to - pos);
+
+            hl->buf = hb;
+            *ll = hl;
+            ll = &hl->next;
+
+            if (data) {
+                *ll = data;
+                ll = &data->next;
+                data = NULL;
+            }
+
+            *ll = cl;
+            ll = &cl->next;
+
+        } else if (pos < from) {
+            /* head kept, tail replaced */
+            ngx_wasm_buf_truncate(buf, from - pos);
+
+            *ll = cl;
+            ll = &cl->next;
+
+        } else if (pos + len > to) {
+            /* head replaced, tail kept */
+            ngx_wasm_buf_advance(buf, to - pos);
+
+            if (data) {
+                *ll = data;
+                ll = &data->next;
+                data = NULL;
+            }
+
+            *ll = cl;
+            ll = &cl->next;
+
+        } else {
+            /* within the range, consume */
+            ngx_wasm_buf_advance(buf, len);
+            ngx_free_chain(pool, cl);
+        }
+
+        pos += len;
+    }
+
+    if (data) {
+        /* range at or past the end of the chain */
+        *ll = data;
+        ll = &data->next;
+    }
+
+    *ll = NULL;
+
+    if (eof || flush) {
+        if (out == NULL) {
+            out = ngx_wasm_chain_get_free_buf(pool, free, 0, tag, 1);
+            if (out == NULL) {
+                return NGX_ERROR;
+            }
+        }
+
+        for (hl = out; hl->next; hl = hl->next) { /* void */ }
+
+        hl->buf->flush = flush;
+        hl->buf->last_buf = eof;
+        hl->buf->last_in_chain = eof;
+    }
+
+    *in = out;
+
+    return NGX_OK;
+}
+
+
 ngx_int_t
 ngx_wasm_bytes_from_path(wasm_byte_vec_t *out, u_char *path, ngx_log_t *log)
 {
@@ -37,6 +37,7 @@ extern const wasm_valkind_t *ngx_wavm_arity_i32x3[];
 extern const wasm_valkind_t *ngx_wavm_arity_i32x4[];
 extern const wasm_valkind_t *ngx_wavm_arity_i32x5[];
 extern const wasm_valkind_t *ngx_wavm_arity_i32x6[];
+extern const wasm_valkind_t *ngx_wavm_arity_i32x7[];
 extern const wasm_valkind_t *ngx_wavm_arity_i32x8[];
 extern const wasm_valkind_t *ngx_wavm_arity_i32x9[];
 extern const wasm_valkind_t *ngx_wavm_arity_i32x10[];
@@ -44,6 +45,8 @@ extern const wasm_valkind_t *ngx_wavm_arity_i32x12[];
 extern const wasm_valkind_t *ngx_wavm_arity_i32_i64[];
 extern const wasm_valkind_t *ngx_wavm_arity_i32_i64_i32[];
 extern const wasm_valkind_t *ngx_wavm_arity_i32_i64_i32x2[];
+extern const wasm_valkind_t *ngx_wavm_arity_i32x2_i64x2_i32x2[];
+extern const wasm_valkind_t *ngx_wavm_arity_i32x2_i64x4_i32x2[];
 extern const wasm_valkind_t *ngx_wavm_arity_i32x5_i64x2_i32x2[];
 
 
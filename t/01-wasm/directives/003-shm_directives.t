@@ -255,3 +255,246 @@ qr/\[emerg\] .*? invalid eviction policy \"\"/
 [crit]
 [stub]
 --- must_die
+
+
+
+=== TEST 16: shm directive - kv cache options
+--- main_config
+    wasm {
+        shm_kv my_kv_1 1m cache=128;
+        shm_kv my_kv_2 64k eviction=lru cache=16 cache_ttl=5s;
+    }
+--- no_error_log
+[error]
+[crit]
+[emerg]
+[stub]
+
+
+
+=== TEST 17: shm directive - kv invalid cache size
+--- main_config eval
+qq{
+    wasm {
+        shm_kv my_shm $::min_shm_size cache=0;
+    }
+}
+--- error_log eval
+qr/\[emerg\] .*? invalid cache size \"0\"/
+--- no_error_log
+[error]
+[crit]
+[stub]
+--- must_die
+
+
+
+=== TEST 18: shm directive - kv cache_ttl without cache
+--- main_config eval
+qq{
+    wasm {
+        shm_kv my_shm $::min_shm_size cache_ttl=1s;
+    }
+}
+--- error_log eval
+qr/\[emerg\] .*? "cache_ttl" requires "cache"/
+--- no_error_log
+[error]
+[crit]
+[stub]
+--- must_die
+
+
+
+=== TEST 19: shm directive - queue does not support cache
+--- main_config eval
+qq{
+    wasm {
+        shm_queue my_shm $::min_shm_size cache=16;
+    }
+}
+--- error_log eval
+qr/\[emerg\] .*? invalid option \"cache=16\"/
+--- no_error_log
+[error]
+[crit]
+[stub]
+--- must_die
+
+
+
+=== TEST 20: shm directive - kv shards
+--- main_config
+    wasm {
+        shm_kv my_kv_1 1m shards=4;
+        shm_kv my_kv_2 1m eviction=lru cache=16 shards=2;
+    }
+--- no_error_log
+[error]
+[crit]
+[emerg]
+[stub]
+
+
+
+=== TEST 21: shm directive - kv invalid shards
+--- main_config eval
+qq{
+    wasm {
+        shm_kv my_shm $::min_shm_size shards=0;
+    }
+}
+--- error_log eval
+qr/\[emerg\] .*? invalid shards \"0\"/
+--- no_error_log
+[error]
+[crit]
+[stub]
+--- must_die
+
+
+
+=== TEST 22: shm directive - kv too small for shards
+--- main_config eval
+qq{
+    wasm {
+        shm_kv my_shm $::min_shm_size shards=4;
+    }
+}
+--- error_log eval
+qr/\[emerg\] .*? shm size of \d+ bytes is too small for 4 shards/
+--- no_error_log
+[error]
+[crit]
+[stub]
+--- must_die
+
+
+
+=== TEST 23: shm directive - kv ordered
+--- main_config
+    wasm {
+        shm_kv my_kv_1 1m ordered;
+        shm_kv my_kv_2 1m eviction=lru ordered shards=2;
+    }
+--- no_error_log
+[error]
+[crit]
+[emerg]
+[stub]
+
+
+
+=== TEST 24: shm directive - queue invalid ordered option
+--- main_config eval
+qq{
+    wasm {
+        shm_queue my_shm $::min_shm_size ordered;
+    }
+}
+--- error_log eval
+qr/\[emerg\] .*? invalid option \"ordered\"/
+--- no_error_log
+[error]
+[crit]
+[stub]
+--- must_die
+
+
+
+=== TEST 25: shm directive - kv persist
+--- main_config eval
+qq{
+    wasm {
+        shm_kv my_kv_1 1m persist=$ENV{TEST_NGINX_HTML_DIR}/my_kv_1.snap;
+        shm_kv my_kv_2 1m shards=2 persist=my_kv_2.snap;
+    }
+}
+--- no_error_log
+[error]
+[crit]
+[emerg]
+[stub]
+
+
+
+=== TEST 26: shm directive - kv invalid persist path
+--- main_config eval
+qq{
+    wasm {
+        shm_kv my_shm $::min_shm_size persist=;
+    }
+}
+--- error_log eval
+qr/\[emerg\] .*? invalid persist path \"\"/
+--- no_error_log
+[error]
+[crit]
+[stub]
+--- must_die
+
+
+
+=== TEST 27: shm directive - queue invalid persist option
+--- main_config eval
+qq{
+    wasm {
+        shm_queue my_shm $::min_shm_size persist=/tmp/my_shm.snap;
+    }
+}
+--- error_log eval
+qr/\[emerg\] .*? invalid option \"persist=\/tmp\/my_shm.snap\"/
+--- no_error_log
+[error]
+[crit]
+[stub]
+--- must_die
+
+
+
+=== TEST 28: shm directive - kv admission
+--- main_config
+    wasm {
+        shm_kv my_kv_1 1m admission=tinylfu;
+        shm_kv my_kv_2 1m eviction=lru admission=tinylfu shards=2;
+        shm_kv my_kv_3 1m admission=none;
+    }
+--- no_error_log
+[error]
+[crit]
+[emerg]
+[stub]
+
+
+
+=== TEST 29: shm directive - kv invalid admission policy
+--- main_config eval
+qq{
+    wasm {
+        shm_kv my_shm $::min_shm_size admission=lfu;
+    }
+}
+--- error_log eval
+qr/\[emerg\] .*? invalid admission policy \"lfu\"/
+--- no_error_log
+[error]
+[crit]
+[stub]
+--- must_die
+
+
+
+=== TEST 30: shm directive - kv admission requires eviction
+--- main_config eval
+qq{
+    wasm {
+        shm_kv my_shm $::min_shm_size eviction=none admission=tinylfu;
+    }
+}
+--- error_log eval
+qr/\[emerg\] .*? "admission" requires an eviction policy/
+--- no_error_log
+[error]
+[crit]
+[stub]
+--- must_die
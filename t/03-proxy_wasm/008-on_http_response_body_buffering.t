@@ -518,3 +518,200 @@ on_response_body, 14 bytes, eof: true
     qr/\[error\] .*? invalid "on_response_body" return action \(PAUSE\): response body buffering already requested/
 ]
 --- no_error_log
+
+
+
+=== TEST 16: proxy_wasm - on_response_body buffering, buffers too small for body spill to temp file
+--- config
+    location /t {
+        wasm_response_body_buffers 3 2;
+        wasm_response_body_max_temp_file_size 1k;
+        echo -n 'a\n';
+        echo_flush;
+        echo -n 'bb\n';
+        echo_flush;
+        echo -n 'ccc\n';
+        echo_flush;
+        echo -n 'dddd\n';
+        proxy_wasm on_phases 'pause_on=response_body';
+        proxy_wasm on_phases 'log_response_body=true';
+    }
+--- response_body
+a
+bb
+ccc
+dddd
+--- grep_error_log eval: qr/on_response_body, .*?eof: (true|false)/
+--- grep_error_log_out
+on_response_body, 2 bytes, eof: false
+on_response_body, 14 bytes, eof: true
+on_response_body, 14 bytes, eof: true
+--- error_log
+response body chunk: "a\nbb\nccc\ndddd\n"
+--- no_error_log
+[error]
+
+
+
+=== TEST 17: proxy_wasm - on_response_body buffering, temp file too small for body
+--- config
+    location /t {
+        wasm_response_body_buffers 3 2;
+        wasm_response_body_max_temp_file_size 4;
+        echo -n 'a\n';
+        echo_flush;
+        echo -n 'bb\n';
+        echo_flush;
+        echo -n 'ccc\n';
+        echo_flush;
+        echo -n 'dddd\n';
+        proxy_wasm on_phases 'pause_on=response_body';
+        proxy_wasm on_phases 'log_response_body=true';
+    }
+--- response_body
+a
+bb
+ccc
+dddd
+--- grep_error_log eval: qr/on_response_body, .*?eof: (true|false)/
+--- grep_error_log_out
+on_response_body, 2 bytes, eof: false
+on_response_body, 14 bytes, eof: false
+on_response_body, 14 bytes, eof: false
+on_response_body, 0 bytes, eof: true
+on_response_body, 0 bytes, eof: true
+--- error_log
+response body chunk: "a\nbb\nccc\ndddd\n"
+--- no_error_log
+[error]
+
+
+
+=== TEST 18: proxy_wasm - on_response_body with body_window buffers the window only
+--- config
+    location /t {
+        echo -n 'a\n';
+        echo_flush;
+        echo -n 'bb\n';
+        echo_flush;
+        echo -n 'ccc\n';
+        echo_flush;
+        echo -n 'dddd\n';
+        proxy_wasm on_phases 'log_response_body=true' body_window=5;
+    }
+--- response_body
+a
+bb
+ccc
+dddd
+--- grep_error_log eval: qr/on_response_body, .*?eof: (true|false)/
+--- grep_error_log_out
+on_response_body, 5 bytes, eof: false
+--- error_log
+response body chunk: "a\nbb\n"
+--- no_error_log
+[error]
+
+
+
+=== TEST 19: proxy_wasm - on_response_body with body_window, next filters without window see the whole body
+--- config
+    location /t {
+        echo -n 'a\n';
+        echo_flush;
+        echo -n 'bb\n';
+        echo_flush;
+        echo -n 'ccc\n';
+        echo_flush;
+        echo -n 'dddd\n';
+        proxy_wasm on_phases '' body_window=5;
+        proxy_wasm on_phases 'log_response_body=true';
+    }
+--- response_body
+a
+bb
+ccc
+dddd
+--- grep_error_log eval: qr/on_response_body, .*?eof: (true|false)/
+--- grep_error_log_out
+on_response_body, 5 bytes, eof: true
+on_response_body, 14 bytes, eof: true
+--- error_log
+response body chunk: "a\nbb\nccc\ndddd\n"
+--- no_error_log
+[error]
+
+
+
+=== TEST 20: proxy_wasm - on_response_body buffering, body spilled to temp file with gzip
+--- config
+    location /t {
+        default_type text/plain;
+        gzip on;
+        gzip_min_length 1;
+        gzip_types text/plain;
+        wasm_response_body_buffers 3 2;
+        wasm_response_body_max_temp_file_size 1k;
+        echo -n 'a\n';
+        echo_flush;
+        echo -n 'bb\n';
+        echo_flush;
+        echo -n 'ccc\n';
+        echo_flush;
+        echo -n 'dddd\n';
+        proxy_wasm on_phases 'pause_on=response_body';
+        proxy_wasm on_phases 'log_response_body=true';
+    }
+--- more_headers
+Accept-Encoding: gzip
+--- response_headers
+Content-Encoding: gzip
+--- response_body_filters eval
+sub {
+    require IO::Uncompress::Gunzip;
+    my ($in, $out) = (shift);
+    IO::Uncompress::Gunzip::gunzip(\$in => \$out) or die;
+    return $out;
+}
+--- response_body
+a
+bb
+ccc
+dddd
+--- error_log
+response body chunk: "a\nbb\nccc\ndddd\n"
+--- no_error_log
+[error]
+
+
+
+=== TEST 21: proxy_wasm - on_response_body buffering, body spilled to temp file with sendfile off
+--- config
+    location /t {
+        sendfile off;
+        wasm_response_body_buffers 3 2;
+        wasm_response_body_max_temp_file_size 1k;
+        echo -n 'a\n';
+        echo_flush;
+        echo -n 'bb\n';
+        echo_flush;
+        echo -n 'ccc\n';
+        echo_flush;
+        echo -n 'dddd\n';
+        proxy_wasm on_phases 'pause_on=response_body';
+        proxy_wasm on_phases 'log_response_body=true';
+    }
+--- response_body
+a
+bb
+ccc
+dddd
+--- grep_error_log eval: qr/on_response_body, .*?eof: (true|false)/
+--- grep_error_log_out
+on_response_body, 2 bytes, eof: false
+on_response_body, 14 bytes, eof: true
+on_response_body, 14 bytes, eof: true
+--- error_log
+response body chunk: "a\nbb\nccc\ndddd\n"
+--- no_error_log
+[error]
@@ -0,0 +1,88 @@
+# vim:set ft= ts=4 sts=4 sw=4 et fdm=marker:
+
+use strict;
+use lib '.';
+use t::TestWasmX;
+
+skip_no_debug();
+
+plan_tests(5);
+run_tests();
+
+__DATA__
+
+=== TEST 1: proxy_wasm steps - skip steps not implemented by any filter
+--- main_config eval
+qq{
+    wasm {
+        module a $ENV{TEST_NGINX_HTML_DIR}/a.wat;
+    }
+}
+--- config
+    location /t {
+        proxy_wasm a;
+        return 200;
+    }
+--- user_files
+>>> a.wat
+(module
+  (memory (export "memory") 1)
+  (func $nop)
+  (func $malloc (param i32) (result i32) i32.const 0)
+  (func $on_context_create (param i32 i32))
+  (func $on_start (param i32 i32) (result i32) i32.const 1)
+  (func $on_request_headers (param i32 i32 i32) (result i32) i32.const 0)
+  (export "proxy_abi_version_0_2_1" (func $nop))
+  (export "malloc" (func $malloc))
+  (export "proxy_on_context_create" (func $on_context_create))
+  (export "proxy_on_vm_start" (func $on_start))
+  (export "proxy_on_configure" (func $on_start))
+  (export "proxy_on_request_headers" (func $on_request_headers)))
+--- error_log
+proxy_wasm skipping "on_response_headers" step: not implemented by any filter
+proxy_wasm skipping "on_response_body" step: not implemented by any filter
+proxy_wasm skipping "on_log" step: not implemented by any filter
+--- no_error_log
+[error]
+
+
+
+=== TEST 2: proxy_wasm steps - skip filters not implementing a step
+--- main_config eval
+qq{
+    wasm {
+        module a $ENV{TEST_NGINX_HTML_DIR}/a.wat;
+        module on_phases $ENV{TEST_NGINX_CRATES_DIR}/on_phases.wasm;
+    }
+}
+--- config
+    location /t {
+        proxy_wasm a;
+        proxy_wasm on_phases;
+        return 200;
+    }
+--- user_files
+>>> a.wat
+(module
+  (memory (export "memory") 1)
+  (func $nop)
+  (func $malloc (param i32) (result i32) i32.const 0)
+  (func $on_context_create (param i32 i32))
+  (func $on_start (param i32 i32) (result i32) i32.const 1)
+  (func $on_request_headers (param i32 i32 i32) (result i32) i32.const 0)
+  (export "proxy_abi_version_0_2_1" (func $nop))
+  (export "malloc" (func $malloc))
+  (export "proxy_on_context_create" (func $on_context_create))
+  (export "proxy_on_vm_start" (func $on_start))
+  (export "proxy_on_configure" (func $on_start))
+  (export "proxy_on_request_headers" (func $on_request_headers)))
+--- error_log eval
+[
+    qr/\["a" #\d+\] filter 1\/2 resuming "on_request_headers" step/,
+    qr/\["on_phases" #\d+\] filter 2\/2 resuming "on_response_body" step/,
+]
+--- no_error_log eval
+[
+    qr/\["a" #\d+\] filter 1\/2 resuming "on_response_body" step/,
+    "[error]",
+]
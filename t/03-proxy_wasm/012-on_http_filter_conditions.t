@@ -0,0 +1,353 @@
+# vim:set ft= ts=4 sts=4 sw=4 et fdm=marker:
+
+use strict;
+use lib '.';
+use t::TestWasmX;
+
+skip_no_debug();
+
+plan_tests(5);
+run_tests();
+
+__DATA__
+
+=== TEST 1: proxy_wasm conditions - methods= skips non-matching requests
+--- main_config eval
+qq{
+    wasm {
+        module a $ENV{TEST_NGINX_HTML_DIR}/a.wat;
+    }
+}
+--- config
+    location /t {
+        proxy_wasm a '' methods=POST,PUT;
+        return 200;
+    }
+--- user_files
+>>> a.wat
+(module
+  (memory (export "memory") 1)
+  (func $nop)
+  (func $malloc (param i32) (result i32) i32.const 0)
+  (func $on_context_create (param i32 i32))
+  (func $on_start (param i32 i32) (result i32) i32.const 1)
+  (func $on_request_headers (param i32 i32 i32) (result i32) i32.const 0)
+  (export "proxy_abi_version_0_2_1" (func $nop))
+  (export "malloc" (func $malloc))
+  (export "proxy_on_context_create" (func $on_context_create))
+  (export "proxy_on_vm_start" (func $on_start))
+  (export "proxy_on_configure" (func $on_start))
+  (export "proxy_on_request_headers" (func $on_request_headers)))
+--- error_log eval
+[
+    qr/"a" filter skipped \(1\/1\): conditions not met/,
+    qr/proxy_wasm skipping "on_request_headers" step: not implemented by any filter/,
+]
+--- no_error_log eval
+[
+    qr/\["a" #\d+\] filter 1\/1 resuming "on_request_headers" step/,
+    "[error]",
+]
+
+
+
+=== TEST 2: proxy_wasm conditions - prefix= skips non-matching requests
+--- main_config eval
+qq{
+    wasm {
+        module a $ENV{TEST_NGINX_HTML_DIR}/a.wat;
+    }
+}
+--- config
+    location /t {
+        proxy_wasm a '' prefix=/api;
+        proxy_wasm a '' prefix=/t;
+        return 200;
+    }
+--- user_files
+>>> a.wat
+(module
+  (memory (export "memory") 1)
+  (func $nop)
+  (func $malloc (param i32) (result i32) i32.const 0)
+  (func $on_context_create (param i32 i32))
+  (func $on_start (param i32 i32) (result i32) i32.const 1)
+  (func $on_request_headers (param i32 i32 i32) (result i32) i32.const 0)
+  (export "proxy_abi_version_0_2_1" (func $nop))
+  (export "malloc" (func $malloc))
+  (export "proxy_on_context_create" (func $on_context_create))
+  (export "proxy_on_vm_start" (func $on_start))
+  (export "proxy_on_configure" (func $on_start))
+  (export "proxy_on_request_headers" (func $on_request_headers)))
+--- error_log eval
+[
+    qr/"a" filter skipped \(1\/2\): conditions not met/,
+    qr/\["a" #\d+\] filter 2\/2 resuming "on_request_headers" step/,
+]
+--- no_error_log eval
+[
+    qr/\["a" #\d+\] filter 1\/2 resuming "on_request_headers" step/,
+    "[error]",
+]
+
+
+
+=== TEST 3: proxy_wasm conditions - if= evaluates a complex value
+--- main_config eval
+qq{
+    wasm {
+        module a $ENV{TEST_NGINX_HTML_DIR}/a.wat;
+    }
+}
+--- http_config
+    map $http_x_filter $run_filter {
+        default  0;
+        yes      1;
+    }
+--- config
+    location /t {
+        proxy_wasm a 'foo=bar' if=$run_filter;
+        proxy_wasm a '' if=$arg_enabled;
+        return 200;
+    }
+--- request
+GET /t?enabled=1
+--- user_files
+>>> a.wat
+(module
+  (memory (export "memory") 1)
+  (func $nop)
+  (func $malloc (param i32) (result i32) i32.const 0)
+  (func $on_context_create (param i32 i32))
+  (func $on_start (param i32 i32) (result i32) i32.const 1)
+  (func $on_request_headers (param i32 i32 i32) (result i32) i32.const 0)
+  (export "proxy_abi_version_0_2_1" (func $nop))
+  (export "malloc" (func $malloc))
+  (export "proxy_on_context_create" (func $on_context_create))
+  (export "proxy_on_vm_start" (func $on_start))
+  (export "proxy_on_configure" (func $on_start))
+  (export "proxy_on_request_headers" (func $on_request_headers)))
+--- error_log eval
+[
+    qr/"a" filter skipped \(1\/2\): conditions not met/,
+    qr/\["a" #\d+\] filter 2\/2 resuming "on_request_headers" step/,
+]
+--- no_error_log eval
+[
+    qr/\["a" #\d+\] filter 1\/2 resuming "on_request_headers" step/,
+    "[error]",
+]
+
+
+
+=== TEST 4: proxy_wasm conditions - all conditions met
+--- main_config eval
+qq{
+    wasm {
+        module a $ENV{TEST_NGINX_HTML_DIR}/a.wat;
+    }
+}
+--- config
+    location /t {
+        proxy_wasm a '' methods=get prefix=/t if=$arg_enabled;
+        return 200;
+    }
+--- request
+GET /t?enabled=yes
+--- user_files
+>>> a.wat
+(module
+  (memory (export "memory") 1)
+  (func $nop)
+  (func $malloc (param i32) (result i32) i32.const 0)
+  (func $on_context_create (param i32 i32))
+  (func $on_start (param i32 i32) (result i32) i32.const 1)
+  (func $on_request_headers (param i32 i32 i32) (result i32) i32.const 0)
+  (export "proxy_abi_version_0_2_1" (func $nop))
+  (export "malloc" (func $malloc))
+  (export "proxy_on_context_create" (func $on_context_create))
+  (export "proxy_on_vm_start" (func $on_start))
+  (export "proxy_on_configure" (func $on_start))
+  (export "proxy_on_request_headers" (func $on_request_headers)))
+--- error_log eval
+[
+    qr/proxy_wasm initializing filter chain \(nfilters: 1/,
+    qr/\["a" #\d+\] filter 1\/1 resuming "on_request_headers" step/,
+]
+--- no_error_log eval
+[
+    qr/filter skipped/,
+    "[error]",
+]
+
+
+
+=== TEST 5: proxy_wasm conditions - sample= with 0 and 1 ratios
+--- main_config eval
+qq{
+    wasm {
+        module a $ENV{TEST_NGINX_HTML_DIR}/a.wat;
+    }
+}
+--- config
+    location /t {
+        proxy_wasm a '' sample=0;
+        proxy_wasm a '' sample=1;
+        return 200;
+    }
+--- user_files
+>>> a.wat
+(module
+  (memory (export "memory") 1)
+  (func $nop)
+  (func $malloc (param i32) (result i32) i32.const 0)
+  (func $on_context_create (param i32 i32))
+  (func $on_start (param i32 i32) (result i32) i32.const 1)
+  (func $on_request_headers (param i32 i32 i32) (result i32) i32.const 0)
+  (export "proxy_abi_version_0_2_1" (func $nop))
+  (export "malloc" (func $malloc))
+  (export "proxy_on_context_create" (func $on_context_create))
+  (export "proxy_on_vm_start" (func $on_start))
+  (export "proxy_on_configure" (func $on_start))
+  (export "proxy_on_request_headers" (func $on_request_headers)))
+--- error_log eval
+[
+    qr/"a" filter skipped \(1\/2\): conditions not met/,
+    qr/\["a" #\d+\] filter 2\/2 resuming "on_request_headers" step/,
+]
+--- no_error_log eval
+[
+    qr/\["a" #\d+\] filter 1\/2 resuming "on_request_headers" step/,
+    "[error]",
+]
+
+
+
+=== TEST 6: proxy_wasm conditions - sample_key= consistent sampling (sampled out)
+"trace-2" hashes above the 0.5 ratio
+--- main_config eval
+qq{
+    wasm {
+        module a $ENV{TEST_NGINX_HTML_DIR}/a.wat;
+    }
+}
+--- config
+    location /t {
+        proxy_wasm a '' sample=0.5 sample_key=$http_x_trace;
+        proxy_wasm a '' sample=0.5 sample_key=$http_x_trace;
+        return 200;
+    }
+--- more_headers
+X-Trace: trace-2
+--- user_files
+>>> a.wat
+(module
+  (memory (export "memory") 1)
+  (func $nop)
+  (func $malloc (param i32) (result i32) i32.const 0)
+  (func $on_context_create (param i32 i32))
+  (func $on_start (param i32 i32) (result i32) i32.const 1)
+  (func $on_request_headers (param i32 i32 i32) (result i32) i32.const 0)
+  (export "proxy_abi_version_0_2_1" (func $nop))
+  (export "malloc" (func $malloc))
+  (export "proxy_on_context_create" (func $on_context_create))
+  (export "proxy_on_vm_start" (func $on_start))
+  (export "proxy_on_configure" (func $on_start))
+  (export "proxy_on_request_headers" (func $on_request_headers)))
+--- error_log eval
+[
+    qr/"a" filter skipped \(1\/2\): conditions not met/,
+    qr/"a" filter skipped \(2\/2\): conditions not met/,
+]
+--- no_error_log eval
+[
+    qr/resuming "on_request_headers" step/,
+    "[error]",
+]
+
+
+
+=== TEST 7: proxy_wasm conditions - sample_key= consistent sampling (sampled in)
+"trace-1" hashes below the 0.5 ratio
+--- main_config eval
+qq{
+    wasm {
+        module a $ENV{TEST_NGINX_HTML_DIR}/a.wat;
+    }
+}
+--- config
+    location /t {
+        proxy_wasm a '' sample=0.5 sample_key=$http_x_trace;
+        proxy_wasm a '' sample=0.5 sample_key=$http_x_trace;
+        return 200;
+    }
+--- more_headers
+X-Trace: trace-1
+--- user_files
+>>> a.wat
+(module
+  (memory (export "memory") 1)
+  (func $nop)
+  (func $malloc (param i32) (result i32) i32.const 0)
+  (func $on_context_create (param i32 i32))
+  (func $on_start (param i32 i32) (result i32) i32.const 1)
+  (func $on_request_headers (param i32 i32 i32) (result i32) i32.const 0)
+  (export "proxy_abi_version_0_2_1" (func $nop))
+  (export "malloc" (func $malloc))
+  (export "proxy_on_context_create" (func $on_context_create))
+  (export "proxy_on_vm_start" (func $on_start))
+  (export "proxy_on_configure" (func $on_start))
+  (export "proxy_on_request_headers" (func $on_request_headers)))
+--- error_log eval
+[
+    qr/\["a" #\d+\] filter 1\/2 resuming "on_request_headers" step/,
+    qr/\["a" #\d+\] filter 2\/2 resuming "on_request_headers" step/,
+]
+--- no_error_log eval
+[
+    qr/filter skipped/,
+    "[error]",
+]
+
+
+
+=== TEST 8: proxy_wasm conditions - criticality=optional filters shed under load
+--- main_config eval
+qq{
+    wasm {
+        module a $ENV{TEST_NGINX_HTML_DIR}/a.wat;
+    }
+}
+--- http_config
+    proxy_wasm_load_shedding connections=1;
+--- config
+    location /t {
+        proxy_wasm a '' criticality=optional;
+        proxy_wasm a '' criticality=critical;
+        return 200;
+    }
+--- user_files
+>>> a.wat
+(module
+  (memory (export "memory") 1)
+  (func $nop)
+  (func $malloc (param i32) (result i32) i32.const 0)
+  (func $on_context_create (param i32 i32))
+  (func $on_start (param i32 i32) (result i32) i32.const 1)
+  (func $on_request_headers (param i32 i32 i32) (result i32) i32.const 0)
+  (export "proxy_abi_version_0_2_1" (func $nop))
+  (export "malloc" (func $malloc))
+  (export "proxy_on_context_create" (func $on_context_create))
+  (export "proxy_on_vm_start" (func $on_start))
+  (export "proxy_on_configure" (func $on_start))
+  (export "proxy_on_request_headers" (func $on_request_headers)))
+--- error_log eval
+[
+    qr/\[warn\] .*? proxy_wasm worker overloaded, shedding optional filters/,
+    qr/\["a" #\d+\] filter 2\/2 resuming "on_request_headers" step/,
+]
+--- no_error_log eval
+[
+    qr/\["a" #\d+\] filter 1\/2 resuming "on_request_headers" step/,
+    "[error]",
+]
@@ -0,0 +1,250 @@
+# vim:set ft= ts=4 sts=4 sw=4 et fdm=marker:
+
+use strict;
+use lib '.';
+use t::TestWasmX;
+
+plan_tests(5);
+run_tests();
+
+__DATA__
+
+=== TEST 1: proxy_wasm request body streaming - on_request_body invoked per chunk
+--- load_nginx_modules: ngx_http_echo_module
+--- wasm_modules: on_phases
+--- http_config eval
+qq{
+    upstream test_upstream {
+        server unix:$ENV{TEST_NGINX_UNIX_SOCKET};
+    }
+
+    server {
+        listen unix:$ENV{TEST_NGINX_UNIX_SOCKET};
+
+        location / {
+            echo_read_request_body;
+            echo \$request_body;
+        }
+    }
+}
+--- config
+    location /t {
+        proxy_wasm_request_body_streaming on;
+        proxy_request_buffering off;
+        proxy_wasm on_phases;
+        proxy_pass http://test_upstream/;
+    }
+--- raw_request eval
+["POST /t HTTP/1.1\r\n"
+. "Host: localhost\r\n"
+. "Connection: close\r\n"
+. "Content-Length: 11\r\n"
+. "\r\n"
+. "Hello ",
+"world"]
+--- raw_request_middle_delay: 0.1
+--- response_body
+Hello world
+--- grep_error_log eval: qr/#\d+ on_request_body.*?(?=(, client|\s+while))/
+--- grep_error_log_out eval
+qr/#\d+ on_request_body, 6 bytes, eof: false
+#\d+ on_request_body, 5 bytes, eof: true/
+--- no_error_log
+[error]
+[crit]
+
+
+
+=== TEST 2: proxy_wasm request body streaming - set_http_request_body() replaces the chunk
+--- load_nginx_modules: ngx_http_echo_module
+--- wasm_modules: hostcalls
+--- http_config eval
+qq{
+    upstream test_upstream {
+        server unix:$ENV{TEST_NGINX_UNIX_SOCKET};
+    }
+
+    server {
+        listen unix:$ENV{TEST_NGINX_UNIX_SOCKET};
+
+        location / {
+            echo_read_request_body;
+            echo \$request_body;
+        }
+    }
+}
+--- config
+    location /t {
+        proxy_wasm_request_body_streaming on;
+        proxy_request_buffering off;
+        proxy_wasm hostcalls 'on=request_body \
+                              test=/t/set_request_body \
+                              value=HELLO_WORLD';
+        proxy_pass http://test_upstream/;
+    }
+--- request
+POST /t
+Hello world
+--- response_body
+HELLO_WORLD
+--- error_log
+on_request_body, 11 bytes, eof: true
+--- no_error_log
+[error]
+[crit]
+
+
+
+=== TEST 3: proxy_wasm request body streaming - on_request_body cannot Pause
+--- wasm_modules: on_phases
+--- http_config eval
+qq{
+    upstream test_upstream {
+        server unix:$ENV{TEST_NGINX_UNIX_SOCKET};
+    }
+
+    server {
+        listen unix:$ENV{TEST_NGINX_UNIX_SOCKET};
+
+        location / {
+            return 200;
+        }
+    }
+}
+--- config
+    location /t {
+        proxy_wasm_request_body_streaming on;
+        proxy_request_buffering off;
+        proxy_wasm on_phases 'pause_on=request_body';
+        proxy_pass http://test_upstream/;
+    }
+--- request
+POST /t
+Hello world
+--- error_code: 500
+--- error_log eval
+[
+    qr/pausing after "RequestBody"/,
+    qr/\[error\] .*? bad "on_request_body" return action: "PAUSE"/,
+]
+--- no_error_log
+[crit]
+[alert]
+
+
+
+=== TEST 4: proxy_wasm request body streaming - body_window stops invoking on_request_body
+--- load_nginx_modules: ngx_http_echo_module
+--- wasm_modules: on_phases
+--- http_config eval
+qq{
+    upstream test_upstream {
+        server unix:$ENV{TEST_NGINX_UNIX_SOCKET};
+    }
+
+    server {
+        listen unix:$ENV{TEST_NGINX_UNIX_SOCKET};
+
+        location / {
+            echo_read_request_body;
+            echo \$request_body;
+        }
+    }
+}
+--- config
+    location /t {
+        proxy_wasm_request_body_streaming on;
+        proxy_request_buffering off;
+        proxy_wasm on_phases '' body_window=4;
+        proxy_pass http://test_upstream/;
+    }
+--- raw_request eval
+["POST /t HTTP/1.1\r\n"
+. "Host: localhost\r\n"
+. "Connection: close\r\n"
+. "Content-Length: 11\r\n"
+. "\r\n"
+. "Hello ",
+"world"]
+--- raw_request_middle_delay: 0.1
+--- response_body
+Hello world
+--- grep_error_log eval: qr/on_request_body, .*?eof: (true|false)/
+--- grep_error_log_out
+on_request_body, 4 bytes, eof: false
+--- no_error_log
+[error]
+[crit]
+
+
+
+=== TEST 5: proxy_wasm request body streaming - body read when the content handler does not
+--- load_nginx_modules: ngx_http_echo_module
+--- wasm_modules: on_phases
+--- config
+    location /t {
+        proxy_wasm_request_body_streaming on;
+        proxy_wasm on_phases;
+        echo ok;
+    }
+--- request
+POST /t
+Hello world
+--- response_body
+ok
+--- grep_error_log eval: qr/#\d+ on_request_body.*?(?=(, client|\s+while))/
+--- grep_error_log_out eval
+qr/#\d+ on_request_body, 11 bytes, eof: true/
+--- no_error_log
+[error]
+[crit]
+
+
+
+=== TEST 6: proxy_wasm request body streaming - chunks reach upstream as they arrive
+--- load_nginx_modules: ngx_http_echo_module
+--- wasm_modules: on_phases
+--- http_config eval
+qq{
+    upstream test_upstream {
+        server unix:$ENV{TEST_NGINX_UNIX_SOCKET};
+    }
+
+    server {
+        listen unix:$ENV{TEST_NGINX_UNIX_SOCKET};
+
+        location / {
+            proxy_wasm_request_body_streaming on;
+            proxy_wasm on_phases;
+            echo_read_request_body;
+            echo \$request_body;
+        }
+    }
+}
+--- config
+    location /t {
+        proxy_wasm_request_body_streaming on;
+        proxy_request_buffering off;
+        proxy_wasm on_phases;
+        proxy_pass http://test_upstream/;
+    }
+--- raw_request eval
+["POST /t HTTP/1.1\r\n"
+. "Host: localhost\r\n"
+. "Connection: close\r\n"
+. "Content-Length: 11\r\n"
+. "\r\n"
+. "Hello ",
+"world"]
+--- raw_request_middle_delay: 0.1
+--- response_body
+Hello world
+--- grep_error_log eval: qr/#\d+ on_request_body.*?(?=(, client|\s+while))/
+--- grep_error_log_out eval
+qr/#\d+ on_request_body, 6 bytes, eof: false
+#\d+ on_request_body, 6 bytes, eof: false
+#\d+ on_request_body, 5 bytes, eof: true
+#\d+ on_request_body, 5 bytes, eof: true/
+--- no_error_log
+[error]
+[crit]
@@ -26,7 +26,7 @@ qr/\[emerg\] .*? "proxy_wasm" directive is specified but config has no "wasm" se
 
 === TEST 2: proxy_wasm directive - invalid number of arguments
 --- config
-    proxy_wasm a foo bar;
+    proxy_wasm;
 --- error_log eval
 qr/\[emerg\] .*? invalid number of arguments in "proxy_wasm" directive/
 --- no_error_log
@@ -240,3 +240,131 @@ should create two instances of the same module
 ]
 --- no_error_log
 [error]
+
+
+
+=== TEST 11: proxy_wasm directive - invalid parameter
+--- main_config
+    wasm {}
+--- config
+    proxy_wasm a foo bar;
+--- error_log eval
+qr/\[emerg\] .*? invalid parameter "bar"/
+--- no_error_log
+[warn]
+[error]
+[alert]
+[crit]
+--- must_die
+
+
+
+=== TEST 12: proxy_wasm directive - invalid methods= option
+--- main_config
+    wasm {}
+--- config
+    proxy_wasm a '' methods=GET,FOO;
+--- error_log eval
+qr/\[emerg\] .*? invalid method "FOO"/
+--- no_error_log
+[warn]
+[error]
+[alert]
+[crit]
+--- must_die
+
+
+
+=== TEST 13: proxy_wasm directive - invalid sample= option
+--- main_config
+    wasm {}
+--- config
+    proxy_wasm a '' sample=1.5;
+--- error_log eval
+qr/\[emerg\] .*? invalid sample ratio "1.5"/
+--- no_error_log
+[warn]
+[error]
+[alert]
+[crit]
+--- must_die
+
+
+
+=== TEST 14: proxy_wasm directive - sample_key= without sample=
+--- main_config
+    wasm {}
+--- config
+    proxy_wasm a '' sample_key=$http_x_trace;
+--- error_log eval
+qr/\[emerg\] .*? "sample_key" requires "sample"/
+--- no_error_log
+[warn]
+[error]
+[alert]
+[crit]
+--- must_die
+
+
+
+=== TEST 15: proxy_wasm directive - invalid criticality= option
+--- main_config
+    wasm {}
+--- config
+    proxy_wasm a '' criticality=low;
+--- error_log eval
+qr/\[emerg\] .*? invalid criticality "low"/
+--- no_error_log
+[warn]
+[error]
+[alert]
+[crit]
+--- must_die
+
+
+
+=== TEST 16: proxy_wasm_load_shedding directive - invalid parameter
+--- main_config
+    wasm {}
+--- http_config
+    proxy_wasm_load_shedding lag=0;
+--- error_log eval
+qr/\[emerg\] .*? invalid parameter "lag=0"/
+--- no_error_log
+[warn]
+[error]
+[alert]
+[crit]
+--- must_die
+
+
+
+=== TEST 17: proxy_wasm directive - invalid body_window= option
+--- main_config
+    wasm {}
+--- config
+    proxy_wasm a '' body_window=0;
+--- error_log eval
+qr/\[emerg\] .*? invalid body window "0"/
+--- no_error_log
+[warn]
+[error]
+[alert]
+[crit]
+--- must_die
+
+
+
+=== TEST 18: proxy_wasm directive - config resembling an option
+--- main_config
+    wasm {}
+--- config
+    proxy_wasm a 'methods=FOO';
+--- error_log eval
+qr/\[emerg\] .*? no "a" module defined/
+--- no_error_log
+[warn]
+[error]
+[alert]
+[crit]
+--- must_die
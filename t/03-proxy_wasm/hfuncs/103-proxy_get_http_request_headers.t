@@ -181,3 +181,29 @@ Connection: close
 [error]
 [crit]
 [alert]
+
+
+
+=== TEST 8: proxy_wasm - get_http_request_headers() x chain with updates in between
+should not reuse the headers marshalled by the first filter
+--- wasm_modules: hostcalls
+--- config
+    location /t {
+        proxy_wasm hostcalls 'test=/t/log/request_headers';
+        proxy_wasm hostcalls 'test=/t/add_request_header \
+                              value=Hello:world';
+        proxy_wasm hostcalls 'test=/t/log/request_headers';
+        return 200;
+    }
+--- grep_error_log eval: qr/(Host|Connection|Hello): [a-z]+/
+--- grep_error_log_out
+Host: localhost
+Connection: close
+Host: localhost
+Connection: close
+Hello: world
+--- no_error_log
+[error]
+[crit]
+[alert]
+[emerg]
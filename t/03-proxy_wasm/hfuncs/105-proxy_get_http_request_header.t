@@ -353,3 +353,42 @@ path: \/t/
 [alert]
 [stub1]
 [stub2]
+
+
+
+=== TEST 14: proxy_wasm - get_http_request_header() many headers x updates in chain
+Header lookups should reflect updates made by previous filters
+--- wasm_modules: hostcalls
+--- config
+    location /t {
+        proxy_wasm hostcalls 'test=/t/log/request_header \
+                              name=header100';
+        proxy_wasm hostcalls 'test=/t/set_request_header \
+                              value=header100:';
+        proxy_wasm hostcalls 'test=/t/log/request_header \
+                              name=header100';
+        proxy_wasm hostcalls 'test=/t/add_request_header \
+                              value=header100:updated';
+        proxy_wasm hostcalls 'test=/t/log/request_header \
+                              name=Header100';
+        return 200;
+    }
+--- more_headers eval
+my $headers = "";
+
+for (1 .. 100) {
+    $headers="${headers}header$_: $_\r\n"
+}
+
+$headers
+--- grep_error_log eval: qr/request header "[^"]+"/
+--- grep_error_log_out
+request header "header100: 100"
+request header "Header100: updated"
+--- no_error_log
+[error]
+[alert]
+[crit]
+[emerg]
+[stub1]
+[stub2]
@@ -47,7 +47,7 @@ Hello world
 
 
 
-=== TEST 3: proxy_wasm - get_http_request_body() returns None when client_body_in_file_only
+=== TEST 3: proxy_wasm - get_http_request_body() retrieves request body buffered to file
 --- load_nginx_modules: ngx_http_echo_module
 --- wasm_modules: hostcalls
 --- config
@@ -62,9 +62,9 @@ POST /t/echo/body
 Hello world
 --- error_code: 200
 --- response_body
---- error_log eval
-qr/\[error\] .*? \[wasm\] cannot read request body buffered to file at "\/.*?\/\d+"/
+Hello world
 --- no_error_log
+[error]
 [crit]
 
 
@@ -173,3 +173,27 @@ ok
 qr/request body: Hello from main request body/
 --- no_error_log
 [error]
+
+
+
+=== TEST 9: proxy_wasm - get_http_request_body() retrieves a window of a request body buffered to file
+--- load_nginx_modules: ngx_http_echo_module
+--- wasm_modules: hostcalls
+--- config
+    client_body_in_file_only on;
+
+    location /t {
+        proxy_wasm hostcalls 'on=request_body \
+                              test=/t/log/request_body \
+                              offset=6 max_len=5';
+        echo ok;
+    }
+--- request
+POST /t
+Hello world
+--- response_body
+ok
+--- error_log eval
+qr/request body: world,/
+--- no_error_log
+[error]
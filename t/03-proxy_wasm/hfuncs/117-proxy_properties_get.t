@@ -683,3 +683,33 @@ qr/\[info\] .*? property not found: nonexistent_property,/
 --- no_error_log
 [error]
 [crit]
+
+
+
+=== TEST 16: proxy_wasm - get_property() - request.query.* and request.cookies.* on: request_headers
+--- wasm_modules: hostcalls
+--- load_nginx_modules: ngx_http_echo_module
+--- config
+    location /t {
+        proxy_wasm hostcalls 'on=request_headers \
+                              test=/t/log/properties \
+                              name=request.query.a,request.query.b,request.query.none,request.cookies.session,request.cookies.theme,request.cookies.none';
+        echo ok;
+    }
+--- request
+GET /t?a=1&c&b=2&a=3
+--- more_headers
+Cookie: session=abc; theme=dark
+--- response_body
+ok
+--- grep_error_log eval: qr/(request\.(query|cookies)\.\w+: .*?|property not found: \S+) at RequestHeaders/
+--- grep_error_log_out
+request.query.a: 1 at RequestHeaders
+request.query.b: 2 at RequestHeaders
+property not found: request.query.none at RequestHeaders
+request.cookies.session: abc at RequestHeaders
+request.cookies.theme: dark at RequestHeaders
+property not found: request.cookies.none at RequestHeaders
+--- no_error_log
+[error]
+[crit]
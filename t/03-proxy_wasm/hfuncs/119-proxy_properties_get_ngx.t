@@ -151,3 +151,59 @@ ngx_http_* calls.
     qr/\[crit\] .*? panicked at/,
     qr/value: InternalFailure/,
 ]
+
+
+
+=== TEST 6: proxy_wasm - get_property() ngx.* - resolved variables reflect updates
+Repeated reads of a property path reuse its resolved variable; prefixed
+variables are still evaluated on each read.
+--- wasm_modules: hostcalls
+--- load_nginx_modules: ngx_http_echo_module
+--- config
+    location /t {
+        proxy_wasm hostcalls 'test=/t/log/property \
+                              name=ngx.http_hello';
+        proxy_wasm hostcalls 'test=/t/set_request_header \
+                              value=Hello:updated';
+        proxy_wasm hostcalls 'test=/t/log/property \
+                              name=ngx.http_hello';
+        echo ok;
+    }
+--- more_headers
+Hello: world
+--- response_body
+ok
+--- grep_error_log eval: qr/ngx\.http_hello: \w+/
+--- grep_error_log_out
+ngx.http_hello: world
+ngx.http_hello: updated
+--- no_error_log
+[error]
+[crit]
+
+
+
+=== TEST 7: proxy_wasm - get_property() ngx.* - memoized variables reflect header updates
+Non-indexed variables memoized within a step are refreshed after a header
+write.
+--- wasm_modules: hostcalls
+--- load_nginx_modules: ngx_http_echo_module
+--- config
+    location /t {
+        proxy_wasm hostcalls 'test=/t/log/property \
+                              name=ngx.host';
+        proxy_wasm hostcalls 'test=/t/set_request_header \
+                              value=Host:updated.com';
+        proxy_wasm hostcalls 'test=/t/log/property \
+                              name=ngx.host';
+        echo ok;
+    }
+--- response_body
+ok
+--- grep_error_log eval: qr/ngx\.host: [\w.]+/
+--- grep_error_log_out
+ngx.host: localhost
+ngx.host: updated.com
+--- no_error_log
+[error]
+[crit]
@@ -0,0 +1,187 @@
+# vim:set ft= ts=4 sts=4 sw=4 et fdm=marker:
+
+use strict;
+use lib '.';
+use t::TestWasmX;
+
+plan_tests(5);
+run_tests();
+
+__DATA__
+
+=== TEST 1: proxy_wasm - get_map_values() retrieves found request headers
+keys: ["hello", "missing"]
+--- main_config eval
+qq{
+    wasm {
+        module a $ENV{TEST_NGINX_HTML_DIR}/a.wat;
+    }
+}
+--- config
+    location /t {
+        proxy_wasm a;
+        return 200;
+    }
+--- more_headers
+Hello: world
+--- user_files
+>>> a.wat
+(module
+  (import "env" "proxy_get_map_values"
+    (func $get_map_values (param i32 i32 i32 i32 i32) (result i32)))
+  (import "env" "proxy_log"
+    (func $log (param i32 i32 i32) (result i32)))
+  (memory (export "memory") 1)
+  (data (i32.const 0) "\02\00\00\00\05\00\00\00\07\00\00\00hello\00missing\00")
+  (global $heap (mut i32) (i32.const 1024))
+  (func $nop)
+  (func $malloc (param $n i32) (result i32)
+    (local $p i32)
+    (local.set $p (global.get $heap))
+    (global.set $heap (i32.add (global.get $heap) (local.get $n)))
+    (local.get $p))
+  (func $on_context_create (param i32 i32))
+  (func $on_start (param i32 i32) (result i32) i32.const 1)
+  (func $on_request_headers (param i32 i32 i32) (result i32)
+    (if (call $get_map_values (i32.const 0)
+                              (i32.const 0) (i32.const 26)
+                              (i32.const 128) (i32.const 132))
+      (then unreachable))
+    ;; 1 pair: count + sizes + "hello\0" + "world\0"
+    (if (i32.ne (i32.load (i32.const 132)) (i32.const 24))
+      (then unreachable))
+    (drop (call $log (i32.const 2)
+                     (i32.add (i32.load (i32.const 128)) (i32.const 18))
+                     (i32.const 5)))
+    i32.const 0)
+  (export "proxy_abi_version_0_2_1" (func $nop))
+  (export "malloc" (func $malloc))
+  (export "proxy_on_context_create" (func $on_context_create))
+  (export "proxy_on_vm_start" (func $on_start))
+  (export "proxy_on_configure" (func $on_start))
+  (export "proxy_on_request_headers" (func $on_request_headers)))
+--- error_log eval
+qr/\[info\] .*? world/
+--- no_error_log
+[error]
+[crit]
+[emerg]
+
+
+
+=== TEST 2: proxy_wasm - get_properties() retrieves found properties
+keys: ["request\0path", "foo\0bar"]
+--- main_config eval
+qq{
+    wasm {
+        module a $ENV{TEST_NGINX_HTML_DIR}/a.wat;
+    }
+}
+--- config
+    location /t {
+        proxy_wasm a;
+        return 200;
+    }
+--- user_files
+>>> a.wat
+(module
+  (import "env" "proxy_get_properties"
+    (func $get_properties (param i32 i32 i32 i32) (result i32)))
+  (import "env" "proxy_log"
+    (func $log (param i32 i32 i32) (result i32)))
+  (memory (export "memory") 1)
+  (data (i32.const 0) "\02\00\00\00\0c\00\00\00\07\00\00\00request\00path\00foo\00bar\00")
+  (global $heap (mut i32) (i32.const 1024))
+  (func $nop)
+  (func $malloc (param $n i32) (result i32)
+    (local $p i32)
+    (local.set $p (global.get $heap))
+    (global.set $heap (i32.add (global.get $heap) (local.get $n)))
+    (local.get $p))
+  (func $on_context_create (param i32 i32))
+  (func $on_start (param i32 i32) (result i32) i32.const 1)
+  (func $on_request_headers (param i32 i32 i32) (result i32)
+    (if (call $get_properties (i32.const 0) (i32.const 33)
+                              (i32.const 128) (i32.const 132))
+      (then unreachable))
+    ;; 1 pair: count + sizes + "request\0path\0" + "/t\0"
+    (if (i32.ne (i32.load (i32.const 132)) (i32.const 28))
+      (then unreachable))
+    (drop (call $log (i32.const 2)
+                     (i32.add (i32.load (i32.const 128)) (i32.const 25))
+                     (i32.const 2)))
+    i32.const 0)
+  (export "proxy_abi_version_0_2_1" (func $nop))
+  (export "malloc" (func $malloc))
+  (export "proxy_on_context_create" (func $on_context_create))
+  (export "proxy_on_vm_start" (func $on_start))
+  (export "proxy_on_configure" (func $on_start))
+  (export "proxy_on_request_headers" (func $on_request_headers)))
+--- error_log eval
+qr/\[info\] .*? \/t/
+--- no_error_log
+[error]
+[crit]
+[emerg]
+
+
+
+=== TEST 3: proxy_wasm - get_shared_data_many() retrieves found values
+keys: ["kv1/a", "kv1/b"]
+--- main_config eval
+qq{
+    wasm {
+        module a $ENV{TEST_NGINX_HTML_DIR}/a.wat;
+        module hostcalls $ENV{TEST_NGINX_CRATES_DIR}/hostcalls.wasm;
+        shm_kv kv1 1m;
+    }
+}
+--- config
+    location /t {
+        proxy_wasm hostcalls 'test=/t/shm/set_shared_data \
+                              key=kv1/a \
+                              value=hello';
+        proxy_wasm a;
+        return 200;
+    }
+--- user_files
+>>> a.wat
+(module
+  (import "env" "proxy_get_shared_data_many"
+    (func $get_shared_data_many (param i32 i32 i32 i32) (result i32)))
+  (import "env" "proxy_log"
+    (func $log (param i32 i32 i32) (result i32)))
+  (memory (export "memory") 1)
+  (data (i32.const 0) "\02\00\00\00\05\00\00\00\05\00\00\00kv1/a\00kv1/b\00")
+  (global $heap (mut i32) (i32.const 1024))
+  (func $nop)
+  (func $malloc (param $n i32) (result i32)
+    (local $p i32)
+    (local.set $p (global.get $heap))
+    (global.set $heap (i32.add (global.get $heap) (local.get $n)))
+    (local.get $p))
+  (func $on_context_create (param i32 i32))
+  (func $on_start (param i32 i32) (result i32) i32.const 1)
+  (func $on_request_headers (param i32 i32 i32) (result i32)
+    (if (call $get_shared_data_many (i32.const 0) (i32.const 24)
+                                    (i32.const 128) (i32.const 132))
+      (then unreachable))
+    ;; 1 pair: count + sizes + "kv1/a\0" + "hello\0"
+    (if (i32.ne (i32.load (i32.const 132)) (i32.const 24))
+      (then unreachable))
+    (drop (call $log (i32.const 2)
+                     (i32.add (i32.load (i32.const 128)) (i32.const 18))
+                     (i32.const 5)))
+    i32.const 0)
+  (export "proxy_abi_version_0_2_1" (func $nop))
+  (export "malloc" (func $malloc))
+  (export "proxy_on_context_create" (func $on_context_create))
+  (export "proxy_on_vm_start" (func $on_start))
+  (export "proxy_on_configure" (func $on_start))
+  (export "proxy_on_request_headers" (func $on_request_headers)))
+--- error_log eval
+qr/\[info\] .*? hello/
+--- no_error_log
+[error]
+[crit]
+[emerg]
@@ -0,0 +1,87 @@
+# vim:set ft= ts=4 sts=4 sw=4 et fdm=marker:
+
+use strict;
+use lib '.';
+use t::TestWasmX;
+
+plan_tests(5);
+run_tests();
+
+__DATA__
+
+=== TEST 1: proxy_wasm - splice_buffer_bytes() replaces a response body range
+--- load_nginx_modules: ngx_http_echo_module
+--- wasm_modules: hostcalls
+--- config
+    location /t {
+        echo 'Hello world';
+        proxy_wasm hostcalls 'on=response_body \
+                              test=/t/splice_response_body \
+                              start=6 end=11 value=Wasm';
+    }
+--- response_body
+Hello Wasm
+--- no_error_log
+[error]
+[crit]
+[alert]
+
+
+
+=== TEST 2: proxy_wasm - splice_buffer_bytes() inserts into a response body
+--- load_nginx_modules: ngx_http_echo_module
+--- wasm_modules: hostcalls
+--- config
+    location /t {
+        echo 'Hello world';
+        proxy_wasm hostcalls 'on=response_body \
+                              test=/t/splice_response_body \
+                              start=5 value=,';
+    }
+--- response_body
+Hello, world
+--- no_error_log
+[error]
+[crit]
+[alert]
+
+
+
+=== TEST 3: proxy_wasm - splice_buffer_bytes() replaces a request body range
+--- wasm_modules: hostcalls
+--- config
+    location /t {
+        proxy_wasm hostcalls 'on=request_body \
+                              test=/t/splice_request_body \
+                              start=0 end=5 value=Goodbye';
+        proxy_wasm hostcalls 'on=request_body';
+    }
+--- request
+POST /t/echo/body
+Hello world
+--- response_body
+Goodbye world
+--- no_error_log
+[error]
+[crit]
+[alert]
+
+
+
+=== TEST 4: proxy_wasm - splice_buffer_bytes() bad range
+--- load_nginx_modules: ngx_http_echo_module
+--- wasm_modules: hostcalls
+--- config
+    location /t {
+        echo 'Hello world';
+        proxy_wasm hostcalls 'on=response_body \
+                              test=/t/splice_response_body \
+                              start=6 end=5 value=Wasm';
+    }
+--- response_body
+Hello world
+--- error_log
+splice_buffer_bytes failed
+--- no_error_log
+[crit]
+[alert]
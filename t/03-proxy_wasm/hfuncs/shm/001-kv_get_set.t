@@ -346,3 +346,105 @@ ok
 [alert]
 [stub1]
 [stub2]
+
+
+
+=== TEST 9: proxy_wasm key/value shm - worker cache is invalidated by writes
+--- valgrind
+--- load_nginx_modules: ngx_http_echo_module
+--- wasm_modules: hostcalls
+--- shm_kv: kv1 1m cache=16
+--- config
+    location /t {
+        # set kv1/test=hello
+        proxy_wasm hostcalls 'test=/t/shm/set_shared_data \
+                              key=kv1/test \
+                              value=hello \
+                              header_ok=set-ok-1';
+        # get kv1/test (fills the cache)
+        proxy_wasm hostcalls 'test=/t/shm/get_shared_data \
+                              key=kv1/test \
+                              header_cas=cas-1 \
+                              header_data=data-1';
+        # get kv1/test (cached)
+        proxy_wasm hostcalls 'test=/t/shm/get_shared_data \
+                              key=kv1/test \
+                              header_cas=cas-2 \
+                              header_data=data-2';
+        # set kv1/test=world
+        proxy_wasm hostcalls 'test=/t/shm/set_shared_data \
+                              key=kv1/test \
+                              value=world \
+                              cas=1 \
+                              header_ok=set-ok-2';
+        # get kv1/test (invalidated)
+        proxy_wasm hostcalls 'test=/t/shm/get_shared_data \
+                              key=kv1/test \
+                              header_cas=cas-3 \
+                              header_data=data-3';
+        echo ok;
+    }
+--- response_headers
+set-ok-1: 1
+cas-1: 1
+data-1: hello
+cas-2: 1
+data-2: hello
+set-ok-2: 1
+cas-3: 2
+data-3: world
+--- response_body
+ok
+--- no_error_log
+[error]
+[crit]
+
+
+
+=== TEST 10: proxy_wasm key/value shm - get and set in a sharded zone
+--- valgrind
+--- load_nginx_modules: ngx_http_echo_module
+--- wasm_modules: hostcalls
+--- shm_kv: kv1 1m shards=4
+--- config
+    location /t {
+        # set kv1/a=hello
+        proxy_wasm hostcalls 'test=/t/shm/set_shared_data \
+                              key=kv1/a \
+                              value=hello \
+                              header_ok=set-ok-1';
+        # set kv1/b=world
+        proxy_wasm hostcalls 'test=/t/shm/set_shared_data \
+                              key=kv1/b \
+                              value=world \
+                              header_ok=set-ok-2';
+        # get kv1/a
+        proxy_wasm hostcalls 'test=/t/shm/get_shared_data \
+                              key=kv1/a \
+                              header_cas=cas-1 \
+                              header_data=data-1';
+        # get kv1/b
+        proxy_wasm hostcalls 'test=/t/shm/get_shared_data \
+                              key=kv1/b \
+                              header_cas=cas-2 \
+                              header_data=data-2';
+        # get kv1/nop
+        proxy_wasm hostcalls 'test=/t/shm/get_shared_data \
+                              key=kv1/nop \
+                              header_exists=exists-3';
+        echo ok;
+    }
+--- response_headers
+set-ok-1: 1
+set-ok-2: 1
+cas-1: 1
+data-1: hello
+cas-2: 1
+data-2: world
+exists-3: 0
+--- response_body
+ok
+--- no_error_log
+[error]
+[crit]
+[emerg]
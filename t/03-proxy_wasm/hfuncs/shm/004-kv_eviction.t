@@ -791,7 +791,7 @@ qr/^[^"]*\[debug\] [^"]* wasm "test" shm store: initialized
 
 === TEST 11: proxy_wasm key/value shm eviction - SLRU: smallest possible queue size
 For an idea of the order of magnitude, x86_64 with ngx_pagesize at 4kb this
-produces a node of ~96 + 2 bytes (may vary depending on the queue node struct).
+produces a node of ~80 + 2 bytes (may vary depending on the queue node struct).
 --- load_nginx_modules: ngx_http_echo_module
 --- wasm_modules: hostcalls
 --- shm_kv: * 1m eviction=slru
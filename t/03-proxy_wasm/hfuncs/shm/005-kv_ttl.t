@@ -0,0 +1,188 @@
+# vim:set ft= ts=4 sts=4 sw=4 et fdm=marker:
+
+use strict;
+use lib '.';
+use t::TestWasmX;
+
+plan_tests(4);
+run_tests();
+
+__DATA__
+
+=== TEST 1: proxy_wasm key/value shm TTL - expired keys are not found
+--- load_nginx_modules: ngx_http_echo_module
+--- main_config eval
+qq{
+    wasm {
+        module a $ENV{TEST_NGINX_HTML_DIR}/a.wat;
+        module hostcalls $ENV{TEST_NGINX_CRATES_DIR}/hostcalls.wasm;
+        shm_kv kv1 1m;
+    }
+}
+--- config
+    location /set {
+        proxy_wasm a;
+        echo ok;
+    }
+
+    location /get {
+        proxy_wasm hostcalls 'test=/t/shm/log_shared_data \
+                              key=kv1/a';
+        echo ok;
+    }
+
+    location /t {
+        echo_location /set;
+        echo_location /get;
+        echo_sleep 0.2;
+        echo_location /get;
+    }
+--- user_files
+>>> a.wat
+(module
+  (import "env" "proxy_set_shared_data_ttl"
+    (func $set_shared_data_ttl (param i32 i32 i32 i32 i32 i32) (result i32)))
+  (memory (export "memory") 1)
+  (data (i32.const 0) "kv1/a")
+  (data (i32.const 8) "hello")
+  (func $nop)
+  (func $malloc (param i32) (result i32) i32.const 0)
+  (func $on_context_create (param i32 i32))
+  (func $on_start (param i32 i32) (result i32) i32.const 1)
+  (func $on_request_headers (param i32 i32 i32) (result i32)
+    ;; set kv1/a=hello with a 100ms TTL
+    (if (call $set_shared_data_ttl (i32.const 0) (i32.const 5)
+                                   (i32.const 8) (i32.const 5)
+                                   (i32.const 0) (i32.const 100))
+      (then unreachable))
+    i32.const 0)
+  (export "proxy_abi_version_0_2_1" (func $nop))
+  (export "malloc" (func $malloc))
+  (export "proxy_on_context_create" (func $on_context_create))
+  (export "proxy_on_vm_start" (func $on_start))
+  (export "proxy_on_configure" (func $on_start))
+  (export "proxy_on_request_headers" (func $on_request_headers)))
+--- ignore_response_body
+--- grep_error_log eval: qr/kv1\/a: ".*?" \d+/
+--- grep_error_log_out
+kv1/a: "hello" 1
+kv1/a: "" 0
+--- no_error_log
+[error]
+[crit]
+
+
+
+=== TEST 2: proxy_wasm key/value shm TTL - set_shared_data() clears the TTL
+--- load_nginx_modules: ngx_http_echo_module
+--- main_config eval
+qq{
+    wasm {
+        module a $ENV{TEST_NGINX_HTML_DIR}/a.wat;
+        module hostcalls $ENV{TEST_NGINX_CRATES_DIR}/hostcalls.wasm;
+        shm_kv kv1 1m;
+    }
+}
+--- config
+    location /set {
+        proxy_wasm a;
+        proxy_wasm hostcalls 'test=/t/shm/set_shared_data \
+                              key=kv1/a \
+                              value=world \
+                              cas=1';
+        echo ok;
+    }
+
+    location /get {
+        proxy_wasm hostcalls 'test=/t/shm/log_shared_data \
+                              key=kv1/a';
+        echo ok;
+    }
+
+    location /t {
+        echo_location /set;
+        echo_sleep 0.2;
+        echo_location /get;
+    }
+--- user_files
+>>> a.wat
+(module
+  (import "env" "proxy_set_shared_data_ttl"
+    (func $set_shared_data_ttl (param i32 i32 i32 i32 i32 i32) (result i32)))
+  (memory (export "memory") 1)
+  (data (i32.const 0) "kv1/a")
+  (data (i32.const 8) "hello")
+  (func $nop)
+  (func $malloc (param i32) (result i32) i32.const 0)
+  (func $on_context_create (param i32 i32))
+  (func $on_start (param i32 i32) (result i32) i32.const 1)
+  (func $on_request_headers (param i32 i32 i32) (result i32)
+    ;; set kv1/a=hello with a 100ms TTL
+    (if (call $set_shared_data_ttl (i32.const 0) (i32.const 5)
+                                   (i32.const 8) (i32.const 5)
+                                   (i32.const 0) (i32.const 100))
+      (then unreachable))
+    i32.const 0)
+  (export "proxy_abi_version_0_2_1" (func $nop))
+  (export "malloc" (func $malloc))
+  (export "proxy_on_context_create" (func $on_context_create))
+  (export "proxy_on_vm_start" (func $on_start))
+  (export "proxy_on_configure" (func $on_start))
+  (export "proxy_on_request_headers" (func $on_request_headers)))
+--- ignore_response_body
+--- grep_error_log eval: qr/kv1\/a: ".*?" \d+/
+--- grep_error_log_out
+kv1/a: "world" 2
+--- no_error_log
+[error]
+[crit]
+
+
+
+=== TEST 3: proxy_wasm key/value shm TTL - expired keys are swept
+--- skip_no_debug
+--- load_nginx_modules: ngx_http_echo_module
+--- main_config eval
+qq{
+    wasm {
+        module a $ENV{TEST_NGINX_HTML_DIR}/a.wat;
+        shm_kv kv1 1m;
+    }
+}
+--- config
+    location /t {
+        proxy_wasm a;
+        echo_sleep 2.5;
+        echo ok;
+    }
+--- user_files
+>>> a.wat
+(module
+  (import "env" "proxy_set_shared_data_ttl"
+    (func $set_shared_data_ttl (param i32 i32 i32 i32 i32 i32) (result i32)))
+  (memory (export "memory") 1)
+  (data (i32.const 0) "kv1/a")
+  (data (i32.const 8) "hello")
+  (func $nop)
+  (func $malloc (param i32) (result i32) i32.const 0)
+  (func $on_context_create (param i32 i32))
+  (func $on_start (param i32 i32) (result i32) i32.const 1)
+  (func $on_request_headers (param i32 i32 i32) (result i32)
+    ;; set kv1/a=hello with a 100ms TTL
+    (if (call $set_shared_data_ttl (i32.const 0) (i32.const 5)
+                                   (i32.const 8) (i32.const 5)
+                                   (i32.const 0) (i32.const 100))
+      (then unreachable))
+    i32.const 0)
+  (export "proxy_abi_version_0_2_1" (func $nop))
+  (export "malloc" (func $malloc))
+  (export "proxy_on_context_create" (func $on_context_create))
+  (export "proxy_on_vm_start" (func $on_start))
+  (export "proxy_on_configure" (func $on_start))
+  (export "proxy_on_request_headers" (func $on_request_headers)))
+--- ignore_response_body
+--- error_log
+wasm "kv1" shm store: swept 1 expired entries
+--- no_error_log
+[error]
+[crit]
@@ -0,0 +1,127 @@
+# vim:set ft= ts=4 sts=4 sw=4 et fdm=marker:
+
+use strict;
+use lib '.';
+use t::TestWasmX;
+
+plan_tests(5);
+run_tests();
+
+__DATA__
+
+=== TEST 1: proxy_wasm key/value shm keys - get_shared_data_keys() by prefix
+keys: ["kv1/t/1/a", "kv1/t/1/b"]
+--- main_config eval
+qq{
+    wasm {
+        module a $ENV{TEST_NGINX_HTML_DIR}/a.wat;
+        module hostcalls $ENV{TEST_NGINX_CRATES_DIR}/hostcalls.wasm;
+        shm_kv kv1 1m ordered;
+    }
+}
+--- config
+    location /t {
+        proxy_wasm hostcalls 'test=/t/shm/set_shared_data \
+                              key=kv1/t/1/b \
+                              value=hello';
+        proxy_wasm hostcalls 'test=/t/shm/set_shared_data \
+                              key=kv1/t/2/a \
+                              value=hello';
+        proxy_wasm hostcalls 'test=/t/shm/set_shared_data \
+                              key=kv1/t/1/a \
+                              value=hello';
+        proxy_wasm a;
+        return 200;
+    }
+--- user_files
+>>> a.wat
+(module
+  (import "env" "proxy_get_shared_data_keys"
+    (func $get_shared_data_keys
+      (param i32 i32 i32 i32 i32 i32 i32) (result i32)))
+  (import "env" "proxy_log"
+    (func $log (param i32 i32 i32) (result i32)))
+  (memory (export "memory") 1)
+  (data (i32.const 0) "kv1/t/1/")
+  (global $heap (mut i32) (i32.const 1024))
+  (func $nop)
+  (func $malloc (param $n i32) (result i32)
+    (local $p i32)
+    (local.set $p (global.get $heap))
+    (global.set $heap (i32.add (global.get $heap) (local.get $n)))
+    (local.get $p))
+  (func $on_context_create (param i32 i32))
+  (func $on_start (param i32 i32) (result i32) i32.const 1)
+  (func $on_request_headers (param i32 i32 i32) (result i32)
+    (if (call $get_shared_data_keys (i32.const 0) (i32.const 8)
+                                    (i32.const 0) (i32.const 0)
+                                    (i32.const 10)
+                                    (i32.const 128) (i32.const 132))
+      (then unreachable))
+    ;; 2 pairs: count + sizes + "kv1/t/1/a\0" + "\0" + "kv1/t/1/b\0" + "\0"
+    (if (i32.ne (i32.load (i32.const 132)) (i32.const 42))
+      (then unreachable))
+    (drop (call $log (i32.const 2)
+                     (i32.add (i32.load (i32.const 128)) (i32.const 31))
+                     (i32.const 9)))
+    i32.const 0)
+  (export "proxy_abi_version_0_2_1" (func $nop))
+  (export "malloc" (func $malloc))
+  (export "proxy_on_context_create" (func $on_context_create))
+  (export "proxy_on_vm_start" (func $on_start))
+  (export "proxy_on_configure" (func $on_start))
+  (export "proxy_on_request_headers" (func $on_request_headers)))
+--- error_log eval
+qr/\[info\] .*? kv1\/t\/1\/b/
+--- no_error_log
+[error]
+[crit]
+[emerg]
+
+
+
+=== TEST 2: proxy_wasm key/value shm keys - get_shared_data_keys() on an unordered zone
+--- main_config eval
+qq{
+    wasm {
+        module a $ENV{TEST_NGINX_HTML_DIR}/a.wat;
+        shm_kv kv1 1m;
+    }
+}
+--- config
+    location /t {
+        proxy_wasm a;
+        return 200;
+    }
+--- user_files
+>>> a.wat
+(module
+  (import "env" "proxy_get_shared_data_keys"
+    (func $get_shared_data_keys
+      (param i32 i32 i32 i32 i32 i32 i32) (result i32)))
+  (memory (export "memory") 1)
+  (data (i32.const 0) "kv1/")
+  (func $nop)
+  (func $malloc (param i32) (result i32) i32.const 1024)
+  (func $on_context_create (param i32 i32))
+  (func $on_start (param i32 i32) (result i32) i32.const 1)
+  (func $on_request_headers (param i32 i32 i32) (result i32)
+    (drop (call $get_shared_data_keys (i32.const 0) (i32.const 4)
+                                      (i32.const 0) (i32.const 0)
+                                      (i32.const 10)
+                                      (i32.const 128) (i32.const 132)))
+    i32.const 0)
+  (export "proxy_abi_version_0_2_1" (func $nop))
+  (export "malloc" (func $malloc))
+  (export "proxy_on_context_create" (func $on_context_create))
+  (export "proxy_on_vm_start" (func $on_start))
+  (export "proxy_on_configure" (func $on_start))
+  (export "proxy_on_request_headers" (func $on_request_headers)))
+--- error_code: 500
+--- response_body_like: 500 Internal Server Error
+--- grep_error_log eval: qr/.*?failed getting keys from shm.*/
+--- grep_error_log_out eval
+qr/(\[error\]|Uncaught RuntimeError|\s+).*?host trap \(bad usage\): failed getting keys from shm \(zone is not ordered\).*/
+--- no_error_log
+[crit]
+[emerg]
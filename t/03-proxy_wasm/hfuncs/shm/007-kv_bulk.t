@@ -0,0 +1,285 @@
+# vim:set ft= ts=4 sts=4 sw=4 et fdm=marker:
+
+use strict;
+use lib '.';
+use t::TestWasmX;
+
+plan_tests(5);
+run_tests();
+
+__DATA__
+
+=== TEST 1: proxy_wasm key/value shm bulk - set_shared_data_many()
+--- main_config eval
+qq{
+    wasm {
+        module a $ENV{TEST_NGINX_HTML_DIR}/a.wat;
+        module hostcalls $ENV{TEST_NGINX_CRATES_DIR}/hostcalls.wasm;
+        shm_kv kv1 1m shards=2;
+    }
+}
+--- config
+    location /t {
+        proxy_wasm a;
+        proxy_wasm hostcalls 'test=/t/shm/log_shared_data \
+                              key=kv1/a';
+        proxy_wasm hostcalls 'test=/t/shm/log_shared_data \
+                              key=kv1/b';
+        return 200;
+    }
+--- user_files
+>>> a.wat
+(module
+  (import "env" "proxy_set_shared_data_many"
+    (func $set_shared_data_many (param i32 i32 i32) (result i32)))
+  (memory (export "memory") 1)
+  ;; 2 pairs: count + sizes + "kv1/a\0" + "1\0" + "kv1/b\0" + "2\0"
+  (data (i32.const 0) "\02\00\00\00\05\00\00\00\01\00\00\00\05\00\00\00\01\00\00\00")
+  (data (i32.const 20) "kv1/a\001\00kv1/b\002\00")
+  (func $nop)
+  (func $malloc (param i32) (result i32) i32.const 1024)
+  (func $on_context_create (param i32 i32))
+  (func $on_start (param i32 i32) (result i32) i32.const 1)
+  (func $on_request_headers (param i32 i32 i32) (result i32)
+    (if (call $set_shared_data_many (i32.const 0) (i32.const 36)
+                                    (i32.const 128))
+      (then unreachable))
+    (if (i32.ne (i32.load (i32.const 128)) (i32.const 2))
+      (then unreachable))
+    i32.const 0)
+  (export "proxy_abi_version_0_2_1" (func $nop))
+  (export "malloc" (func $malloc))
+  (export "proxy_on_context_create" (func $on_context_create))
+  (export "proxy_on_vm_start" (func $on_start))
+  (export "proxy_on_configure" (func $on_start))
+  (export "proxy_on_request_headers" (func $on_request_headers)))
+--- error_log eval
+[
+    qr/\[info\] .*? kv1\/a: "1" \d+/,
+    qr/\[info\] .*? kv1\/b: "2" \d+/,
+]
+--- no_error_log
+[error]
+[crit]
+
+
+
+=== TEST 2: proxy_wasm key/value shm bulk - delete_shared_data_many()
+--- main_config eval
+qq{
+    wasm {
+        module a $ENV{TEST_NGINX_HTML_DIR}/a.wat;
+        module hostcalls $ENV{TEST_NGINX_CRATES_DIR}/hostcalls.wasm;
+        shm_kv kv1 1m;
+    }
+}
+--- config
+    location /t {
+        proxy_wasm hostcalls 'test=/t/shm/set_shared_data \
+                              key=kv1/a \
+                              value=1';
+        proxy_wasm hostcalls 'test=/t/shm/set_shared_data \
+                              key=kv1/b \
+                              value=2';
+        proxy_wasm a;
+        proxy_wasm hostcalls 'test=/t/shm/log_shared_data \
+                              key=kv1/a';
+        proxy_wasm hostcalls 'test=/t/shm/log_shared_data \
+                              key=kv1/b';
+        return 200;
+    }
+--- user_files
+>>> a.wat
+(module
+  (import "env" "proxy_delete_shared_data_many"
+    (func $delete_shared_data_many (param i32 i32) (result i32)))
+  (memory (export "memory") 1)
+  ;; 1 key: count + sizes + "kv1/a\0" + "\0"
+  (data (i32.const 0) "\01\00\00\00\05\00\00\00\00\00\00\00kv1/a\00\00")
+  (func $nop)
+  (func $malloc (param i32) (result i32) i32.const 1024)
+  (func $on_context_create (param i32 i32))
+  (func $on_start (param i32 i32) (result i32) i32.const 1)
+  (func $on_request_headers (param i32 i32 i32) (result i32)
+    (if (call $delete_shared_data_many (i32.const 0) (i32.const 19))
+      (then unreachable))
+    i32.const 0)
+  (export "proxy_abi_version_0_2_1" (func $nop))
+  (export "malloc" (func $malloc))
+  (export "proxy_on_context_create" (func $on_context_create))
+  (export "proxy_on_vm_start" (func $on_start))
+  (export "proxy_on_configure" (func $on_start))
+  (export "proxy_on_request_headers" (func $on_request_headers)))
+--- error_log eval
+[
+    qr/\[info\] .*? kv1\/a: "" 0/,
+    qr/\[info\] .*? kv1\/b: "2" \d+/,
+]
+--- no_error_log
+[error]
+[crit]
+
+
+
+=== TEST 3: proxy_wasm key/value shm bulk - delete_shared_data_prefix()
+--- main_config eval
+qq{
+    wasm {
+        module a $ENV{TEST_NGINX_HTML_DIR}/a.wat;
+        module hostcalls $ENV{TEST_NGINX_CRATES_DIR}/hostcalls.wasm;
+        shm_kv kv1 1m;
+    }
+}
+--- config
+    location /t {
+        proxy_wasm hostcalls 'test=/t/shm/set_shared_data \
+                              key=kv1/t/1/a \
+                              value=hello';
+        proxy_wasm hostcalls 'test=/t/shm/set_shared_data \
+                              key=kv1/t/1/b \
+                              value=hello';
+        proxy_wasm hostcalls 'test=/t/shm/set_shared_data \
+                              key=kv1/t/2/a \
+                              value=hello';
+        proxy_wasm a;
+        proxy_wasm hostcalls 'test=/t/shm/log_shared_data \
+                              key=kv1/t/1/a';
+        proxy_wasm hostcalls 'test=/t/shm/log_shared_data \
+                              key=kv1/t/2/a';
+        return 200;
+    }
+--- user_files
+>>> a.wat
+(module
+  (import "env" "proxy_delete_shared_data_prefix"
+    (func $delete_shared_data_prefix (param i32 i32 i32) (result i32)))
+  (memory (export "memory") 1)
+  (data (i32.const 0) "kv1/t/1/")
+  (func $nop)
+  (func $malloc (param i32) (result i32) i32.const 1024)
+  (func $on_context_create (param i32 i32))
+  (func $on_start (param i32 i32) (result i32) i32.const 1)
+  (func $on_request_headers (param i32 i32 i32) (result i32)
+    (if (call $delete_shared_data_prefix (i32.const 0) (i32.const 8)
+                                         (i32.const 128))
+      (then unreachable))
+    (if (i32.ne (i32.load (i32.const 128)) (i32.const 2))
+      (then unreachable))
+    i32.const 0)
+  (export "proxy_abi_version_0_2_1" (func $nop))
+  (export "malloc" (func $malloc))
+  (export "proxy_on_context_create" (func $on_context_create))
+  (export "proxy_on_vm_start" (func $on_start))
+  (export "proxy_on_configure" (func $on_start))
+  (export "proxy_on_request_headers" (func $on_request_headers)))
+--- error_log eval
+[
+    qr/\[info\] .*? kv1\/t\/1\/a: "" 0/,
+    qr/\[info\] .*? kv1\/t\/2\/a: "hello" \d+/,
+]
+--- no_error_log
+[error]
+[crit]
+
+
+
+=== TEST 4: proxy_wasm key/value shm bulk - set_shared_data_many() with an unknown namespace
+--- main_config eval
+qq{
+    wasm {
+        module a $ENV{TEST_NGINX_HTML_DIR}/a.wat;
+        shm_kv kv1 1m;
+    }
+}
+--- config
+    location /t {
+        proxy_wasm a;
+        return 200;
+    }
+--- user_files
+>>> a.wat
+(module
+  (import "env" "proxy_set_shared_data_many"
+    (func $set_shared_data_many (param i32 i32 i32) (result i32)))
+  (memory (export "memory") 1)
+  ;; 1 pair: count + sizes + "nope/a\0" + "1\0"
+  (data (i32.const 0) "\01\00\00\00\06\00\00\00\01\00\00\00nope/a\001\00")
+  (func $nop)
+  (func $malloc (param i32) (result i32) i32.const 1024)
+  (func $on_context_create (param i32 i32))
+  (func $on_start (param i32 i32) (result i32) i32.const 1)
+  (func $on_request_headers (param i32 i32 i32) (result i32)
+    (drop (call $set_shared_data_many (i32.const 0) (i32.const 21)
+                                      (i32.const 128)))
+    i32.const 0)
+  (export "proxy_abi_version_0_2_1" (func $nop))
+  (export "malloc" (func $malloc))
+  (export "proxy_on_context_create" (func $on_context_create))
+  (export "proxy_on_vm_start" (func $on_start))
+  (export "proxy_on_configure" (func $on_start))
+  (export "proxy_on_request_headers" (func $on_request_headers)))
+--- error_code: 500
+--- response_body_like: 500 Internal Server Error
+--- grep_error_log eval: qr/.*?failed setting value to shm.*/
+--- grep_error_log_out eval
+qr/(\[error\]|Uncaught RuntimeError|\s+).*?host trap \(bad usage\): failed setting value to shm \(could not resolve namespace\).*/
+--- no_error_log
+[crit]
+[emerg]
+
+
+
+=== TEST 5: proxy_wasm key/value shm bulk - set_shared_data_many() partial failure
+Pairs written before an allocation failure are kept and counted.
+--- main_config eval
+qq{
+    wasm {
+        module a $ENV{TEST_NGINX_HTML_DIR}/a.wat;
+        module hostcalls $ENV{TEST_NGINX_CRATES_DIR}/hostcalls.wasm;
+        shm_kv kv1 1m;
+        shm_kv kv2 $::min_shm_size eviction=none;
+    }
+}
+--- config
+    location /t {
+        proxy_wasm a;
+        proxy_wasm hostcalls 'test=/t/shm/log_shared_data \
+                              key=kv1/a';
+        return 200;
+    }
+--- user_files
+>>> a.wat
+(module
+  (import "env" "proxy_set_shared_data_many"
+    (func $set_shared_data_many (param i32 i32 i32) (result i32)))
+  (memory (export "memory") 2)
+  ;; 2 pairs: count + sizes + "kv1/a\0" + "1\0" + "kv2/b\0" + 64KiB value
+  (data (i32.const 0) "\02\00\00\00\05\00\00\00\01\00\00\00\05\00\00\00\00\00\01\00")
+  (data (i32.const 20) "kv1/a\001\00kv2/b\00")
+  (func $nop)
+  (func $malloc (param i32) (result i32) i32.const 1024)
+  (func $on_context_create (param i32 i32))
+  (func $on_start (param i32 i32) (result i32) i32.const 1)
+  (func $on_request_headers (param i32 i32 i32) (result i32)
+    ;; InternalFailure
+    (if (i32.ne (call $set_shared_data_many (i32.const 0) (i32.const 65571)
+                                            (i32.const 131068))
+                (i32.const 10))
+      (then unreachable))
+    (if (i32.ne (i32.load (i32.const 131068)) (i32.const 1))
+      (then unreachable))
+    i32.const 0)
+  (export "proxy_abi_version_0_2_1" (func $nop))
+  (export "malloc" (func $malloc))
+  (export "proxy_on_context_create" (func $on_context_create))
+  (export "proxy_on_vm_start" (func $on_start))
+  (export "proxy_on_configure" (func $on_start))
+  (export "proxy_on_request_headers" (func $on_request_headers)))
+--- error_log eval
+[
+    qr/\[error\] .*? failed setting value to shm \(could not write to slab\), 1 of 2 pairs written/,
+    qr/\[info\] .*? kv1\/a: "1" \d+/,
+]
+--- no_error_log
+[emerg]
+[alert]
@@ -0,0 +1,187 @@
+# vim:set ft= ts=4 sts=4 sw=4 et fdm=marker:
+
+use strict;
+use lib '.';
+use t::TestWasmX;
+
+plan_tests(4);
+run_tests();
+
+__DATA__
+
+=== TEST 1: proxy_wasm key/value shm integers - increment_shared_data() with bounds
+--- main_config eval
+qq{
+    wasm {
+        module a $ENV{TEST_NGINX_HTML_DIR}/a.wat;
+        shm_kv kv1 1m;
+    }
+}
+--- config
+    location /t {
+        proxy_wasm a;
+        return 200;
+    }
+--- user_files
+>>> a.wat
+(module
+  (import "env" "proxy_increment_shared_data"
+    (func $incr (param i32 i32 i64 i64 i64 i64 i32 i32) (result i32)))
+  (import "env" "proxy_log"
+    (func $log (param i32 i32 i32) (result i32)))
+  (memory (export "memory") 1)
+  (data (i32.const 0) "kv1/tokens")
+  (data (i32.const 16) "bucket drained")
+  (func $nop)
+  (func $malloc (param i32) (result i32) i32.const 1024)
+  (func $on_context_create (param i32 i32))
+  (func $on_start (param i32 i32) (result i32) i32.const 1)
+  (func $take (result i32)
+    ;; one token from a bucket of 10, never below 0
+    (call $incr (i32.const 0) (i32.const 10)
+                (i64.const -1) (i64.const 10)
+                (i64.const 0) (i64.const 10)
+                (i32.const 0) (i32.const 128)))
+  (func $on_request_headers (param i32 i32 i32) (result i32)
+    (local $i i32)
+    (loop $drain
+      (if (call $take)
+        (then unreachable))
+      (local.set $i (i32.add (local.get $i) (i32.const 1)))
+      (br_if $drain (i32.lt_u (local.get $i) (i32.const 10))))
+    (if (i64.ne (i64.load (i32.const 128)) (i64.const 0))
+      (then unreachable))
+    ;; out of bounds: CasMismatch, current value returned
+    (i64.store (i32.const 128) (i64.const -1))
+    (if (i32.ne (call $take) (i32.const 8))
+      (then unreachable))
+    (if (i64.ne (i64.load (i32.const 128)) (i64.const 0))
+      (then unreachable))
+    (drop (call $log (i32.const 2) (i32.const 16) (i32.const 14)))
+    i32.const 0)
+  (export "proxy_abi_version_0_2_1" (func $nop))
+  (export "malloc" (func $malloc))
+  (export "proxy_on_context_create" (func $on_context_create))
+  (export "proxy_on_vm_start" (func $on_start))
+  (export "proxy_on_configure" (func $on_start))
+  (export "proxy_on_request_headers" (func $on_request_headers)))
+--- error_log eval
+qr/\[info\] .*? bucket drained/
+--- no_error_log
+[error]
+[crit]
+
+
+
+=== TEST 2: proxy_wasm key/value shm integers - compare_exchange_shared_data()
+--- main_config eval
+qq{
+    wasm {
+        module a $ENV{TEST_NGINX_HTML_DIR}/a.wat;
+        shm_kv kv1 1m shards=2;
+    }
+}
+--- config
+    location /t {
+        proxy_wasm a;
+        return 200;
+    }
+--- user_files
+>>> a.wat
+(module
+  (import "env" "proxy_compare_exchange_shared_data"
+    (func $cmpxchg (param i32 i32 i64 i64 i32 i32) (result i32)))
+  (import "env" "proxy_log"
+    (func $log (param i32 i32 i32) (result i32)))
+  (memory (export "memory") 1)
+  (data (i32.const 0) "kv1/leader")
+  (data (i32.const 16) "leader elected")
+  (func $nop)
+  (func $malloc (param i32) (result i32) i32.const 1024)
+  (func $on_context_create (param i32 i32))
+  (func $on_start (param i32 i32) (result i32) i32.const 1)
+  (func $on_request_headers (param i32 i32 i32) (result i32)
+    ;; missing key: 0
+    (if (call $cmpxchg (i32.const 0) (i32.const 10)
+                       (i64.const 0) (i64.const 5)
+                       (i32.const 0) (i32.const 128))
+      (then unreachable))
+    (if (i64.ne (i64.load (i32.const 128)) (i64.const 5))
+      (then unreachable))
+    ;; not the expected value: CasMismatch, current value returned
+    (if (i32.ne (call $cmpxchg (i32.const 0) (i32.const 10)
+                               (i64.const 0) (i64.const 6)
+                               (i32.const 0) (i32.const 128))
+                (i32.const 8))
+      (then unreachable))
+    (if (i64.ne (i64.load (i32.const 128)) (i64.const 5))
+      (then unreachable))
+    (drop (call $log (i32.const 2) (i32.const 16) (i32.const 14)))
+    i32.const 0)
+  (export "proxy_abi_version_0_2_1" (func $nop))
+  (export "malloc" (func $malloc))
+  (export "proxy_on_context_create" (func $on_context_create))
+  (export "proxy_on_vm_start" (func $on_start))
+  (export "proxy_on_configure" (func $on_start))
+  (export "proxy_on_request_headers" (func $on_request_headers)))
+--- error_log eval
+qr/\[info\] .*? leader elected/
+--- no_error_log
+[error]
+[crit]
+
+
+
+=== TEST 3: proxy_wasm key/value shm integers - increment_shared_data() on a non-integer value
+--- main_config eval
+qq{
+    wasm {
+        module a $ENV{TEST_NGINX_HTML_DIR}/a.wat;
+        module hostcalls $ENV{TEST_NGINX_CRATES_DIR}/hostcalls.wasm;
+        shm_kv kv1 1m;
+    }
+}
+--- config
+    location /t {
+        proxy_wasm hostcalls 'test=/t/shm/set_shared_data \
+                              key=kv1/a \
+                              value=hello';
+        proxy_wasm a;
+        return 200;
+    }
+--- user_files
+>>> a.wat
+(module
+  (import "env" "proxy_increment_shared_data"
+    (func $incr (param i32 i32 i64 i64 i64 i64 i32 i32) (result i32)))
+  (import "env" "proxy_log"
+    (func $log (param i32 i32 i32) (result i32)))
+  (memory (export "memory") 1)
+  (data (i32.const 0) "kv1/a")
+  (data (i32.const 16) "not a number")
+  (func $nop)
+  (func $malloc (param i32) (result i32) i32.const 1024)
+  (func $on_context_create (param i32 i32))
+  (func $on_start (param i32 i32) (result i32) i32.const 1)
+  (func $on_request_headers (param i32 i32 i32) (result i32)
+    ;; BadArgument
+    (if (i32.ne (call $incr (i32.const 0) (i32.const 5)
+                            (i64.const 1) (i64.const 0)
+                            (i64.const -9223372036854775808)
+                            (i64.const 9223372036854775807)
+                            (i32.const 0) (i32.const 128))
+                (i32.const 2))
+      (then unreachable))
+    (drop (call $log (i32.const 2) (i32.const 16) (i32.const 12)))
+    i32.const 0)
+  (export "proxy_abi_version_0_2_1" (func $nop))
+  (export "malloc" (func $malloc))
+  (export "proxy_on_context_create" (func $on_context_create))
+  (export "proxy_on_vm_start" (func $on_start))
+  (export "proxy_on_configure" (func $on_start))
+  (export "proxy_on_request_headers" (func $on_request_headers)))
+--- error_log eval
+qr/\[info\] .*? not a number/
+--- no_error_log
+[error]
+[crit]
@@ -92,12 +92,16 @@ kv/k2: "v2" 1
 
             _, perr = pcall(shm.kv.set, {}, "k1", "v1", false)
             ngx.say(perr)
+
+            _, perr = pcall(shm.kv.set, {}, "k1", "v1", 0, -1)
+            ngx.say(perr)
         }
     }
 --- response_body
 key must be a string
 value must be a string
 cas must be a number
+ttl must be a positive number
 --- no_error_log
 [crit]
 [emerg]
@@ -127,3 +131,39 @@ locked
 --- no_error_log
 [error]
 [crit]
+
+
+
+=== TEST 5: shm_kv - set() with ttl
+--- shm_kv: kv 16k
+--- config
+    location /t {
+        access_by_lua_block {
+            local shm = require "resty.wasmx.shm"
+
+            local written = shm.kv:set("kv/k1", "v1", 0, 0.1)
+            assert(written == 1)
+
+            written = shm.kv:set("kv/k2", "v2")
+            assert(written == 1)
+
+            ngx.say(shm.kv:get("kv/k1"))
+
+            ngx.sleep(0.2)
+
+            ngx.say(shm.kv:get("kv/k1"))
+            ngx.say(shm.kv:get("kv/k2"))
+
+            -- expired keys are treated as absent by cas checks
+            written = shm.kv:set("kv/k1", "v3", 0)
+            ngx.say(written)
+        }
+    }
+--- response_body
+v11
+nil
+v21
+1
+--- no_error_log
+[error]
+[crit]
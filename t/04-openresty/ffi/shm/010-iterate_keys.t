@@ -46,8 +46,8 @@ __DATA__
         }
     }
 --- response_body
-k3
 k2
+k3
 k1
 --- grep_error_log: iterate_keys fetched a new page
 --- grep_error_log_out
@@ -78,8 +78,8 @@ iterate_keys fetched a new page
         }
     }
 --- response_body
-k3
 k2
+k3
 k1
 --- grep_error_log: iterate_keys fetched a new page
 --- grep_error_log_out
@@ -111,8 +111,8 @@ iterate_keys fetched a new page
         }
     }
 --- response_body
-k3
 k2
+k3
 k1
 --- grep_error_log: iterate_keys fetched a new page
 --- grep_error_log_out
@@ -215,9 +215,70 @@ get() does not wait on lock if the shm is already locked.
         }
     }
 --- response_body
-v3
 v2
+v3
 v1
 --- no_error_log
 [error]
 [crit]
+
+
+
+=== TEST 8: shm - iterate_keys() skips expired keys not swept yet
+--- config
+    location /t {
+        access_by_lua_block {
+            local shm = require "resty.wasmx.shm"
+
+            shm.kv:set("k1", "value")
+            shm.kv:set("k2", "value", nil, 0.01)
+            shm.kv:set("k3", "value", nil, 0.01)
+
+            ngx.sleep(0.1)
+
+            shm.kv:lock()
+
+            for k in shm.kv:iterate_keys({ page_size = 1 }) do
+                ngx.say(k)
+            end
+
+            shm.kv:unlock()
+        }
+    }
+--- response_body
+k1
+--- no_error_log
+[error]
+[crit]
+
+
+
+=== TEST 9: shm - iterate_keys() fails when the shm is written to between pages
+--- config
+    location /t {
+        access_by_lua_block {
+            local shm = require "resty.wasmx.shm"
+
+            shm.kv:set("k1", "value")
+            shm.kv:set("k2", "value")
+
+            shm.kv:lock()
+
+            local ok, err = pcall(function()
+                for k in shm.kv:iterate_keys({ page_size = 1 }) do
+                    shm.kv:unlock()
+                    shm.kv:set("k3", "value")
+                    shm.kv:lock()
+                end
+            end)
+
+            shm.kv:unlock()
+
+            ngx.say(err)
+        }
+    }
+--- response_body_like
+attempt to resume kv:iterate_keys\(\) but the shm zone was written to since the iteration started; keep it locked until the iteration ends.
+--- no_error_log
+[error]
+[crit]
@@ -40,8 +40,8 @@ __DATA__
         }
     }
 --- response_body
-k1
 k2
+k1
 --- no_error_log
 [error]
 [crit]
@@ -65,7 +65,7 @@ k2
         }
     }
 --- response_body
-k1
+k2
 --- no_error_log
 [error]
 [crit]
@@ -112,3 +112,28 @@ max_count must be >= 0
 --- no_error_log
 [crit]
 [emerg]
+
+
+
+=== TEST 5: shm - get_keys() skips expired keys not swept yet
+--- config
+    location /t {
+        access_by_lua_block {
+            local shm = require "resty.wasmx.shm"
+
+            shm.kv:set("k1", "value")
+            shm.kv:set("k2", "value", nil, 0.01)
+            shm.kv:set("k3", "value", nil, 0.01)
+
+            ngx.sleep(0.1)
+
+            for _, k in ipairs(shm.kv:get_keys()) do
+                ngx.say(k)
+            end
+        }
+    }
+--- response_body
+k1
+--- no_error_log
+[error]
+[crit]
@@ -0,0 +1,151 @@
+# vim:set ft= ts=4 sts=4 sw=4 et fdm=marker:
+
+use strict;
+use lib '.';
+use t::TestWasmX::Lua;
+
+skip_no_openresty();
+
+add_block_preprocessor(sub {
+    my $block = shift;
+    if (!defined $block->main_config) {
+        $block->set_value("main_config", <<_EOC_
+            wasm {
+                shm_kv kv 16k ordered;
+                shm_kv sharded 1m ordered shards=4;
+                shm_kv unordered 16k;
+            }
+_EOC_
+        );
+    }
+});
+
+plan_tests(4);
+run_tests();
+
+__DATA__
+
+=== TEST 1: shm - scan() by prefix
+--- valgrind
+--- config
+    location /t {
+        access_by_lua_block {
+            local shm = require "resty.wasmx.shm"
+
+            shm.kv:set("tenant/1/b", "value")
+            shm.kv:set("tenant/2/a", "value")
+            shm.kv:set("tenant/1/a", "value")
+            shm.kv:set("tenant/10/a", "value")
+            shm.kv:set("other", "value")
+
+            local keys, cursor = shm.kv:scan({ prefix = "tenant/1/" })
+
+            for _, k in ipairs(keys) do
+                ngx.say(k)
+            end
+
+            ngx.say(cursor)
+        }
+    }
+--- response_body
+tenant/1/a
+tenant/1/b
+nil
+--- no_error_log
+[error]
+[crit]
+
+
+
+=== TEST 2: shm - scan() resumes in batches across shards
+--- config
+    location /t {
+        access_by_lua_block {
+            local shm = require "resty.wasmx.shm"
+
+            for _, k in ipairs({ "e", "c", "a", "d", "b" }) do
+                shm.sharded:set(k, "value")
+            end
+
+            local keys, cursor
+
+            repeat
+                keys, cursor = shm.sharded:scan({ cursor = cursor,
+                                                  max_count = 2 })
+                ngx.say(table.concat(keys, " "))
+            until cursor == nil
+        }
+    }
+--- response_body
+a b
+c d
+e
+--- no_error_log
+[error]
+[crit]
+
+
+
+=== TEST 3: shm - scan() range
+--- config
+    location /t {
+        access_by_lua_block {
+            local shm = require "resty.wasmx.shm"
+
+            for _, k in ipairs({ "a", "b", "c", "d", "e" }) do
+                shm.kv:set(k, "value")
+            end
+
+            local keys = shm.kv:scan({ start = "b", stop = "d" })
+
+            ngx.say(table.concat(keys, " "))
+        }
+    }
+--- response_body
+b c
+--- no_error_log
+[error]
+[crit]
+
+
+
+=== TEST 4: shm - scan() on an unordered zone
+--- config
+    location /t {
+        access_by_lua_block {
+            local shm = require "resty.wasmx.shm"
+
+            ngx.say(shm.unordered:scan())
+        }
+    }
+--- response_body
+nilnot ordered
+--- no_error_log
+[error]
+[crit]
+
+
+
+=== TEST 5: shm - scan() bad args
+--- config
+    location /t {
+        access_by_lua_block {
+            local shm = require "resty.wasmx.shm"
+
+            local _, perr = pcall(shm.kv.scan, shm.kv, false)
+            ngx.say(perr)
+
+            _, perr = pcall(shm.kv.scan, shm.kv, { prefix = 1 })
+            ngx.say(perr)
+
+            _, perr = pcall(shm.kv.scan, shm.kv, { max_count = 0 })
+            ngx.say(perr)
+        }
+    }
+--- response_body
+opts must be a table
+opts.prefix must be a string
+opts.max_count must be > 0
+--- no_error_log
+[crit]
+[emerg]
@@ -0,0 +1,141 @@
+# vim:set ft= ts=4 sts=4 sw=4 et fdm=marker:
+
+use strict;
+use lib '.';
+use t::TestWasmX::Lua;
+
+skip_no_openresty();
+
+add_block_preprocessor(sub {
+    my $block = shift;
+    if (!defined $block->main_config) {
+        $block->set_value("main_config", <<_EOC_
+            wasm {
+                shm_kv kv 1m;
+                shm_kv ordered 1m ordered shards=4;
+            }
+_EOC_
+        );
+    }
+});
+
+plan_tests(4);
+run_tests();
+
+__DATA__
+
+=== TEST 1: shm - set_many()
+--- valgrind
+--- config
+    location /t {
+        access_by_lua_block {
+            local shm = require "resty.wasmx.shm"
+
+            shm.kv:set("k2", "old")
+
+            ngx.say(shm.kv:set_many({ k1 = "v1", k2 = "v2", k3 = "v3" }))
+
+            for _, k in ipairs({ "k1", "k2", "k3" }) do
+                ngx.say(k, ": ", (shm.kv:get(k)))
+            end
+        }
+    }
+--- response_body
+3
+k1: v1
+k2: v2
+k3: v3
+--- no_error_log
+[error]
+[crit]
+
+
+
+=== TEST 2: shm - delete_many()
+--- config
+    location /t {
+        access_by_lua_block {
+            local shm = require "resty.wasmx.shm"
+
+            shm.kv:set_many({ a = "1", b = "2", c = "3" })
+
+            ngx.say(shm.kv:delete_many({ "a", "c", "missing" }))
+            ngx.say(shm.kv:get("a"))
+            ngx.say((shm.kv:get("b")))
+            ngx.say(shm.kv:get("c"))
+        }
+    }
+--- response_body
+2
+nil
+2
+nil
+--- no_error_log
+[error]
+[crit]
+
+
+
+=== TEST 3: shm - delete_prefix() on hashed and ordered zones
+--- config
+    location /t {
+        access_by_lua_block {
+            local shm = require "resty.wasmx.shm"
+
+            for _, zone in ipairs({ shm.kv, shm.ordered }) do
+                for i = 1, 50 do
+                    zone:set("tenant/1/" .. i, "value")
+                end
+
+                zone:set("tenant/10/a", "value")
+                zone:set("tenant/2/a", "value")
+
+                ngx.say(zone:delete_prefix("tenant/1/"))
+                ngx.say(zone:get("tenant/1/7"))
+                ngx.say((zone:get("tenant/10/a")))
+                ngx.say((zone:get("tenant/2/a")))
+            end
+        }
+    }
+--- response_body
+50
+nil
+value
+value
+50
+nil
+value
+value
+--- no_error_log
+[error]
+[crit]
+
+
+
+=== TEST 4: shm - bulk operations bad args
+--- config
+    location /t {
+        access_by_lua_block {
+            local shm = require "resty.wasmx.shm"
+
+            local _, perr = pcall(shm.kv.set_many, shm.kv, false)
+            ngx.say(perr)
+
+            _, perr = pcall(shm.kv.set_many, shm.kv, { k = 1 })
+            ngx.say(perr)
+
+            _, perr = pcall(shm.kv.delete_many, shm.kv, "k")
+            ngx.say(perr)
+
+            _, perr = pcall(shm.kv.delete_prefix, shm.kv, 1)
+            ngx.say(perr)
+        }
+    }
+--- response_body
+kvs must be a table
+values must be strings
+keys must be a table
+prefix must be a string
+--- no_error_log
+[crit]
+[emerg]
@@ -0,0 +1,179 @@
+# vim:set ft= ts=4 sts=4 sw=4 et fdm=marker:
+
+use strict;
+use lib '.';
+use t::TestWasmX::Lua;
+use File::Temp qw(tempdir);
+use Compress::Zlib qw(crc32);
+
+skip_no_openresty();
+
+our $snapshots = tempdir(CLEANUP => 1);
+
+sub write_snapshot {
+    my ($name, $bad_crc, @entries) = @_;
+    my $body = '';
+
+    for my $e (@entries) {
+        my ($key, $value, $cas, $expires) = @$e;
+
+        # ngx_wa_shm_kv_persist_entry_t
+        $body .= pack("Q L L L x4", $expires, $cas, length $key,
+                      length $value) . $key . $value;
+    }
+
+    my $crc = crc32($body);
+    $crc ^= 1 if $bad_crc;
+
+    open my $fh, '>:raw', "$snapshots/$name" or die $!;
+    # ngx_wa_shm_kv_persist_header_t
+    print $fh pack("a4 L L L Q", "WAKV", 1, scalar @entries, $crc,
+                   length $body) . $body;
+    close $fh;
+}
+
+my $later = (time() + 3600) * 1000;
+
+write_snapshot("kv.snap", 0, ["a", "1", 5, 0], ["b", "2", 1, 1000],
+               ["c", "3", 1, $later]);
+write_snapshot("sharded.snap", 0, ["c", "v", 1, 0], ["a", "v", 1, 0],
+               ["b", "v", 1, 0]);
+write_snapshot("corrupt.snap", 1, ["a", "1", 1, 0]);
+
+plan_tests(5);
+run_tests();
+
+__DATA__
+
+=== TEST 1: shm - persist= restores a snapshot
+--- main_config eval
+qq{
+    wasm {
+        shm_kv kv 1m persist=$::snapshots/kv.snap;
+    }
+}
+--- config
+    location /t {
+        access_by_lua_block {
+            local shm = require "resty.wasmx.shm"
+
+            ngx.say(shm.kv:get("a"))
+            ngx.say(shm.kv:get("b"))
+            ngx.say((shm.kv:get("c")))
+        }
+    }
+--- response_body
+15
+nil
+3
+--- error_log eval
+qr/\[notice\] .*? "kv" shm store: restored 2 entries from/
+--- no_error_log
+[error]
+[crit]
+
+
+
+=== TEST 2: shm - persist= restores a snapshot into sharded, ordered zones
+--- main_config eval
+qq{
+    wasm {
+        shm_kv kv 1m ordered shards=2 persist=$::snapshots/sharded.snap;
+    }
+}
+--- config
+    location /t {
+        access_by_lua_block {
+            local shm = require "resty.wasmx.shm"
+
+            ngx.say(table.concat(shm.kv:scan(), " "))
+        }
+    }
+--- response_body
+a b c
+--- error_log eval
+qr/\[notice\] .*? "kv" shm store: restored 3 entries from/
+--- no_error_log
+[error]
+[crit]
+
+
+
+=== TEST 3: shm - persist= ignores an invalid snapshot
+--- main_config eval
+qq{
+    wasm {
+        shm_kv kv 1m persist=$::snapshots/corrupt.snap;
+    }
+}
+--- config
+    location /t {
+        access_by_lua_block {
+            local shm = require "resty.wasmx.shm"
+
+            ngx.say(shm.kv:get("a"))
+        }
+    }
+--- response_body
+nil
+--- error_log eval
+qr/\[warn\] .*? "kv" shm store: ignoring invalid snapshot ".*?corrupt.snap" \(checksum mismatch\)/
+--- no_error_log
+[error]
+[crit]
+
+
+
+=== TEST 4: shm - persist= writes a snapshot on shutdown
+--- skip_no_debug
+--- main_config eval
+qq{
+    wasm {
+        shm_kv kv 1m persist=$::snapshots/new.snap;
+    }
+}
+--- config
+    location /t {
+        access_by_lua_block {
+            local shm = require "resty.wasmx.shm"
+
+            ngx.say(shm.kv:set("a", "1"))
+        }
+    }
+--- response_body
+1
+--- shutdown_error_log eval
+qr/\[debug\] .*? wasm "kv" shm store: persisted 1 entries to ".*?new.snap"/
+--- no_error_log
+[error]
+[crit]
+
+
+
+=== TEST 5: shm - persist= writes a snapshot copied in chunks
+--- skip_no_debug
+--- main_config eval
+qq{
+    wasm {
+        shm_kv kv 4m shards=2 persist=$::snapshots/chunked.snap;
+    }
+}
+--- config
+    location /t {
+        access_by_lua_block {
+            local shm = require "resty.wasmx.shm"
+
+            for i = 1, 600 do
+                assert(shm.kv:set("key" .. i, string.rep("v", i)))
+            end
+
+            ngx.say("ok")
+        }
+    }
+--- response_body
+ok
+--- shutdown_error_log eval
+qr/\[debug\] .*? wasm "kv" shm store: persisted 600 entries to ".*?chunked.snap"/
+--- no_error_log
+[error]
+[crit]
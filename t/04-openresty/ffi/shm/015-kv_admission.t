@@ -0,0 +1,117 @@
+# vim:set ft= ts=4 sts=4 sw=4 et fdm=marker:
+
+use strict;
+use lib '.';
+use t::TestWasmX::Lua;
+
+skip_no_openresty();
+
+add_block_preprocessor(sub {
+    my $block = shift;
+    if (!defined $block->main_config) {
+        $block->set_value("main_config", <<_EOC_
+            wasm {
+                shm_kv kv 64k eviction=lru admission=tinylfu;
+                shm_kv plain 64k eviction=lru;
+            }
+_EOC_
+        );
+    }
+});
+
+plan_tests(4);
+run_tests();
+
+__DATA__
+
+=== TEST 1: shm - stats() counts hits and misses
+--- valgrind
+--- config
+    location /t {
+        access_by_lua_block {
+            local shm = require "resty.wasmx.shm"
+
+            shm.kv:set("a", "value")
+            shm.kv:get("a")
+            shm.kv:get("a")
+            shm.kv:get("missing")
+
+            local stats = shm.kv:stats()
+
+            ngx.say("hits: ", stats.hits)
+            ngx.say("misses: ", stats.misses)
+            ngx.say("admitted: ", stats.admitted)
+            ngx.say("rejected: ", stats.rejected)
+        }
+    }
+--- response_body
+hits: 2
+misses: 1
+admitted: 0
+rejected: 0
+--- no_error_log
+[error]
+[crit]
+
+
+
+=== TEST 2: shm - admission=tinylfu keeps the working set through a burst of one-off keys
+--- config
+    location /t {
+        access_by_lua_block {
+            local shm = require "resty.wasmx.shm"
+            local value = string.rep("x", 100)
+
+            for _, zone in ipairs({ shm.kv, shm.plain }) do
+                for i = 1, 10 do
+                    zone:set("hot/" .. i, "value")
+                end
+
+                for _ = 1, 3 do
+                    for i = 1, 10 do
+                        zone:get("hot/" .. i)
+                    end
+                end
+
+                for i = 1, 2000 do
+                    zone:set("scan/" .. i, value)
+                end
+
+                local n = 0
+
+                for i = 1, 10 do
+                    if zone:get("hot/" .. i) then
+                        n = n + 1
+                    end
+                end
+
+                ngx.say(n)
+            end
+
+            ngx.say(shm.kv:stats().rejected > 0)
+        }
+    }
+--- response_body
+10
+0
+true
+--- no_error_log
+[error]
+[crit]
+
+
+
+=== TEST 3: shm - stats() without admission policy
+--- config
+    location /t {
+        access_by_lua_block {
+            local shm = require "resty.wasmx.shm"
+
+            ngx.say(shm.plain:stats())
+        }
+    }
+--- response_body
+nilno admission policy
+--- no_error_log
+[error]
+[crit]
@@ -0,0 +1,180 @@
+# vim:set ft= ts=4 sts=4 sw=4 et fdm=marker:
+
+use strict;
+use lib '.';
+use t::TestWasmX::Lua;
+
+skip_no_openresty();
+
+add_block_preprocessor(sub {
+    my $block = shift;
+    if (!defined $block->main_config) {
+        $block->set_value("main_config", <<_EOC_
+            wasm {
+                shm_kv kv 16k;
+                shm_kv sharded 1m shards=4;
+            }
+_EOC_
+        );
+    }
+});
+
+plan_tests(4);
+run_tests();
+
+__DATA__
+
+=== TEST 1: shm - incr() and decr()
+--- valgrind
+--- config
+    location /t {
+        access_by_lua_block {
+            local shm = require "resty.wasmx.shm"
+
+            ngx.say(shm.kv:incr("hits"))
+            ngx.say(shm.kv:incr("hits", 10))
+            ngx.say(shm.kv:decr("hits"))
+            ngx.say(shm.sharded:incr("hits", 1, { init = 100 }))
+
+            -- 8-byte little-endian integers
+            local v = shm.kv:get("hits")
+            ngx.say(#v, " ", string.byte(v, 1))
+        }
+    }
+--- response_body
+1
+11
+10
+101
+8 10
+--- no_error_log
+[error]
+[crit]
+
+
+
+=== TEST 2: shm - decr() with bounds
+--- config
+    location /t {
+        access_by_lua_block {
+            local shm = require "resty.wasmx.shm"
+
+            local opts = { init = 2, min = 0 }
+
+            ngx.say(shm.kv:decr("bucket", 1, opts))
+            ngx.say(shm.kv:decr("bucket", 1, opts))
+            ngx.say(shm.kv:decr("bucket", 1, opts))
+            ngx.say(shm.kv:incr("bucket", 5, { max = 3 }))
+        }
+    }
+--- response_body
+1
+0
+nilout of bounds0
+nilout of bounds0
+--- no_error_log
+[error]
+[crit]
+
+
+
+=== TEST 3: shm - compare_exchange()
+--- config
+    location /t {
+        access_by_lua_block {
+            local shm = require "resty.wasmx.shm"
+
+            ngx.say(shm.kv:compare_exchange("leader", 0, 7))
+            ngx.say(shm.kv:compare_exchange("leader", 0, 8))
+            ngx.say(shm.kv:compare_exchange("leader", 7, 8))
+        }
+    }
+--- response_body
+true7
+false7
+true8
+--- no_error_log
+[error]
+[crit]
+
+
+
+=== TEST 4: shm - incr() on a non-integer value
+--- config
+    location /t {
+        access_by_lua_block {
+            local shm = require "resty.wasmx.shm"
+
+            shm.kv:set("a", "hello")
+
+            ngx.say(shm.kv:incr("a"))
+        }
+    }
+--- response_body
+nilnot a number
+--- no_error_log
+[error]
+[crit]
+
+
+
+=== TEST 5: shm - incr() of a key not admitted
+--- main_config
+    wasm {
+        shm_kv kv 64k eviction=lru admission=tinylfu;
+    }
+--- config
+    location /t {
+        access_by_lua_block {
+            local shm = require "resty.wasmx.shm"
+            local value = string.rep("x", 100)
+
+            -- fill the zone with frequently read entries
+            for i = 1, 2000 do
+                shm.kv:set("hot/" .. i, value)
+
+                for _ = 1, 3 do
+                    shm.kv:get("hot/" .. i)
+                end
+            end
+
+            ngx.say(shm.kv:incr("counter"))
+            ngx.say(shm.kv:get("counter"))
+        }
+    }
+--- response_body
+nilnot admitted
+nil
+--- no_error_log
+[error]
+[crit]
+
+
+
+=== TEST 6: shm - incr() bad args
+--- config
+    location /t {
+        access_by_lua_block {
+            local shm = require "resty.wasmx.shm"
+
+            local _, perr = pcall(shm.kv.incr, shm.kv, 1)
+            ngx.say(perr)
+
+            _, perr = pcall(shm.kv.incr, shm.kv, "a", 1.5)
+            ngx.say(perr)
+
+            _, perr = pcall(shm.kv.incr, shm.kv, "a", 1, { min = "0" })
+            ngx.say(perr)
+
+            _, perr = pcall(shm.kv.compare_exchange, shm.kv, "a", 0, nil)
+            ngx.say(perr)
+        }
+    }
+--- response_body
+key must be a string
+delta must be an integer
+opts.min must be an integer
+value must be an integer
+--- no_error_log
+[crit]
+[emerg]
@@ -15,6 +15,14 @@ extern "C" {
         return_value_data: *mut *mut u8,
         return_value_size: *mut usize,
     ) -> i32;
+
+    fn proxy_splice_buffer_bytes(
+        buffer_type: i32,
+        start: usize,
+        end: usize,
+        buffer_data: *const u8,
+        buffer_size: usize,
+    ) -> i32;
 }
 
 pub(crate) fn test_log_levels(_: &TestHttp) {
@@ -46,7 +54,17 @@ pub(crate) fn test_log_request_headers(ctx: &TestHttp) {
 }
 
 pub(crate) fn test_log_request_body(ctx: &TestHttp) {
-    let body = ctx.get_http_request_body(0, 30);
+    let offset = ctx
+        .config
+        .get("offset")
+        .map_or(0, |v| v.parse::<usize>().unwrap());
+
+    let max_len = ctx
+        .config
+        .get("max_len")
+        .map_or(30, |v| v.parse::<usize>().unwrap());
+
+    let body = ctx.get_http_request_body(offset, max_len);
     if let Some(bytes) = body {
         match String::from_utf8(bytes) {
             Ok(s) => info!("request body: {}", s),
@@ -362,6 +380,49 @@ pub(crate) fn test_set_response_body(ctx: &mut TestHttp) {
     ctx.config.insert(key.clone(), key);
 }
 
+fn splice_body(ctx: &TestHttp, buffer_type: BufferType) {
+    let value = ctx.config.get("value").map_or("", |v| v.as_str());
+
+    let start = ctx
+        .config
+        .get("start")
+        .map_or(0, |v| v.parse::<usize>().unwrap());
+
+    let end = ctx
+        .config
+        .get("end")
+        .map_or(start, |v| v.parse::<usize>().unwrap());
+
+    let status = unsafe {
+        proxy_splice_buffer_bytes(
+            buffer_type as i32,
+            start,
+            end,
+            value.as_ptr(),
+            value.len(),
+        )
+    };
+
+    if status != 0 {
+        error!("splice_buffer_bytes failed: {}", status);
+    }
+}
+
+pub(crate) fn test_splice_request_body(ctx: &TestHttp) {
+    splice_body(ctx, BufferType::HttpRequestBody);
+}
+
+pub(crate) fn test_splice_response_body(ctx: &mut TestHttp) {
+    let key = "splice_response_body".to_string();
+    if ctx.config.get(&key).is_some() {
+        return;
+    }
+
+    splice_body(ctx, BufferType::HttpResponseBody);
+
+    ctx.config.insert(key.clone(), key);
+}
+
 pub(crate) fn test_get_shared_data(ctx: &TestHttp) {
     let hcas = ctx
         .config
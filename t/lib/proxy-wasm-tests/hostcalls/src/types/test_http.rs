@@ -91,6 +91,8 @@ impl TestHttp {
             /* set/add request/response body */
             "/t/set_request_body" => test_set_request_body(self),
             "/t/set_response_body" => test_set_response_body(self),
+            "/t/splice_request_body" => test_splice_request_body(self),
+            "/t/splice_response_body" => test_splice_response_body(self),
 
             /* set property */
             "/t/set_property" => test_set_property(self),